@@ -306,10 +306,12 @@ enum EFileWrite
 	FILEWRITE_Unbuffered        = 0x08,
 	FILEWRITE_Append			= 0x10,
 	FILEWRITE_AllowRead         = 0x20,
+	FILEWRITE_Async             = 0x40,
 };
 enum EFileRead
 {
 	FILEREAD_NoFail             = 0x01,
+	FILEREAD_Sequential         = 0x02,
 };
 class CORE_API FFileManager
 {
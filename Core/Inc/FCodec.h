@@ -6,6 +6,9 @@ Revision history:
 	* Created by Tim Sweeney.
 =============================================================================*/
 
+#include <string.h>
+#include "FThreadPool.h"
+
 /*-----------------------------------------------------------------------------
 	Coder/decoder base class.
 -----------------------------------------------------------------------------*/
@@ -13,10 +16,183 @@ Revision history:
 class FCodec
 {
 public:
+	virtual ~FCodec() {}
 	virtual UBOOL Encode( FArchive& In, FArchive& Out )=0;
 	virtual UBOOL Decode( FArchive& In, FArchive& Out )=0;
 };
 
+/*-----------------------------------------------------------------------------
+	Chunked byte I/O for codecs.
+-----------------------------------------------------------------------------*/
+
+enum {CODEC_CHUNK_SIZE=4096};
+
+//
+// Reads the rest of an archive in chunks, so byte-oriented codecs don't
+// pay for a virtual Serialize call per byte.
+//
+struct FCodecReader
+{
+	FArchive&	In;
+	INT			Remaining, Pos, Count;
+	BYTE		Buffer[CODEC_CHUNK_SIZE];
+	FCodecReader( FArchive& InIn )
+	:	In( InIn ), Remaining( InIn.TotalSize()-InIn.Tell() ), Pos( 0 ), Count( 0 )
+	{}
+	// Make the next chunk available, returning its size.
+	INT Fill()
+	{
+		Count = Min<INT>( Remaining, CODEC_CHUNK_SIZE );
+		if( Count )
+			In.Serialize( Buffer, Count );
+		Remaining -= Count;
+		Pos        = 0;
+		return Count;
+	}
+	UBOOL Get( BYTE& B )
+	{
+		if( Pos==Count && !Fill() )
+			return 0;
+		B = Buffer[Pos++];
+		return 1;
+	}
+};
+
+//
+// Collects output bytes and passes them on to an archive in chunks.
+//
+struct FCodecWriter
+{
+	FArchive&	Out;
+	INT			Count;
+	BYTE		Buffer[CODEC_CHUNK_SIZE];
+	FCodecWriter( FArchive& InOut )
+	:	Out( InOut ), Count( 0 )
+	{}
+	~FCodecWriter()
+	{
+		Flush();
+	}
+	void Put( BYTE B )
+	{
+		if( Count==CODEC_CHUNK_SIZE )
+			Flush();
+		Buffer[Count++] = B;
+	}
+	void Flush()
+	{
+		if( Count )
+			Out.Serialize( Buffer, Count );
+		Count = 0;
+	}
+};
+
+/*-----------------------------------------------------------------------------
+	Pull-based decoding.
+-----------------------------------------------------------------------------*/
+
+//
+// A source of decoded bytes. Each codec provides an FDecoder source that
+// pulls its input from another source, so a chain of them decodes with
+// memory bounded by the largest stage state rather than the data size.
+//
+class FCodecSource
+{
+public:
+	virtual ~FCodecSource()
+	{}
+	// Read up to Count bytes, returning fewer only at the end of data.
+	virtual INT Read( BYTE* Dest, INT Count )=0;
+
+	// Copy the rest of the source to an archive.
+	void Pump( FArchive& Out )
+	{
+		BYTE Buffer[CODEC_CHUNK_SIZE];
+		INT Count;
+		while( (Count=Read( Buffer, CODEC_CHUNK_SIZE ))>0 )
+			Out.Serialize( Buffer, Count );
+	}
+};
+
+//
+// Reads a byte range from an archive.
+//
+class FCodecArchiveSource : public FCodecSource
+{
+public:
+	FCodecArchiveSource( FArchive& InAr, INT InRemaining )
+	:	Ar( InAr ), Remaining( InRemaining )
+	{}
+	FCodecArchiveSource( FArchive& InAr )
+	:	Ar( InAr ), Remaining( InAr.TotalSize()-InAr.Tell() )
+	{}
+	INT Read( BYTE* Dest, INT Count )
+	{
+		Count = Min( Count, Remaining );
+		if( Count>0 )
+			Ar.Serialize( Dest, Count );
+		Remaining -= Count;
+		return Count;
+	}
+private:
+	FArchive&	Ar;
+	INT			Remaining;
+};
+
+//
+// Buffered byte access to the source feeding a decoder.
+//
+struct FCodecSourceReader
+{
+	FCodecSource&	Src;
+	INT				Pos, Count;
+	BYTE			Buffer[CODEC_CHUNK_SIZE];
+	FCodecSourceReader( FCodecSource& InSrc )
+	:	Src( InSrc ), Pos( 0 ), Count( 0 )
+	{}
+	UBOOL Get( BYTE& B )
+	{
+		if( Pos==Count )
+		{
+			Count = Src.Read( Buffer, CODEC_CHUNK_SIZE );
+			Pos   = 0;
+			if( !Count )
+				return 0;
+		}
+		B = Buffer[Pos++];
+		return 1;
+	}
+	// Read exactly Num bytes, returning 0 if the source ends first.
+	UBOOL Get( BYTE* Dest, INT Num )
+	{
+		while( Num>0 )
+		{
+			if( Pos==Count )
+			{
+				Count = Src.Read( Buffer, CODEC_CHUNK_SIZE );
+				Pos   = 0;
+				if( !Count )
+					return 0;
+			}
+			INT Copy = Min( Num, Count-Pos );
+			appMemcpy( Dest, Buffer+Pos, Copy );
+			Pos  += Copy;
+			Dest += Copy;
+			Num  -= Copy;
+		}
+		return 1;
+	}
+	// Read a little endian INT, as written by FArchive on Intel.
+	UBOOL Get( INT& Value )
+	{
+		BYTE B[4];
+		if( !Get( B, 4 ) )
+			return 0;
+		Value = B[0] | (B[1]<<8) | (B[2]<<16) | (B[3]<<24);
+		return 1;
+	}
+};
+
 /*-----------------------------------------------------------------------------
 	Burrows-Wheeler inspired data compressor.
 -----------------------------------------------------------------------------*/
@@ -27,6 +203,7 @@ private:
 	enum {MAX_BUFFER_SIZE=0x40000}; /* Hand tuning suggests this is an ideal size */
 	static BYTE* CompressBuffer;
 	static INT CompressLength;
+	UBOOL UseSuffixArray;
 	static INT ClampedBufferCompare( const INT* P1, const INT* P2 )
 	{
 		guardSlow(FCodecBWT::ClampedBufferCompare);
@@ -42,32 +219,178 @@ private:
 		return *P1 - *P2;
 		unguardSlow;
 	}
+
+	// SA-IS suffix array construction (Nong, Zhang & Chan), linear in N.
+	// S holds N symbols in [0,K) and must end in a unique smallest sentinel.
+	static void GetBuckets( const INT* S, INT* Bkt, INT N, INT K, UBOOL End )
+	{
+		INT i, Sum=0;
+		for( i=0; i<K; i++ )
+			Bkt[i] = 0;
+		for( i=0; i<N; i++ )
+			Bkt[S[i]]++;
+		for( i=0; i<K; i++ )
+		{
+			Sum += Bkt[i];
+			Bkt[i] = End ? Sum : Sum-Bkt[i];
+		}
+	}
+	static void InduceSort( const BYTE* IsS, INT* SA, const INT* S, INT* Bkt, INT N, INT K )
+	{
+		INT i, j;
+		GetBuckets( S, Bkt, N, K, 0 );
+		for( i=0; i<N; i++ )
+			if( (j=SA[i]-1)>=0 && !IsS[j] )
+				SA[Bkt[S[j]]++] = j;
+		GetBuckets( S, Bkt, N, K, 1 );
+		for( i=N-1; i>=0; i-- )
+			if( (j=SA[i]-1)>=0 && IsS[j] )
+				SA[--Bkt[S[j]]] = j;
+	}
+	static void SuffixSort( const INT* S, INT* SA, INT N, INT K )
+	{
+		guard(FCodecBWT::SuffixSort);
+		TArray<BYTE> IsSArray(N);
+		TArray<INT>  BktArray(K);
+		BYTE* IsS = &IsSArray(0);
+		INT*  Bkt = &BktArray(0);
+		INT i, j;
+		#define IS_LMS(i) ((i)>0 && IsS[i] && !IsS[(i)-1])
+
+		// Classify suffixes as S- or L-type.
+		IsS[N-1] = 1;
+		if( N>1 )
+			IsS[N-2] = 0;
+		for( i=N-3; i>=0; i-- )
+			IsS[i] = S[i]<S[i+1] || (S[i]==S[i+1] && IsS[i+1]);
+
+		// Sort the LMS substrings by induction.
+		GetBuckets( S, Bkt, N, K, 1 );
+		for( i=0; i<N; i++ )
+			SA[i] = -1;
+		for( i=1; i<N; i++ )
+			if( IS_LMS(i) )
+				SA[--Bkt[S[i]]] = i;
+		InduceSort( IsS, SA, S, Bkt, N, K );
+
+		// Compact the sorted LMS substrings into the front of SA and name them.
+		INT N1=0;
+		for( i=0; i<N; i++ )
+			if( IS_LMS(SA[i]) )
+				SA[N1++] = SA[i];
+		for( i=N1; i<N; i++ )
+			SA[i] = -1;
+		INT Name=0, Prev=-1;
+		for( i=0; i<N1; i++ )
+		{
+			INT Pos=SA[i];
+			UBOOL Diff=0;
+			for( INT d=0; d<N; d++ )
+			{
+				if( Prev==-1 || S[Pos+d]!=S[Prev+d] || IsS[Pos+d]!=IsS[Prev+d] )
+				{
+					Diff = 1;
+					break;
+				}
+				else if( d>0 && (IS_LMS(Pos+d) || IS_LMS(Prev+d)) )
+					break;
+			}
+			if( Diff )
+			{
+				Name++;
+				Prev = Pos;
+			}
+			SA[N1+Pos/2] = Name-1;
+		}
+		for( i=N-1, j=N-1; i>=N1; i-- )
+			if( SA[i]>=0 )
+				SA[j--] = SA[i];
+
+		// Sort the reduced string, recursing if the names are not yet unique.
+		INT* S1 = SA+N-N1;
+		if( Name<N1 )
+			SuffixSort( S1, SA, N1, Name );
+		else for( i=0; i<N1; i++ )
+			SA[S1[i]] = i;
+
+		// Induce the full suffix array from the sorted LMS suffixes.
+		GetBuckets( S, Bkt, N, K, 1 );
+		for( i=1, j=0; i<N; i++ )
+			if( IS_LMS(i) )
+				S1[j++] = i;
+		for( i=0; i<N1; i++ )
+			SA[i] = S1[SA[i]];
+		for( i=N1; i<N; i++ )
+			SA[i] = -1;
+		for( i=N1-1; i>=0; i-- )
+		{
+			j     = SA[i];
+			SA[i] = -1;
+			SA[--Bkt[S[j]]] = j;
+		}
+		InduceSort( IsS, SA, S, Bkt, N, K );
+
+		#undef IS_LMS
+		unguard;
+	}
+
+	// Sort the Length+1 rotations of Buffer. The end of the block sorts
+	// after every byte value, which is what Decode relies on.
+	void SortBlock( BYTE* Buffer, INT Length, INT* CompressPosition, INT* SuffixText, INT* SuffixArray )
+	{
+		guard(FCodecBWT::SortBlock);
+		INT i;
+		if( UseSuffixArray )
+		{
+			// Shift bytes up by one so the end marker (257) sorts last and
+			// the sentinel (0) sorts first, then drop the sentinel suffix.
+			for( i=0; i<Length; i++ )
+				SuffixText[i] = Buffer[i] + 1;
+			SuffixText[Length  ] = 257;
+			SuffixText[Length+1] = 0;
+			SuffixSort( SuffixText, SuffixArray, Length+2, 258 );
+			appMemcpy( CompressPosition, SuffixArray+1, (Length+1)*sizeof(INT) );
+		}
+		else
+		{
+			// The comparison sort goes through static state and is not reentrant.
+			CompressBuffer = Buffer;
+			CompressLength = Length;
+			for( i=0; i<Length+1; i++ )
+				CompressPosition[i] = i;
+			appQsort( CompressPosition, Length+1, sizeof(INT), (QSORT_COMPARE)ClampedBufferCompare );
+		}
+		unguard;
+	}
 public:
+	FCodecBWT( UBOOL InUseSuffixArray=1 )
+	:	UseSuffixArray( InUseSuffixArray )
+	{}
 	UBOOL Encode( FArchive& In, FArchive& Out )
 	{
 		guard(FCodecBWT::Encode);
 		TArray<BYTE> CompressBufferArray(MAX_BUFFER_SIZE);
 		TArray<INT>  CompressPosition   (MAX_BUFFER_SIZE+1);
-		CompressBuffer = &CompressBufferArray(0);
-		INT i, First=0, Last=0;
+		TArray<INT>  SuffixText         (UseSuffixArray ? MAX_BUFFER_SIZE+2 : 0);
+		TArray<INT>  SuffixArray        (UseSuffixArray ? MAX_BUFFER_SIZE+2 : 0);
+		BYTE* Buffer = &CompressBufferArray(0);
+		INT i, Length, First=0, Last=0;
 		while( !In.AtEnd() )
 		{
-			CompressLength = Min<INT>( In.TotalSize()-In.Tell(), MAX_BUFFER_SIZE );
-			In.Serialize( CompressBuffer, CompressLength );
-			for( i=0; i<CompressLength+1; i++ )
-				CompressPosition(i) = i;
-			appQsort( &CompressPosition(0), CompressLength+1, sizeof(INT), (QSORT_COMPARE)ClampedBufferCompare );
-			for( i=0; i<CompressLength+1; i++ )
+			Length = Min<INT>( In.TotalSize()-In.Tell(), MAX_BUFFER_SIZE );
+			In.Serialize( Buffer, Length );
+			SortBlock( Buffer, Length, &CompressPosition(0), UseSuffixArray ? &SuffixText(0) : NULL, UseSuffixArray ? &SuffixArray(0) : NULL );
+			for( i=0; i<Length+1; i++ )
 				if( CompressPosition(i)==1 )
 					First = i;
 				else if( CompressPosition(i)==0 )
 					Last = i;
-			Out << CompressLength << First << Last;
-			for( i=0; i<CompressLength+1; i++ )
-				Out << CompressBuffer[CompressPosition(i)?CompressPosition(i)-1:0];
+			Out << Length << First << Last;
+			for( i=0; i<Length+1; i++ )
+				Out << Buffer[CompressPosition(i)?CompressPosition(i)-1:0];
 			//GWarn->Logf(TEXT("Compression table"));
-			//for( i=0; i<CompressLength+1; i++ )
-			//	GWarn->Logf(TEXT("    %03i: %s"),CompressPosition(i)?CompressBuffer[CompressPosition(i)-1]:-1,appFromAnsi((ANSICHAR*)CompressBuffer+CompressPosition(i)));
+			//for( i=0; i<Length+1; i++ )
+			//	GWarn->Logf(TEXT("    %03i: %s"),CompressPosition(i)?Buffer[CompressPosition(i)-1]:-1,appFromAnsi((ANSICHAR*)Buffer+CompressPosition(i)));
 		}
 		return 0;
 		unguard;
@@ -75,16 +398,56 @@ public:
 	UBOOL Decode( FArchive& In, FArchive& Out )
 	{
 		guard(FCodecBWT::Decode);
-		TArray<BYTE> DecompressBuffer(MAX_BUFFER_SIZE+1);
-		TArray<INT>  Temp(MAX_BUFFER_SIZE+1);
-		INT DecompressLength, DecompressCount[256+1], RunningTotal[256+1], i, j;
-		while( !In.AtEnd() )
+		FCodecArchiveSource Src( In );
+		FDecoder Decoder( Src );
+		Decoder.Pump( Out );
+		return 1;
+		unguard;
+	}
+
+	// Inverts one block at a time.
+	class FDecoder : public FCodecSource
+	{
+	public:
+		FDecoder( FCodecSource& InSrc )
+		:	Reader				( InSrc )
+		,	DecompressBuffer	( MAX_BUFFER_SIZE+1 )
+		,	Temp				( MAX_BUFFER_SIZE+1 )
+		,	Index				( 0 )
+		,	Remaining			( 0 )
+		{}
+		INT Read( BYTE* Dest, INT Count )
+		{
+			guard(FCodecBWT::FDecoder::Read);
+			INT Done=0;
+			while( Done<Count && (Remaining || NextBlock()) )
+			{
+				INT Num = Min( Count-Done, Remaining );
+				for( INT j=0; j<Num; j++, Index=Temp(Index) )
+					Dest[Done+j] = DecompressBuffer(Index);
+				Done      += Num;
+				Remaining -= Num;
+			}
+			return Done;
+			unguard;
+		}
+	private:
+		FCodecSourceReader	Reader;
+		TArray<BYTE>		DecompressBuffer;
+		TArray<INT>			Temp;
+		INT					Index, Remaining;
+		UBOOL NextBlock()
 		{
-			INT First, Last;
-			In << DecompressLength << First << Last;
+			guard(FCodecBWT::FDecoder::NextBlock);
+			INT DecompressLength, DecompressCount[256+1], RunningTotal[256+1], First, Last, i;
+			if( !Reader.Get( DecompressLength ) )
+				return 0;
+			verify(Reader.Get( First ));
+			verify(Reader.Get( Last ));
+			check(DecompressLength>=0);
 			check(DecompressLength<=MAX_BUFFER_SIZE+1);
-			check(DecompressLength<=In.TotalSize()-In.Tell());
-			In.Serialize( &DecompressBuffer(0), ++DecompressLength );
+			verify(Reader.Get( &DecompressBuffer(0), ++DecompressLength ));
+			check(First>=0 && First<DecompressLength);
 			for( i=0; i<257; i++ )
 				DecompressCount[ i ]=0;
 			for( i=0; i<DecompressLength; i++ )
@@ -98,15 +461,15 @@ public:
 			}
 			for( i=0; i<DecompressLength; i++ )
 			{
-				INT Index = i!=Last ? DecompressBuffer(i) : 256;
-				Temp(RunningTotal[Index] + DecompressCount[Index]++) = i;
+				INT Slot = i!=Last ? DecompressBuffer(i) : 256;
+				Temp(RunningTotal[Slot] + DecompressCount[Slot]++) = i;
 			}
-			for( i=First,j=0 ; j<DecompressLength-1; i=Temp(i),j++ )
-				Out << DecompressBuffer(i);
+			Index     = First;
+			Remaining = DecompressLength-1;
+			return 1;
+			unguard;
 		}
-		return 1;
-		unguard;
-	}
+	};
 };
 BYTE* FCodecBWT::CompressBuffer;
 INT   FCodecBWT::CompressLength;
@@ -119,233 +482,447 @@ class FCodecRLE : public FCodec
 {
 private:
 	enum {RLE_LEAD=5};
-	UBOOL EncodeEmitRun( FArchive& Out, BYTE Char, BYTE Count )
+	UBOOL EncodeEmitRun( FCodecWriter& Out, BYTE Char, BYTE Count )
 	{
 		for( INT Down=Min<INT>(Count,RLE_LEAD); Down>0; Down-- )
-			Out << Char;
+			Out.Put( Char );
 		if( Count>=RLE_LEAD )
-			Out << Count;
+			Out.Put( Count );
 		return 1;
 	}
 public:
 	UBOOL Encode( FArchive& In, FArchive& Out )
 	{
 		guard(FCodecRLE::Encode);
-		BYTE PrevChar=0, PrevCount=0, B;
-		while( !In.AtEnd() )
+		FCodecReader Reader( In );
+		FCodecWriter Writer( Out );
+		BYTE PrevChar=0, PrevCount=0;
+		while( Reader.Fill() )
 		{
-			In << B;
-			if( B!=PrevChar || PrevCount==255 )
+			for( BYTE* B=Reader.Buffer; B<Reader.Buffer+Reader.Count; B++ )
 			{
-				EncodeEmitRun( Out, PrevChar, PrevCount );
-				PrevChar  = B;
-				PrevCount = 0;
+				if( *B!=PrevChar || PrevCount==255 )
+				{
+					EncodeEmitRun( Writer, PrevChar, PrevCount );
+					PrevChar  = *B;
+					PrevCount = 0;
+				}
+				PrevCount++;
 			}
-			PrevCount++;
 		}
-		EncodeEmitRun( Out, PrevChar, PrevCount );
+		EncodeEmitRun( Writer, PrevChar, PrevCount );
 		return 0;
 		unguard;
 	}
 	UBOOL Decode( FArchive& In, FArchive& Out )
 	{
 		guard(FCodecRLE::Decode);
-		INT Count=0;
-		BYTE PrevChar=0, B, C;
-		while( !In.AtEnd() )
+		FCodecArchiveSource Src( In );
+		FDecoder Decoder( Src );
+		Decoder.Pump( Out );
+		return 1;
+		unguard;
+	}
+
+	// Expands runs as they are read.
+	class FDecoder : public FCodecSource
+	{
+	public:
+		FDecoder( FCodecSource& InSrc )
+		:	Reader( InSrc ), Count( 0 ), Pending( 0 ), PrevChar( 0 )
+		{}
+		INT Read( BYTE* Dest, INT Num )
 		{
-			In << B;
-			Out << B;
-			if( B!=PrevChar )
-			{
-				PrevChar = B;
-				Count    = 1;
-			}
-			else if( ++Count==RLE_LEAD )
+			guard(FCodecRLE::FDecoder::Read);
+			INT Done=0;
+			BYTE B, C;
+			while( Done<Num )
 			{
-				In << C;
-				check(C>=2);
-				while( C-->RLE_LEAD )
-					Out << B;
-				Count = 0;
+				if( Pending )
+				{
+					INT Copy = Min( Pending, Num-Done );
+					appMemset( Dest+Done, PrevChar, Copy );
+					Done    += Copy;
+					Pending -= Copy;
+					continue;
+				}
+				if( !Reader.Get(B) )
+					break;
+				Dest[Done++] = B;
+				if( B!=PrevChar )
+				{
+					PrevChar = B;
+					Count    = 1;
+				}
+				else if( ++Count==RLE_LEAD )
+				{
+					verify(Reader.Get(C));
+					check(C>=2);
+					Pending = Max<INT>( C-RLE_LEAD, 0 );
+					Count   = 0;
+				}
 			}
+			return Done;
+			unguard;
 		}
-		return 1;
-		unguard;
-	}
+	private:
+		FCodecSourceReader	Reader;
+		INT					Count, Pending;
+		BYTE				PrevChar;
+	};
 };
 
 /*-----------------------------------------------------------------------------
 	Huffman codec.
 -----------------------------------------------------------------------------*/
 
+//
+// Canonical Huffman coder. The stream is an INT symbol count followed by
+// an LSB-first bitstream holding the code tree (pre-order, 1 for a node
+// followed by its two children, 0 for a leaf followed by its 8 bit
+// symbol) and then the codes, so any tree written by older encoders is
+// still understood. Decoding resolves up to TABLE_BITS bits per lookup.
+//
 class FCodecHuffman : public FCodec
 {
 private:
-	struct FHuffman
+	enum {TABLE_BITS=11};
+	enum {MAX_NODES=2*256-1};
+	enum {MAX_CODE_BITS=56};
+	enum {CHUNK_SIZE=CODEC_CHUNK_SIZE};
+
+	// Writes an LSB-first bitstream through a small buffer.
+	struct FBitSink
 	{
-		INT Ch, Count;
-		TArray<FHuffman*> Child;
-		TArray<BYTE> Bits;
-		FHuffman( INT InCh )
-		: Ch(InCh), Count(0)
+		FArchive&	Out;
+		QWORD		Accum;
+		INT			NumBits, Count;
+		BYTE		Buffer[CHUNK_SIZE];
+		FBitSink( FArchive& InOut )
+		:	Out( InOut ), Accum( 0 ), NumBits( 0 ), Count( 0 )
+		{}
+		void Write( QWORD Bits, INT Length )
+		{
+			Accum   |= Bits << NumBits;
+			NumBits += Length;
+			while( NumBits>=8 )
+			{
+				Buffer[Count++] = (BYTE)Accum;
+				Accum   >>= 8;
+				NumBits  -= 8;
+				if( Count==CHUNK_SIZE )
+				{
+					Out.Serialize( Buffer, Count );
+					Count = 0;
+				}
+			}
+		}
+		void Flush()
 		{
+			if( NumBits )
+				Write( 0, 8-NumBits );
+			if( Count )
+				Out.Serialize( Buffer, Count );
+			Count = 0;
 		}
-		~FHuffman()
+	};
+
+	// Reads an LSB-first bitstream from a source, yielding zeros past the end.
+	struct FBitSource
+	{
+		FCodecSource&	Src;
+		INT				Pos, Count, Padding, NumBits;
+		QWORD			Accum;
+		BYTE			Buffer[CHUNK_SIZE];
+		FBitSource( FCodecSource& InSrc )
+		:	Src( InSrc ), Pos( 0 ), Count( 0 ), Padding( 0 ), NumBits( 0 ), Accum( 0 )
+		{}
+		void Refill()
 		{
-			for( INT i=0; i<Child.Num(); i++ )
-				delete Child( i );
+			for( ; NumBits<=MAX_CODE_BITS; NumBits+=8 )
+			{
+				if( Pos==Count )
+				{
+					Count = Src.Read( Buffer, CHUNK_SIZE );
+					Pos   = 0;
+				}
+				if( Pos<Count )
+					Accum |= (QWORD)Buffer[Pos++] << NumBits;
+				else
+					Padding++;
+			}
 		}
-		void PrependBit( BYTE B )
+		DWORD Read( INT Length )
 		{
-			Bits.Insert( 0 );
-			Bits(0) = B;
-			for( INT i=0; i<Child.Num(); i++ )
-				Child(i)->PrependBit( B );
+			if( NumBits<Length )
+				Refill();
+			DWORD Result = (DWORD)Accum & ((1<<Length)-1);
+			Accum   >>= Length;
+			NumBits  -= Length;
+			return Result;
 		}
-		void WriteTable( FBitWriter& Writer )
+		UBOOL Overrun()
 		{
-			Writer.WriteBit( Child.Num()!=0 );
-			if( Child.Num() )
-				for( INT i=0; i<Child.Num(); i++ )
-					Child(i)->WriteTable( Writer );
-			else
+			return Padding*8 > NumBits;
+		}
+	};
+
+	// Flattened decoding tree plus a lookup table indexed by the next
+	// TABLE_BITS bits. Entries hold (Length<<16)|Symbol for short codes,
+	// or the node to continue walking from for longer ones.
+	struct FDecodeTable
+	{
+		INT		NumNodes;
+		INT		Child[MAX_NODES][2];
+		INT		Symbol[MAX_NODES];
+		DWORD	Table[1<<TABLE_BITS];
+		INT ReadTree( FBitSource& Source )
+		{
+			check(NumNodes<MAX_NODES);
+			INT Node = NumNodes++;
+			if( Source.Read(1) )
 			{
-				BYTE B = Ch;
-				Writer << B;
+				Symbol[Node] = -1;
+				for( INT i=0; i<2; i++ )
+					Child[Node][i] = ReadTree( Source );
 			}
+			else Symbol[Node] = Source.Read(8);
+			return Node;
 		}
-		void ReadTable( FBitReader& Reader )
+		void Fill( INT Node, INT Depth, DWORD Code )
 		{
-			if( Reader.ReadBit() )
+			if( Symbol[Node]>=0 )
 			{
-				Child.Add( 2 );
-				for( INT i=0; i<Child.Num(); i++ )
-				{
-					Child( i ) = new FHuffman( -1 );
-					Child( i )->ReadTable( Reader );
-				}
+				for( DWORD i=Code; i<(1<<TABLE_BITS); i+=(1<<Depth) )
+					Table[i] = (Depth<<16) | Symbol[Node];
+			}
+			else if( Depth==TABLE_BITS )
+				Table[Code] = Node;
+			else for( INT i=0; i<2; i++ )
+				Fill( Child[Node][i], Depth+1, Code | (i<<Depth) );
+		}
+		void Init( FBitSource& Source )
+		{
+			NumNodes = 0;
+			ReadTree( Source );
+			if( Symbol[0]<0 )
+				Fill( 0, 0, 0 );
+		}
+		BYTE Decode( FBitSource& Source )
+		{
+			if( Source.NumBits<TABLE_BITS )
+				Source.Refill();
+			DWORD Entry = Table[(DWORD)Source.Accum & ((1<<TABLE_BITS)-1)];
+			if( Entry>>16 )
+			{
+				Source.Accum   >>= Entry>>16;
+				Source.NumBits  -= Entry>>16;
+				return (BYTE)Entry;
 			}
-			else Ch = Arctor<BYTE>( Reader );
+			Source.Read( TABLE_BITS );
+			INT Node;
+			for( Node=Entry; Symbol[Node]<0; Node=Child[Node][Source.Read(1)] );
+			return Symbol[Node];
 		}
 	};
-	static QSORT_RETURN CDECL CompareHuffman( const FHuffman** A, const FHuffman** B )
+
+	// Compute optimal code lengths for the symbols with nonzero counts.
+	static void BuildLengths( const INT* Counts, INT* Lengths )
+	{
+		INT NodeCount[MAX_NODES], Parent[MAX_NODES], Live[256], NumLive=0, NumNodes=256, i;
+		for( i=0; i<256; i++ )
+		{
+			Lengths[i]   = 0;
+			NodeCount[i] = Counts[i];
+			if( Counts[i] )
+				Live[NumLive++] = i;
+		}
+		if( NumLive<2 )
+			return;
+		while( NumLive>1 )
+		{
+			INT A=0, B=1;
+			if( NodeCount[Live[B]]<NodeCount[Live[A]] )
+				Exchange( A, B );
+			for( i=2; i<NumLive; i++ )
+				if( NodeCount[Live[i]]<NodeCount[Live[A]] )
+					B = A, A = i;
+				else if( NodeCount[Live[i]]<NodeCount[Live[B]] )
+					B = i;
+			INT Node = NumNodes++;
+			NodeCount[Node] = NodeCount[Live[A]] + NodeCount[Live[B]];
+			Parent[Live[A]] = Parent[Live[B]] = Node;
+			Live[A] = Node;
+			Live[B] = Live[--NumLive];
+		}
+		for( i=0; i<256; i++ )
+			if( Counts[i] )
+				for( INT Node=i; Node!=NumNodes-1; Node=Parent[Node] )
+					Lengths[i]++;
+	}
+
+	// Assign canonical codes, ordered by length and then by symbol.
+	static void BuildCodes( const INT* Lengths, QWORD* Codes )
+	{
+		QWORD Code=0;
+		for( INT i=0; i<256; i++ )
+			Codes[i] = 0;
+		for( INT Length=1; Length<=MAX_CODE_BITS; Length++, Code<<=1 )
+			for( INT i=0; i<256; i++ )
+				if( Lengths[i]==Length )
+					Codes[i] = Code++;
+	}
+
+	// Write the subtree for the codes starting with Prefix.
+	static void WriteTree( FBitSink& Sink, const INT* Lengths, const QWORD* Codes, INT Depth, QWORD Prefix, INT Used )
 	{
-		return (*B)->Count - (*A)->Count;
+		for( INT i=0; i<256; i++ )
+			if( Lengths[i]==Depth && Codes[i]==Prefix && (Depth || i==Used) )
+			{
+				Sink.Write( (i<<1) | 0, 9 );
+				return;
+			}
+		check(Depth<MAX_CODE_BITS);
+		Sink.Write( 1, 1 );
+		for( INT i=0; i<2; i++ )
+			WriteTree( Sink, Lengths, Codes, Depth+1, (Prefix<<1) | i, Used );
 	}
 public:
 	UBOOL Encode( FArchive& In, FArchive& Out )
 	{
 		guard(FCodecHuffman::Encode);
 		INT SavedPos = In.Tell();
-		INT Total=0, i;
+		INT Total = In.TotalSize()-SavedPos, Counts[256], Lengths[256], Used=0, i, Num;
+		QWORD Codes[256], Reversed[256];
+		BYTE Chunk[CHUNK_SIZE];
 
 		// Compute character frequencies.
-		TArray<FHuffman*> Huff(256);
 		for( i=0; i<256; i++ )
-			Huff(i) = new FHuffman(i);
-		TArray<FHuffman*> Index = Huff;
-		while( !In.AtEnd() )
-			Huff(Arctor<BYTE>(In))->Count++, Total++;
+			Counts[i] = 0;
+		for( INT Pos=0; Pos<Total; Pos+=Num )
+		{
+			In.Serialize( Chunk, Num=Min<INT>(Total-Pos,CHUNK_SIZE) );
+			for( i=0; i<Num; i++ )
+				Counts[Chunk[i]]++;
+		}
 		In.Seek( SavedPos );
 		Out << Total;
 
-		// Build compression table.
-		while( Huff.Num()>1 && Huff.Last()->Count==0 )
-			delete Huff.Pop();
-		INT BitCount = Huff.Num()*(8+1);
-		while( Huff.Num()>1 )
+		// Build the code. A lone symbol is a bare leaf with an empty code.
+		for( i=0; i<256; i++ )
+			if( Counts[i] )
+				Used = i;
+		BuildLengths( Counts, Lengths );
+		BuildCodes( Lengths, Codes );
+		for( i=0; i<256; i++ )
 		{
-			FHuffman* Node  = new FHuffman( -1 );
-			Node->Child.Add( 2 );
-			for( i=0; i<Node->Child.Num(); i++ )
-			{
-				Node->Child(i) = Huff.Pop();
-				Node->Child(i)->PrependBit(i);
-				Node->Count += Node->Child(i)->Count;
-			}
-			for( i=0; i<Huff.Num(); i++ )
-				if( Huff(i)->Count < Node->Count )
-					break;
-			Huff.Insert( i );
-			Huff( i ) = Node;
-			BitCount++;
+			Reversed[i] = 0;
+			for( INT j=0; j<Lengths[i]; j++ )
+				Reversed[i] |= ((Codes[i]>>j)&1) << (Lengths[i]-1-j);
 		}
-		FHuffman* Root = Huff.Pop();
-
-		// Calc stats.
-		while( !In.AtEnd() )
-			BitCount += Index(Arctor<BYTE>(In))->Bits.Num();
-		In.Seek( SavedPos );
 
 		// Save table and bitstream.
-		FBitWriter Writer( BitCount );
-		Root->WriteTable( Writer );
-		while( !In.AtEnd() )
+		FBitSink Sink( Out );
+		WriteTree( Sink, Lengths, Codes, 0, 0, Used );
+		for( INT Pos=0; Pos<Total; Pos+=Num )
 		{
-			FHuffman* P = Index(Arctor<BYTE>(In));
-			for( INT i=0; i<P->Bits.Num(); i++ )
-				Writer.WriteBit( P->Bits(i) );
+			In.Serialize( Chunk, Num=Min<INT>(Total-Pos,CHUNK_SIZE) );
+			for( i=0; i<Num; i++ )
+				Sink.Write( Reversed[Chunk[i]], Lengths[Chunk[i]] );
 		}
-		check(!Writer.IsError());
-		check(Writer.GetNumBits()==BitCount);
-		Out.Serialize( Writer.GetData(), Writer.GetNumBytes() );
-
-		// Finish up.
-		delete Root;
+		Sink.Flush();
 		return 0;
-
 		unguard;
 	}
 	UBOOL Decode( FArchive& In, FArchive& Out )
 	{
 		guard(FCodecHuffman::Decode);
-		INT Total;
-		In << Total;
-		TArray<BYTE> InArray( In.TotalSize()-In.Tell() );
-		In.Serialize( &InArray(0), InArray.Num() );
-		FBitReader Reader( &InArray(0), InArray.Num()*8 );
-		FHuffman Root(-1);
-		Root.ReadTable( Reader );
-		while( Total-- > 0 )
-		{
-			check(!Reader.AtEnd());
-			for( FHuffman* Node=&Root; Node->Ch==-1; Node=Node->Child(Reader.ReadBit()) );
-			BYTE B = Node->Ch;
-			Out << B;
-		}
+		FCodecArchiveSource Src( In );
+		FDecoder Decoder( Src );
+		Decoder.Pump( Out );
 		return 1;
 		unguard;
 	}
+
+	// Decodes symbols on demand. The table is read on the first call.
+	class FDecoder : public FCodecSource
+	{
+	public:
+		FDecoder( FCodecSource& InSrc )
+		:	Source( InSrc ), Table( NULL ), Remaining( 0 )
+		{}
+		~FDecoder()
+		{
+			if( Table )
+				delete Table;
+		}
+		INT Read( BYTE* Dest, INT Count )
+		{
+			guard(FCodecHuffman::FDecoder::Read);
+			if( !Table )
+			{
+				// The symbol count is byte aligned ahead of the bitstream.
+				for( INT i=0; i<4; i++ )
+					Remaining |= Source.Read(8) << (i*8);
+				check(Remaining>=0);
+				Table = new(TEXT("HuffmanTable"))FDecodeTable;
+				Table->Init( Source );
+			}
+			Count = Min( Count, Remaining );
+			if( Table->Symbol[0]>=0 )
+			{
+				// Single symbol stream, nothing to read.
+				appMemset( Dest, Table->Symbol[0], Count );
+			}
+			else for( INT i=0; i<Count; i++ )
+				Dest[i] = Table->Decode( Source );
+			Remaining -= Count;
+			check(!Source.Overrun());
+			return Count;
+			unguard;
+		}
+	private:
+		FBitSource		Source;
+		FDecodeTable*	Table;
+		INT				Remaining;
+	};
 };
 
 /*-----------------------------------------------------------------------------
 	Move-to-front encoder.
 -----------------------------------------------------------------------------*/
 
+//
+// The recency list is kept as a plain byte array so the search and the
+// shift are single memchr and memmove calls, which the C runtime
+// vectorizes. After BWT most symbols are at the front already.
+//
 class FCodecMTF : public FCodec
 {
 public:
 	UBOOL Encode( FArchive& In, FArchive& Out )
 	{
 		guard(FCodecMTF::Encode);
-		BYTE List[256], B, C;
-		INT i;
-		for( i=0; i<256; i++ )
+		FCodecReader Reader( In );
+		FCodecWriter Writer( Out );
+		BYTE List[256];
+		for( INT i=0; i<256; i++ )
 			List[i] = i;
-		while( !In.AtEnd() )
+		while( Reader.Fill() )
 		{
-			In << B;
-			for( i=0; i<256; i++ )
-				if( List[i]==B )
-					break;
-			check(i<256);
-			C = i;
-			Out << C;
-			INT NewPos=0;
-			for( i; i>NewPos; i-- )
-				List[i]=List[i-1];
-			List[NewPos] = B;
+			for( BYTE* B=Reader.Buffer; B<Reader.Buffer+Reader.Count; B++ )
+			{
+				if( List[0]==*B )
+				{
+					Writer.Put( 0 );
+					continue;
+				}
+				BYTE* Found = (BYTE*)memchr( List, *B, 256 );
+				check(Found);
+				Writer.Put( Found-List );
+				memmove( List+1, List, Found-List );
+				List[0] = *B;
+			}
 		}
 		return 0;
 		unguard;
@@ -353,23 +930,276 @@ public:
 	UBOOL Decode( FArchive& In, FArchive& Out )
 	{
 		guard(FCodecMTF::Decode);
-		BYTE List[256], B, C;
-		INT i;
-		for( i=0; i<256; i++ )
-			List[i] = i;
-		while( !In.AtEnd() )
+		FCodecArchiveSource Src( In );
+		FDecoder Decoder( Src );
+		Decoder.Pump( Out );
+		return 1;
+		unguard;
+	}
+
+	// Ranks are replaced by their symbols in place.
+	class FDecoder : public FCodecSource
+	{
+	public:
+		FDecoder( FCodecSource& InSrc )
+		:	Src( InSrc )
 		{
-			In << B;
-			C = List[B];
-			Out << C;
-			INT NewPos=0;
-			for( i=B; i>NewPos; i-- )
-				List[i]=List[i-1];
-			List[NewPos] = C;
+			for( INT i=0; i<256; i++ )
+				List[i] = i;
 		}
+		INT Read( BYTE* Dest, INT Count )
+		{
+			Count = Src.Read( Dest, Count );
+			for( BYTE* B=Dest; B<Dest+Count; B++ )
+			{
+				BYTE C = List[*B];
+				if( *B )
+				{
+					memmove( List+1, List, *B );
+					List[0] = C;
+				}
+				*B = C;
+			}
+			return Count;
+		}
+	private:
+		FCodecSource&	Src;
+		BYTE			List[256];
+	};
+};
+
+/*-----------------------------------------------------------------------------
+	LZ77 codec.
+-----------------------------------------------------------------------------*/
+
+//
+// Fast byte oriented LZ77 coder in the style of LZ4, trading some ratio
+// for much faster coding than the BWT chain. The stream is a series of
+// independent blocks, each an INT raw length and INT packed length
+// followed by the packed bytes, or by the raw bytes when packing does
+// not make the block smaller. Packed blocks are sequences of a token
+// byte (literal count in the high nibble, match length minus MIN_MATCH
+// in the low nibble, 15 meaning more follows as 255-terminated bytes),
+// the literals, and a 16 bit match offset. The last sequence of a block
+// has literals only.
+//
+class FCodecLZ : public FCodec
+{
+private:
+	enum {MAX_BUFFER_SIZE=0x40000};
+	enum {HASH_BITS=14};
+	enum {MIN_MATCH=4};
+	enum {MAX_OFFSET=0xffff};
+	enum {SKIP_BITS=6};
+
+	static DWORD Load32( const BYTE* P )
+	{
+		DWORD Result;
+		memcpy( &Result, P, sizeof(Result) );
+		return Result;
+	}
+	static BYTE* WriteLength( BYTE* Out, INT Length )
+	{
+		for( ; Length>=255; Length-=255 )
+			*Out++ = 255;
+		*Out++ = Length;
+		return Out;
+	}
+	static BYTE* WriteSequence( BYTE* Out, const BYTE* Literals, INT NumLiterals, INT Offset, INT MatchLength )
+	{
+		BYTE* Token = Out++;
+		*Token = Min(NumLiterals,15)<<4;
+		if( NumLiterals>=15 )
+			Out = WriteLength( Out, NumLiterals-15 );
+		appMemcpy( Out, Literals, NumLiterals );
+		Out += NumLiterals;
+		if( MatchLength )
+		{
+			*Out++ = Offset;
+			*Out++ = Offset>>8;
+			MatchLength -= MIN_MATCH;
+			*Token |= Min(MatchLength,15);
+			if( MatchLength>=15 )
+				Out = WriteLength( Out, MatchLength-15 );
+		}
+		return Out;
+	}
+
+	// Pack a block into Dest, which must hold MaxPackedLength(Length) bytes.
+	static INT MaxPackedLength( INT Length )
+	{
+		return Length + Length/255 + 16;
+	}
+	static INT Compress( const BYTE* Src, INT Length, BYTE* Dest, INT* Hash )
+	{
+		for( INT i=0; i<(1<<HASH_BITS); i++ )
+			Hash[i] = -MAX_OFFSET-1;
+		BYTE* Out = Dest;
+		INT Pos=0, Anchor=0;
+		while( Pos<=Length-MIN_MATCH )
+		{
+			DWORD Seq  = Load32( Src+Pos );
+			DWORD Slot = (Seq*2654435761U) >> (32-HASH_BITS);
+			INT   Ref  = Hash[Slot];
+			Hash[Slot] = Pos;
+			if( Pos-Ref>MAX_OFFSET || Load32(Src+Ref)!=Seq )
+			{
+				// Step faster through data that does not compress.
+				Pos += 1 + ((Pos-Anchor)>>SKIP_BITS);
+				continue;
+			}
+			while( Pos>Anchor && Ref>0 && Src[Pos-1]==Src[Ref-1] )
+				Pos--, Ref--;
+			INT MatchLength = MIN_MATCH;
+			while( Pos+MatchLength<Length && Src[Ref+MatchLength]==Src[Pos+MatchLength] )
+				MatchLength++;
+			Out    = WriteSequence( Out, Src+Anchor, Pos-Anchor, Pos-Ref, MatchLength );
+			Pos   += MatchLength;
+			Anchor = Pos;
+		}
+		Out = WriteSequence( Out, Src+Anchor, Length-Anchor, 0, 0 );
+		return Out-Dest;
+	}
+
+	// Unpack a block, validating it against untrusted input.
+	static void Decompress( const BYTE* In, INT PackedLength, BYTE* Out, INT RawLength )
+	{
+		guard(FCodecLZ::Decompress);
+		const BYTE* InEnd = In+PackedLength;
+		BYTE* OutStart = Out;
+		BYTE* OutEnd = Out+RawLength;
+		for( ;; )
+		{
+			check(In<InEnd);
+			INT Token = *In++;
+			INT Length = Token>>4;
+			if( Length==15 )
+				for( BYTE B=255; B==255; Length+=B )
+				{
+					check(In<InEnd);
+					B = *In++;
+				}
+			check(Length<=InEnd-In && Length<=OutEnd-Out);
+			appMemcpy( Out, In, Length );
+			In  += Length;
+			Out += Length;
+			if( In==InEnd )
+				break;
+			check(InEnd-In>=2);
+			INT Offset = In[0] | (In[1]<<8);
+			In += 2;
+			check(Offset>0 && Offset<=Out-OutStart);
+			Length = Token&15;
+			if( Length==15 )
+				for( BYTE B=255; B==255; Length+=B )
+				{
+					check(In<InEnd);
+					B = *In++;
+				}
+			Length += MIN_MATCH;
+			check(Length<=OutEnd-Out);
+			const BYTE* Match = Out-Offset;
+			if( Offset>=Length )
+			{
+				appMemcpy( Out, Match, Length );
+				Out += Length;
+			}
+			else while( Length-- )
+				*Out++ = *Match++;
+		}
+		check(Out==OutEnd);
+		unguard;
+	}
+public:
+	UBOOL Encode( FArchive& In, FArchive& Out )
+	{
+		guard(FCodecLZ::Encode);
+		TArray<BYTE> Raw(MAX_BUFFER_SIZE), Packed(MaxPackedLength(MAX_BUFFER_SIZE));
+		TArray<INT>  Hash(1<<HASH_BITS);
+		for( INT Remaining=In.TotalSize()-In.Tell(); Remaining>0; )
+		{
+			INT RawLength = Min<INT>( Remaining, MAX_BUFFER_SIZE );
+			In.Serialize( &Raw(0), RawLength );
+			INT PackedLength = Compress( &Raw(0), RawLength, &Packed(0), &Hash(0) );
+			if( PackedLength>=RawLength )
+			{
+				PackedLength = RawLength;
+				Out << RawLength << PackedLength;
+				Out.Serialize( &Raw(0), RawLength );
+			}
+			else
+			{
+				Out << RawLength << PackedLength;
+				Out.Serialize( &Packed(0), PackedLength );
+			}
+			Remaining -= RawLength;
+		}
+		return 0;
+		unguard;
+	}
+	UBOOL Decode( FArchive& In, FArchive& Out )
+	{
+		guard(FCodecLZ::Decode);
+		FCodecArchiveSource Src( In );
+		FDecoder Decoder( Src );
+		Decoder.Pump( Out );
 		return 1;
 		unguard;
 	}
+
+	// Unpacks one block at a time.
+	class FDecoder : public FCodecSource
+	{
+	public:
+		FDecoder( FCodecSource& InSrc )
+		:	Reader	( InSrc )
+		,	Raw		( MAX_BUFFER_SIZE )
+		,	Packed	( MAX_BUFFER_SIZE )
+		,	Pos		( 0 )
+		,	Count	( 0 )
+		{}
+		INT Read( BYTE* Dest, INT Num )
+		{
+			guard(FCodecLZ::FDecoder::Read);
+			INT Done=0;
+			while( Done<Num && (Pos<Count || NextBlock()) )
+			{
+				INT Copy = Min( Num-Done, Count-Pos );
+				appMemcpy( Dest+Done, &Raw(Pos), Copy );
+				Done += Copy;
+				Pos  += Copy;
+			}
+			return Done;
+			unguard;
+		}
+	private:
+		FCodecSourceReader	Reader;
+		TArray<BYTE>		Raw, Packed;
+		INT					Pos, Count;
+		UBOOL NextBlock()
+		{
+			guard(FCodecLZ::FDecoder::NextBlock);
+			INT RawLength, PackedLength;
+			if( !Reader.Get( RawLength ) )
+				return 0;
+			verify(Reader.Get( PackedLength ));
+			check(RawLength>0 && RawLength<=MAX_BUFFER_SIZE);
+			check(PackedLength>0 && PackedLength<=RawLength);
+			if( PackedLength==RawLength )
+			{
+				verify(Reader.Get( &Raw(0), RawLength ));
+			}
+			else
+			{
+				verify(Reader.Get( &Packed(0), PackedLength ));
+				Decompress( &Packed(0), PackedLength, &Raw(0), RawLength );
+			}
+			Pos   = 0;
+			Count = RawLength;
+			return 1;
+			unguard;
+		}
+	};
 };
 
 /*-----------------------------------------------------------------------------
@@ -380,6 +1210,7 @@ class FCodecFull : public FCodec
 {
 private:
 	TArray<FCodec*> Codecs;
+	UBOOL LogTimes;
 	void Code( FArchive& In, FArchive& Out, INT Step, INT First, UBOOL (FCodec::*Func)(FArchive&,FArchive&) )
 	{
 		guard(FCodecFull::Code);
@@ -394,17 +1225,22 @@ private:
 			(Codecs(First + Step*i)->*Func)( *(i ? &Reader : &In), *(i<Codecs.Num()-1 ? &Writer : &Out) );
 			EndTime = appSeconds() - StartTime;
 			TotalTime += EndTime.GetFloat();
-			GWarn->Logf(TEXT("stage %d: %f secs"), i, EndTime.GetFloat() );
+			if( LogTimes )
+				GWarn->Logf(TEXT("stage %d: %f secs"), i, EndTime.GetFloat() );
 			if( i<Codecs.Num()-1 )
 			{
-				InData = OutData;
+				ExchangeArray( InData, OutData );
 				OutData.Empty();
 			}
 		}
-		GWarn->Logf(TEXT("Total: %f secs"), TotalTime );
+		if( LogTimes )
+			GWarn->Logf(TEXT("Total: %f secs"), TotalTime );
 		unguard;
 	}
 public:
+	FCodecFull( UBOOL InLogTimes=1 )
+	:	LogTimes( InLogTimes )
+	{}
 	UBOOL Encode( FArchive& In, FArchive& Out )
 	{
 		guard(FCodecFull::Encode);
@@ -434,6 +1270,339 @@ public:
 	}
 };
 
+// The RLE-BWT-MTF-RLE-Huffman chain used by .uz files.
+inline FCodecFull* CreateUzCodec( UBOOL LogTimes=1 )
+{
+	FCodecFull* Codec = new FCodecFull( LogTimes );
+	Codec->AddCodec(new FCodecRLE);
+	Codec->AddCodec(new FCodecBWT);
+	Codec->AddCodec(new FCodecMTF);
+	Codec->AddCodec(new FCodecRLE);
+	Codec->AddCodec(new FCodecHuffman);
+	return Codec;
+}
+inline FCodec* CreateQuietUzCodec()
+{
+	return CreateUzCodec( 0 );
+}
+
+/*-----------------------------------------------------------------------------
+	Block-parallel codec.
+-----------------------------------------------------------------------------*/
+
+//
+// Splits the stream into independent blocks, each coded by its own codec
+// instance on a worker pool. The container is laid out as:
+//
+//	INT RawSize, BlockSize, NumBlocks;
+//	INT PackedSize[NumBlocks];
+//	BYTE Packed[NumBlocks][PackedSize[i]];
+//
+// The index is written up front so that readers can locate any block
+// without decoding its predecessors; encoding requires a seekable Out.
+//
+class FCodecParallel : public FCodec
+{
+public:
+	enum {DEFAULT_BLOCK_SIZE=0x100000};
+	typedef FCodec* (*FCreateCodec)();
+	FCodecParallel( FCreateCodec InCreateCodec=CreateQuietUzCodec, INT InNumThreads=0, INT InBlockSize=DEFAULT_BLOCK_SIZE )
+	:	CreateCodec	( InCreateCodec )
+	,	NumThreads	( InNumThreads )
+	,	BlockSize	( InBlockSize )
+	{}
+	UBOOL Encode( FArchive& In, FArchive& Out )
+	{
+		guard(FCodecParallel::Encode);
+		INT RawSize   = In.TotalSize() - In.Tell();
+		INT NumBlocks = (RawSize + BlockSize - 1) / BlockSize;
+		TArray<INT> PackedSizes(NumBlocks);
+		Out << RawSize << BlockSize << NumBlocks;
+		INT IndexPos = Out.Tell();
+		for( INT i=0; i<NumBlocks; i++ )
+		{
+			PackedSizes(i) = 0;
+			Out << PackedSizes(i);
+		}
+
+		FThreadPool Pool( NumThreads );
+		TArray<FBlockTask*> Tasks;
+		for( INT i=0; i<Max(Pool.NumThreads(),1)*2; i++ )
+			Tasks.AddItem( new FBlockTask );
+		for( INT First=0; First<NumBlocks; First+=Tasks.Num() )
+		{
+			INT Count = Min( Tasks.Num(), NumBlocks-First );
+			for( INT i=0; i<Count; i++ )
+			{
+				FBlockTask& Task = *Tasks(i);
+				Task.Init( CreateCodec(), 1 );
+				Task.InData.Add( Min( BlockSize, RawSize-(First+i)*BlockSize ) );
+				In.Serialize( &Task.InData(0), Task.InData.Num() );
+				Pool.AddTask( &Task );
+			}
+			check(Pool.Wait());
+			for( INT i=0; i<Count; i++ )
+			{
+				FBlockTask& Task = *Tasks(i);
+				PackedSizes(First+i) = Task.OutData.Num();
+				Out.Serialize( &Task.OutData(0), Task.OutData.Num() );
+				Task.Exit();
+			}
+		}
+
+		for( INT i=0; i<Tasks.Num(); i++ )
+			delete Tasks(i);
+
+		INT EndPos = Out.Tell();
+		Out.Seek( IndexPos );
+		for( INT i=0; i<NumBlocks; i++ )
+			Out << PackedSizes(i);
+		Out.Seek( EndPos );
+		return 0;
+		unguard;
+	}
+	UBOOL Decode( FArchive& In, FArchive& Out )
+	{
+		guard(FCodecParallel::Decode);
+		INT RawSize, InBlockSize, NumBlocks;
+		In << RawSize << InBlockSize << NumBlocks;
+		check(RawSize>=0);
+		check(InBlockSize>0);
+		check(NumBlocks==(RawSize + InBlockSize - 1) / InBlockSize);
+		TArray<INT> PackedSizes(NumBlocks);
+		for( INT i=0; i<NumBlocks; i++ )
+		{
+			In << PackedSizes(i);
+			check(PackedSizes(i)>=0 && PackedSizes(i)<=In.TotalSize()-In.Tell());
+		}
+
+		FThreadPool Pool( NumThreads );
+		TArray<FBlockTask*> Tasks;
+		for( INT i=0; i<Max(Pool.NumThreads(),1)*2; i++ )
+			Tasks.AddItem( new FBlockTask );
+		for( INT First=0; First<NumBlocks; First+=Tasks.Num() )
+		{
+			INT Count = Min( Tasks.Num(), NumBlocks-First );
+			for( INT i=0; i<Count; i++ )
+			{
+				FBlockTask& Task = *Tasks(i);
+				Task.Init( CreateCodec(), 0 );
+				Task.InData.Add( PackedSizes(First+i) );
+				In.Serialize( &Task.InData(0), Task.InData.Num() );
+				Pool.AddTask( &Task );
+			}
+			check(Pool.Wait());
+			for( INT i=0; i<Count; i++ )
+			{
+				FBlockTask& Task = *Tasks(i);
+				check(Task.OutData.Num()==Min( InBlockSize, RawSize-(First+i)*InBlockSize ));
+				Out.Serialize( &Task.OutData(0), Task.OutData.Num() );
+				Task.Exit();
+			}
+		}
+		for( INT i=0; i<Tasks.Num(); i++ )
+			delete Tasks(i);
+		return 1;
+		unguard;
+	}
+private:
+	// Codes one block on a worker thread.
+	struct FBlockTask : public FThreadTask
+	{
+		FCodec*      Codec;
+		UBOOL        Encoding;
+		TArray<BYTE> InData, OutData;
+		FBlockTask()
+		:	Codec( NULL )
+		{}
+		void Init( FCodec* InCodec, UBOOL InEncoding )
+		{
+			Codec    = InCodec;
+			Encoding = InEncoding;
+		}
+		void Exit()
+		{
+			delete Codec;
+			Codec = NULL;
+			InData.Empty();
+			OutData.Empty();
+		}
+		void DoWork()
+		{
+			FBufferReader Reader( InData );
+			FBufferWriter Writer( OutData );
+			if( Encoding )
+				Codec->Encode( Reader, Writer );
+			else
+				Codec->Decode( Reader, Writer );
+		}
+	};
+	FCreateCodec CreateCodec;
+	INT          NumThreads;
+	INT          BlockSize;
+};
+
+/*-----------------------------------------------------------------------------
+	.uz file signatures.
+-----------------------------------------------------------------------------*/
+
+//
+// A .uz file starts with an INT signature and the original FString
+// filename, followed by the coded data. 5679 is avoided because later
+// engine generations use it for zlib based .uz2 files.
+//
+enum EUzSignature
+{
+	UZ_SIGNATURE_FULL		= 5678,	// CreateUzCodec stream.
+	UZ_SIGNATURE_PARALLEL	= 5690,	// FCodecParallel container of CreateUzCodec blocks.
+	UZ_SIGNATURE_LZ			= 5691,	// FCodecLZ stream, for fast decompression.
+};
+
+/*-----------------------------------------------------------------------------
+	Streaming .uz decoder.
+-----------------------------------------------------------------------------*/
+
+//
+// Decodes the body of a .uz file as it is read, following its header.
+// Only one BWT or LZ block and one Huffman table are held at a time, so
+// memory use does not depend on the file size. Parallel containers are
+// decoded one block after another.
+//
+class FUzDecoder : public FCodecSource
+{
+public:
+	static UBOOL IsKnownSignature( INT Signature )
+	{
+		return Signature==UZ_SIGNATURE_FULL || Signature==UZ_SIGNATURE_PARALLEL || Signature==UZ_SIGNATURE_LZ;
+	}
+	FUzDecoder( FArchive& InAr, INT InSignature )
+	:	Ar			( InAr )
+	,	Signature	( InSignature )
+	,	RawSize		( -1 )
+	,	BlockSize	( 0 )
+	,	Block		( 0 )
+	,	BlockRead	( 0 )
+	,	Source		( NULL )
+	,	Huffman		( NULL )
+	,	RLE1		( NULL )
+	,	MTF			( NULL )
+	,	BWT			( NULL )
+	,	RLE2		( NULL )
+	,	LZ			( NULL )
+	,	Output		( NULL )
+	{
+		guard(FUzDecoder::FUzDecoder);
+		check(IsKnownSignature(Signature));
+		if( Signature==UZ_SIGNATURE_PARALLEL )
+		{
+			INT NumBlocks;
+			Ar << RawSize << BlockSize << NumBlocks;
+			check(RawSize>=0);
+			check(BlockSize>0);
+			check(NumBlocks==(RawSize + BlockSize - 1) / BlockSize);
+			PackedSizes.Add( NumBlocks );
+			for( INT i=0; i<NumBlocks; i++ )
+			{
+				Ar << PackedSizes(i);
+				check(PackedSizes(i)>=0);
+			}
+		}
+		unguard;
+	}
+	~FUzDecoder()
+	{
+		CloseChain();
+	}
+	// Size of the decoded data, or -1 if it is only known at the end.
+	INT GetRawSize()
+	{
+		return RawSize;
+	}
+	INT Read( BYTE* Dest, INT Count )
+	{
+		guard(FUzDecoder::Read);
+		INT Done=0;
+		while( Done<Count )
+		{
+			if( !Output && !OpenChain() )
+				break;
+			INT Num = Output->Read( Dest+Done, Count-Done );
+			Done      += Num;
+			BlockRead += Num;
+			if( Done<Count )
+			{
+				if( Signature==UZ_SIGNATURE_PARALLEL )
+					check(BlockRead==Min( BlockSize, RawSize-(Block-1)*BlockSize ));
+				CloseChain();
+			}
+		}
+		return Done;
+		unguard;
+	}
+private:
+	FArchive&				Ar;
+	INT						Signature, RawSize, BlockSize, Block, BlockRead;
+	TArray<INT>				PackedSizes;
+	FCodecArchiveSource*	Source;
+	FCodecHuffman::FDecoder*	Huffman;
+	FCodecRLE::FDecoder*	RLE1;
+	FCodecMTF::FDecoder*	MTF;
+	FCodecBWT::FDecoder*	BWT;
+	FCodecRLE::FDecoder*	RLE2;
+	FCodecLZ::FDecoder*		LZ;
+	FCodecSource*			Output;
+
+	// Set up the stages for the next stream, in reverse order of encoding.
+	UBOOL OpenChain()
+	{
+		guard(FUzDecoder::OpenChain);
+		if( Signature==UZ_SIGNATURE_PARALLEL )
+		{
+			if( Block==PackedSizes.Num() )
+				return 0;
+			check(PackedSizes(Block)<=Ar.TotalSize()-Ar.Tell());
+			Source = new FCodecArchiveSource( Ar, PackedSizes(Block++) );
+		}
+		else
+		{
+			if( Block++ )
+				return 0;
+			Source = new FCodecArchiveSource( Ar );
+		}
+		if( Signature==UZ_SIGNATURE_LZ )
+			Output = LZ = new FCodecLZ::FDecoder( *Source );
+		else
+		{
+			Huffman = new FCodecHuffman::FDecoder( *Source );
+			RLE1    = new FCodecRLE::FDecoder( *Huffman );
+			MTF     = new FCodecMTF::FDecoder( *RLE1 );
+			BWT     = new FCodecBWT::FDecoder( *MTF );
+			Output  = RLE2 = new FCodecRLE::FDecoder( *BWT );
+		}
+		BlockRead = 0;
+		return 1;
+		unguard;
+	}
+	void CloseChain()
+	{
+		delete LZ;
+		delete RLE2;
+		delete BWT;
+		delete MTF;
+		delete RLE1;
+		delete Huffman;
+		delete Source;
+		RLE2 = NULL;
+		BWT = NULL;
+		MTF = NULL;
+		RLE1 = NULL;
+		Huffman = NULL;
+		Source = NULL;
+		LZ = NULL;
+		Output = NULL;
+	}
+};
+
 /*-----------------------------------------------------------------------------
 	The End.
 -----------------------------------------------------------------------------*/
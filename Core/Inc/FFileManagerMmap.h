@@ -15,24 +15,29 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include "FFileManagerGeneric.h"
+#include "FThreadPool.h"
 
 /*-----------------------------------------------------------------------------
 	File Manager.
 -----------------------------------------------------------------------------*/
 
-#define MAX_PRECACHE 8192
-
 // File manager.
+//
+// The reader maps the whole file. Offsets are kept as 64-bit values; the
+// FArchive interface only carries INT offsets, so the 64-bit accessors
+// are provided alongside for code that knows it has a mapped file.
+//
 class FArchiveFileReader : public FArchive
 {
 public:
-	FArchiveFileReader( INT InFile, BYTE* InMap, FOutputDevice* InError, INT InSize )
+	FArchiveFileReader( INT InFile, BYTE* InMap, FOutputDevice* InError, SQWORD InSize )
 	:	File			( InFile )
-	,	Map				( InMap )
 	,	Error			( InError )
 	,	Size			( InSize )
 	,	Pos				( 0 )
+	,	Map				( InMap )
 	{
 		guard(FArchiveFileReader::FArchiveFileReader);
 		ArIsLoading = ArIsPersistent = 1;
@@ -48,122 +53,217 @@ public:
 	void Precache( INT HintCount )
 	{
 		guardSlow(FArchiveFileReader::Precache);
-		BYTE* StartAddr = Map+Pos;
-		INT Length = Min( Min( HintCount, Size-Pos ), MAX_PRECACHE );
-		if( mlock( StartAddr, Length ) == -1 )
-		{
-			ArIsError = 1;
-			Error->Logf( TEXT("Failed to precache (%i bytes): %s"), Length, appFromAnsi(strerror(errno)) );
-			return;
-		}
-		munlock( StartAddr, Length );
+		Advise( Pos, Min<SQWORD>( HintCount, Size-Pos ), MADV_WILLNEED );
 		unguardSlow;
 	}
 	void Seek( INT InPos )
 	{
-		guard(FArchiveFileReader::Seek);
-		check(InPos>=0);
-		check(InPos<=Size);
-		Pos = InPos;
-		unguard;
+		Seek64( InPos );
 	}
 	INT Tell()
 	{
-		return Pos;
+		return Min<SQWORD>( Pos, MAXINT );
 	}
 	INT TotalSize()
 	{
-		return Size;
+		return Min<SQWORD>( Size, MAXINT );
 	}
 	UBOOL Close()
 	{
 		guardSlow(FArchiveFileReader::Close);
 		if( File != -1 )
 		{
-			munmap( Map, Size );
+			if( Map )
+				munmap( Map, Size );
 			close( File );
 		}
 		File = -1;
+		Map  = NULL;
 		return !ArIsError;
 		unguardSlow;
 	}
 	void Serialize( void* V, INT Length )
 	{
 		guardSlow(FArchiveFileReader::Serialize);
-		if( Length > Size-Pos )
+		const BYTE* Data = GetData( Length );
+		if( Data )
+			appMemcpy( V, Data, Length );
+		unguardSlow;
+	}
+
+	// 64-bit offsets.
+	void Seek64( SQWORD InPos )
+	{
+		guard(FArchiveFileReader::Seek64);
+		check(InPos>=0);
+		check(InPos<=Size);
+		Pos = InPos;
+		unguard;
+	}
+	SQWORD Tell64()
+	{
+		return Pos;
+	}
+	SQWORD TotalSize64()
+	{
+		return Size;
+	}
+
+	// Zero-copy read. Returns a pointer to the next Length bytes of the
+	// mapping and advances past them, or NULL at end of file. The data
+	// stays valid until the archive is closed.
+	const BYTE* GetData( INT Length )
+	{
+		guardSlow(FArchiveFileReader::GetData);
+		if( Length<0 || Length > Size-Pos )
 		{
 			ArIsError = 1;
-			Error->Logf( TEXT("ReadFile beyond EOF %i+%i/%i"), Pos, Length, Size );
-			return;
+			Error->Logf( TEXT("ReadFile beyond EOF %i+%i/%i"), (INT)Pos, Length, (INT)Size );
+			return NULL;
 		}
-		appMemcpy( V, Map+Pos, Length );
+		const BYTE* Result = Map+Pos;
 		Pos += Length;
+		return Result;
 		unguardSlow;
 	}
+
+	// Hint that the rest of the file will be read front to back.
+	void AdviseSequential()
+	{
+		Advise( Pos, Size-Pos, MADV_SEQUENTIAL );
+	}
 protected:
 	INT				File;
 	FOutputDevice*	Error;
-	INT				Size;
-	INT				Pos;
+	SQWORD			Size;
+	SQWORD			Pos;
 	BYTE*			Map;
+
+	// Apply an madvise hint to a range, rounded out to whole pages. Hints
+	// are best effort, so failure is not an archive error.
+	void Advise( SQWORD Start, SQWORD Length, INT Advice )
+	{
+		if( !Map || Length<=0 )
+			return;
+		static SQWORD PageSize = sysconf( _SC_PAGESIZE );
+		SQWORD Offset = Start - Start%PageSize;
+		madvise( Map+Offset, Length+Start-Offset, Advice );
+	}
 };
+//
+// File writer which collects data in large buffers and writes them with
+// pwrite at explicit offsets. Writes larger than the buffer go straight
+// out together with the buffered data in one pwritev. With
+// FILEWRITE_Async, full buffers are handed to a background thread so
+// that saving overlaps with the caller; Flush and Close still wait for
+// the data to reach the file. Precache on a writer preallocates space
+// for that many more bytes.
+//
 class FArchiveFileWriter : public FArchive
 {
 public:
-	FArchiveFileWriter( FILE* InFile, FOutputDevice* InError )
-	:	File		(InFile)
+	enum {BUFFER_SIZE=0x10000, ASYNC_BUFFER_SIZE=0x40000};
+	enum {ASYNC_BUFFER_COUNT=4};
+	FArchiveFileWriter( INT InFile, FOutputDevice* InError, SQWORD InPos, UBOOL InAsync )
+	:	File		( InFile )
 	,	Error		( InError )
-	,	Pos			(0)
-	,	BufferCount	(0)
+	,	Pos			( InPos )
+	,	BufferPos	( InPos )
+	,	End			( InPos )
+	,	Allocated	( 0 )
+	,	BufferCount	( 0 )
+	,	Async		( InAsync )
+	,	Fill		( 0 )
+	,	Write		( 0 )
+	,	NumQueued	( 0 )
+	,	Exiting		( 0 )
+	,	Failed		( 0 )
 	{
+		guard(FArchiveFileWriter::FArchiveFileWriter);
 		ArIsSaving = ArIsPersistent = 1;
+		BufferSize = Async ? ASYNC_BUFFER_SIZE : BUFFER_SIZE;
+		for( INT i=0; i<(Async ? ASYNC_BUFFER_COUNT : 1); i++ )
+			Blocks[i].Data = (BYTE*)appMalloc( BufferSize, TEXT("FileWriterBuffer") );
+		Buffer = Blocks[0].Data;
+		if( Async && !Thread.Start( WriterMain, this ) )
+		{
+			// Fall back to writing on the calling thread.
+			for( INT i=1; i<ASYNC_BUFFER_COUNT; i++ )
+				appFree( Blocks[i].Data );
+			Async = 0;
+		}
+		unguard;
 	}
 	~FArchiveFileWriter()
 	{
 		guard(FArchiveFileWriter::~FArchiveFileWriter);
-		if( File )
+		if( File != -1 )
 			Close();
-		File = NULL;
+		File = -1;
 		unguard;
 	}
 	void Seek( INT InPos )
 	{
-		Flush();
-		if( fseek(File,InPos,SEEK_SET) )
-		{
-			ArIsError = 1;
-			Error->Logf( LocalizeError("SeekFailed",TEXT("Core")) );
-		}
-		Pos = InPos;
+		Seek64( InPos );
 	}
 	INT Tell()
 	{
-		return Pos;
+		return Min<SQWORD>( Pos, MAXINT );
+	}
+	void Precache( INT HintCount )
+	{
+		Preallocate( Pos + HintCount );
 	}
 	UBOOL Close()
 	{
 		guardSlow(FArchiveFileWriter::Close);
-		Flush();
-		if( File && fclose( File ) )
+		if( File != -1 )
 		{
-			ArIsError = 1;
-			Error->Logf( LocalizeError("WriteFailed",TEXT("Core")) );
+			Flush();
+			if( Async )
+			{
+				Section.Lock();
+				Exiting = 1;
+				WorkReady.Signal();
+				Section.Unlock();
+				Thread.Join();
+			}
+			// Drop any preallocated space that was not written.
+			if( Allocated>End && ftruncate( File, End ) )
+				ArIsError = 1;
+			if( close( File ) )
+				ArIsError = 1;
+			if( ArIsError )
+				Error->Logf( LocalizeError("WriteFailed",TEXT("Core")) );
+			for( INT i=0; i<(Async ? ASYNC_BUFFER_COUNT : 1); i++ )
+				appFree( Blocks[i].Data );
 		}
-		File = NULL;
+		File = -1;
 		return !ArIsError;
 		unguardSlow;
 	}
 	void Serialize( void* V, INT Length )
 	{
+		if( !Async && Length>=BufferSize )
+		{
+			// Large write, send it out with the pending data.
+			if( !WriteAt( File, Buffer, BufferCount, (BYTE*)V, Length, BufferPos ) )
+				SetError();
+			End         = Max( End, Pos+Length );
+			Pos        += Length;
+			BufferPos   = Pos;
+			BufferCount = 0;
+			return;
+		}
 		Pos += Length;
 		INT Copy;
-		while( Length > (Copy=ARRAY_COUNT(Buffer)-BufferCount) )
+		while( Length > (Copy=BufferSize-BufferCount) )
 		{
 			appMemcpy( Buffer+BufferCount, V, Copy );
 			BufferCount += Copy;
 			Length      -= Copy;
 			V            = (BYTE*)V + Copy;
-			Flush();
+			Submit();
 		}
 		if( Length )
 		{
@@ -173,19 +273,156 @@ public:
 	}
 	void Flush()
 	{
-		if( BufferCount && fwrite( Buffer, BufferCount, 1, File )!=1 )
+		Submit();
+		if( Async )
 		{
-			ArIsError = 1;
-			Error->Logf( LocalizeError("WriteFailed",TEXT("Core")) );
+			FScopeLock Lock( Section );
+			while( NumQueued )
+				WorkDone.Wait( Section );
+			if( Failed )
+				SetError();
 		}
-		BufferCount=0;
+	}
+
+	// 64-bit offsets.
+	void Seek64( SQWORD InPos )
+	{
+		Submit();
+		Pos = BufferPos = InPos;
+	}
+	SQWORD Tell64()
+	{
+		return Pos;
+	}
+
+	// Reserve disk space up to Size bytes, so that large files are laid
+	// out contiguously and out of space errors happen up front. Space that
+	// is not written is released on Close.
+	UBOOL Preallocate( SQWORD Size )
+	{
+		guard(FArchiveFileWriter::Preallocate);
+#if defined(__LINUX__)
+		if( File!=-1 && Size>Allocated && Size>End && posix_fallocate( File, 0, Size )==0 )
+		{
+			Allocated = Size;
+			return 1;
+		}
+#endif
+		return 0;
+		unguard;
 	}
 protected:
-	FILE*			File;
-	FOutputDevice*	Error;
-	INT				Pos;
-	INT				BufferCount;
-	BYTE			Buffer[4096];
+	struct FBlock
+	{
+		BYTE*	Data;
+		INT		Count;
+		SQWORD	Offset;
+	};
+	INT					File;
+	FOutputDevice*		Error;
+	SQWORD				Pos, BufferPos, End, Allocated;
+	INT					BufferSize, BufferCount;
+	BYTE*				Buffer;
+	FBlock				Blocks[ASYNC_BUFFER_COUNT];
+
+	// Async state. Blocks[Write..Fill) are queued for the writer thread,
+	// and Blocks[Fill] is being filled by the caller.
+	UBOOL				Async;
+	INT					Fill, Write, NumQueued;
+	UBOOL				Exiting, Failed;
+	FThread				Thread;
+	FCriticalSection	Section;
+	FCondition			WorkReady, WorkDone;
+
+	void SetError()
+	{
+		if( !ArIsError )
+			Error->Logf( LocalizeError("WriteFailed",TEXT("Core")) );
+		ArIsError = 1;
+	}
+
+	// Write out or queue the buffered data.
+	void Submit()
+	{
+		if( !BufferCount )
+			return;
+		End = Max( End, BufferPos+BufferCount );
+		if( !Async )
+		{
+			if( !WriteAt( File, Buffer, BufferCount, NULL, 0, BufferPos ) )
+				SetError();
+		}
+		else
+		{
+			FScopeLock Lock( Section );
+			Blocks[Fill].Count  = BufferCount;
+			Blocks[Fill].Offset = BufferPos;
+			Fill = (Fill+1) % ASYNC_BUFFER_COUNT;
+			NumQueued++;
+			WorkReady.Signal();
+			while( NumQueued==ASYNC_BUFFER_COUNT )
+				WorkDone.Wait( Section );
+			if( Failed )
+				SetError();
+			Buffer = Blocks[Fill].Data;
+		}
+		BufferPos  += BufferCount;
+		BufferCount = 0;
+	}
+
+	// Write two ranges back to back at Offset, retrying short writes.
+	static UBOOL WriteAt( INT File, const BYTE* A, INT ACount, const BYTE* B, INT BCount, SQWORD Offset )
+	{
+		while( ACount+BCount>0 )
+		{
+			ssize_t Result;
+#if defined(__LINUX__)
+			iovec Vec[2];
+			Vec[0].iov_base = (void*)A;
+			Vec[0].iov_len  = ACount;
+			Vec[1].iov_base = (void*)B;
+			Vec[1].iov_len  = BCount;
+			Result = pwritev( File, Vec+(ACount ? 0 : 1), ACount ? 2 : 1, Offset );
+#else
+			Result = ACount ? pwrite( File, A, ACount, Offset ) : pwrite( File, B, BCount, Offset );
+#endif
+			if( Result<0 && errno==EINTR )
+				continue;
+			if( Result<=0 )
+				return 0;
+			Offset += Result;
+			INT FromA = Min<INT>( Result, ACount );
+			A      += FromA;
+			ACount -= FromA;
+			B      += Result-FromA;
+			BCount -= Result-FromA;
+		}
+		return 1;
+	}
+
+	// Background writer. Runs no engine code besides the primitives, so
+	// it needs no guard blocks and never allocates.
+	static void WriterMain( void* Arg )
+	{
+		FArchiveFileWriter* Ar = (FArchiveFileWriter*)Arg;
+		Ar->Section.Lock();
+		for( ;; )
+		{
+			while( !Ar->NumQueued && !Ar->Exiting )
+				Ar->WorkReady.Wait( Ar->Section );
+			if( !Ar->NumQueued )
+				break;
+			FBlock& Block = Ar->Blocks[Ar->Write];
+			Ar->Section.Unlock();
+			UBOOL Ok = WriteAt( Ar->File, Block.Data, Block.Count, NULL, 0, Block.Offset );
+			Ar->Section.Lock();
+			Ar->Failed |= !Ok;
+			Ar->Write = (Ar->Write+1) % ASYNC_BUFFER_COUNT;
+			Ar->NumQueued--;
+			Ar->WorkDone.Broadcast();
+		}
+		Ar->Section.Unlock();
+	}
 };
 
 class FFileManagerMmap : public FFileManagerGeneric
@@ -231,10 +468,13 @@ public:
 			}
 		}
 
-		INT Size = lseek( File, 0, SEEK_END );
-		lseek( File, 0, SEEK_SET );
-
-		BYTE* Map = (BYTE*)mmap( NULL, Size, PROT_READ, MAP_PRIVATE, File, 0 );
+		// Empty files cannot be mapped, and are read through a NULL map.
+		struct stat Stat;
+		BYTE* Map = NULL;
+		if( fstat( File, &Stat ) || (SQWORD)(size_t)Stat.st_size!=Stat.st_size )
+			Map = (BYTE*)MAP_FAILED;
+		else if( Stat.st_size>0 )
+			Map = (BYTE*)mmap( NULL, Stat.st_size, PROT_READ, MAP_PRIVATE, File, 0 );
 		if( Map == MAP_FAILED )
 		{
 			close( File );
@@ -243,7 +483,10 @@ public:
 			return NULL;
 		}
 
-		return new(TEXT("MmapFileReader"))FArchiveFileReader(File,Map,Error,Size);
+		FArchiveFileReader* Reader = new(TEXT("MmapFileReader"))FArchiveFileReader(File,Map,Error,Stat.st_size);
+		if( Flags & FILEREAD_Sequential )
+			Reader->AdviseSequential();
+		return Reader;
 
 		unguard;
 	}
@@ -259,8 +502,8 @@ public:
 		if( (Flags & FILEWRITE_NoReplaceExisting) && FileSize(Filename)>=0 )
 			return NULL;
 
-		const ANSICHAR* Mode = (Flags & FILEWRITE_Append) ? "ab" : "wb"; 
-		FILE* File = NULL;
+		INT Mode = O_WRONLY | O_CREAT | ((Flags & FILEWRITE_Append) ? O_APPEND : O_TRUNC);
+		INT File = -1;
 		if( RewriteToConfigPath( Filename, FixedFilename ) )
 		{
 			// If appending, copy the file from the application directory
@@ -274,25 +517,68 @@ public:
 					return NULL;
 				}
 			}
-			File = fopen(TCHAR_TO_ANSI(Filename),Mode);
+			File = open(TCHAR_TO_ANSI(Filename),Mode,0666);
 		}
 		else
 		{
-			File = fopen(TCHAR_TO_ANSI(FixedFilename),Mode);
+			File = open(TCHAR_TO_ANSI(FixedFilename),Mode,0666);
 		}
-		if( !File )
+		if( File == -1 )
 		{
 			if( Flags & FILEWRITE_NoFail )
 				appErrorf( TEXT("Failed to write: %s"), Filename );
 			return NULL;
 		}
-		if( Flags & FILEWRITE_Unbuffered )
-			setvbuf( File, 0, _IONBF, 0 );
 
-		return new(TEXT("MmapFileWriter"))FArchiveFileWriter(File,Error);
+		// Appended writes land at the end regardless of offset.
+		SQWORD Pos = (Flags & FILEWRITE_Append) ? lseek( File, 0, SEEK_END ) : 0;
+		return new(TEXT("MmapFileWriter"))FArchiveFileWriter(File,Error,Pos,(Flags & FILEWRITE_Async)!=0);
 
 		unguard;
 	}
+	UBOOL Copy( const TCHAR* DestFile, const TCHAR* SrcFile, UBOOL ReplaceExisting, UBOOL EvenIfReadOnly, UBOOL Attributes, void (*Progress)(FLOAT Fraction) )
+	{
+		// Writes straight from the source mapping, in large chunks which
+		// bypass the writer's buffer.
+		guard(FFileManagerMmap::Copy);
+		enum {COPY_CHUNK=0x100000};
+		UBOOL Success = 0;
+		if( Progress )
+			Progress( 0.0f );
+		FArchiveFileReader* Src = (FArchiveFileReader*)CreateFileReader( SrcFile, FILEREAD_Sequential, GNull );
+		if( Src )
+		{
+			SQWORD Size = Src->TotalSize64();
+			FArchive* Dest = CreateFileWriter( DestFile, (ReplaceExisting?0:FILEWRITE_NoReplaceExisting) | (EvenIfReadOnly?FILEWRITE_EvenIfReadOnly:0), GNull );
+			if( Dest )
+			{
+				if( Size<=MAXINT )
+					Dest->Precache( Size );
+				for( SQWORD Total=0; Total<Size; Total+=COPY_CHUNK )
+				{
+					INT Count = Min<SQWORD>( Size-Total, COPY_CHUNK );
+					const BYTE* Data = Src->GetData( Count );
+					if( !Data )
+						break;
+					Dest->Serialize( (void*)Data, Count );
+					if( Dest->IsError() )
+						break;
+					if( Progress )
+						Progress( (FLOAT)Total / Size );
+				}
+				Success = Dest->Close();
+				delete Dest;
+				if( !Success )
+					Delete( DestFile );
+			}
+			Success = Success && Src->Close();
+			delete Src;
+		}
+		if( Progress )
+			Progress( 1.0 );
+		return Success;
+		unguard;
+	}
 	UBOOL Delete( const TCHAR* OrigFilename, UBOOL RequireExists=0, UBOOL EvenReadOnly=0 )
 	{
 		guard(FFileManagerMmap::Delete);
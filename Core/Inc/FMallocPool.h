@@ -0,0 +1,614 @@
+/*=============================================================================
+	FMallocPool.h: Pooled memory allocator for Unix platforms.
+=============================================================================*/
+
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+	#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+//
+// Size class allocator along the lines of FMallocWindows. Small requests
+// are served from POOL_SIZE chunks of equally sized blocks, mapped at
+// POOL_SIZE alignment so that the pool header of any block is found by
+// masking its address. Larger requests get their own mapping, with the
+// same header in front; a few freed ones are kept for reuse, and on Linux
+// they grow by remapping instead of copying. Blocks are 16 byte aligned.
+//
+// Each thread keeps a short free list per size class, so allocating and
+// freeing small blocks usually takes no lock. Blocks move between these
+// caches and the pools in batches. Their stats are likewise kept per
+// thread and added to the totals every STAT_BATCH calls.
+//
+class FMallocPool : public FMalloc
+{
+private:
+	// Counts.
+	enum {POOL_SIZE   = 0x40000};
+	enum {POOL_MAX    = 32768+1};
+	enum {CLASS_COUNT = 40     };
+	enum {HEADER_SIZE = 64     };
+	enum {CACHE_BYTES = 0x10000};
+	enum {STAT_BATCH  = 64     };
+	enum {OS_CACHE_COUNT = 8       };
+	enum {OS_CACHE_MAX   = 0x200000};
+
+	// Forward declares.
+	struct FFreeMem;
+	struct FPoolTable;
+
+	// Header at the start of every mapping.
+	struct FPoolInfoBase
+	{
+		SIZE_T		Bytes;		// Bytes requested, for OS allocations.
+		SIZE_T		OsBytes;	// Bytes mapped.
+		DWORD		Taken;		// Number of blocks handed out; the pool is unmapped when this counts down to zero.
+		FPoolTable*	Table;		// Size class, or NULL for OS allocations.
+		FFreeMem*	FirstMem;	// Blocks which have been freed.
+		BYTE*		Unused;		// Start of the blocks never handed out.
+	};
+	typedef TDoubleLinkedList<FPoolInfoBase> FPoolInfo;
+
+	// Information about a free block.
+	struct FFreeMem
+	{
+		FFreeMem*	Next;
+		FPoolInfo* GetPool()
+		{
+			return (FPoolInfo*)((SIZE_T)this & ~(SIZE_T)(POOL_SIZE-1));
+		}
+	};
+
+	// Pool table.
+	struct FPoolTable
+	{
+		FPoolInfo*	FirstPool;
+		FPoolInfo*	ExaustedPool;
+		DWORD		BlockSize;
+		INT			CacheMax;	// Blocks kept per thread.
+	};
+
+	// Per-thread free lists, and stats not yet added to the totals.
+	struct FThreadCache
+	{
+		FMallocPool*	Owner;
+		FFreeMem*		FirstMem[CLASS_COUNT];
+		INT				Count[CLASS_COUNT];
+		SIZE_T			Allocs,Frees,AllocBytes,FreeBytes;
+	};
+
+	// Variables.
+	FPoolTable		PoolTable[CLASS_COUNT];
+	FPoolInfo*		OsCache[OS_CACHE_COUNT];
+	BYTE			MemSizeToClass[(POOL_MAX+15)/16+1];
+	INT				MemInit;
+	pthread_key_t	CacheKey;
+	pthread_mutex_t	Mutex;
+	// Signed, as flushed thread caches can briefly take the totals below zero.
+	ssize_t			OsCurrent,OsPeak,UsedCurrent,UsedPeak,CurrentAllocs,TotalAllocs;
+
+	// Implementation.
+	void OutOfMemory()
+	{
+		guardSlow(OutOfMemory);
+		appErrorf( LocalizeError("OutOfMemory",TEXT("Core")) );
+		unguardSlow;
+	}
+	static void AddStat( ssize_t& Current, ssize_t& Peak, ssize_t Delta )
+	{
+		ssize_t New = __sync_add_and_fetch( &Current, Delta );
+		if( New>Peak )
+			Peak = New;
+	}
+	static void SubStat( ssize_t& Current, ssize_t Delta )
+	{
+		__sync_sub_and_fetch( &Current, Delta );
+	}
+	void FlushStats( FThreadCache* Cache )
+	{
+		// A thread may free more than it allocated since its last flush.
+		AddStat( UsedCurrent, UsedPeak, (ssize_t)Cache->AllocBytes-(ssize_t)Cache->FreeBytes );
+		__sync_add_and_fetch( &CurrentAllocs, (ssize_t)Cache->Allocs-(ssize_t)Cache->Frees );
+		__sync_add_and_fetch( &TotalAllocs, Cache->Allocs );
+		Cache->Allocs = Cache->Frees = Cache->AllocBytes = Cache->FreeBytes = 0;
+	}
+
+	// Map Bytes of memory aligned to POOL_SIZE.
+	void* MapAligned( SIZE_T Bytes )
+	{
+		guardSlow(FMallocPool::MapAligned);
+		BYTE* Mem = (BYTE*)mmap( NULL, Bytes+POOL_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+		if( Mem==(BYTE*)MAP_FAILED )
+			OutOfMemory();
+		BYTE* Result = (BYTE*)Align( (SIZE_T)Mem, (SIZE_T)POOL_SIZE );
+		if( Result>Mem )
+			munmap( Mem, Result-Mem );
+		if( Result+Bytes<Mem+Bytes+POOL_SIZE )
+			munmap( Result+Bytes, Mem+POOL_SIZE-Result );
+		STAT(AddStat( OsCurrent, OsPeak, Bytes ));
+		return Result;
+		unguardSlow;
+	}
+	void Unmap( FPoolInfo* Pool )
+	{
+		STAT(SubStat( OsCurrent, Pool->OsBytes ));
+		verify(munmap( Pool, Pool->OsBytes )==0);
+	}
+#if __LINUX__
+	// Grow an OS allocation by moving its pages rather than copying them,
+	// in place if the following pages are free or else to a fresh aligned
+	// range. Returns NULL if the kernel refuses.
+	FPoolInfo* Remap( FPoolInfo* Pool, SIZE_T Bytes )
+	{
+		guardSlow(FMallocPool::Remap);
+		SIZE_T OsBytes = Pool->OsBytes;
+		if( mremap( Pool, OsBytes, Bytes, 0 )==(void*)Pool )
+		{
+			STAT(AddStat( OsCurrent, OsPeak, Bytes-OsBytes ));
+		}
+		else
+		{
+			FPoolInfo* Dest = (FPoolInfo*)MapAligned( Bytes );
+			if( mremap( Pool, OsBytes, Bytes, MREMAP_MAYMOVE|MREMAP_FIXED, Dest )!=(void*)Dest )
+			{
+				Dest->OsBytes = Bytes;
+				Unmap( Dest );
+				return NULL;
+			}
+			STAT(SubStat( OsCurrent, OsBytes ));
+			Pool = Dest;
+		}
+		Pool->OsBytes = Bytes;
+		return Pool;
+		unguardSlow;
+	}
+#endif
+
+	// Take a block from the pools. Called with the mutex held.
+	FFreeMem* AllocBlock( FPoolTable* Table )
+	{
+		FPoolInfo* Pool = Table->FirstPool;
+		if( !Pool )
+		{
+			// Must create a new pool.
+			Pool = (FPoolInfo*)MapAligned( POOL_SIZE );
+			Pool->Link( Table->FirstPool );
+			Pool->Bytes		= POOL_SIZE;
+			Pool->OsBytes	= POOL_SIZE;
+			Pool->Taken		= 0;
+			Pool->Table		= Table;
+			Pool->FirstMem	= NULL;
+			Pool->Unused	= (BYTE*)Pool + HEADER_SIZE;
+		}
+
+		// Prefer freed blocks, so untouched pages stay untouched.
+		FFreeMem* Free;
+		Pool->Taken++;
+		if( Pool->FirstMem )
+		{
+			Free           = Pool->FirstMem;
+			Pool->FirstMem = Free->Next;
+		}
+		else
+		{
+			Free          = (FFreeMem*)Pool->Unused;
+			Pool->Unused += Table->BlockSize;
+		}
+		if( !Pool->FirstMem && Pool->Unused+Table->BlockSize>(BYTE*)Pool+POOL_SIZE )
+		{
+			// Move to exausted list.
+			Pool->Unlink();
+			Pool->Link( Table->ExaustedPool );
+		}
+		return Free;
+	}
+
+	// Return a block to its pool. Called with the mutex held.
+	void FreeBlock( FFreeMem* Free )
+	{
+		FPoolInfo*  Pool  = Free->GetPool();
+		FPoolTable* Table = Pool->Table;
+
+		// If this pool was exausted, move to available list.
+		if( !Pool->FirstMem && Pool->Unused+Table->BlockSize>(BYTE*)Pool+POOL_SIZE )
+		{
+			Pool->Unlink();
+			Pool->Link( Table->FirstPool );
+		}
+		Free->Next     = Pool->FirstMem;
+		Pool->FirstMem = Free;
+
+		// Free this pool, unless it is the last one of its size.
+		checkSlow(Pool->Taken>=1);
+		if( --Pool->Taken==0 && (Table->FirstPool!=Pool || Pool->Next) )
+		{
+			Pool->Unlink();
+			Unmap( Pool );
+		}
+	}
+
+	// Reuse a recently freed OS allocation of about the right size, which
+	// saves mapping and faulting in fresh pages.
+	FPoolInfo* TakeOsPool( SIZE_T Bytes )
+	{
+		FPoolInfo* Pool = NULL;
+		pthread_mutex_lock( &Mutex );
+		INT Best = INDEX_NONE;
+		for( INT i=0; i<OS_CACHE_COUNT; i++ )
+			if( OsCache[i] && OsCache[i]->OsBytes>=Bytes && OsCache[i]->OsBytes*2<=Bytes*3 )
+				if( Best==INDEX_NONE || OsCache[i]->OsBytes<OsCache[Best]->OsBytes )
+					Best = i;
+		if( Best!=INDEX_NONE )
+			Exchange( Pool, OsCache[Best] );
+		pthread_mutex_unlock( &Mutex );
+		return Pool;
+	}
+	void FreeOsPool( FPoolInfo* Pool )
+	{
+		if( Pool->OsBytes<=OS_CACHE_MAX )
+		{
+			// Keep it in place of an empty or smaller entry.
+			pthread_mutex_lock( &Mutex );
+			INT Smallest = 0;
+			for( INT i=1; i<OS_CACHE_COUNT && OsCache[Smallest]; i++ )
+				if( !OsCache[i] || OsCache[i]->OsBytes<OsCache[Smallest]->OsBytes )
+					Smallest = i;
+			if( !OsCache[Smallest] || OsCache[Smallest]->OsBytes<Pool->OsBytes )
+				Exchange( Pool, OsCache[Smallest] );
+			pthread_mutex_unlock( &Mutex );
+		}
+		if( Pool )
+			Unmap( Pool );
+	}
+
+	// Thread cache management.
+	FThreadCache* GetCache()
+	{
+		FThreadCache* Cache = (FThreadCache*)pthread_getspecific( CacheKey );
+		if( !Cache )
+		{
+			Cache = (FThreadCache*)mmap( NULL, sizeof(FThreadCache), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+			if( Cache==(FThreadCache*)MAP_FAILED )
+				OutOfMemory();
+			Cache->Owner = this;
+			for( INT i=0; i<CLASS_COUNT; i++ )
+			{
+				Cache->FirstMem[i] = NULL;
+				Cache->Count[i]    = 0;
+			}
+			Cache->Allocs = Cache->Frees = Cache->AllocBytes = Cache->FreeBytes = 0;
+			pthread_setspecific( CacheKey, Cache );
+		}
+		return Cache;
+	}
+	void Refill( FThreadCache* Cache, INT Class )
+	{
+		FPoolTable* Table = &PoolTable[Class];
+		pthread_mutex_lock( &Mutex );
+		for( INT i=Max(Table->CacheMax/2,1); i>0; i-- )
+		{
+			FFreeMem* Free = AllocBlock( Table );
+			Free->Next = Cache->FirstMem[Class];
+			Cache->FirstMem[Class] = Free;
+			Cache->Count[Class]++;
+		}
+		pthread_mutex_unlock( &Mutex );
+	}
+	void Drain( FThreadCache* Cache, INT Class, INT Keep )
+	{
+		pthread_mutex_lock( &Mutex );
+		while( Cache->Count[Class]>Keep )
+		{
+			FFreeMem* Free = Cache->FirstMem[Class];
+			Cache->FirstMem[Class] = Free->Next;
+			Cache->Count[Class]--;
+			FreeBlock( Free );
+		}
+		pthread_mutex_unlock( &Mutex );
+	}
+	static void DestroyCache( void* Arg )
+	{
+		FThreadCache* Cache = (FThreadCache*)Arg;
+		for( INT i=0; i<CLASS_COUNT; i++ )
+			Cache->Owner->Drain( Cache, i, 0 );
+		STAT(Cache->Owner->FlushStats( Cache ));
+		munmap( Cache, sizeof(FThreadCache) );
+	}
+
+public:
+	// FMalloc interface.
+	FMallocPool()
+	:	MemInit			( 0 )
+	,	OsCurrent		( 0 )
+	,	OsPeak			( 0 )
+	,	UsedCurrent		( 0 )
+	,	UsedPeak		( 0 )
+	,	CurrentAllocs	( 0 )
+	,	TotalAllocs		( 0 )
+	{}
+	void* Malloc( DWORD Size, const TCHAR* Tag )
+	{
+		guardSlow(FMallocPool::Malloc);
+		checkSlow(Size>0);
+		checkSlow(MemInit);
+		if( Size<POOL_MAX )
+		{
+			// Allocate from this thread's cache.
+			INT Class = MemSizeToClass[(Size+15)>>4];
+			FThreadCache* Cache = GetCache();
+			if( !Cache->FirstMem[Class] )
+				Refill( Cache, Class );
+			FFreeMem* Free = Cache->FirstMem[Class];
+			Cache->FirstMem[Class] = Free->Next;
+			Cache->Count[Class]--;
+#if STATS
+			// Counted per thread, to keep atomics off this path.
+			Cache->AllocBytes += PoolTable[Class].BlockSize;
+			if( ++Cache->Allocs+Cache->Frees>=STAT_BATCH )
+				FlushStats( Cache );
+#endif
+			return Free;
+		}
+		else
+		{
+			// Use OS for large allocations.
+			SIZE_T AlignedSize = Align( (SIZE_T)Size+HEADER_SIZE, (SIZE_T)GPageSize );
+			FPoolInfo* Pool = TakeOsPool( AlignedSize );
+			if( !Pool )
+			{
+				Pool = (FPoolInfo*)MapAligned( AlignedSize );
+				Pool->OsBytes = AlignedSize;
+			}
+			Pool->Bytes	= Size;
+			Pool->Table	= NULL;
+			STAT(AddStat( UsedCurrent, UsedPeak, Size ));
+			STAT(__sync_add_and_fetch( &CurrentAllocs, 1 ));
+			STAT(__sync_add_and_fetch( &TotalAllocs, 1 ));
+			return (BYTE*)Pool + HEADER_SIZE;
+		}
+		unguardSlow;
+	}
+	void* Realloc( void* Ptr, DWORD NewSize, const TCHAR* Tag )
+	{
+		guardSlow(FMallocPool::Realloc);
+		checkSlow(MemInit);
+		void* NewPtr = Ptr;
+		if( Ptr && NewSize )
+		{
+			FPoolInfo* Pool = ((FFreeMem*)Ptr)->GetPool();
+			if( Pool->Table )
+			{
+				// Allocated from pool, so grow or shrink if necessary.
+				if( NewSize>=POOL_MAX || &PoolTable[MemSizeToClass[(NewSize+15)>>4]]!=Pool->Table )
+				{
+					NewPtr = Malloc( NewSize, Tag );
+					appMemcpy( NewPtr, Ptr, Min(NewSize,Pool->Table->BlockSize) );
+					Free( Ptr );
+				}
+			}
+			else
+			{
+				// Allocated from OS.
+				SIZE_T AlignedSize = Align( (SIZE_T)NewSize+HEADER_SIZE, (SIZE_T)GPageSize );
+				FPoolInfo* NewPool;
+				if( NewSize+HEADER_SIZE<=Pool->OsBytes && NewSize*3>=Pool->OsBytes*2 )
+				{
+					// Keep as-is, reallocation isn't worth the overhead.
+					STAT(AddStat( UsedCurrent, UsedPeak, NewSize ));
+					STAT(SubStat( UsedCurrent, Pool->Bytes ));
+					Pool->Bytes = NewSize;
+				}
+#if __LINUX__
+				else if( NewSize>=POOL_MAX && AlignedSize>Pool->OsBytes && (NewPool=Remap( Pool, AlignedSize ))!=NULL )
+				{
+					// Grown without copying.
+					STAT(AddStat( UsedCurrent, UsedPeak, NewSize ));
+					STAT(SubStat( UsedCurrent, NewPool->Bytes ));
+					NewPool->Bytes = NewSize;
+					NewPtr         = (BYTE*)NewPool + HEADER_SIZE;
+				}
+#endif
+				else
+				{
+					// Grow or shrink.
+					NewPtr = Malloc( NewSize, Tag );
+					appMemcpy( NewPtr, Ptr, Min<SIZE_T>(NewSize,Pool->Bytes) );
+					Free( Ptr );
+				}
+			}
+		}
+		else if( NewSize )
+		{
+			NewPtr = Malloc( NewSize, Tag );
+		}
+		else
+		{
+			if( Ptr )
+				Free( Ptr );
+			NewPtr = NULL;
+		}
+		return NewPtr;
+		unguardfSlow(( TEXT("%p %i %s"), Ptr, NewSize, Tag ));
+	}
+	void Free( void* Ptr )
+	{
+		guardSlow(FMallocPool::Free);
+		if( !Ptr )
+			return;
+		checkSlow(MemInit);
+		FFreeMem*  Free = (FFreeMem*)Ptr;
+		FPoolInfo* Pool = Free->GetPool();
+		if( Pool->Table )
+		{
+			// Free into this thread's cache, handing half back when full.
+			// Draining may unmap the pool, so don't touch it afterwards.
+			FPoolTable* Table = Pool->Table;
+			INT Class = Table - PoolTable;
+			FThreadCache* Cache = GetCache();
+			Free->Next = Cache->FirstMem[Class];
+			Cache->FirstMem[Class] = Free;
+#if STATS
+			Cache->FreeBytes += Table->BlockSize;
+			if( Cache->Allocs+ ++Cache->Frees>=STAT_BATCH )
+				FlushStats( Cache );
+#endif
+			if( ++Cache->Count[Class]>Table->CacheMax )
+				Drain( Cache, Class, Table->CacheMax/2 );
+		}
+		else
+		{
+			// Free an OS allocation.
+			checkSlow(Ptr==(BYTE*)Pool+HEADER_SIZE);
+			STAT(SubStat( UsedCurrent, Pool->Bytes ));
+			STAT(__sync_sub_and_fetch( &CurrentAllocs, 1 ));
+			FreeOsPool( Pool );
+		}
+		unguardSlow;
+	}
+	void DumpAllocs()
+	{
+		guard(FMallocPool::DumpAllocs);
+		FMallocPool::HeapCheck();
+		FThreadCache* Cache = (FThreadCache*)pthread_getspecific( CacheKey );
+		if( Cache )
+			STAT(FlushStats( Cache ));
+
+		STAT(debugf( TEXT("Memory Allocation Status") ));
+		STAT(debugf( TEXT("Curr Memory % 5.3fM / % 5.3fM"), UsedCurrent/1024.0/1024.0, OsCurrent/1024.0/1024.0 ));
+		STAT(debugf( TEXT("Peak Memory % 5.3fM / % 5.3fM"), UsedPeak   /1024.0/1024.0, OsPeak   /1024.0/1024.0 ));
+		STAT(debugf( TEXT("Allocs      % 6i Current / % 6i Total"), (INT)CurrentAllocs, (INT)TotalAllocs ));
+
+#if STATS
+		if( ParseParam(appCmdLine(), TEXT("MEMSTAT")) )
+		{
+			debugf( TEXT("Block Size Num Pools Cur Allocs Mem Used Mem Waste Efficiency") );
+			debugf( TEXT("---------- --------- ---------- -------- --------- ----------") );
+			INT TotalPoolCount=0, TotalAllocCount=0, TotalMemUsed=0, TotalMemWaste=0;
+			pthread_mutex_lock( &Mutex );
+			for( INT i=0; i<CLASS_COUNT; i++ )
+			{
+				FPoolTable* Table = &PoolTable[i];
+				INT PoolCount=0, AllocCount=0, MemUsed=0;
+				for( INT j=0; j<2; j++ )
+				{
+					for( FPoolInfo* Pool=(j?Table->FirstPool:Table->ExaustedPool); Pool; Pool=Pool->Next )
+					{
+						PoolCount++;
+						AllocCount += Pool->Taken;
+						MemUsed    += Pool->Unused - (BYTE*)Pool;
+					}
+				}
+				INT MemWaste = MemUsed - AllocCount*Table->BlockSize;
+				debugf
+				(
+					TEXT("% 10i % 9i % 10i % 7iK % 8iK % 9.2f%%"),
+					Table->BlockSize,
+					PoolCount,
+					AllocCount,
+					MemUsed /1024,
+					MemWaste/1024,
+					MemUsed ? 100.0 * (MemUsed-MemWaste) / MemUsed : 100.0
+				);
+				TotalPoolCount  += PoolCount;
+				TotalAllocCount += AllocCount;
+				TotalMemUsed    += MemUsed;
+				TotalMemWaste   += MemWaste;
+			}
+			pthread_mutex_unlock( &Mutex );
+			debugf
+			(
+				TEXT("BlkOverall % 9i % 10i % 7iK % 8iK % 9.2f%%"),
+				TotalPoolCount,
+				TotalAllocCount,
+				TotalMemUsed /1024,
+				TotalMemWaste/1024,
+				TotalMemUsed ? 100.0 * (TotalMemUsed-TotalMemWaste) / TotalMemUsed : 100.0
+			);
+		}
+#endif
+		unguard;
+	}
+	void HeapCheck()
+	{
+		guard(FMallocPool::HeapCheck);
+		pthread_mutex_lock( &Mutex );
+		for( INT i=0; i<CLASS_COUNT; i++ )
+		{
+			FPoolTable* Table = &PoolTable[i];
+			for( INT j=0; j<2; j++ )
+			{
+				FPoolInfo** PoolPtr;
+				for( PoolPtr=(j?&Table->ExaustedPool:&Table->FirstPool); *PoolPtr; PoolPtr=&(*PoolPtr)->Next )
+				{
+					FPoolInfo* Pool=*PoolPtr;
+					check(Pool->PrevLink==PoolPtr);
+					check(Pool->Table==Table);
+					check(Pool->Unused<=(BYTE*)Pool+POOL_SIZE);
+					for( FFreeMem* Free=Pool->FirstMem; Free; Free=Free->Next )
+						check(Free->GetPool()==Pool && (BYTE*)Free<Pool->Unused);
+				}
+			}
+		}
+		pthread_mutex_unlock( &Mutex );
+		unguard;
+	}
+	void Init()
+	{
+		guard(FMallocPool::Init);
+		check(!MemInit);
+		check(sizeof(FPoolInfo)<=HEADER_SIZE);
+		MemInit = 1;
+
+		// Get OS page size.
+		GPageSize = sysconf( _SC_PAGESIZE );
+		check(!(GPageSize&(GPageSize-1)));
+		check(GPageSize<=POOL_SIZE);
+
+		// Init tables. Sizes step by 16 up to 128, then by quarter powers of two.
+		INT i;
+		for( i=0; i<CLASS_COUNT; i++ )
+		{
+			INT Group = (i-8)/4;
+			PoolTable[i].FirstPool    = NULL;
+			PoolTable[i].ExaustedPool = NULL;
+			PoolTable[i].BlockSize    = i<8 ? (i+1)*16 : (128<<Group) + ((i-8)%4+1)*(32<<Group);
+			PoolTable[i].CacheMax     = Max<INT>( CACHE_BYTES/PoolTable[i].BlockSize, 2 );
+		}
+		for( i=0; i<OS_CACHE_COUNT; i++ )
+			OsCache[i] = NULL;
+		for( i=0; i<(INT)ARRAY_COUNT(MemSizeToClass); i++ )
+		{
+			INT Index;
+			for( Index=0; Index<CLASS_COUNT-1 && PoolTable[Index].BlockSize<(DWORD)i*16; Index++ );
+			MemSizeToClass[i] = Index;
+		}
+		check(POOL_MAX-1==PoolTable[CLASS_COUNT-1].BlockSize);
+		pthread_mutex_init( &Mutex, NULL );
+		verify(pthread_key_create( &CacheKey, DestroyCache )==0);
+		unguard;
+	}
+	void Exit()
+	{
+		guard(FMallocPool::Exit);
+		// Hand back the calling thread's cache, so pools can be released.
+		FThreadCache* Cache = (FThreadCache*)pthread_getspecific( CacheKey );
+		if( Cache )
+		{
+			pthread_setspecific( CacheKey, NULL );
+			DestroyCache( Cache );
+		}
+		pthread_key_delete( CacheKey );
+		MemInit = 0;
+		for( INT i=0; i<OS_CACHE_COUNT; i++ )
+			if( OsCache[i] )
+				Unmap( OsCache[i] );
+		unguard;
+	}
+};
+
+/*-----------------------------------------------------------------------------
+	The End.
+-----------------------------------------------------------------------------*/
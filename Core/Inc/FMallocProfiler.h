@@ -0,0 +1,452 @@
+/*=============================================================================
+	FMallocProfiler.h: Allocator wrapper keeping statistics per tag.
+
+	On Windows, this expects <windows.h> to have been included already,
+	like FMallocWindows.h does.
+=============================================================================*/
+
+#include <stdio.h>
+#include "FThreadPool.h"
+
+/*-----------------------------------------------------------------------------
+	FMallocProfiler.
+-----------------------------------------------------------------------------*/
+
+//
+// Passes calls through to another allocator while counting live bytes,
+// peak bytes and calls per allocation tag and per power of two size
+// class. Each block carries a 16 byte header recording its size and tag,
+// so the profiler must be installed by the launcher before appInit, and
+// stays in place until exit.
+//
+// Enabled with -MALLOCPROFILE. MALLOCPROFILECSV=<file> additionally
+// appends a snapshot to a CSV file every MALLOCPROFILEINTERVAL=<secs>
+// (default 60) from a background thread, which shows slow growth over
+// long uptimes. The MEMPROFILE exec command prints the current figures.
+//
+class FMallocProfiler : public FMalloc, public FExec
+{
+public:
+	FMallocProfiler( FMalloc* InMalloc )
+	:	UsedMalloc	( InMalloc )
+	,	Enabled		( 0 )
+	,	NumTags		( 0 )
+	,	NumHashed	( 0 )
+	,	Interval	( 60.f )
+	,	Exiting		( 0 )
+	{
+		for( INT i=0; i<TAG_HASH_SIZE; i++ )
+			TagHash[i] = NULL;
+		CsvFilename[0] = 0;
+	}
+
+	// Check the command line for profiling options. Must be called before
+	// the profiler is installed. Returns whether to install it.
+	UBOOL Enable( const TCHAR* CmdLine )
+	{
+		TCHAR Filename[256];
+		if( Parse( CmdLine, TEXT("MALLOCPROFILECSV="), Filename, ARRAY_COUNT(Filename) ) )
+		{
+			INT i;
+			for( i=0; Filename[i] && i<ARRAY_COUNT(CsvFilename)-1; i++ )
+				CsvFilename[i] = (ANSICHAR)Filename[i];
+			CsvFilename[i] = 0;
+			Enabled = 1;
+		}
+		Parse( CmdLine, TEXT("MALLOCPROFILEINTERVAL="), Interval );
+		Interval = Max( Interval, 1.f );
+		Enabled |= ParseParam( CmdLine, TEXT("MALLOCPROFILE") );
+		return Enabled;
+	}
+	UBOOL IsEnabled()
+	{
+		return Enabled;
+	}
+
+	// Log the busiest tags and the size classes.
+	void Report( FOutputDevice& Ar, INT MaxTags=30 )
+	{
+		guard(FMallocProfiler::Report);
+		TArray<FStats> Stats(MAX_TAGS);
+		TArray<const TCHAR*> Names(MAX_TAGS);
+		FStats Total, Classes[SIZE_CLASS_COUNT];
+		INT Count = Snapshot( &Stats(0), &Names(0), Total, Classes );
+
+		// Sort by live bytes.
+		TArray<INT> Order(Count);
+		INT i;
+		for( i=0; i<Count; i++ )
+		{
+			INT j;
+			for( j=i; j>0 && Stats(Order(j-1)).LiveBytes<Stats(i).LiveBytes; j-- )
+				Order(j) = Order(j-1);
+			Order(j) = i;
+		}
+
+		Ar.Logf( TEXT("Memory by tag: %iK live, %iK peak, %i blocks"), (INT)(Total.LiveBytes/1024), (INT)(Total.PeakBytes/1024), Total.LiveAllocs );
+		Ar.Logf( TEXT("   Live K   Peak K   Blocks     Allocs   Reallocs      Frees Tag") );
+		for( i=0; i<Count && i<MaxTags; i++ )
+			LogStats( Ar, Stats(Order(i)), Names(Order(i)) );
+		Ar.Logf( TEXT("Memory by size:") );
+		for( i=0; i<SIZE_CLASS_COUNT; i++ )
+		{
+			if( Classes[i].Allocs || Classes[i].LiveAllocs )
+			{
+				TCHAR Name[16];
+				appSprintf( Name, TEXT("<= %u"), ClassSize(i) );
+				LogStats( Ar, Classes[i], Name );
+			}
+		}
+		unguard;
+	}
+
+	// Append a snapshot to the CSV file, or another file if given.
+	UBOOL WriteCsv( const ANSICHAR* Filename=NULL )
+	{
+		FScopeLock CsvLock( CsvSection );
+		if( !Filename )
+			Filename = CsvFilename;
+		FILE* File = *Filename ? fopen( Filename, "a" ) : NULL;
+		if( !File )
+			return 0;
+		INT Count = Snapshot( CsvStats, CsvNames, CsvTotal, CsvClasses );
+		fseek( File, 0, SEEK_END );
+		if( ftell(File)==0 )
+			fprintf( File, "Time,Kind,Name,LiveBytes,PeakBytes,LiveAllocs,Allocs,Reallocs,Frees\n" );
+		FLOAT Time = appSeconds() - StartTime;
+		WriteCsvRow( File, Time, "total", NULL, CsvTotal );
+		for( INT i=0; i<Count; i++ )
+			WriteCsvRow( File, Time, "tag", CsvNames[i], CsvStats[i] );
+		for( INT i=0; i<SIZE_CLASS_COUNT; i++ )
+		{
+			if( CsvClasses[i].Allocs || CsvClasses[i].LiveAllocs )
+			{
+				TCHAR Name[16];
+				appSprintf( Name, TEXT("%u"), ClassSize(i) );
+				WriteCsvRow( File, Time, "size", Name, CsvClasses[i] );
+			}
+		}
+		return fclose( File )==0;
+	}
+
+	// Restart peaks at the current figures and clear the call counts.
+	void Reset()
+	{
+		FScopeLock Lock( Section );
+		for( INT i=0; i<NumTags; i++ )
+			Tags[i].Reset();
+		for( INT i=0; i<SIZE_CLASS_COUNT; i++ )
+			Classes[i].Reset();
+		Total.Reset();
+	}
+
+	// FMalloc interface.
+	void* Malloc( DWORD Size, const TCHAR* Tag )
+	{
+		FHeader* Header = (FHeader*)UsedMalloc->Malloc( Size+sizeof(FHeader), Tag );
+		Header->Size  = Size;
+		Header->Magic = HEADER_MAGIC;
+		FScopeLock Lock( Section );
+		Header->Tag = FindTag( Tag );
+		AddBlock( Header, 0 );
+		return Header+1;
+	}
+	void* Realloc( void* Ptr, DWORD NewSize, const TCHAR* Tag )
+	{
+		if( !Ptr )
+			return NewSize ? Malloc( NewSize, Tag ) : NULL;
+		if( !NewSize )
+		{
+			Free( Ptr );
+			return NULL;
+		}
+		FHeader* Header = (FHeader*)Ptr - 1;
+		check(Header->Magic==HEADER_MAGIC);
+		{
+			FScopeLock Lock( Section );
+			RemoveBlock( Header, 0 );
+		}
+		Header = (FHeader*)UsedMalloc->Realloc( Header, NewSize+sizeof(FHeader), Tag );
+		Header->Size = NewSize;
+		FScopeLock Lock( Section );
+		Header->Tag = FindTag( Tag );
+		AddBlock( Header, 1 );
+		return Header+1;
+	}
+	void Free( void* Ptr )
+	{
+		if( !Ptr )
+			return;
+		FHeader* Header = (FHeader*)Ptr - 1;
+		check(Header->Magic==HEADER_MAGIC);
+		{
+			FScopeLock Lock( Section );
+			RemoveBlock( Header, 1 );
+		}
+		Header->Magic = 0;
+		UsedMalloc->Free( Header );
+	}
+	void DumpAllocs()
+	{
+		UsedMalloc->DumpAllocs();
+		Report( *GLog );
+	}
+	void HeapCheck()
+	{
+		UsedMalloc->HeapCheck();
+	}
+	void Init()
+	{
+		UsedMalloc->Init();
+		StartTime = appSeconds();
+		if( *CsvFilename )
+			Thread.Start( CsvMain, this );
+	}
+	void Exit()
+	{
+		Exiting = 1;
+		Thread.Join();
+		if( *CsvFilename )
+			WriteCsv();
+		UsedMalloc->Exit();
+	}
+
+	// FExec interface.
+	UBOOL Exec( const TCHAR* Cmd, FOutputDevice& Ar )
+	{
+		guard(FMallocProfiler::Exec);
+		if( !ParseCommand( &Cmd, TEXT("MEMPROFILE") ) )
+			return 0;
+		FString Filename;
+		if( ParseCommand( &Cmd, TEXT("RESET") ) )
+		{
+			Reset();
+			Ar.Logf( TEXT("Memory profile peaks and counts reset") );
+		}
+		else if( ParseCommand( &Cmd, TEXT("CSV") ) )
+		{
+			UBOOL Written = ParseToken( Cmd, Filename, 0 ) ? WriteCsv( TCHAR_TO_ANSI(*Filename) ) : WriteCsv();
+			Ar.Logf( Written ? TEXT("Memory profile written") : TEXT("Failed to write memory profile") );
+		}
+		else
+		{
+			Report( Ar, ParseCommand( &Cmd, TEXT("ALL") ) ? MAX_TAGS : 30 );
+		}
+		return 1;
+		unguard;
+	}
+
+private:
+	enum {MAX_TAGS=1024};
+	enum {TAG_HASH_SIZE=4096};
+	enum {SIZE_CLASS_COUNT=28};
+	enum {HEADER_MAGIC=0x50524f46};
+
+	// Header in front of every block, keeping blocks 16 byte aligned.
+	struct FHeader
+	{
+		DWORD	Size;
+		INT		Tag;
+		DWORD	Magic;
+		DWORD	Pad;
+	};
+
+	// Figures for a tag or size class.
+	struct FStats
+	{
+		SQWORD	LiveBytes, PeakBytes;
+		INT		LiveAllocs;
+		QWORD	Allocs, Reallocs, Frees;
+		FStats()
+		:	LiveBytes( 0 ), PeakBytes( 0 ), LiveAllocs( 0 ), Allocs( 0 ), Reallocs( 0 ), Frees( 0 )
+		{}
+		void Add( DWORD Size, UBOOL IsRealloc )
+		{
+			LiveBytes += Size;
+			PeakBytes  = Max( PeakBytes, LiveBytes );
+			LiveAllocs++;
+			if( IsRealloc )
+				Reallocs++;
+			else
+				Allocs++;
+		}
+		void Remove( DWORD Size, UBOOL IsFree )
+		{
+			LiveBytes -= Size;
+			LiveAllocs--;
+			if( IsFree )
+				Frees++;
+		}
+		void Reset()
+		{
+			PeakBytes = LiveBytes;
+			Allocs = Reallocs = Frees = 0;
+		}
+	};
+
+	FMalloc*			UsedMalloc;
+	UBOOL				Enabled;
+	FCriticalSection	Section;
+	INT					NumTags;
+	INT					NumHashed;
+	const TCHAR*		TagNames[MAX_TAGS];
+	FStats				Tags[MAX_TAGS];
+	FStats				Classes[SIZE_CLASS_COUNT];
+	FStats				Total;
+	const TCHAR*		TagHash[TAG_HASH_SIZE];
+	INT					TagIndices[TAG_HASH_SIZE];
+
+	// CSV output. The snapshot buffers are only used with CsvSection held.
+	ANSICHAR			CsvFilename[256];
+	FLOAT				Interval;
+	FTime				StartTime;
+	FThread				Thread;
+	volatile UBOOL		Exiting;
+	FCriticalSection	CsvSection;
+	FStats				CsvStats[MAX_TAGS];
+	const TCHAR*		CsvNames[MAX_TAGS];
+	FStats				CsvTotal;
+	FStats				CsvClasses[SIZE_CLASS_COUNT];
+
+	static DWORD ClassSize( INT Class )
+	{
+		return 16u << Class;
+	}
+	static INT SizeToClass( DWORD Size )
+	{
+		return Min<INT>( Max<INT>( appCeilLogTwo(Size), 4 ) - 4, SIZE_CLASS_COUNT-1 );
+	}
+
+	// Account for a block. Called with the section held.
+	void AddBlock( FHeader* Header, UBOOL IsRealloc )
+	{
+		Tags[Header->Tag].Add( Header->Size, IsRealloc );
+		Classes[SizeToClass(Header->Size)].Add( Header->Size, IsRealloc );
+		Total.Add( Header->Size, IsRealloc );
+	}
+	void RemoveBlock( FHeader* Header, UBOOL IsFree )
+	{
+		Tags[Header->Tag].Remove( Header->Size, IsFree );
+		Classes[SizeToClass(Header->Size)].Remove( Header->Size, IsFree );
+		Total.Remove( Header->Size, IsFree );
+	}
+
+	// Map a tag to its index. Tags are nearly always literals, so they are
+	// keyed by pointer, but equal strings from different modules share an
+	// index. Called with the section held.
+	INT FindTag( const TCHAR* Tag )
+	{
+		if( !Tag )
+			Tag = TEXT("None");
+		INT Slot = (INT)(((SIZE_T)Tag >> 3) % TAG_HASH_SIZE);
+		for( INT i=0; i<TAG_HASH_SIZE; i++, Slot=(Slot+1)%TAG_HASH_SIZE )
+		{
+			if( TagHash[Slot]==Tag )
+				return TagIndices[Slot];
+			if( !TagHash[Slot] )
+				break;
+		}
+		INT Index;
+		for( Index=0; Index<NumTags && !SameTag(TagNames[Index],Tag); Index++ );
+		if( Index==NumTags )
+		{
+			// Lump the rest together once the table is full.
+			if( NumTags==MAX_TAGS-1 )
+				TagNames[NumTags++] = TEXT("Other");
+			if( NumTags==MAX_TAGS )
+				return MAX_TAGS-1;
+			TagNames[NumTags++] = Tag;
+		}
+		if( !TagHash[Slot] && NumHashed<TAG_HASH_SIZE/2 )
+		{
+			TagHash[Slot]    = Tag;
+			TagIndices[Slot] = Index;
+			NumHashed++;
+		}
+		return Index;
+	}
+	static UBOOL SameTag( const TCHAR* A, const TCHAR* B )
+	{
+		while( *A && *A==*B )
+			A++, B++;
+		return *A==*B;
+	}
+
+	// Copy the figures of all tags which have been used. Takes the section
+	// only briefly, and doesn't allocate.
+	INT Snapshot( FStats* OutTags, const TCHAR** OutNames, FStats& OutTotal, FStats* OutClasses )
+	{
+		FScopeLock Lock( Section );
+		INT Count=0;
+		for( INT i=0; i<NumTags; i++ )
+		{
+			if( Tags[i].Allocs || Tags[i].LiveAllocs )
+			{
+				OutTags [Count] = Tags[i];
+				OutNames[Count] = TagNames[i];
+				Count++;
+			}
+		}
+		for( INT i=0; i<SIZE_CLASS_COUNT; i++ )
+			OutClasses[i] = Classes[i];
+		OutTotal = Total;
+		return Count;
+	}
+
+	static void LogStats( FOutputDevice& Ar, const FStats& Stats, const TCHAR* Name )
+	{
+		Ar.Logf
+		(
+			TEXT("% 9i% 9i% 9i% 11.0f% 11.0f% 11.0f %s"),
+			(INT)(Stats.LiveBytes/1024),
+			(INT)(Stats.PeakBytes/1024),
+			Stats.LiveAllocs,
+			(DOUBLE)Stats.Allocs,
+			(DOUBLE)Stats.Reallocs,
+			(DOUBLE)Stats.Frees,
+			Name
+		);
+	}
+	static void WriteCsvRow( FILE* File, FLOAT Time, const ANSICHAR* Kind, const TCHAR* Name, const FStats& Stats )
+	{
+		fprintf( File, "%.1f,%s,\"", Time, Kind );
+		for( ; Name && *Name; Name++ )
+		{
+			if( *Name=='"' )
+				fputc( '"', File );
+			fputc( (ANSICHAR)*Name, File );
+		}
+		fprintf
+		(
+			File,
+			"\",%.0f,%.0f,%i,%.0f,%.0f,%.0f\n",
+			(DOUBLE)Stats.LiveBytes,
+			(DOUBLE)Stats.PeakBytes,
+			Stats.LiveAllocs,
+			(DOUBLE)Stats.Allocs,
+			(DOUBLE)Stats.Reallocs,
+			(DOUBLE)Stats.Frees
+		);
+	}
+
+	// Background thread appending to the CSV file. It must not allocate,
+	// as the wrapped allocator may not be thread-safe.
+	static void CsvMain( void* Arg )
+	{
+		FMallocProfiler* Profiler = (FMallocProfiler*)Arg;
+		FTime LastTime = appSeconds();
+		while( !Profiler->Exiting )
+		{
+			appSleep( 0.25f );
+			if( appSeconds()-LastTime>=Profiler->Interval )
+			{
+				Profiler->WriteCsv();
+				LastTime = appSeconds();
+			}
+		}
+	}
+};
+
+/*-----------------------------------------------------------------------------
+	The End.
+-----------------------------------------------------------------------------*/
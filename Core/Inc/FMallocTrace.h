@@ -0,0 +1,192 @@
+/*=============================================================================
+	FMallocTrace.h: Allocator wrapper recording every call to a file.
+
+	On Windows, this expects <windows.h> to have been included already,
+	like FMallocWindows.h does.
+=============================================================================*/
+
+#include <stdio.h>
+#include "FThreadPool.h"
+
+/*-----------------------------------------------------------------------------
+	Trace format.
+-----------------------------------------------------------------------------*/
+
+//
+// A trace is the MALLOC_TRACE_MAGIC DWORD followed by records, each a
+// BYTE op and its fields, all little endian:
+//
+//	MTRACE_Tag:     INT TagIndex, INT Length, ANSICHAR Tag[Length]
+//	MTRACE_Malloc:  QWORD Ptr, DWORD Size, INT TagIndex
+//	MTRACE_Realloc: QWORD OldPtr, QWORD NewPtr, DWORD NewSize, INT TagIndex
+//	MTRACE_Free:    QWORD Ptr
+//
+// A tag is defined before the first record using it. Pointers are only
+// used to pair up calls, so traces replay on any platform.
+//
+enum {MALLOC_TRACE_MAGIC=0x52544d55};
+enum EMallocTraceOp
+{
+	MTRACE_Tag		= 0,
+	MTRACE_Malloc	= 1,
+	MTRACE_Realloc	= 2,
+	MTRACE_Free		= 3,
+};
+
+/*-----------------------------------------------------------------------------
+	FMallocTrace.
+-----------------------------------------------------------------------------*/
+
+//
+// Passes calls through to another allocator while appending them to a
+// trace file. Installed by the launcher before appInit, so it writes
+// with stdio and allocates nothing itself.
+//
+class FMallocTrace : public FMalloc
+{
+public:
+	FMallocTrace( FMalloc* InMalloc, const ANSICHAR* Filename )
+	:	UsedMalloc	( InMalloc )
+	,	File		( fopen( Filename, "wb" ) )
+	,	NumTags		( 0 )
+	{
+		for( INT i=0; i<TAG_HASH_SIZE; i++ )
+			TagHash[i] = NULL;
+		if( File )
+		{
+			setvbuf( File, Buffer, _IOFBF, sizeof(Buffer) );
+			WriteDWORD( MALLOC_TRACE_MAGIC );
+		}
+	}
+	~FMallocTrace()
+	{
+		if( File )
+			fclose( File );
+		File = NULL;
+	}
+	UBOOL IsTracing()
+	{
+		return File!=NULL;
+	}
+
+	// FMalloc interface.
+	void* Malloc( DWORD Size, const TCHAR* Tag )
+	{
+		void* Result = UsedMalloc->Malloc( Size, Tag );
+		if( File )
+		{
+			FScopeLock Lock( Section );
+			INT TagIndex = FindTag( Tag );
+			WriteBYTE( MTRACE_Malloc );
+			WriteQWORD( (SIZE_T)Result );
+			WriteDWORD( Size );
+			WriteDWORD( TagIndex );
+		}
+		return Result;
+	}
+	void* Realloc( void* Ptr, DWORD NewSize, const TCHAR* Tag )
+	{
+		void* Result = UsedMalloc->Realloc( Ptr, NewSize, Tag );
+		if( File )
+		{
+			FScopeLock Lock( Section );
+			INT TagIndex = FindTag( Tag );
+			WriteBYTE( MTRACE_Realloc );
+			WriteQWORD( (SIZE_T)Ptr );
+			WriteQWORD( (SIZE_T)Result );
+			WriteDWORD( NewSize );
+			WriteDWORD( TagIndex );
+		}
+		return Result;
+	}
+	void Free( void* Ptr )
+	{
+		UsedMalloc->Free( Ptr );
+		if( File && Ptr )
+		{
+			FScopeLock Lock( Section );
+			WriteBYTE( MTRACE_Free );
+			WriteQWORD( (SIZE_T)Ptr );
+		}
+	}
+	void DumpAllocs()
+	{
+		UsedMalloc->DumpAllocs();
+	}
+	void HeapCheck()
+	{
+		UsedMalloc->HeapCheck();
+	}
+	void Init()
+	{
+		UsedMalloc->Init();
+	}
+	void Exit()
+	{
+		if( File )
+		{
+			FScopeLock Lock( Section );
+			fclose( File );
+			File = NULL;
+		}
+		UsedMalloc->Exit();
+	}
+private:
+	enum {TAG_HASH_SIZE=4096};
+	FMalloc*			UsedMalloc;
+	FILE*				File;
+	INT					NumTags;
+	const TCHAR*		TagHash[TAG_HASH_SIZE];
+	INT					TagIndices[TAG_HASH_SIZE];
+	FCriticalSection	Section;
+	ANSICHAR			Buffer[0x10000];
+
+	void WriteBYTE( BYTE B )
+	{
+		fputc( B, File );
+	}
+	void WriteDWORD( DWORD D )
+	{
+		BYTE B[4] = { (BYTE)D, (BYTE)(D>>8), (BYTE)(D>>16), (BYTE)(D>>24) };
+		fwrite( B, 4, 1, File );
+	}
+	void WriteQWORD( QWORD Q )
+	{
+		WriteDWORD( (DWORD)Q );
+		WriteDWORD( (DWORD)(Q>>32) );
+	}
+
+	// Map a tag to its index, defining it in the trace when first seen.
+	// Tags are nearly always literals, so they are keyed by pointer.
+	INT FindTag( const TCHAR* Tag )
+	{
+		if( !Tag )
+			return -1;
+		INT Slot = (INT)(((SIZE_T)Tag >> 3) % TAG_HASH_SIZE);
+		for( INT i=0; i<TAG_HASH_SIZE; i++, Slot=(Slot+1)%TAG_HASH_SIZE )
+		{
+			if( TagHash[Slot]==Tag )
+				return TagIndices[Slot];
+			if( !TagHash[Slot] )
+			{
+				if( NumTags>=TAG_HASH_SIZE/2 )
+					return -1;
+				TagHash[Slot]    = Tag;
+				TagIndices[Slot] = NumTags;
+				INT Length;
+				for( Length=0; Tag[Length]; Length++ );
+				WriteBYTE( MTRACE_Tag );
+				WriteDWORD( NumTags );
+				WriteDWORD( Length );
+				for( INT j=0; j<Length; j++ )
+					WriteBYTE( (BYTE)Tag[j] );
+				return NumTags++;
+			}
+		}
+		return -1;
+	}
+};
+
+/*-----------------------------------------------------------------------------
+	The End.
+-----------------------------------------------------------------------------*/
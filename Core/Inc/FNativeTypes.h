@@ -9,12 +9,28 @@
 	#include "FFileManagerWindows.h"
 	typedef FFileManagerWindows FFileManagerNative;
 	#include "FMallocWindows.h"
-	typedef FMallocWindows FMallocNative;
+	#include "FThreadPool.h"
+	// FMallocWindows is not thread-safe, so it is only used through a lock.
+	class FMallocWindowsThreadSafe : public FMallocThreadSafeProxy
+	{
+	public:
+		FMallocWindowsThreadSafe()
+		:	FMallocThreadSafeProxy( &Inner )
+		{}
+	private:
+		FMallocWindows Inner;
+	};
+	typedef FMallocWindowsThreadSafe FMallocNative;
 #elif defined(__LINUX__) || defined(__APPLE__)
 	#include "FFileManagerMmap.h"
 	typedef FFileManagerMmap FFileManagerNative;
-	#include "FMallocAnsi.h"
-	typedef FMallocAnsi FMallocNative;
+	#if USE_MALLOC_ANSI
+		#include "FMallocAnsi.h"
+		typedef FMallocAnsi FMallocNative;
+	#else
+		#include "FMallocPool.h"
+		typedef FMallocPool FMallocNative;
+	#endif
 #else
 	#include "FFileManagerAnsi.h"
 	typedef FFileManagerAnsi FFileManagerNative;
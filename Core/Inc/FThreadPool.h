@@ -0,0 +1,296 @@
+/*=============================================================================
+	FThreadPool.h: Portable threads and worker thread pool.
+
+	Platform headers are only included by FThreadPool.cpp, which every
+	module using these classes compiles. Here, the native objects are kept
+	in opaque storage.
+=============================================================================*/
+
+#ifndef _INC_FTHREADPOOL
+#define _INC_FTHREADPOOL
+
+/*-----------------------------------------------------------------------------
+	Synchronization primitives.
+-----------------------------------------------------------------------------*/
+
+// Room for the largest native object, checked in FThreadPool.cpp.
+enum {THREAD_STORAGE_QWORDS=8};
+
+//
+// Mutual exclusion lock.
+//
+class FCriticalSection
+{
+	friend class FCondition;
+public:
+	FCriticalSection();
+	~FCriticalSection();
+	void Lock();
+	void Unlock();
+private:
+	QWORD Storage[THREAD_STORAGE_QWORDS];
+};
+
+//
+// Holds a critical section for the lifetime of the scope.
+//
+class FScopeLock
+{
+public:
+	FScopeLock( FCriticalSection& InSection )
+	:	Section( InSection )
+	{
+		Section.Lock();
+	}
+	~FScopeLock()
+	{
+		Section.Unlock();
+	}
+private:
+	FCriticalSection& Section;
+};
+
+//
+// Condition variable, used together with an FCriticalSection.
+// Signal and Broadcast must be called with the section locked, and
+// waits must recheck their condition in a loop.
+//
+class FCondition
+{
+public:
+	FCondition();
+	~FCondition();
+	// Atomically release the locked section and wait to be signalled.
+	void Wait( FCriticalSection& Section );
+	void Signal();
+	void Broadcast();
+private:
+	QWORD Storage[THREAD_STORAGE_QWORDS];
+};
+
+/*-----------------------------------------------------------------------------
+	Threads.
+-----------------------------------------------------------------------------*/
+
+//
+// A joinable OS thread running a plain function.
+//
+class FThread
+{
+public:
+	typedef void (*FThreadFunc)( void* Arg );
+	FThread()
+	:	Started( 0 )
+	{}
+	~FThread()
+	{
+		check(!Started);
+	}
+	UBOOL Start( FThreadFunc InFunc, void* InArg );
+	void Join();
+	static INT NumProcessors();
+private:
+	FThreadFunc Func;
+	void*       Arg;
+	UBOOL       Started;
+	QWORD       Handle;
+	static void Run( FThread* Thread )
+	{
+		Thread->Func( Thread->Arg );
+	}
+	friend struct FThreadEntry;
+};
+
+/*-----------------------------------------------------------------------------
+	Thread-safe allocator proxy.
+-----------------------------------------------------------------------------*/
+
+//
+// Serializes access to an allocator which is not itself thread-safe,
+// such as FMallocWindows. It must be installed as GMalloc at startup,
+// before any thread is started, and stay installed until exit.
+//
+class FMallocThreadSafeProxy : public FMalloc
+{
+public:
+	FMallocThreadSafeProxy( FMalloc* InMalloc )
+	:	UsedMalloc( InMalloc )
+	{}
+	FMalloc* GetInner()
+	{
+		return UsedMalloc;
+	}
+	// FMalloc interface.
+	void* Malloc( DWORD Size, const TCHAR* Tag )
+	{
+		FScopeLock Lock( Section );
+		return UsedMalloc->Malloc( Size, Tag );
+	}
+	void* Realloc( void* Ptr, DWORD NewSize, const TCHAR* Tag )
+	{
+		FScopeLock Lock( Section );
+		return UsedMalloc->Realloc( Ptr, NewSize, Tag );
+	}
+	void Free( void* Ptr )
+	{
+		FScopeLock Lock( Section );
+		UsedMalloc->Free( Ptr );
+	}
+	void DumpAllocs()
+	{
+		FScopeLock Lock( Section );
+		UsedMalloc->DumpAllocs();
+	}
+	void HeapCheck()
+	{
+		FScopeLock Lock( Section );
+		UsedMalloc->HeapCheck();
+	}
+	void Init()
+	{
+		UsedMalloc->Init();
+	}
+	void Exit()
+	{
+		UsedMalloc->Exit();
+	}
+private:
+	FMalloc*         UsedMalloc;
+	FCriticalSection Section;
+};
+
+/*-----------------------------------------------------------------------------
+	Worker thread pool.
+-----------------------------------------------------------------------------*/
+
+//
+// A unit of work executed by FThreadPool.
+//
+class FThreadTask
+{
+public:
+	virtual ~FThreadTask()
+	{}
+	virtual void DoWork()=0;
+};
+
+//
+// Fixed set of worker threads consuming a FIFO of tasks. Tasks are not
+// owned by the pool. Tasks may allocate, so GMalloc must be thread-safe.
+//
+class FThreadPool
+{
+public:
+	FThreadPool( INT InNumThreads=0 )
+	:	Pending		( 0 )
+	,	Exiting		( 0 )
+	,	Failed		( 0 )
+	{
+		guard(FThreadPool::FThreadPool);
+		if( InNumThreads<=0 )
+			InNumThreads = FThread::NumProcessors();
+		for( INT i=0; i<InNumThreads; i++ )
+		{
+			FThread* Thread = new FThread;
+			if( !Thread->Start( WorkerMain, this ) )
+			{
+				delete Thread;
+				break;
+			}
+			Threads.AddItem( Thread );
+		}
+		unguard;
+	}
+	~FThreadPool()
+	{
+		guard(FThreadPool::~FThreadPool);
+		Section.Lock();
+		Exiting = 1;
+		WorkReady.Broadcast();
+		Section.Unlock();
+		for( INT i=0; i<Threads.Num(); i++ )
+		{
+			Threads(i)->Join();
+			delete Threads(i);
+		}
+		Threads.Empty();
+		Queue.Empty();
+		unguard;
+	}
+	INT NumThreads()
+	{
+		return Threads.Num();
+	}
+	void AddTask( FThreadTask* Task )
+	{
+		guard(FThreadPool::AddTask);
+		if( !Threads.Num() )
+		{
+			// No threads could be started, so run inline.
+			Task->DoWork();
+			return;
+		}
+		FScopeLock Lock( Section );
+		Queue.AddItem( Task );
+		Pending++;
+		WorkReady.Signal();
+		unguard;
+	}
+	// Wait until every queued task has finished. Returns 0 if any failed.
+	UBOOL Wait()
+	{
+		guard(FThreadPool::Wait);
+		FScopeLock Lock( Section );
+		while( Pending )
+			WorkDone.Wait( Section );
+		UBOOL Result = !Failed;
+		Failed = 0;
+		return Result;
+		unguard;
+	}
+private:
+	TArray<FThread*>       Threads;
+	TArray<FThreadTask*>   Queue;
+	INT                    Pending;
+	UBOOL                  Exiting;
+	UBOOL                  Failed;
+	FCriticalSection       Section;
+	FCondition             WorkReady;
+	FCondition             WorkDone;
+
+	static void WorkerMain( void* Arg )
+	{
+		FThreadPool* Pool = (FThreadPool*)Arg;
+		Pool->Section.Lock();
+		for( ;; )
+		{
+			while( !Pool->Queue.Num() && !Pool->Exiting )
+				Pool->WorkReady.Wait( Pool->Section );
+			if( !Pool->Queue.Num() )
+				break;
+			FThreadTask* Task = Pool->Queue(0);
+			Pool->Queue.Remove( 0 );
+			Pool->Section.Unlock();
+			UBOOL TaskFailed = 0;
+			try
+			{
+				Task->DoWork();
+			}
+			catch( ... )
+			{
+				TaskFailed = 1;
+			}
+			Pool->Section.Lock();
+			Pool->Failed |= TaskFailed;
+			if( --Pool->Pending==0 )
+				Pool->WorkDone.Broadcast();
+		}
+		Pool->Section.Unlock();
+	}
+};
+
+#endif
+
+/*-----------------------------------------------------------------------------
+	The End.
+-----------------------------------------------------------------------------*/
@@ -0,0 +1,208 @@
+/*=============================================================================
+	FThreadPool.cpp: Native implementation of the portable thread classes.
+
+	Core is shipped as a binary, so every module using FThreadPool.h
+	compiles this file itself.
+=============================================================================*/
+
+#if defined(WIN32)
+	#pragma warning( disable : 4201 )
+	#define STRICT
+	#include <windows.h>
+#else
+	#include <unistd.h>
+	#include <pthread.h>
+#endif
+
+#include "Core.h"
+#include "FThreadPool.h"
+
+/*-----------------------------------------------------------------------------
+	Native storage.
+-----------------------------------------------------------------------------*/
+
+#if defined(WIN32)
+	typedef CRITICAL_SECTION FNativeSection;
+	// Semaphore based, as condition variables need Windows Vista.
+	// Waiters is only changed with the section locked.
+	struct FNativeCondition
+	{
+		HANDLE Semaphore;
+		INT    Waiters;
+	};
+	typedef HANDLE FNativeThread;
+#else
+	typedef pthread_mutex_t FNativeSection;
+	typedef pthread_cond_t FNativeCondition;
+	typedef pthread_t FNativeThread;
+#endif
+
+// Fails to compile if the opaque storage in FThreadPool.h is too small.
+typedef BYTE FNativeSectionFits[sizeof(FNativeSection)<=THREAD_STORAGE_QWORDS*sizeof(QWORD) ? 1 : -1];
+typedef BYTE FNativeConditionFits[sizeof(FNativeCondition)<=THREAD_STORAGE_QWORDS*sizeof(QWORD) ? 1 : -1];
+typedef BYTE FNativeThreadFits[sizeof(FNativeThread)<=sizeof(QWORD) ? 1 : -1];
+
+#define NATIVE_SECTION(Storage)		((FNativeSection*)(Storage))
+#define NATIVE_CONDITION(Storage)	((FNativeCondition*)(Storage))
+#define NATIVE_THREAD(Handle)		((FNativeThread*)&(Handle))
+
+/*-----------------------------------------------------------------------------
+	FCriticalSection.
+-----------------------------------------------------------------------------*/
+
+FCriticalSection::FCriticalSection()
+{
+#if defined(WIN32)
+	InitializeCriticalSection( NATIVE_SECTION(Storage) );
+#else
+	pthread_mutex_init( NATIVE_SECTION(Storage), NULL );
+#endif
+}
+FCriticalSection::~FCriticalSection()
+{
+#if defined(WIN32)
+	DeleteCriticalSection( NATIVE_SECTION(Storage) );
+#else
+	pthread_mutex_destroy( NATIVE_SECTION(Storage) );
+#endif
+}
+void FCriticalSection::Lock()
+{
+#if defined(WIN32)
+	EnterCriticalSection( NATIVE_SECTION(Storage) );
+#else
+	pthread_mutex_lock( NATIVE_SECTION(Storage) );
+#endif
+}
+void FCriticalSection::Unlock()
+{
+#if defined(WIN32)
+	LeaveCriticalSection( NATIVE_SECTION(Storage) );
+#else
+	pthread_mutex_unlock( NATIVE_SECTION(Storage) );
+#endif
+}
+
+/*-----------------------------------------------------------------------------
+	FCondition.
+-----------------------------------------------------------------------------*/
+
+FCondition::FCondition()
+{
+#if defined(WIN32)
+	NATIVE_CONDITION(Storage)->Semaphore = CreateSemaphore( NULL, 0, MAXLONG, NULL );
+	NATIVE_CONDITION(Storage)->Waiters   = 0;
+#else
+	pthread_cond_init( NATIVE_CONDITION(Storage), NULL );
+#endif
+}
+FCondition::~FCondition()
+{
+#if defined(WIN32)
+	CloseHandle( NATIVE_CONDITION(Storage)->Semaphore );
+#else
+	pthread_cond_destroy( NATIVE_CONDITION(Storage) );
+#endif
+}
+void FCondition::Wait( FCriticalSection& Section )
+{
+#if defined(WIN32)
+	// A wakeup released before this thread blocks is kept by the semaphore.
+	NATIVE_CONDITION(Storage)->Waiters++;
+	Section.Unlock();
+	WaitForSingleObject( NATIVE_CONDITION(Storage)->Semaphore, INFINITE );
+	Section.Lock();
+#else
+	pthread_cond_wait( NATIVE_CONDITION(Storage), NATIVE_SECTION(Section.Storage) );
+#endif
+}
+void FCondition::Signal()
+{
+#if defined(WIN32)
+	if( NATIVE_CONDITION(Storage)->Waiters>0 )
+	{
+		NATIVE_CONDITION(Storage)->Waiters--;
+		ReleaseSemaphore( NATIVE_CONDITION(Storage)->Semaphore, 1, NULL );
+	}
+#else
+	pthread_cond_signal( NATIVE_CONDITION(Storage) );
+#endif
+}
+void FCondition::Broadcast()
+{
+#if defined(WIN32)
+	if( NATIVE_CONDITION(Storage)->Waiters>0 )
+	{
+		ReleaseSemaphore( NATIVE_CONDITION(Storage)->Semaphore, NATIVE_CONDITION(Storage)->Waiters, NULL );
+		NATIVE_CONDITION(Storage)->Waiters = 0;
+	}
+#else
+	pthread_cond_broadcast( NATIVE_CONDITION(Storage) );
+#endif
+}
+
+/*-----------------------------------------------------------------------------
+	FThread.
+-----------------------------------------------------------------------------*/
+
+struct FThreadEntry
+{
+#if defined(WIN32)
+	static DWORD WINAPI ThreadProc( void* Parm )
+	{
+		FThread::Run( (FThread*)Parm );
+		return 0;
+	}
+#else
+	static void* ThreadProc( void* Parm )
+	{
+		FThread::Run( (FThread*)Parm );
+		return NULL;
+	}
+#endif
+};
+
+UBOOL FThread::Start( FThreadFunc InFunc, void* InArg )
+{
+	guard(FThread::Start);
+	check(!Started);
+	Func = InFunc;
+	Arg  = InArg;
+#if defined(WIN32)
+	*NATIVE_THREAD(Handle) = CreateThread( NULL, 0, FThreadEntry::ThreadProc, this, 0, NULL );
+	Started = *NATIVE_THREAD(Handle)!=NULL;
+#else
+	Started = pthread_create( NATIVE_THREAD(Handle), NULL, FThreadEntry::ThreadProc, this )==0;
+#endif
+	return Started;
+	unguard;
+}
+void FThread::Join()
+{
+	guard(FThread::Join);
+	if( Started )
+	{
+#if defined(WIN32)
+		WaitForSingleObject( *NATIVE_THREAD(Handle), INFINITE );
+		CloseHandle( *NATIVE_THREAD(Handle) );
+#else
+		pthread_join( *NATIVE_THREAD(Handle), NULL );
+#endif
+		Started = 0;
+	}
+	unguard;
+}
+INT FThread::NumProcessors()
+{
+#if defined(WIN32)
+	SYSTEM_INFO Info;
+	GetSystemInfo( &Info );
+	return Max<INT>( Info.dwNumberOfProcessors, 1 );
+#else
+	return Max<INT>( sysconf(_SC_NPROCESSORS_ONLN), 1 );
+#endif
+}
+
+/*-----------------------------------------------------------------------------
+	The End.
+-----------------------------------------------------------------------------*/
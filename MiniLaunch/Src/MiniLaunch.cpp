@@ -33,6 +33,8 @@ extern "C" {TCHAR GPackage[64]=TEXT("MiniLaunch");}
 
 // Memory allocator.
 FMallocNative Malloc;
+#include "FMallocProfiler.h"
+FMallocProfiler Profiler( &Malloc );
 
 // Log file.
 #include "FOutputDeviceFile.h"
@@ -65,7 +67,7 @@ static UEngine* InitEngine()
 	FTime LoadTime = appSeconds();
 
 	// Set exec hook.
-	GExec = NULL;
+	GExec = Profiler.IsEnabled() ? &Profiler : NULL;
 
 	// Update first-run.
 	INT FirstRun=0;
@@ -220,10 +222,11 @@ int main( int argc, char* argv[] )
 		}
 #endif
 
-		// Init core.
+		// Init core, profiling allocations if requested.
 		GIsClient = 1;
 		GIsGuarded = 1;
-		appInit( TEXT("UnrealTournament"), CmdLine, &Malloc, &Log, &Error, &Warn, &FileManager, FConfigCacheIni::Factory, 1 );
+		FMalloc* UsedMalloc = Profiler.Enable( CmdLine ) ? (FMalloc*)&Profiler : &Malloc;
+		appInit( TEXT("UnrealTournament"), CmdLine, UsedMalloc, &Log, &Error, &Warn, &FileManager, FConfigCacheIni::Factory, 1 );
 
 		// Init mode.
 		GIsServer		= 1;
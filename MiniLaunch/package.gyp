@@ -9,7 +9,8 @@
 				"../Engine/package.gyp:*"
 			],
 			"sources": [
-				"Src/MiniLaunch.cpp"
+				"Src/MiniLaunch.cpp",
+				"../Core/Src/FThreadPool.cpp"
 			],
 			"conditions": [
 				["OS == 'win'", {
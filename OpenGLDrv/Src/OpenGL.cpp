@@ -721,6 +721,118 @@ static const char *g_fpDualTextureAndDetailTextureTwoLayer =
 ;
 
 
+/*-----------------------------------------------------------------------------
+	GLSL programs.
+-----------------------------------------------------------------------------*/
+
+//Complex surface uber-program
+//One program covers every complex surface pass combination, selected by uMode:
+//  x = number of base layers (0 for the separate detail texture pass)
+//  y = fog map follows the base layers
+//  z = number of detail texture layers, detail texture follows the base layers
+//Layer math matches the complex surface fragment programs above
+
+static const char *g_glslComplexSurfaceVS =
+	"#version 330 core\n"
+
+	"layout(std140) uniform FrameState {\n"
+	"	mat4 uMVP;\n"
+	"};\n"
+	"layout(std140) uniform SurfaceState {\n"
+	"	vec4 uXAxis;\n"
+	"	vec4 uYAxis;\n"
+	"	vec4 uTexInfo[4];\n"
+	"	vec4 uColor;\n"
+	"	ivec4 uMode;\n"
+	"};\n"
+
+	"layout(location = 0) in vec3 aPos;\n"
+
+	"out vec2 vTexCoord[4];\n"
+	"out float vPosZ;\n"
+
+	"void main() {\n"
+	"	vec4 pos = vec4(aPos, 1.0);\n"
+	"	vec2 mapDot = vec2(dot(pos, uXAxis), dot(pos, uYAxis));\n"
+	"	for (int i = 0; i < 4; i++) {\n"
+	"		vTexCoord[i] = (mapDot - uTexInfo[i].xy) * uTexInfo[i].zw;\n"
+	"	}\n"
+	"	vPosZ = aPos.z;\n"
+	"	gl_Position = uMVP * pos;\n"
+	"}\n"
+;
+static const char *g_glslComplexSurfaceFS =
+	"#version 330 core\n"
+
+	"layout(std140) uniform SurfaceState {\n"
+	"	vec4 uXAxis;\n"
+	"	vec4 uYAxis;\n"
+	"	vec4 uTexInfo[4];\n"
+	"	vec4 uColor;\n"
+	"	ivec4 uMode;\n"
+	"};\n"
+	"uniform sampler2D uTexture0;\n"
+	"uniform sampler2D uTexture1;\n"
+	"uniform sampler2D uTexture2;\n"
+	"uniform sampler2D uTexture3;\n"
+
+	"in vec2 vTexCoord[4];\n"
+	"in float vPosZ;\n"
+
+	"out vec4 oColor;\n"
+
+	"const float RNearZ = 0.002631578947;\n"
+	"const float DetailScale = 4.223;\n"
+
+	"vec4 SampleLayer(int i, vec2 texCoord) {\n"
+	"	if (i == 0) return texture(uTexture0, texCoord);\n"
+	"	if (i == 1) return texture(uTexture1, texCoord);\n"
+	"	if (i == 2) return texture(uTexture2, texCoord);\n"
+	"	return texture(uTexture3, texCoord);\n"
+	"}\n"
+
+	"void main() {\n"
+	"	int numLayers = uMode.x;\n"
+	"	float detailBlend = clamp(vPosZ * RNearZ, 0.0, 1.0);\n"
+
+	"	if (numLayers == 0) {\n"
+	"		vec4 t0 = mix(texture(uTexture0, vTexCoord[0]), uColor, detailBlend);\n"
+	"		if (uMode.z >= 2) {\n"
+	"			vec4 t1 = texture(uTexture0, vTexCoord[0] * DetailScale);\n"
+	"			t1 = mix(t1, uColor, clamp(detailBlend * DetailScale, 0.0, 1.0));\n"
+	"			t0 = (t0 * t1) * 2.0;\n"
+	"		}\n"
+	"		if (detailBlend > 0.999) discard;\n"
+	"		oColor = t0;\n"
+	"		return;\n"
+	"	}\n"
+
+	"	vec4 t0 = texture(uTexture0, vTexCoord[0]);\n"
+	"	for (int i = 1; i < numLayers; i++) {\n"
+	"		t0 *= SampleLayer(i, vTexCoord[i]);\n"
+	"		t0.rgb += t0.rgb * uColor.a;\n"
+	"	}\n"
+
+	"	if (uMode.y != 0) {\n"
+	"		vec4 fog = SampleLayer(numLayers, vTexCoord[numLayers]);\n"
+	"		t0.rgb = (t0.rgb * (1.0 - fog.a)) + fog.rgb;\n"
+	"	}\n"
+
+	"	if (uMode.z != 0) {\n"
+	"		vec4 t1 = mix(SampleLayer(numLayers, vTexCoord[numLayers]), uColor, detailBlend);\n"
+	"		t0.rgb = (t0.rgb * t1.rgb) * 2.0;\n"
+	"		if (uMode.z >= 2) {\n"
+	"			t1 = SampleLayer(numLayers, vTexCoord[numLayers] * DetailScale);\n"
+	"			t1 = mix(t1, uColor, clamp(detailBlend * DetailScale, 0.0, 1.0));\n"
+	"			t0.rgb = (t0.rgb * t1.rgb) * 2.0;\n"
+	"		}\n"
+	"	}\n"
+
+	"	oColor = t0;\n"
+	"}\n"
+;
+
+
 /*-----------------------------------------------------------------------------
 	OpenGLDrv.
 -----------------------------------------------------------------------------*/
@@ -822,8 +934,23 @@ void UOpenGLRenderDevice::StaticConstructor() {
 	SC_AddBoolConfigParam(1,  TEXT("MaskedTextureHack"), CPP_PROPERTY_LOCAL(MaskedTextureHack), 1);
 	SC_AddBoolConfigParam(0,  TEXT("UseAA"), CPP_PROPERTY_LOCAL(UseAA), 0);
 	SC_AddIntConfigParam(TEXT("NumAASamples"), CPP_PROPERTY_LOCAL(NumAASamples), 4);
-	SC_AddBoolConfigParam(1,  TEXT("NoAATiles"), CPP_PROPERTY_LOCAL(NoAATiles), 1);
-	SC_AddBoolConfigParam(0,  TEXT("ZRangeHack"), CPP_PROPERTY_LOCAL(ZRangeHack), UTGLR_DEFAULT_ZRangeHack);
+	SC_AddBoolConfigParam(13,  TEXT("NoAATiles"), CPP_PROPERTY_LOCAL(NoAATiles), 1);
+	SC_AddBoolConfigParam(12,  TEXT("ZRangeHack"), CPP_PROPERTY_LOCAL(ZRangeHack), UTGLR_DEFAULT_ZRangeHack);
+	SC_AddBoolConfigParam(11,  TEXT("UseStreamingVBO"), CPP_PROPERTY_LOCAL(UseStreamingVBO), 1);
+	SC_AddBoolConfigParam(10,  TEXT("UseGLSL"), CPP_PROPERTY_LOCAL(UseGLSL), 0);
+	SC_AddBoolConfigParam(9,  TEXT("DeferComplexSurfaces"), CPP_PROPERTY_LOCAL(DeferComplexSurfaces), 0);
+	SC_AddBoolConfigParam(8,  TEXT("UseLightMapAtlas"), CPP_PROPERTY_LOCAL(UseLightMapAtlas), 1);
+	SC_AddBoolConfigParam(7,  TEXT("UseAsyncTextures"), CPP_PROPERTY_LOCAL(UseAsyncTextures), 0);
+	SC_AddIntConfigParam(TEXT("AsyncTextureThreads"), CPP_PROPERTY_LOCAL(AsyncTextureThreads), 0);
+	SC_AddBoolConfigParam(6,  TEXT("UseTextureDiskCache"), CPP_PROPERTY_LOCAL(UseTextureDiskCache), 0);
+	SC_AddBoolConfigParam(5,  TEXT("CompressTextures"), CPP_PROPERTY_LOCAL(CompressTextures), 0);
+	SC_AddBoolConfigParam(4,  TEXT("UseBindHash"), CPP_PROPERTY_LOCAL(UseBindHash), 1);
+	SC_AddBoolConfigParam(3,  TEXT("UseRenderThread"), CPP_PROPERTY_LOCAL(UseRenderThread), 0);
+	SC_AddBoolConfigParam(2,  TEXT("UseProfiler"), CPP_PROPERTY_LOCAL(UseProfiler), 0);
+	SC_AddBoolConfigParam(1,  TEXT("FramePaceBeforeInput"), CPP_PROPERTY_LOCAL(FramePaceBeforeInput), 0);
+	SC_AddBoolConfigParam(0,  TEXT("Offscreen"), CPP_PROPERTY_LOCAL(Offscreen), 0);
+	SC_AddIntConfigParam(TEXT("OffscreenSizeX"), CPP_PROPERTY_LOCAL(OffscreenSizeX), 1024);
+	SC_AddIntConfigParam(TEXT("OffscreenSizeY"), CPP_PROPERTY_LOCAL(OffscreenSizeY), 768);
 
 #undef CPP_PROPERTY_LOCAL
 #undef CPP_PROPERTY_LOCAL_DCV
@@ -850,6 +977,80 @@ void UOpenGLRenderDevice::StaticConstructor() {
 
 	//Frame rate limit timer not yet initialized
 	m_frameRateLimitTimerInitialized = false;
+	m_paceDeadlineValid = false;
+	m_paceSleepMargin = 0.002f;
+	ResetPaceStats();
+
+	//Streaming VBO not yet allocated
+	m_streamVBOActive = false;
+	m_streamVBO = 0;
+
+	//Texture conversion workers not yet started
+	m_texConvertQueue = NULL;
+	m_texPBOActive = false;
+
+	//Render thread not yet started
+	m_renderThread = NULL;
+	m_cmdBufferIndex = 0;
+	m_pRecordBuffer = NULL;
+	m_renderThreadReplaying = false;
+	m_renderThreadAbort = false;
+	m_streamVBOMapFailed = false;
+	m_recordFrameCount = 0;
+
+	//Not capturing frames
+	m_capture = NULL;
+	m_capturePBOActive = false;
+
+	//Frame profiler not yet started
+	m_profActive = false;
+	m_profFrameActive = false;
+	m_profFrameHead = 0;
+	m_profFrameCount = 0;
+
+	//Texture disk cache not yet opened
+	m_texDiskCacheActive = false;
+
+	//Not rendering offscreen
+	m_offscreenActive = false;
+	m_offscreenFBO = 0;
+	m_offscreenColorRB = 0;
+	m_offscreenDepthRB = 0;
+
+	//Timedemo benchmark not running
+	m_timeDemoArmed = false;
+	m_timeDemoActive = false;
+	m_timeDemoExitRequested = false;
+	m_timeDemoPanning = false;
+	m_timeDemoPanAccum = 0;
+
+	//Hitch benchmark not running
+	m_hitchBenchArmed = false;
+	m_hitchBenchActive = false;
+
+	//Vertex buffering benchmark not running
+	m_vertBenchArmed = false;
+	m_vertBenchCapturing = false;
+
+	//GLSL programs not yet allocated
+	m_glslCurrent = 0;
+	m_glslComplexSurface = 0;
+	m_glslFrameUBO = 0;
+	m_glslSurfaceUBO = 0;
+	m_glslFrameStateDirty = true;
+
+	//Deferred complex surface list starts empty
+	m_dcsActive = false;
+	m_dcsSurfaces = NULL;
+	m_dcsSortedSurfaces = NULL;
+	m_dcsPolyCounts = NULL;
+	m_dcsVerts = NULL;
+	for (INT dcsLayer = 0; dcsLayer < DCS_MAX_LAYERS; dcsLayer++) {
+		m_dcsTexCoords[dcsLayer] = NULL;
+	}
+	m_dcsNumSurfaces = 0;
+	m_dcsNumPolys = 0;
+	m_dcsNumVerts = 0;
 
 	unguard;
 }
@@ -883,6 +1084,7 @@ void UOpenGLRenderDevice::DbgPrintInitParam(const char *pName, FLOAT value) {
 
 
 #ifdef UTGLR_INCLUDE_SSE_CODE
+#ifdef UTGLR_USE_ASM_CODE
 bool UOpenGLRenderDevice::CPU_DetectCPUID(void) {
 	//Check for cpuid instruction support
 	__try {
@@ -988,6 +1190,32 @@ l_no_sse2:
 
 	return bSupportsSSE2;
 }
+#else
+//Only built for targets with SSE2, where the OS supports it and cpuid is always present
+bool UOpenGLRenderDevice::CPU_DetectCPUID(void) {
+	return true;
+}
+
+bool UOpenGLRenderDevice::CPU_DetectSSE(void) {
+	unsigned int cpuEAX, cpuEBX, cpuECX, cpuEDX;
+
+	if (!__get_cpuid(1, &cpuEAX, &cpuEBX, &cpuECX, &cpuEDX)) {
+		return false;
+	}
+
+	return (cpuEDX & 0x02000000) ? true : false;
+}
+
+bool UOpenGLRenderDevice::CPU_DetectSSE2(void) {
+	unsigned int cpuEAX, cpuEBX, cpuECX, cpuEDX;
+
+	if (!__get_cpuid(1, &cpuEAX, &cpuEBX, &cpuECX, &cpuEDX)) {
+		return false;
+	}
+
+	return (cpuEDX & 0x04000000) ? true : false;
+}
+#endif //UTGLR_USE_ASM_CODE
 #endif //UTGLR_INCLUDE_SSE_CODE
 
 
@@ -998,6 +1226,11 @@ void UOpenGLRenderDevice::InitFrameRateLimitTimerSafe(void) {
 	}
 	m_frameRateLimitTimerInitialized = true;
 
+	//Start the deadlines from the next frame
+	m_paceDeadlineValid = false;
+	//Covers the usual sleep overshoot until it has been measured
+	m_paceSleepMargin = 0.002f;
+
 	return;
 }
 
@@ -1012,262 +1245,569 @@ void UOpenGLRenderDevice::ShutdownFrameRateLimitTimer(void) {
 }
 
 
-static void FASTCALL Buffer3Verts(UOpenGLRenderDevice *pRD, FTransTexture** Pts) {
-	FGLTexCoord *pTexCoordArray = &pRD->TexCoordArray[0][pRD->BufferedVerts];
-	FGLNormal *pNormalArray = &pRD->NormalArray[pRD->BufferedVerts];
-	FGLVertex *pVertexArray = &pRD->VertexArray[pRD->BufferedVerts];
-	FGLSingleColor *pSingleColorArray = &pRD->SingleColorArray[pRD->BufferedVerts];
-	FGLDoubleColor *pDoubleColorArray = &pRD->DoubleColorArray[pRD->BufferedVerts];
-	pRD->BufferedVerts += 3;
-	for (INT i = 0; i < 3; i++) {
-		const FTransTexture* P = *Pts++;
+//Waits for the frame deadline if the frame rate is limited and records the interval since the previous frame
+void UOpenGLRenderDevice::PaceFrame(void) {
+#if defined UTGLR_DX_BUILD || defined UTGLR_RUNE_BUILD
+	FLOAT curTime;
+#else
+	FTime curTime;
+#endif
 
-		pTexCoordArray->u = P->U * pRD->TexInfo[0].UMult;
-		pTexCoordArray->v = P->V * pRD->TexInfo[0].VMult;
-		pTexCoordArray++;
+	curTime = appSeconds();
 
-		if (pRD->m_requestedColorFlags & UOpenGLRenderDevice::CF_NORMAL_ARRAY) {
-			pNormalArray->x = P->Normal.X;
-			pNormalArray->y = P->Normal.Y;
-			pNormalArray->z = P->Normal.Z;
-			pNormalArray++;
+	if (FrameRateLimit >= 20) {
+		FLOAT period = 1.0f / FrameRateLimit;
+		FLOAT remaining;
+
+		//First time timer init if necessary
+		InitFrameRateLimitTimerSafe();
+
+		if (!m_paceDeadlineValid) {
+			m_paceDeadline = curTime;
+			m_paceDeadlineValid = true;
 		}
+		m_paceDeadline = m_paceDeadline + period;
 
-		pVertexArray->x = P->Point.X;
-		pVertexArray->y = P->Point.Y;
-		pVertexArray->z = P->Point.Z;
-		pVertexArray++;
+		remaining = m_paceDeadline - curTime;
+		if (remaining <= 0.0f) {
+			//Start over from a late frame rather than rushing the following ones to catch up
+			m_paceLateFrames++;
+			m_paceDeadline = curTime;
+		}
+		else {
+			//Sleep while the OS is sure to wake up in time, then spin to the deadline
+			if (remaining > m_paceSleepMargin) {
+				FLOAT sleepTime = remaining - m_paceSleepMargin;
+				FLOAT overshoot;
 
-		if (pRD->m_requestedColorFlags & UOpenGLRenderDevice::CF_DUAL_COLOR_ARRAY) {
-			FLOAT f255_Times_One_Minus_FogW = 255.0f * (1.0f - P->Fog.W);
-			pDoubleColorArray->color = UOpenGLRenderDevice::FPlaneTo_RGBScaled_A255(&P->Light, f255_Times_One_Minus_FogW);
-			pDoubleColorArray->specular = UOpenGLRenderDevice::FPlaneTo_RGB_A0(&P->Fog);
-			pDoubleColorArray++;
+				appSleep(sleepTime);
+				overshoot = (appSeconds() - curTime) - sleepTime;
+
+				//Follow the worst recent overshoot, forgetting old ones slowly
+				m_paceSleepMargin = Clamp(Max(m_paceSleepMargin * 0.99f, overshoot + 0.0002f), 0.0005f, period);
+			}
+			do {
+				curTime = appSeconds();
+			} while ((m_paceDeadline - curTime) > 0.0f);
 		}
-		else if (pRD->m_requestedColorFlags & UOpenGLRenderDevice::CF_COLOR_ARRAY) {
-#ifdef UTGLR_RUNE_BUILD
-			pSingleColorArray->color = UOpenGLRenderDevice::FPlaneTo_RGB_Aub(&P->Light, pRD->m_gpAlpha);
-#else
-			pSingleColorArray->color = UOpenGLRenderDevice::FPlaneTo_RGB_A255(&P->Light);
-#endif
-			pSingleColorArray++;
+	}
+	else {
+		m_paceDeadlineValid = false;
+	}
+
+	if (m_pacePrevTimeValid) {
+		FLOAT intervalMs = (curTime - m_pacePrevTime) * 1000.0f;
+		INT bucket = Min(appFloor(intervalMs * 20.0f), (INT)PACE_HIST_BUCKETS);
+
+		m_paceHist[Max(bucket, 0)]++;
+		m_paceNumFrames++;
+		if (intervalMs > m_paceMaxMs) {
+			m_paceMaxMs = intervalMs;
 		}
 	}
+	m_pacePrevTime = curTime;
+	m_pacePrevTimeValid = true;
 }
 
-static void FASTCALL Buffer3BasicVerts(UOpenGLRenderDevice *pRD, FTransTexture** Pts) {
-	FGLTexCoord *pTexCoordArray = &pRD->TexCoordArray[0][pRD->BufferedVerts];
-	FGLVertex *pVertexArray = &pRD->VertexArray[pRD->BufferedVerts];
-	pRD->BufferedVerts += 3;
-	FLOAT UMult = pRD->TexInfo[0].UMult;
-	FLOAT VMult = pRD->TexInfo[0].VMult;
-	for (INT i = 0; i < 3; i++) {
-		const FTransTexture* P = *Pts++;
+void UOpenGLRenderDevice::ResetPaceStats(void) {
+	appMemzero(m_paceHist, sizeof(m_paceHist));
+	m_paceNumFrames = 0;
+	m_paceLateFrames = 0;
+	m_paceMaxMs = 0.0f;
+	m_pacePrevTimeValid = false;
+}
 
-		pTexCoordArray->u = P->U * UMult;
-		pTexCoordArray->v = P->V * VMult;
-		pTexCoordArray++;
+//Returns the upper edge of the histogram bucket holding the given fraction of the frames
+FLOAT UOpenGLRenderDevice::GetPacePercentileMs(FLOAT Fraction) {
+	DWORD target = (DWORD)appCeil(Fraction * m_paceNumFrames);
+	DWORD count = 0;
+	INT i;
 
-		pVertexArray->x = P->Point.X;
-		pVertexArray->y = P->Point.Y;
-		pVertexArray->z = P->Point.Z;
-		pVertexArray++;
+	for (i = 0; i < PACE_HIST_BUCKETS; i++) {
+		count += m_paceHist[i];
+		if ((count >= target) && (count > 0)) {
+			return Min((i + 1) * 0.05f, m_paceMaxMs);
+		}
 	}
+
+	return m_paceMaxMs;
 }
 
-static void FASTCALL Buffer3ColoredVerts(UOpenGLRenderDevice *pRD, FTransTexture** Pts) {
-	FGLTexCoord *pTexCoordArray = &pRD->TexCoordArray[0][pRD->BufferedVerts];
-	FGLVertex *pVertexArray = &pRD->VertexArray[pRD->BufferedVerts];
-	FGLSingleColor *pSingleColorArray = &pRD->SingleColorArray[pRD->BufferedVerts];
-	pRD->BufferedVerts += 3;
-	for (INT i = 0; i < 3; i++) {
-		const FTransTexture* P = *Pts++;
 
-		pTexCoordArray->u = P->U * pRD->TexInfo[0].UMult;
-		pTexCoordArray->v = P->V * pRD->TexInfo[0].VMult;
-		pTexCoordArray++;
+void UOpenGLRenderDevice::InitDeferredComplexSurfacesSafe(void) {
+	INT i;
 
-		pVertexArray->x = P->Point.X;
-		pVertexArray->y = P->Point.Y;
-		pVertexArray->z = P->Point.Z;
-		pVertexArray++;
+	//Only initialize once
+	if (m_dcsSurfaces != NULL) {
+		return;
+	}
 
-		pSingleColorArray->color = UOpenGLRenderDevice::FPlaneTo_RGB_A255(&P->Light);
-		pSingleColorArray++;
+	m_dcsSurfaces = (FGLDeferredSurface *)appMalloc(DCS_MAX_SURFACES * sizeof(FGLDeferredSurface), TEXT("OpenGLDeferredSurfaces"));
+	m_dcsSortedSurfaces = (FGLDeferredSurface **)appMalloc(DCS_MAX_SURFACES * sizeof(FGLDeferredSurface *), TEXT("OpenGLDeferredSurfaces"));
+	m_dcsPolyCounts = (GLsizei *)appMalloc(DCS_MAX_POLYS * sizeof(GLsizei), TEXT("OpenGLDeferredSurfaces"));
+	m_dcsVerts = (FGLVertex *)appMalloc(DCS_MAX_VERTS * sizeof(FGLVertex), TEXT("OpenGLDeferredSurfaces"));
+	for (i = 0; i < DCS_MAX_LAYERS; i++) {
+		m_dcsTexCoords[i] = (FGLTexCoord *)appMalloc(DCS_MAX_VERTS * sizeof(FGLTexCoord), TEXT("OpenGLDeferredSurfaces"));
 	}
+
+	m_dcsNumSurfaces = 0;
+	m_dcsNumPolys = 0;
+	m_dcsNumVerts = 0;
+
+	return;
 }
 
-#ifdef UTGLR_INCLUDE_SSE_CODE
-__declspec(naked) static void FASTCALL Buffer3ColoredVerts_SSE(UOpenGLRenderDevice *pRD, FTransTexture** Pts) {
-	static float f255 = 255.0f;
-	__asm {
-		//pRD is in ecx
-		//Pts is in edx
+void UOpenGLRenderDevice::ShutdownDeferredComplexSurfaces(void) {
+	INT i;
 
-		push ebx
-		push esi
-		push edi
-		push ebp
+	//Only shutdown once
+	if (m_dcsSurfaces == NULL) {
+		return;
+	}
+	m_dcsActive = false;
+	m_dcsNumSurfaces = 0;
+	m_dcsNumPolys = 0;
+	m_dcsNumVerts = 0;
 
-		mov eax, [ecx]UOpenGLRenderDevice.BufferedVerts
+	appFree(m_dcsSurfaces);
+	m_dcsSurfaces = NULL;
+	appFree(m_dcsSortedSurfaces);
+	m_dcsSortedSurfaces = NULL;
+	appFree(m_dcsPolyCounts);
+	m_dcsPolyCounts = NULL;
+	appFree(m_dcsVerts);
+	m_dcsVerts = NULL;
+	for (i = 0; i < DCS_MAX_LAYERS; i++) {
+		appFree(m_dcsTexCoords[i]);
+		m_dcsTexCoords[i] = NULL;
+	}
 
-		lea ebx, [eax*8]
-		add ebx, [ecx]UOpenGLRenderDevice.TexCoordArray[0]
+	return;
+}
 
-		lea esi, [eax*4]
-		add esi, [ecx]UOpenGLRenderDevice.SingleColorArray
+void UOpenGLRenderDevice::InitStreamVBOSafe(void) {
+	DWORD bufferSize = STREAM_VBO_NUM_SEGMENTS * STREAM_VBO_SEGMENT_SIZE;
+	INT i;
 
-		lea edi, [eax + eax*2]
-		lea edi, [edi*4]
-		add edi, [ecx]UOpenGLRenderDevice.VertexArray
+	//Only initialize once
+	if (m_streamVBOActive) {
+		return;
+	}
 
-		//BufferedVerts += 3
-		add eax, 3
-		mov [ecx]UOpenGLRenderDevice.BufferedVerts, eax
+	//Persistent mapping needs fences to know when a segment may be rewritten
+	m_streamVBOPersistent = (SUPPORTS_GL_ARB_buffer_storage && SUPPORTS_GL_ARB_sync) ? true : false;
+	m_streamVBOMappedPtr = NULL;
+	m_streamVBOOffset = 0;
+	m_streamVBOSegment = 0;
+	for (i = 0; i < STREAM_VBO_NUM_SEGMENTS; i++) {
+		m_streamVBOFences[i] = NULL;
+	}
 
-		lea eax, [ecx]UOpenGLRenderDevice.TexInfo
-		movss xmm0, [eax]FTexInfo.UMult
-		movss xmm1, [eax]FTexInfo.VMult
-		movss xmm2, f255
+	glGenBuffersARB(1, &m_streamVBO);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, m_streamVBO);
+	if (m_streamVBOPersistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
 
-		//Pts in edx
-		//Get PtsPlus12B
-		lea ebp, [edx + 12]
+		glBufferStorage(GL_ARRAY_BUFFER_ARB, bufferSize, NULL, flags);
+		m_streamVBOMappedPtr = (BYTE *)glMapBufferRange(GL_ARRAY_BUFFER_ARB, 0, bufferSize, flags);
+		if (m_streamVBOMappedPtr == NULL) {
+			//Immutable storage cannot be respecified, so start over with a new buffer
+			glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+			glDeleteBuffersARB(1, &m_streamVBO);
+			glGenBuffersARB(1, &m_streamVBO);
+			glBindBufferARB(GL_ARRAY_BUFFER_ARB, m_streamVBO);
 
-v_loop:
-			mov eax, [edx]
-			add edx, 4
+			m_streamVBOPersistent = false;
+		}
+	}
+	if (!m_streamVBOPersistent) {
+		//Orphaning fallback
+		glBufferDataARB(GL_ARRAY_BUFFER_ARB, bufferSize, NULL, GL_STREAM_DRAW_ARB);
+	}
 
-			movss xmm3, [eax]FTransTexture.U
-			mulss xmm3, xmm0
-			movss [ebx]FGLTexCoord.u, xmm3
-			movss xmm3, [eax]FTransTexture.V
-			mulss xmm3, xmm1
-			movss [ebx]FGLTexCoord.v, xmm3
-			add ebx, TYPE FGLTexCoord
+	//The buffer stays bound while streaming is active
+	//Every array draw points the enabled arrays into it first
+	m_streamVBOActive = true;
 
-			mov ecx, [eax]FOutVector.Point.X
-			mov [edi]FGLVertex.x, ecx
-			mov ecx, [eax]FOutVector.Point.Y
-			mov [edi]FGLVertex.y, ecx
-			mov ecx, [eax]FOutVector.Point.Z
-			mov [edi]FGLVertex.z, ecx
-			add edi, TYPE FGLVertex
+	debugf(NAME_Init, TEXT("Streaming VBO: %s"), m_streamVBOPersistent ? TEXT("persistent") : TEXT("orphaning"));
+	if (DebugBit(DEBUG_BIT_BASIC)) dbgPrintf("utglr: Streaming VBO persistent = %u\n", m_streamVBOPersistent ? 1 : 0);
 
-			movss xmm3, [eax]FTransSample.Light + 0
-			mulss xmm3, xmm2
-			movss xmm4, [eax]FTransSample.Light + 4
-			mulss xmm4, xmm2
-			movss xmm5, [eax]FTransSample.Light + 8
-			mulss xmm5, xmm2
-			cvtss2si eax, xmm3
-			and eax, 255
-			cvtss2si ecx, xmm4
-			and ecx, 255
-			shl ecx, 8
-			or eax, ecx
-			cvtss2si ecx, xmm5
-			shl ecx, 16
-			or ecx, 0xFF000000
-			or eax, ecx
-			mov [esi]FGLSingleColor.color, eax
-			add esi, TYPE FGLSingleColor
+	return;
+}
 
-			cmp edx, ebp
-			jne v_loop
+void UOpenGLRenderDevice::ShutdownStreamVBO(void) {
+	INT i;
 
-		pop ebp
-		pop edi
-		pop esi
-		pop ebx
+	//Only shutdown once
+	if (!m_streamVBOActive) {
+		return;
+	}
+	m_streamVBOActive = false;
 
-		ret
+	for (i = 0; i < STREAM_VBO_NUM_SEGMENTS; i++) {
+		if (m_streamVBOFences[i] != NULL) {
+			glDeleteSync(m_streamVBOFences[i]);
+			m_streamVBOFences[i] = NULL;
+		}
+	}
+	if (m_streamVBOMappedPtr != NULL) {
+		glUnmapBufferARB(GL_ARRAY_BUFFER_ARB);
+		m_streamVBOMappedPtr = NULL;
 	}
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+	glDeleteBuffersARB(1, &m_streamVBO);
+	m_streamVBO = 0;
+
+	return;
 }
 
-__declspec(naked) static void FASTCALL Buffer3ColoredVerts_SSE2(UOpenGLRenderDevice *pRD, FTransTexture** Pts) {
-	static __m128 fColorMul = { 255.0f, 255.0f, 255.0f, 0.0f };
-	static DWORD alphaOr = 0xFF000000;
-	__asm {
-		//pRD is in ecx
-		//Pts is in edx
 
-		push ebx
-		push esi
-		push edi
-		push ebp
+void UOpenGLRenderDevice::InitTextureConversionSafe(void) {
+	guard(UOpenGLRenderDevice::InitTextureConversion);
+	INT numThreads;
 
-		mov eax, [ecx]UOpenGLRenderDevice.BufferedVerts
+	//Only initialize once
+	if (m_texConvertQueue) {
+		return;
+	}
 
-		lea ebx, [eax*8]
-		add ebx, [ecx]UOpenGLRenderDevice.TexCoordArray[0]
+	//Leave a processor for the game and render thread by default
+	numThreads = AsyncTextureThreads;
+	if (numThreads <= 0) {
+		numThreads = Max(1, FThread::NumProcessors() - 1);
+	}
+	m_texConvertQueue = new FGLTexConvertQueue(numThreads);
 
-		lea esi, [eax*4]
-		add esi, [ecx]UOpenGLRenderDevice.SingleColorArray
+	//Converted mipmaps are uploaded from a ring of pixel unpack buffers when available
+	m_texPBOActive = (SUPPORTS_GL_ARB_pixel_buffer_object && SUPPORTS_GL_ARB_vertex_buffer_object && SUPPORTS_GL_ARB_map_buffer_range) ? true : false;
+	if (m_texPBOActive) {
+		glGenBuffersARB(TEX_PBO_RING_SIZE, m_texPBOs);
+	}
+	m_texPBOIndex = 0;
 
-		lea edi, [eax + eax*2]
-		lea edi, [edi*4]
-		add edi, [ecx]UOpenGLRenderDevice.VertexArray
+	debugf(NAME_Init, TEXT("Async textures: %i threads, %s uploads"), m_texConvertQueue->Pool.NumThreads(), m_texPBOActive ? TEXT("PBO") : TEXT("client memory"));
+	if (DebugBit(DEBUG_BIT_BASIC)) dbgPrintf("utglr: Async texture threads = %i\n", m_texConvertQueue->Pool.NumThreads());
 
-		//BufferedVerts += 3
-		add eax, 3
-		mov [ecx]UOpenGLRenderDevice.BufferedVerts, eax
+	unguard;
+}
 
-		lea eax, [ecx]UOpenGLRenderDevice.TexInfo
-		movss xmm0, [eax]FTexInfo.UMult
-		movss xmm1, [eax]FTexInfo.VMult
-		movaps xmm2, fColorMul
-		movd xmm3, alphaOr
+void UOpenGLRenderDevice::ShutdownTextureConversion(void) {
+	guard(UOpenGLRenderDevice::ShutdownTextureConversion);
 
-		//Pts in edx
-		//Get PtsPlus12B
-		lea ebp, [edx + 12]
+	//Only shutdown once
+	if (!m_texConvertQueue) {
+		return;
+	}
 
-v_loop:
-			mov eax, [edx]
-			add edx, 4
+	//Textures still waiting get their converted mipmaps now
+	FinishTextureConversions(true);
 
-			movss xmm4, [eax]FTransTexture.U
-			mulss xmm4, xmm0
-			movss [ebx]FGLTexCoord.u, xmm4
-			movss xmm4, [eax]FTransTexture.V
-			mulss xmm4, xmm1
-			movss [ebx]FGLTexCoord.v, xmm4
-			add ebx, TYPE FGLTexCoord
+	delete m_texConvertQueue;
+	m_texConvertQueue = NULL;
 
-			mov ecx, [eax]FOutVector.Point.X
-			mov [edi]FGLVertex.x, ecx
-			mov ecx, [eax]FOutVector.Point.Y
-			mov [edi]FGLVertex.y, ecx
-			mov ecx, [eax]FOutVector.Point.Z
-			mov [edi]FGLVertex.z, ecx
-			add edi, TYPE FGLVertex
+	if (m_texPBOActive) {
+		glDeleteBuffersARB(TEX_PBO_RING_SIZE, m_texPBOs);
+		m_texPBOActive = false;
+	}
 
-			movups xmm4, [eax]FTransSample.Light
-			mulps xmm4, xmm2
-			cvtps2dq xmm4, xmm4
-			packssdw xmm4, xmm4
-			packuswb xmm4, xmm4
-			por xmm4, xmm3
-			movd [esi]FGLSingleColor.color, xmm4
-			add esi, TYPE FGLSingleColor
+	unguard;
+}
 
-			cmp edx, ebp
-			jne v_loop
 
-		pop ebp
-		pop edi
-		pop esi
-		pop ebx
+void UOpenGLRenderDevice::InitTexDiskCacheSafe(void) {
+	guard(UOpenGLRenderDevice::InitTexDiskCache);
 
-		ret
+	//Only initialize once
+	if (m_texDiskCacheActive) {
+		return;
+	}
+
+	m_texDiskCachePath = GSys->CachePath * TEXT("OpenGLDrv");
+	if (!GFileManager->MakeDirectory(*m_texDiskCachePath, 1)) {
+		debugf(TEXT("Texture disk cache: cannot create %s"), *m_texDiskCachePath);
+		UseTextureDiskCache = 0;
+		PL_UseTextureDiskCache = 0;
+		return;
 	}
+	m_texDiskCacheActive = true;
+
+	debugf(NAME_Init, TEXT("Texture disk cache: %s"), *m_texDiskCachePath);
+
+	unguard;
 }
-#endif
 
-static void FASTCALL Buffer3FoggedVerts(UOpenGLRenderDevice *pRD, FTransTexture** Pts) {
+void UOpenGLRenderDevice::ShutdownTexDiskCache(void) {
+	//Entries are complete files, so there is nothing to write back
+	m_texDiskCacheActive = false;
+}
+
+//Creates a framebuffer object with color and depth renderbuffers and leaves it bound
+//Returns false and leaves rendering to the window if it cannot be created
+bool UOpenGLRenderDevice::InitOffscreenSafe(INT SizeX, INT SizeY) {
+	guard(UOpenGLRenderDevice::InitOffscreen);
+	GLenum status;
+
+	//Only initialize once
+	if (m_offscreenActive) {
+		return true;
+	}
+
+	if (!SUPPORTS_GL_ARB_framebuffer_object) {
+		debugf(TEXT("Offscreen: ARB_framebuffer_object not supported, rendering to the window"));
+		return false;
+	}
+
+	glGenRenderbuffers(1, &m_offscreenColorRB);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_offscreenColorRB);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SizeX, SizeY);
+
+	glGenRenderbuffers(1, &m_offscreenDepthRB);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_offscreenDepthRB);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SizeX, SizeY);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &m_offscreenFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_offscreenFBO);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_offscreenColorRB);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_offscreenDepthRB);
+
+	status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	m_offscreenActive = true;
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		debugf(TEXT("Offscreen: framebuffer incomplete (0x%X), rendering to the window"), status);
+		ShutdownOffscreen();
+		return false;
+	}
+
+	//Depth precision now comes from the depth renderbuffer
+	m_numDepthBits = 24;
+
+	debugf(NAME_Init, TEXT("Offscreen: rendering to %ix%i framebuffer"), SizeX, SizeY);
+
+	return true;
+	unguard;
+}
+
+void UOpenGLRenderDevice::ShutdownOffscreen(void) {
+	if (!m_offscreenActive) {
+		return;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &m_offscreenFBO);
+	glDeleteRenderbuffers(1, &m_offscreenColorRB);
+	glDeleteRenderbuffers(1, &m_offscreenDepthRB);
+	m_offscreenFBO = 0;
+	m_offscreenColorRB = 0;
+	m_offscreenDepthRB = 0;
+
+	m_offscreenActive = false;
+}
+
+//Points the vertex arrays back at client memory
+void UOpenGLRenderDevice::SetClientArrayPointers(void) {
+	glVertexPointer(3, GL_FLOAT, sizeof(FGLVertex), &VertexArray[0].x);
+	if (m_glslCurrent != 0) {
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(FGLVertex), &VertexArray[0].x);
+	}
+	glNormalPointer(GL_FLOAT, sizeof(FGLNormal), &NormalArray[0].x);
+
+	if (UseMultiTexture) {
+		INT texUnit;
+
+		for (texUnit = 0; texUnit < TMUnits; texUnit++) {
+			glClientActiveTextureARB(GL_TEXTURE0_ARB + texUnit);
+			glTexCoordPointer(2, GL_FLOAT, sizeof(FGLTexCoord), &TexCoordArray[texUnit][0].u);
+		}
+		glClientActiveTextureARB(GL_TEXTURE0_ARB);
+	}
+	else {
+		glTexCoordPointer(2, GL_FLOAT, sizeof(FGLTexCoord), &TexCoordArray[0][0].u);
+	}
+
+	if (m_currentColorFlags & CF_DUAL_COLOR_ARRAY) {
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(FGLDoubleColor), &DoubleColorArray[0].color);
+	}
+	else {
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(FGLSingleColor), &SingleColorArray[0].color);
+	}
+	if (UseVertexSpecular) {
+		glSecondaryColorPointerEXT(3, GL_UNSIGNED_BYTE, sizeof(FGLDoubleColor), &DoubleColorArray[0].specular);
+	}
+
+	return;
+}
+
+//Returns a write pointer for size bytes of the streaming VBO, or NULL if it could not be mapped
+//Allocations never straddle segments, so a segment is fenced once all draws using it are issued
+BYTE * UOpenGLRenderDevice::StreamVBOReserve(DWORD size, DWORD &bufferOffset) {
+	DWORD offset = m_streamVBOOffset;
+
+	size = (size + (STREAM_VBO_ALIGN - 1)) & ~(STREAM_VBO_ALIGN - 1);
+
+	//Move to the start of the next segment if this one is full
+	if ((offset + size) > ((m_streamVBOSegment + 1) * STREAM_VBO_SEGMENT_SIZE)) {
+		DWORD segment = m_streamVBOSegment;
+
+		if (m_streamVBOPersistent) {
+			//Fence the segment just filled
+			m_streamVBOFences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+		segment = (segment + 1) % STREAM_VBO_NUM_SEGMENTS;
+		m_streamVBOSegment = segment;
+		offset = segment * STREAM_VBO_SEGMENT_SIZE;
+
+		if (m_streamVBOPersistent) {
+			//Wait for the GPU to finish with the next segment
+			GLsync fence = m_streamVBOFences[segment];
+			if (fence != NULL) {
+				GLenum waitRet = glClientWaitSync(fence, 0, 0);
+				if (waitRet == GL_TIMEOUT_EXPIRED) {
+					m_streamVBOStallCount++;
+					do {
+						waitRet = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+					} while (waitRet == GL_TIMEOUT_EXPIRED);
+				}
+				glDeleteSync(fence);
+				m_streamVBOFences[segment] = NULL;
+			}
+		}
+		else if (segment == 0) {
+			//Orphan the buffer on wrap so the driver can hand out fresh storage
+			glBufferDataARB(GL_ARRAY_BUFFER_ARB, STREAM_VBO_NUM_SEGMENTS * STREAM_VBO_SEGMENT_SIZE, NULL, GL_STREAM_DRAW_ARB);
+		}
+	}
+
+	m_streamVBOOffset = offset + size;
+	m_streamVBOBytes += size;
+	bufferOffset = offset;
+
+	if (m_streamVBOPersistent) {
+		return m_streamVBOMappedPtr + offset;
+	}
+
+	//Ranges are not reused until the buffer is orphaned again, so no synchronization is needed
+	return (BYTE *)glMapBufferRange(GL_ARRAY_BUFFER_ARB, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+static void FASTCALL StreamCopyArray(BYTE *pDst, const void *pSrc, DWORD stride, INT firstVert, INT numVerts, const GLuint *pIndices) {
+	if (pIndices == NULL) {
+		appMemcpy(pDst, (const BYTE *)pSrc + (firstVert * stride), numVerts * stride);
+		return;
+	}
+
+	//Gather indexed vertices
+	//All vertex array strides are a multiple of 4 bytes
+	DWORD numDwords = stride / sizeof(DWORD);
+	DWORD *pDstDword = (DWORD *)pDst;
+	for (INT i = 0; i < numVerts; i++) {
+		const DWORD *pSrcDword = (const DWORD *)((const BYTE *)pSrc + (pIndices[i] * stride));
+		for (DWORD j = 0; j < numDwords; j++) {
+			*pDstDword++ = pSrcDword[j];
+		}
+	}
+}
+
+static inline DWORD StreamArraySize(DWORD stride, INT numVerts) {
+	return ((stride * numVerts) + (UOpenGLRenderDevice::STREAM_VBO_ALIGN - 1)) & ~(UOpenGLRenderDevice::STREAM_VBO_ALIGN - 1);
+}
+
+//Copies numVerts vertices of every enabled array into the streaming VBO and points the arrays at the copies
+//Vertices start at firstVert, or are gathered through pIndices if it is not NULL
+//The copies always start at vertex 0
+//Returns false and falls back to client memory vertex arrays if the VBO could not be mapped
+bool UOpenGLRenderDevice::StreamVertexArraysNoCheck(INT firstVert, INT numVerts, const GLuint *pIndices, BYTE colorFlags) {
+	DWORD colorStride = 0;
+	DWORD size;
+	DWORD texUnit;
+	DWORD texBit;
+
+	if (colorFlags & CF_DUAL_COLOR_ARRAY) {
+		colorStride = sizeof(FGLDoubleColor);
+	}
+	else if (colorFlags & CF_COLOR_ARRAY) {
+		colorStride = sizeof(FGLSingleColor);
+	}
+
+	//Total size of the enabled arrays
+	//A draw never exceeds VERTEX_ARRAY_SIZE vertices, so this always fits in one segment
+	size = StreamArraySize(sizeof(FGLVertex), numVerts);
+	if (colorFlags & CF_NORMAL_ARRAY) {
+		size += StreamArraySize(sizeof(FGLNormal), numVerts);
+	}
+	size += StreamArraySize(colorStride, numVerts);
+	for (texBit = 1; texBit <= m_clientTexEnableBits; texBit <<= 1) {
+		if (texBit & m_clientTexEnableBits) {
+			size += StreamArraySize(sizeof(FGLTexCoord), numVerts);
+		}
+	}
+
+	DWORD bufferOffset;
+	BYTE *pDst = StreamVBOReserve(size, bufferOffset);
+	if (pDst == NULL) {
+		m_streamVBOMapFailed = true;
+		UseStreamingVBO = 0;
+		PL_UseStreamingVBO = 0;
+		ShutdownStreamVBO();
+		SetClientArrayPointers();
+		return false;
+	}
+	BYTE *pDstStart = pDst;
+
+	#define UTGLR_STREAM_OFFSET(_pDst) ((const GLvoid *)(uintptr_t)(bufferOffset + (DWORD)((_pDst) - pDstStart)))
+
+	StreamCopyArray(pDst, VertexArray, sizeof(FGLVertex), firstVert, numVerts, pIndices);
+	glVertexPointer(3, GL_FLOAT, sizeof(FGLVertex), UTGLR_STREAM_OFFSET(pDst));
+	if (m_glslCurrent != 0) {
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(FGLVertex), UTGLR_STREAM_OFFSET(pDst));
+	}
+	pDst += StreamArraySize(sizeof(FGLVertex), numVerts);
+
+	if (colorFlags & CF_NORMAL_ARRAY) {
+		StreamCopyArray(pDst, NormalArray, sizeof(FGLNormal), firstVert, numVerts, pIndices);
+		glNormalPointer(GL_FLOAT, sizeof(FGLNormal), UTGLR_STREAM_OFFSET(pDst));
+		pDst += StreamArraySize(sizeof(FGLNormal), numVerts);
+	}
+
+	if (colorStride != 0) {
+		StreamCopyArray(pDst, SingleColorArray, colorStride, firstVert, numVerts, pIndices);
+		glColorPointer(4, GL_UNSIGNED_BYTE, colorStride, UTGLR_STREAM_OFFSET(pDst));
+		if (colorFlags & CF_DUAL_COLOR_ARRAY) {
+			glSecondaryColorPointerEXT(3, GL_UNSIGNED_BYTE, sizeof(FGLDoubleColor), (GLvoid *)UTGLR_STREAM_OFFSET(pDst + sizeof(DWORD)));
+		}
+		pDst += StreamArraySize(colorStride, numVerts);
+	}
+
+	for (texUnit = 0, texBit = 1; texBit <= m_clientTexEnableBits; texUnit++, texBit <<= 1) {
+		if (texBit & m_clientTexEnableBits) {
+			StreamCopyArray(pDst, TexCoordArray[texUnit], sizeof(FGLTexCoord), firstVert, numVerts, pIndices);
+			if (SUPPORTS_GL_ARB_multitexture) {
+				glClientActiveTextureARB(GL_TEXTURE0_ARB + texUnit);
+			}
+			glTexCoordPointer(2, GL_FLOAT, sizeof(FGLTexCoord), UTGLR_STREAM_OFFSET(pDst));
+			pDst += StreamArraySize(sizeof(FGLTexCoord), numVerts);
+		}
+	}
+	if (SUPPORTS_GL_ARB_multitexture && (m_clientTexEnableBits > 0x1)) {
+		glClientActiveTextureARB(GL_TEXTURE0_ARB);
+	}
+
+	#undef UTGLR_STREAM_OFFSET
+
+	if (!m_streamVBOPersistent) {
+		glUnmapBufferARB(GL_ARRAY_BUFFER_ARB);
+	}
+
+	return true;
+}
+
+
+static void FASTCALL Buffer3Verts(UOpenGLRenderDevice *pRD, FTransTexture** Pts) {
 	FGLTexCoord *pTexCoordArray = &pRD->TexCoordArray[0][pRD->BufferedVerts];
+	FGLNormal *pNormalArray = &pRD->NormalArray[pRD->BufferedVerts];
 	FGLVertex *pVertexArray = &pRD->VertexArray[pRD->BufferedVerts];
+	FGLSingleColor *pSingleColorArray = &pRD->SingleColorArray[pRD->BufferedVerts];
 	FGLDoubleColor *pDoubleColorArray = &pRD->DoubleColorArray[pRD->BufferedVerts];
 	pRD->BufferedVerts += 3;
 	for (INT i = 0; i < 3; i++) {
@@ -1277,22 +1817,80 @@ static void FASTCALL Buffer3FoggedVerts(UOpenGLRenderDevice *pRD, FTransTexture*
 		pTexCoordArray->v = P->V * pRD->TexInfo[0].VMult;
 		pTexCoordArray++;
 
+		if (pRD->m_requestedColorFlags & UOpenGLRenderDevice::CF_NORMAL_ARRAY) {
+			pNormalArray->x = P->Normal.X;
+			pNormalArray->y = P->Normal.Y;
+			pNormalArray->z = P->Normal.Z;
+			pNormalArray++;
+		}
+
 		pVertexArray->x = P->Point.X;
 		pVertexArray->y = P->Point.Y;
 		pVertexArray->z = P->Point.Z;
 		pVertexArray++;
 
-		FLOAT f255_Times_One_Minus_FogW = 255.0f * (1.0f - P->Fog.W);
-		pDoubleColorArray->color = UOpenGLRenderDevice::FPlaneTo_RGBScaled_A255(&P->Light, f255_Times_One_Minus_FogW);
-		pDoubleColorArray->specular = UOpenGLRenderDevice::FPlaneTo_RGB_A0(&P->Fog);
-		pDoubleColorArray++;
+		if (pRD->m_requestedColorFlags & UOpenGLRenderDevice::CF_DUAL_COLOR_ARRAY) {
+			FLOAT f255_Times_One_Minus_FogW = 255.0f * (1.0f - P->Fog.W);
+			pDoubleColorArray->color = UOpenGLRenderDevice::FPlaneTo_RGBScaled_A255(&P->Light, f255_Times_One_Minus_FogW);
+			pDoubleColorArray->specular = UOpenGLRenderDevice::FPlaneTo_RGB_A0(&P->Fog);
+			pDoubleColorArray++;
+		}
+		else if (pRD->m_requestedColorFlags & UOpenGLRenderDevice::CF_COLOR_ARRAY) {
+#ifdef UTGLR_RUNE_BUILD
+			pSingleColorArray->color = UOpenGLRenderDevice::FPlaneTo_RGB_Aub(&P->Light, pRD->m_gpAlpha);
+#else
+			pSingleColorArray->color = UOpenGLRenderDevice::FPlaneTo_RGB_A255(&P->Light);
+#endif
+			pSingleColorArray++;
+		}
 	}
 }
 
-#ifdef UTGLR_INCLUDE_SSE_CODE
-__declspec(naked) static void FASTCALL Buffer3FoggedVerts_SSE(UOpenGLRenderDevice *pRD, FTransTexture** Pts) {
+static void FASTCALL Buffer3BasicVerts(UOpenGLRenderDevice *pRD, FTransTexture** Pts) {
+	FGLTexCoord *pTexCoordArray = &pRD->TexCoordArray[0][pRD->BufferedVerts];
+	FGLVertex *pVertexArray = &pRD->VertexArray[pRD->BufferedVerts];
+	pRD->BufferedVerts += 3;
+	FLOAT UMult = pRD->TexInfo[0].UMult;
+	FLOAT VMult = pRD->TexInfo[0].VMult;
+	for (INT i = 0; i < 3; i++) {
+		const FTransTexture* P = *Pts++;
+
+		pTexCoordArray->u = P->U * UMult;
+		pTexCoordArray->v = P->V * VMult;
+		pTexCoordArray++;
+
+		pVertexArray->x = P->Point.X;
+		pVertexArray->y = P->Point.Y;
+		pVertexArray->z = P->Point.Z;
+		pVertexArray++;
+	}
+}
+
+static void FASTCALL Buffer3ColoredVerts(UOpenGLRenderDevice *pRD, FTransTexture** Pts) {
+	FGLTexCoord *pTexCoordArray = &pRD->TexCoordArray[0][pRD->BufferedVerts];
+	FGLVertex *pVertexArray = &pRD->VertexArray[pRD->BufferedVerts];
+	FGLSingleColor *pSingleColorArray = &pRD->SingleColorArray[pRD->BufferedVerts];
+	pRD->BufferedVerts += 3;
+	for (INT i = 0; i < 3; i++) {
+		const FTransTexture* P = *Pts++;
+
+		pTexCoordArray->u = P->U * pRD->TexInfo[0].UMult;
+		pTexCoordArray->v = P->V * pRD->TexInfo[0].VMult;
+		pTexCoordArray++;
+
+		pVertexArray->x = P->Point.X;
+		pVertexArray->y = P->Point.Y;
+		pVertexArray->z = P->Point.Z;
+		pVertexArray++;
+
+		pSingleColorArray->color = UOpenGLRenderDevice::FPlaneTo_RGB_A255(&P->Light);
+		pSingleColorArray++;
+	}
+}
+
+#if defined UTGLR_INCLUDE_SSE_CODE && defined UTGLR_USE_ASM_CODE
+__declspec(naked) static void FASTCALL Buffer3ColoredVerts_SSE(UOpenGLRenderDevice *pRD, FTransTexture** Pts) {
 	static float f255 = 255.0f;
-	static float f1 = 1.0f;
 	__asm {
 		//pRD is in ecx
 		//Pts is in edx
@@ -1301,15 +1899,14 @@ __declspec(naked) static void FASTCALL Buffer3FoggedVerts_SSE(UOpenGLRenderDevic
 		push esi
 		push edi
 		push ebp
-		sub esp, 4
 
 		mov eax, [ecx]UOpenGLRenderDevice.BufferedVerts
 
 		lea ebx, [eax*8]
 		add ebx, [ecx]UOpenGLRenderDevice.TexCoordArray[0]
 
-		lea esi, [eax*8]
-		add esi, [ecx]UOpenGLRenderDevice.DoubleColorArray
+		lea esi, [eax*4]
+		add esi, [ecx]UOpenGLRenderDevice.SingleColorArray
 
 		lea edi, [eax + eax*2]
 		lea edi, [edi*4]
@@ -1340,12 +1937,6 @@ v_loop:
 			movss [ebx]FGLTexCoord.v, xmm3
 			add ebx, TYPE FGLTexCoord
 
-			mov [esp], ebx
-
-			movss xmm6, f1
-			subss xmm6, [eax]FTransSample.Fog + 12
-			mulss xmm6, xmm2
-
 			mov ecx, [eax]FOutVector.Point.X
 			mov [edi]FGLVertex.x, ecx
 			mov ecx, [eax]FOutVector.Point.Y
@@ -1355,30 +1946,10 @@ v_loop:
 			add edi, TYPE FGLVertex
 
 			movss xmm3, [eax]FTransSample.Light + 0
-			mulss xmm3, xmm6
-			movss xmm4, [eax]FTransSample.Light + 4
-			mulss xmm4, xmm6
-			movss xmm5, [eax]FTransSample.Light + 8
-			mulss xmm5, xmm6
-			cvtss2si ebx, xmm3
-			and ebx, 255
-			cvtss2si ecx, xmm4
-			and ecx, 255
-			shl ecx, 8
-			or ebx, ecx
-			cvtss2si ecx, xmm5
-			shl ecx, 16
-			or ecx, 0xFF000000
-			or ebx, ecx
-			mov [esi]FGLDoubleColor.color, ebx
-
-			mov ebx, [esp]
-
-			movss xmm3, [eax]FTransSample.Fog + 0
 			mulss xmm3, xmm2
-			movss xmm4, [eax]FTransSample.Fog + 4
+			movss xmm4, [eax]FTransSample.Light + 4
 			mulss xmm4, xmm2
-			movss xmm5, [eax]FTransSample.Fog + 8
+			movss xmm5, [eax]FTransSample.Light + 8
 			mulss xmm5, xmm2
 			cvtss2si eax, xmm3
 			and eax, 255
@@ -1387,16 +1958,15 @@ v_loop:
 			shl ecx, 8
 			or eax, ecx
 			cvtss2si ecx, xmm5
-			and ecx, 255
 			shl ecx, 16
+			or ecx, 0xFF000000
 			or eax, ecx
-			mov [esi]FGLDoubleColor.specular, eax
-			add esi, TYPE FGLDoubleColor
+			mov [esi]FGLSingleColor.color, eax
+			add esi, TYPE FGLSingleColor
 
 			cmp edx, ebp
 			jne v_loop
 
-		add esp, 4
 		pop ebp
 		pop edi
 		pop esi
@@ -1405,19 +1975,112 @@ v_loop:
 		ret
 	}
 }
+#endif
 
-__declspec(naked) static void FASTCALL Buffer3FoggedVerts_SSE2(UOpenGLRenderDevice *pRD, FTransTexture** Pts) {
-	static __m128 fColorMul = { 255.0f, 255.0f, 255.0f, 0.0f };
-	static DWORD alphaOr = 0xFF000000;
-	static float f1 = 1.0f;
-	__asm {
-		//pRD is in ecx
-		//Pts is in edx
+#ifdef UTGLR_INCLUDE_SSE_CODE
+//Converts a polygon point for the colored SSE2 buffer verts proc
+static inline void ConvertColoredVert_SSE2(const FTransTexture *P, const __m128 &uvMult, const __m128 &colorMul, const __m128i &alphaOr,
+	FGLTexCoord &TexCoord, FGLVertex &Vertex, FGLSingleColor &SingleColor)
+{
+	__m128 uv;
+	__m128i color;
+
+	uv = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)&P->U);
+	_mm_storel_pi((__m64 *)&TexCoord, _mm_mul_ps(uv, uvMult));
+
+	Vertex.x = P->Point.X;
+	Vertex.y = P->Point.Y;
+	Vertex.z = P->Point.Z;
+
+	color = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(&P->Light.X), colorMul));
+	color = _mm_packs_epi32(color, color);
+	color = _mm_packus_epi16(color, color);
+	SingleColor.color = _mm_cvtsi128_si32(_mm_or_si128(color, alphaOr));
+}
+
+//Buffers all triangles of a polygon, which has more than 3 points if it was clipped
+//Each point is converted once, then written to every triangle of the fan that uses it
+static void FASTCALL BufferColoredPolyVerts_SSE2(UOpenGLRenderDevice *pRD, FTransTexture** Pts, INT NumPts) {
+	static __m128 fColorMul = { 255.0f, 255.0f, 255.0f, 0.0f };
+	FGLTexCoord *pTexCoordArray = &pRD->TexCoordArray[0][pRD->BufferedVerts];
+	FGLVertex *pVertexArray = &pRD->VertexArray[pRD->BufferedVerts];
+	FGLSingleColor *pSingleColorArray = &pRD->SingleColorArray[pRD->BufferedVerts];
+	pRD->BufferedVerts += (NumPts - 2) * 3;
+
+	__m128 uvMult = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)&pRD->TexInfo[0].UMult);
+	__m128 colorMul = fColorMul;
+	__m128i alphaOr = _mm_cvtsi32_si128(0xFF000000);
+
+	FGLTexCoord firstTexCoord, prevTexCoord, curTexCoord;
+	FGLVertex firstVertex, prevVertex, curVertex;
+	FGLSingleColor firstColor, prevColor, curColor;
+
+	ConvertColoredVert_SSE2(Pts[0], uvMult, colorMul, alphaOr, firstTexCoord, firstVertex, firstColor);
+	ConvertColoredVert_SSE2(Pts[1], uvMult, colorMul, alphaOr, prevTexCoord, prevVertex, prevColor);
+
+	INT i = 2;
+	do {
+		ConvertColoredVert_SSE2(Pts[i], uvMult, colorMul, alphaOr, curTexCoord, curVertex, curColor);
+
+		pTexCoordArray[0] = firstTexCoord;
+		pTexCoordArray[1] = prevTexCoord;
+		pTexCoordArray[2] = curTexCoord;
+		pTexCoordArray += 3;
+
+		pVertexArray[0] = firstVertex;
+		pVertexArray[1] = prevVertex;
+		pVertexArray[2] = curVertex;
+		pVertexArray += 3;
+
+		pSingleColorArray[0] = firstColor;
+		pSingleColorArray[1] = prevColor;
+		pSingleColorArray[2] = curColor;
+		pSingleColorArray += 3;
+
+		prevTexCoord = curTexCoord;
+		prevVertex = curVertex;
+		prevColor = curColor;
+	} while (++i < NumPts);
+}
+#endif //UTGLR_INCLUDE_SSE_CODE
+
+static void FASTCALL Buffer3FoggedVerts(UOpenGLRenderDevice *pRD, FTransTexture** Pts) {
+	FGLTexCoord *pTexCoordArray = &pRD->TexCoordArray[0][pRD->BufferedVerts];
+	FGLVertex *pVertexArray = &pRD->VertexArray[pRD->BufferedVerts];
+	FGLDoubleColor *pDoubleColorArray = &pRD->DoubleColorArray[pRD->BufferedVerts];
+	pRD->BufferedVerts += 3;
+	for (INT i = 0; i < 3; i++) {
+		const FTransTexture* P = *Pts++;
+
+		pTexCoordArray->u = P->U * pRD->TexInfo[0].UMult;
+		pTexCoordArray->v = P->V * pRD->TexInfo[0].VMult;
+		pTexCoordArray++;
+
+		pVertexArray->x = P->Point.X;
+		pVertexArray->y = P->Point.Y;
+		pVertexArray->z = P->Point.Z;
+		pVertexArray++;
+
+		FLOAT f255_Times_One_Minus_FogW = 255.0f * (1.0f - P->Fog.W);
+		pDoubleColorArray->color = UOpenGLRenderDevice::FPlaneTo_RGBScaled_A255(&P->Light, f255_Times_One_Minus_FogW);
+		pDoubleColorArray->specular = UOpenGLRenderDevice::FPlaneTo_RGB_A0(&P->Fog);
+		pDoubleColorArray++;
+	}
+}
+
+#if defined UTGLR_INCLUDE_SSE_CODE && defined UTGLR_USE_ASM_CODE
+__declspec(naked) static void FASTCALL Buffer3FoggedVerts_SSE(UOpenGLRenderDevice *pRD, FTransTexture** Pts) {
+	static float f255 = 255.0f;
+	static float f1 = 1.0f;
+	__asm {
+		//pRD is in ecx
+		//Pts is in edx
 
 		push ebx
 		push esi
 		push edi
 		push ebp
+		sub esp, 4
 
 		mov eax, [ecx]UOpenGLRenderDevice.BufferedVerts
 
@@ -1438,8 +2101,7 @@ __declspec(naked) static void FASTCALL Buffer3FoggedVerts_SSE2(UOpenGLRenderDevi
 		lea eax, [ecx]UOpenGLRenderDevice.TexInfo
 		movss xmm0, [eax]FTexInfo.UMult
 		movss xmm1, [eax]FTexInfo.VMult
-		movaps xmm2, fColorMul
-		movd xmm3, alphaOr
+		movss xmm2, f255
 
 		//Pts in edx
 		//Get PtsPlus12B
@@ -1449,18 +2111,19 @@ v_loop:
 			mov eax, [edx]
 			add edx, 4
 
-			movss xmm4, [eax]FTransTexture.U
-			mulss xmm4, xmm0
-			movss [ebx]FGLTexCoord.u, xmm4
-			movss xmm4, [eax]FTransTexture.V
-			mulss xmm4, xmm1
-			movss [ebx]FGLTexCoord.v, xmm4
+			movss xmm3, [eax]FTransTexture.U
+			mulss xmm3, xmm0
+			movss [ebx]FGLTexCoord.u, xmm3
+			movss xmm3, [eax]FTransTexture.V
+			mulss xmm3, xmm1
+			movss [ebx]FGLTexCoord.v, xmm3
 			add ebx, TYPE FGLTexCoord
 
+			mov [esp], ebx
+
 			movss xmm6, f1
 			subss xmm6, [eax]FTransSample.Fog + 12
 			mulss xmm6, xmm2
-			shufps xmm6, xmm6, 0x00
 
 			mov ecx, [eax]FOutVector.Point.X
 			mov [edi]FGLVertex.x, ecx
@@ -1470,22 +2133,49 @@ v_loop:
 			mov [edi]FGLVertex.z, ecx
 			add edi, TYPE FGLVertex
 
-			movups xmm4, [eax]FTransSample.Light
-			mulps xmm4, xmm6
-			cvtps2dq xmm4, xmm4
-
-			movups xmm5, [eax]FTransSample.Fog
-			mulps xmm5, xmm2
-			cvtps2dq xmm5, xmm5
-			packssdw xmm4, xmm5
-			packuswb xmm4, xmm4
-			por xmm4, xmm3
-			movq QWORD PTR ([esi]FGLDoubleColor.color), xmm4
+			movss xmm3, [eax]FTransSample.Light + 0
+			mulss xmm3, xmm6
+			movss xmm4, [eax]FTransSample.Light + 4
+			mulss xmm4, xmm6
+			movss xmm5, [eax]FTransSample.Light + 8
+			mulss xmm5, xmm6
+			cvtss2si ebx, xmm3
+			and ebx, 255
+			cvtss2si ecx, xmm4
+			and ecx, 255
+			shl ecx, 8
+			or ebx, ecx
+			cvtss2si ecx, xmm5
+			shl ecx, 16
+			or ecx, 0xFF000000
+			or ebx, ecx
+			mov [esi]FGLDoubleColor.color, ebx
+
+			mov ebx, [esp]
+
+			movss xmm3, [eax]FTransSample.Fog + 0
+			mulss xmm3, xmm2
+			movss xmm4, [eax]FTransSample.Fog + 4
+			mulss xmm4, xmm2
+			movss xmm5, [eax]FTransSample.Fog + 8
+			mulss xmm5, xmm2
+			cvtss2si eax, xmm3
+			and eax, 255
+			cvtss2si ecx, xmm4
+			and ecx, 255
+			shl ecx, 8
+			or eax, ecx
+			cvtss2si ecx, xmm5
+			and ecx, 255
+			shl ecx, 16
+			or eax, ecx
+			mov [esi]FGLDoubleColor.specular, eax
 			add esi, TYPE FGLDoubleColor
 
 			cmp edx, ebp
 			jne v_loop
 
+		add esp, 4
 		pop ebp
 		pop edi
 		pop esi
@@ -1496,6 +2186,78 @@ v_loop:
 }
 #endif
 
+#ifdef UTGLR_INCLUDE_SSE_CODE
+//Converts a polygon point for the fogged SSE2 buffer verts proc
+static inline void ConvertFoggedVert_SSE2(const FTransTexture *P, const __m128 &uvMult, const __m128 &colorMul, const __m128i &alphaOr,
+	FGLTexCoord &TexCoord, FGLVertex &Vertex, FGLDoubleColor &DoubleColor)
+{
+	__m128 uv;
+	__m128 lightScale;
+	__m128i color;
+	__m128i specular;
+
+	uv = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)&P->U);
+	_mm_storel_pi((__m64 *)&TexCoord, _mm_mul_ps(uv, uvMult));
+
+	Vertex.x = P->Point.X;
+	Vertex.y = P->Point.Y;
+	Vertex.z = P->Point.Z;
+
+	//Light is scaled by 255 * (1 - fog alpha), alpha of the light is replaced by 255 below
+	lightScale = _mm_set1_ps(255.0f * (1.0f - P->Fog.W));
+	color = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(&P->Light.X), lightScale));
+	specular = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(&P->Fog.X), colorMul));
+	color = _mm_packs_epi32(color, specular);
+	color = _mm_packus_epi16(color, color);
+	_mm_storel_epi64((__m128i *)&DoubleColor, _mm_or_si128(color, alphaOr));
+}
+
+//Buffers all triangles of a polygon, which has more than 3 points if it was clipped
+//Each point is converted once, then written to every triangle of the fan that uses it
+static void FASTCALL BufferFoggedPolyVerts_SSE2(UOpenGLRenderDevice *pRD, FTransTexture** Pts, INT NumPts) {
+	static __m128 fColorMul = { 255.0f, 255.0f, 255.0f, 0.0f };
+	FGLTexCoord *pTexCoordArray = &pRD->TexCoordArray[0][pRD->BufferedVerts];
+	FGLVertex *pVertexArray = &pRD->VertexArray[pRD->BufferedVerts];
+	FGLDoubleColor *pDoubleColorArray = &pRD->DoubleColorArray[pRD->BufferedVerts];
+	pRD->BufferedVerts += (NumPts - 2) * 3;
+
+	__m128 uvMult = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)&pRD->TexInfo[0].UMult);
+	__m128 colorMul = fColorMul;
+	__m128i alphaOr = _mm_cvtsi32_si128(0xFF000000);
+
+	FGLTexCoord firstTexCoord, prevTexCoord, curTexCoord;
+	FGLVertex firstVertex, prevVertex, curVertex;
+	FGLDoubleColor firstColor, prevColor, curColor;
+
+	ConvertFoggedVert_SSE2(Pts[0], uvMult, colorMul, alphaOr, firstTexCoord, firstVertex, firstColor);
+	ConvertFoggedVert_SSE2(Pts[1], uvMult, colorMul, alphaOr, prevTexCoord, prevVertex, prevColor);
+
+	INT i = 2;
+	do {
+		ConvertFoggedVert_SSE2(Pts[i], uvMult, colorMul, alphaOr, curTexCoord, curVertex, curColor);
+
+		pTexCoordArray[0] = firstTexCoord;
+		pTexCoordArray[1] = prevTexCoord;
+		pTexCoordArray[2] = curTexCoord;
+		pTexCoordArray += 3;
+
+		pVertexArray[0] = firstVertex;
+		pVertexArray[1] = prevVertex;
+		pVertexArray[2] = curVertex;
+		pVertexArray += 3;
+
+		pDoubleColorArray[0] = firstColor;
+		pDoubleColorArray[1] = prevColor;
+		pDoubleColorArray[2] = curColor;
+		pDoubleColorArray += 3;
+
+		prevTexCoord = curTexCoord;
+		prevVertex = curVertex;
+		prevColor = curColor;
+	} while (++i < NumPts);
+}
+#endif //UTGLR_INCLUDE_SSE_CODE
+
 
 //Must be called with (NumPts > 3)
 void UOpenGLRenderDevice::BufferAdditionalClippedVerts(FTransTexture** Pts, INT NumPts) {
@@ -1551,6 +2313,119 @@ void UOpenGLRenderDevice::BufferAdditionalClippedVerts(FTransTexture** Pts, INT
 }
 
 
+void UOpenGLRenderDevice::CaptureVertBenchPoly(FTransTexture** Pts, INT NumPts) {
+	//Capture stops when full, the benchmark then uses the start of the frame
+	if ((m_vertBenchVerts.Num() + NumPts) > VERT_BENCH_MAX_VERTS) {
+		return;
+	}
+
+	for (INT i = 0; i < NumPts; i++) {
+		m_vertBenchVerts.AddItem(*Pts[i]);
+	}
+	m_vertBenchNumPts.AddItem(NumPts);
+}
+
+//Replays the captured polygons through a buffer verts proc
+//Returns seconds per pass over all polygons
+DOUBLE UOpenGLRenderDevice::TimeVertBenchProcs(void (FASTCALL *pBuffer3VertsProc)(UOpenGLRenderDevice *, FTransTexture **), void (FASTCALL *pBufferPolyVertsProc)(UOpenGLRenderDevice *, FTransTexture **, INT), FTransTexture **pPts) {
+	DWORD benchCycles = 0;
+	INT pass;
+
+	cycle(benchCycles);
+	for (pass = 0; pass < m_vertBenchPasses; pass++) {
+		FTransTexture **pPolyPts = pPts;
+		INT poly;
+
+		BufferedVerts = 0;
+		for (poly = 0; poly < m_vertBenchNumPts.Num(); poly++) {
+			INT NumPts = m_vertBenchNumPts(poly);
+
+			//Start over instead of drawing when the buffer is full
+			if ((BufferedVerts + (NumPts - 2) * 3) >= (VERTEX_ARRAY_SIZE - 14)) {
+				BufferedVerts = 0;
+			}
+
+			if (pBufferPolyVertsProc) {
+				(pBufferPolyVertsProc)(this, pPolyPts, NumPts);
+			}
+			else {
+				(pBuffer3VertsProc)(this, pPolyPts);
+				if (NumPts > 3) {
+					BufferAdditionalClippedVerts(pPolyPts, NumPts);
+				}
+			}
+			pPolyPts += NumPts;
+		}
+	}
+	uncycle(benchCycles);
+
+	BufferedVerts = 0;
+
+	return benchCycles * GSecondsPerCycle / m_vertBenchPasses;
+}
+
+void UOpenGLRenderDevice::RunVertBench(void) {
+	guard(UOpenGLRenderDevice::RunVertBench);
+	TArray<FTransTexture *> Pts;
+	DWORD savedColorFlags = m_requestedColorFlags;
+	INT numOutVerts = 0;
+	INT i;
+
+	if (m_vertBenchNumPts.Num() == 0) {
+		new(m_deferredLog)FString(TEXT("VERTBENCH: no gouraud polygons were buffered"));
+		return;
+	}
+
+	//Clipped polygons are buffered as triangle lists
+	for (i = 0; i < m_vertBenchNumPts.Num(); i++) {
+		numOutVerts += (m_vertBenchNumPts(i) - 2) * 3;
+	}
+	Pts.Add(m_vertBenchVerts.Num());
+	for (i = 0; i < m_vertBenchVerts.Num(); i++) {
+		Pts(i) = &m_vertBenchVerts(i);
+	}
+
+	new(m_deferredLog)FString(FString::Printf(TEXT("VERTBENCH: %i polygons, %i points buffered as %i vertices, %i passes"),
+		m_vertBenchNumPts.Num(), m_vertBenchVerts.Num(), numOutVerts, m_vertBenchPasses));
+
+	#define UTGLR_VERT_BENCH(name, buffer3VertsProc, bufferPolyVertsProc) \
+		new(m_deferredLog)FString(FString::Printf(TEXT("VERTBENCH: %s %.2f ns per vertex"), TEXT(name), \
+			TimeVertBenchProcs(buffer3VertsProc, bufferPolyVertsProc, &Pts(0)) * 1000000000.0 / numOutVerts))
+
+	m_requestedColorFlags = CF_COLOR_ARRAY;
+	UTGLR_VERT_BENCH("Colored", Buffer3ColoredVerts, NULL);
+#if defined UTGLR_INCLUDE_SSE_CODE && defined UTGLR_USE_ASM_CODE
+	if (UseSSE) {
+		UTGLR_VERT_BENCH("Colored SSE", Buffer3ColoredVerts_SSE, NULL);
+	}
+#endif
+#ifdef UTGLR_INCLUDE_SSE_CODE
+	if (UseSSE2) {
+		UTGLR_VERT_BENCH("Colored SSE2", NULL, BufferColoredPolyVerts_SSE2);
+	}
+#endif
+
+	m_requestedColorFlags = CF_COLOR_ARRAY | CF_DUAL_COLOR_ARRAY;
+	UTGLR_VERT_BENCH("Fogged", Buffer3FoggedVerts, NULL);
+#if defined UTGLR_INCLUDE_SSE_CODE && defined UTGLR_USE_ASM_CODE
+	if (UseSSE) {
+		UTGLR_VERT_BENCH("Fogged SSE", Buffer3FoggedVerts_SSE, NULL);
+	}
+#endif
+#ifdef UTGLR_INCLUDE_SSE_CODE
+	if (UseSSE2) {
+		UTGLR_VERT_BENCH("Fogged SSE2", NULL, BufferFoggedPolyVerts_SSE2);
+	}
+#endif
+
+	#undef UTGLR_VERT_BENCH
+
+	m_requestedColorFlags = savedColorFlags;
+
+	unguard;
+}
+
+
 void UOpenGLRenderDevice::BuildGammaRamp(float redGamma, float greenGamma, float blueGamma, int brightness, FGammaRamp &ramp) {
 	unsigned int u;
 
@@ -1749,6 +2624,10 @@ UBOOL UOpenGLRenderDevice::FailedInitf(const TCHAR* Fmt, ...) {
 void UOpenGLRenderDevice::Exit() {
 	guard(UOpenGLRenderDevice::Exit);
 	check(NumDevices > 0);
+
+	//Frames still queued must finish before the context goes away
+	StopRenderThread();
+
 	check(SetContext() == 0);
 
 	UnsetRes();
@@ -1766,6 +2645,7 @@ void UOpenGLRenderDevice::Exit() {
 				m_sharedNonZeroPrefixBindTrees[u].clear(&m_QWORD_CTTree_Allocator);
 			}
 		}
+		m_sharedBindHash.clear();
 		m_sharedNonZeroPrefixBindChain.mark_as_clear();
 		//Texture ids and memory for non zero prefix tex id pool are not freed on exit
 		m_sharedRGBA8TexPool.clear(&m_TexPoolMap_Allocator);
@@ -1782,6 +2662,16 @@ void UOpenGLRenderDevice::ShutdownAfterError() {
 		dbgPrintf("utglr: ShutdownAfterError\n");
 	}
 
+	//Stop the render thread after the command it is replaying, so it no longer uses the context
+	//The failed frame is expected here, so the result of the wait is ignored
+	if (m_renderThread) {
+		m_renderThreadAbort = true;
+		m_renderThread->Wait();
+		delete m_renderThread;
+		m_renderThread = NULL;
+		m_pRecordBuffer = NULL;
+	}
+
 	//ChangeDisplaySettings(NULL, 0);
 
 	unguard;
@@ -1790,6 +2680,10 @@ void UOpenGLRenderDevice::ShutdownAfterError() {
 
 UBOOL UOpenGLRenderDevice::SetRes(INT NewX, INT NewY, INT NewColorBytes, UBOOL Fullscreen) {
 	guard(UOpenGLRenderDevice::SetRes);
+
+	//The render thread is started again by the next threaded frame
+	StopRenderThread();
+
 	check(SetContext() == 0);
 
 	unsigned int u;
@@ -1834,6 +2728,13 @@ UBOOL UOpenGLRenderDevice::SetRes(INT NewX, INT NewY, INT NewColorBytes, UBOOL F
 	//TODO: Set this correctly
 	m_numDepthBits = MinDepthBits;
 
+	//Offscreen rendering uses a fixed size hidden window
+	if (Offscreen && (OffscreenSizeX > 0) && (OffscreenSizeY > 0)) {
+		NewX = OffscreenSizeX;
+		NewY = OffscreenSizeY;
+		Fullscreen = 0;
+	}
+
 	// Change window size.
 	Viewport->ResizeViewport(Fullscreen ? (BLIT_Fullscreen | BLIT_OpenGL) : (BLIT_HardwarePaint | BLIT_OpenGL), NewX, NewY, NewColorBytes);
 
@@ -1843,6 +2744,13 @@ UBOOL UOpenGLRenderDevice::SetRes(INT NewX, INT NewY, INT NewColorBytes, UBOOL F
 	//Get OpenGL extension function pointers
 	GetGLExtProcs();
 
+	//Redirect rendering to a framebuffer object and hide the window
+	if (Offscreen) {
+		if (InitOffscreenSafe(NewX, NewY)) {
+			SDL_HideWindow(GetWindow());
+		}
+	}
+
 	debugf(NAME_Init, TEXT("Depth bits: %u"), m_numDepthBits);
 	if (DebugBit(DEBUG_BIT_BASIC)) dbgPrintf("utglr: Depth bits: %u\n", m_numDepthBits);
 	if (m_usingAA) {
@@ -1917,6 +2825,21 @@ UBOOL UOpenGLRenderDevice::SetRes(INT NewX, INT NewY, INT NewColorBytes, UBOOL F
 		UTGLR_DEBUG_SHOW_PARAM_REG(NumAASamples);
 		UTGLR_DEBUG_SHOW_PARAM_REG(NoAATiles);
 		UTGLR_DEBUG_SHOW_PARAM_REG(ZRangeHack);
+		UTGLR_DEBUG_SHOW_PARAM_REG(UseStreamingVBO);
+		UTGLR_DEBUG_SHOW_PARAM_REG(UseGLSL);
+		UTGLR_DEBUG_SHOW_PARAM_REG(DeferComplexSurfaces);
+		UTGLR_DEBUG_SHOW_PARAM_REG(UseLightMapAtlas);
+		UTGLR_DEBUG_SHOW_PARAM_REG(UseAsyncTextures);
+		UTGLR_DEBUG_SHOW_PARAM_REG(AsyncTextureThreads);
+		UTGLR_DEBUG_SHOW_PARAM_REG(UseTextureDiskCache);
+		UTGLR_DEBUG_SHOW_PARAM_REG(CompressTextures);
+		UTGLR_DEBUG_SHOW_PARAM_REG(UseBindHash);
+		UTGLR_DEBUG_SHOW_PARAM_REG(UseRenderThread);
+		UTGLR_DEBUG_SHOW_PARAM_REG(UseProfiler);
+		UTGLR_DEBUG_SHOW_PARAM_REG(FramePaceBeforeInput);
+		UTGLR_DEBUG_SHOW_PARAM_REG(Offscreen);
+		UTGLR_DEBUG_SHOW_PARAM_REG(OffscreenSizeX);
+		UTGLR_DEBUG_SHOW_PARAM_REG(OffscreenSizeY);
 
 		#undef UTGLR_DEBUG_SHOW_PARAM_REG
 		#undef UTGLR_DEBUG_SHOW_PARAM_DCV
@@ -2073,7 +2996,7 @@ UBOOL UOpenGLRenderDevice::SetRes(INT NewX, INT NewY, INT NewColorBytes, UBOOL F
 	check(MinLogTextureSize <= MaxLogTextureSize);
 
 	// Flush textures.
-	Flush(1);
+	FlushNoRecord(1);
 
 	//Invalidate fixed texture ids
 	m_noTextureId = 0;
@@ -2143,11 +3066,46 @@ UBOOL UOpenGLRenderDevice::SetRes(INT NewX, INT NewY, INT NewColorBytes, UBOOL F
 		glSecondaryColorPointerEXT(3, GL_UNSIGNED_BYTE, sizeof(FGLDoubleColor), &DoubleColorArray[0].specular);
 	}
 
+	//Set up streaming VBO
+	if (UseStreamingVBO) {
+		InitStreamVBOSafe();
+	}
+
+	//Allocate deferred complex surface lists
+	if (DeferComplexSurfaces) {
+		InitDeferredComplexSurfacesSafe();
+	}
+
+	//Start texture conversion workers
+	if (UseAsyncTextures) {
+		InitTextureConversionSafe();
+	}
+
+	//Open converted texture disk cache
+	if (UseTextureDiskCache) {
+		InitTexDiskCacheSafe();
+	}
+
+	//Allocate frame profiler queries
+	if (UseProfiler) {
+		InitProfilerSafe();
+	}
+
+	//Set up GLSL programs
+	//Done after the vertex arrays are set up as the program position attribute array shares them
+	m_glslCurrent = 0;
+	if (UseGLSL) {
+		TryInitializeGLSLMode();
+	}
+
 	//Initialize texture state cache information
 	m_texEnableBits = 0x1;
 	m_clientTexEnableBits = 0x1;
 
 	// Init variables.
+	m_dcsNumSurfaces = 0;
+	m_dcsNumPolys = 0;
+	m_dcsNumVerts = 0;
 	BufferedVerts = 0;
 	BufferedTileVerts = 0;
 
@@ -2184,6 +3142,7 @@ UBOOL UOpenGLRenderDevice::SetRes(INT NewX, INT NewY, INT NewColorBytes, UBOOL F
 	PL_UseTrilinear = UseTrilinear;
 	PL_Use16BitTextures = Use16BitTextures;
 	PL_TexDXT1ToDXT3 = TexDXT1ToDXT3;
+	PL_UseLightMapAtlas = UseLightMapAtlas;
 	PL_MaxAnisotropy = MaxAnisotropy;
 	PL_SmoothMaskedTextures = SmoothMaskedTextures;
 	PL_MaskedTextureHack = MaskedTextureHack;
@@ -2195,6 +3154,13 @@ UBOOL UOpenGLRenderDevice::SetRes(INT NewX, INT NewY, INT NewColorBytes, UBOOL F
 	PL_UseFragmentProgram = UseFragmentProgram;
 	PL_UseSSE = UseSSE;
 	PL_UseSSE2 = UseSSE2;
+	PL_UseStreamingVBO = UseStreamingVBO;
+	PL_UseGLSL = UseGLSL;
+	PL_UseAsyncTextures = UseAsyncTextures;
+	PL_UseTextureDiskCache = UseTextureDiskCache;
+	PL_CompressTextures = CompressTextures;
+	PL_UseBindHash = UseBindHash;
+	PL_UseProfiler = UseProfiler;
 
 
 	//Reset current frame count
@@ -2212,7 +3178,7 @@ void UOpenGLRenderDevice::UnsetRes() {
 	guard(UOpenGLRenderDevice::UnsetRes);
 
 	//Flush textures
-	Flush(1);
+	FlushNoRecord(1);
 
 	//Free fixed textures if they were allocated
 	if (m_noTextureId != 0) {
@@ -2227,6 +3193,33 @@ void UOpenGLRenderDevice::UnsetRes() {
 	//Free vertex and fragment programs if they were allocated and leave vertex and fragment program modes if necessary
 	ShutdownFragmentProgramMode();
 
+	//Free GLSL programs if they were allocated and leave GLSL mode if necessary
+	ShutdownGLSLMode();
+
+	//Free streaming VBO if it was allocated
+	ShutdownStreamVBO();
+
+	//Free deferred complex surface lists if they were allocated
+	ShutdownDeferredComplexSurfaces();
+
+	//Free render thread compose buffer
+	m_renderThreadComposeBuffer.Empty();
+
+	//Stop texture conversion workers if they were started
+	ShutdownTextureConversion();
+
+	//Finish the frame capture if one is running
+	StopCapture();
+
+	//Close converted texture disk cache if it was opened
+	ShutdownTexDiskCache();
+
+	//Free frame profiler queries if they were allocated
+	ShutdownProfiler();
+
+	//Free the offscreen framebuffer if it was allocated
+	ShutdownOffscreen();
+
 	unguard;
 }
 
@@ -2279,6 +3272,8 @@ void UOpenGLRenderDevice::ConfigValidate_RequiredExtensions(void) {
 	if (!SUPPORTS_GL_ARB_fragment_program) UseFragmentProgram = 0;
 	if (!SUPPORTS_GL_EXT_bgra) UseBGRATextures = 0;
 	if (!SUPPORTS_GL_EXT_multi_draw_arrays) UseMultiDrawArrays = 0;
+	if (!SUPPORTS_GL_ARB_vertex_buffer_object || !SUPPORTS_GL_ARB_map_buffer_range) UseStreamingVBO = 0;
+	if (!SUPPORTS_GL_ARB_vertex_buffer_object || !SUPPORTS_GL_ARB_uniform_buffer_object) UseGLSL = 0;
 	if (!SUPPORTS_GL_EXT_paletted_texture) UsePalette = 0;
 	if (!SUPPORTS_GL_EXT_texture_env_combine) DetailTextures = 0;
 	if (!SUPPORTS_GL_EXT_texture_env_combine) UseDetailAlpha = 0;
@@ -2305,6 +3300,9 @@ void UOpenGLRenderDevice::ConfigValidate_Main(void) {
 	//Limit maximum DetailMax
 	if (DetailMax > 3) DetailMax = 3;
 
+	//Editor viewports share textures between devices, so conversions stay synchronous
+	if (GIsEditor) UseAsyncTextures = 0;
+
 	return;
 }
 
@@ -2350,9 +3348,11 @@ UBOOL UOpenGLRenderDevice::Init(UViewport* InViewport, INT NewX, INT NewY, INT N
 	// Init this GL rendering context.
 	m_zeroPrefixBindTrees = ShareLists ? m_sharedZeroPrefixBindTrees : m_localZeroPrefixBindTrees;
 	m_nonZeroPrefixBindTrees = ShareLists ? m_sharedNonZeroPrefixBindTrees : m_localNonZeroPrefixBindTrees;
+	m_bindHash = ShareLists ? &m_sharedBindHash : &m_localBindHash;
 	m_nonZeroPrefixBindChain = ShareLists ? &m_sharedNonZeroPrefixBindChain : &m_localNonZeroPrefixBindChain;
 	m_nonZeroPrefixTexIdPool = ShareLists ? &m_sharedNonZeroPrefixTexIdPool : &m_localNonZeroPrefixTexIdPool;
 	m_RGBA8TexPool = ShareLists ? &m_sharedRGBA8TexPool : &m_localRGBA8TexPool;
+	m_lightMapAtlas = ShareLists ? &m_sharedLightMapAtlas : &m_localLightMapAtlas;
 
 	Viewport = InViewport;
 	Context = SDL_GL_CreateContext( GetWindow() );
@@ -2374,6 +3374,9 @@ UBOOL UOpenGLRenderDevice::Exec(const TCHAR* Cmd, FOutputDevice& Ar) {
 		return 1;
 	}
 	if (ParseCommand(&Cmd, TEXT("DGL"))) {
+		//Commands change state the render thread uses
+		SyncRenderThread();
+
 		if (ParseCommand(&Cmd, TEXT("BUFFERTRIS"))) {
 			BufferActorTris = !BufferActorTris;
 			if (!UseVertexSpecular) BufferActorTris = 0;
@@ -2391,6 +3394,128 @@ UBOOL UOpenGLRenderDevice::Exec(const TCHAR* Cmd, FOutputDevice& Ar) {
 			}
 			return 1;
 		}
+		else if (ParseCommand(&Cmd, TEXT("HITCHBENCH"))) {
+			//Measures frame times after the next flush, which happens on level entry
+			//FLUSH starts it now by discarding all cached textures
+			UBOOL flushNow = ParseCommand(&Cmd, TEXT("FLUSH"));
+			m_hitchBenchFrames = 300;
+			Parse(Cmd, TEXT("FRAMES="), m_hitchBenchFrames);
+			if (m_hitchBenchFrames < 1) m_hitchBenchFrames = 1;
+			m_hitchBenchArmed = true;
+			m_hitchBenchActive = false;
+			debugf(TEXT("HITCHBENCH armed for %i frames, async textures [%i]"), m_hitchBenchFrames, (m_texConvertQueue) ? 1 : 0);
+			if (flushNow) {
+				Flush(1);
+			}
+			return 1;
+		}
+		else if (ParseCommand(&Cmd, TEXT("VERTBENCH"))) {
+			//Captures the gouraud polygons of the next frame, then times buffering them with each buffer verts proc
+			m_vertBenchPasses = 100;
+			Parse(Cmd, TEXT("PASSES="), m_vertBenchPasses);
+			m_vertBenchPasses = Clamp(m_vertBenchPasses, 1, 10000);
+			m_vertBenchArmed = true;
+			debugf(TEXT("VERTBENCH armed for %i passes, SSE [%i], SSE2 [%i]"), m_vertBenchPasses, UseSSE ? 1 : 0, UseSSE2 ? 1 : 0);
+			return 1;
+		}
+		else if (ParseCommand(&Cmd, TEXT("BINDBENCH"))) {
+			RunBindBench();
+			return 1;
+		}
+		else if (ParseCommand(&Cmd, TEXT("HITBENCH"))) {
+			INT passes = 20;
+			Parse(Cmd, TEXT("PASSES="), passes);
+			RunHitBench(Clamp(passes, 1, 10000));
+			return 1;
+		}
+		else if (ParseCommand(&Cmd, TEXT("TIMEDEMO"))) {
+			//Times FRAMES= frames after WARMUP= frames and checksums the image every CHECKSUM= frames
+			//DEMO= plays a recorded demo, PAN turns the view instead, EXIT quits when done
+			FString demoName;
+			m_timeDemoPan = ParseCommand(&Cmd, TEXT("PAN")) ? true : false;
+			m_timeDemoExit = ParseCommand(&Cmd, TEXT("EXIT")) ? true : false;
+			m_timeDemoFrames = 1000;
+			Parse(Cmd, TEXT("FRAMES="), m_timeDemoFrames);
+			m_timeDemoFrames = Clamp(m_timeDemoFrames, 1, 1000000);
+			m_timeDemoWarmup = 30;
+			Parse(Cmd, TEXT("WARMUP="), m_timeDemoWarmup);
+			//The first frame has no previous frame to time against
+			if (m_timeDemoWarmup < 1) m_timeDemoWarmup = 1;
+			m_timeDemoChecksumInterval = 100;
+			Parse(Cmd, TEXT("CHECKSUM="), m_timeDemoChecksumInterval);
+			m_timeDemoFilename = TEXT("");
+			Parse(Cmd, TEXT("FILE="), m_timeDemoFilename);
+			m_timeDemoArmed = true;
+			m_timeDemoActive = false;
+			debugf(TEXT("TIMEDEMO armed for %i frames, warmup %i, checksum every %i, offscreen [%i]"),
+				m_timeDemoFrames, m_timeDemoWarmup, m_timeDemoChecksumInterval, m_offscreenActive ? 1 : 0);
+			if (Parse(Cmd, TEXT("DEMO="), demoName)) {
+				Viewport->Exec(*FString::Printf(TEXT("DEMOPLAY %s"), *demoName), Ar);
+			}
+			return 1;
+		}
+		else if (ParseCommand(&Cmd, TEXT("PACE"))) {
+			//Frame time percentiles since the last RESET
+			debugf(TEXT("PACE: %u frames, p50 %.2f ms, p99 %.2f ms, max %.2f ms, %u late, limit %i, before input [%i], sleep margin %.2f ms"),
+				m_paceNumFrames,
+				GetPacePercentileMs(0.5f),
+				GetPacePercentileMs(0.99f),
+				m_paceMaxMs,
+				m_paceLateFrames,
+				FrameRateLimit,
+				FramePaceBeforeInput ? 1 : 0,
+				m_paceSleepMargin * 1000.0f);
+			if (ParseCommand(&Cmd, TEXT("RESET"))) {
+				ResetPaceStats();
+			}
+			return 1;
+		}
+		else if (ParseCommand(&Cmd, TEXT("PROFILE"))) {
+			//ON and OFF switch the frame profiler at the next frame
+			//CSV writes the recorded frames to FILE=, or to OpenGLProfile.csv
+			if (ParseCommand(&Cmd, TEXT("ON"))) {
+				UseProfiler = 1;
+			}
+			else if (ParseCommand(&Cmd, TEXT("OFF"))) {
+				UseProfiler = 0;
+			}
+			else if (ParseCommand(&Cmd, TEXT("CSV"))) {
+				FString Filename;
+
+				if (!Parse(Cmd, TEXT("FILE="), Filename)) {
+					Filename = TEXT("OpenGLProfile.csv");
+				}
+				check(SetContext() == 0);
+				if (WriteProfCSV(*Filename)) {
+					debugf(TEXT("PROFILE: wrote %i frames to %s"), m_profFrameCount, *Filename);
+				}
+				else {
+					debugf(TEXT("PROFILE: cannot write %s"), *Filename);
+				}
+				return 1;
+			}
+			debugf(TEXT("PROFILE [%i], %i frames recorded, timer query [%i]"), UseProfiler ? 1 : 0, m_profFrameCount, SUPPORTS_GL_ARB_timer_query ? 1 : 0);
+			return 1;
+		}
+		else if (ParseCommand(&Cmd, TEXT("CAPTURE"))) {
+			//Writes every frame to FILE=, as Y4M if the name ends in .y4m or else as raw BGRA
+			//STOP writes the frames still being read back and closes the file
+			FString Filename;
+			INT FrameRate = 30;
+
+			check(SetContext() == 0);
+			if (ParseCommand(&Cmd, TEXT("STOP"))) {
+				StopCapture();
+			}
+			else if (Parse(Cmd, TEXT("FILE="), Filename)) {
+				Parse(Cmd, TEXT("FPS="), FrameRate);
+				StartCapture(*Filename, Clamp(FrameRate, 1, 1000));
+			}
+			else {
+				debugf(TEXT("CAPTURE FILE=<name> [FPS=<rate>] or CAPTURE STOP, capturing [%i]"), m_capture ? 1 : 0);
+			}
+			return 1;
+		}
 
 		return 0;
 	}
@@ -2400,7 +3525,7 @@ UBOOL UOpenGLRenderDevice::Exec(const TCHAR* Cmd, FOutputDevice& Ar) {
 	unguard;
 }
 
-void UOpenGLRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane ScreenClear, DWORD RenderLockFlags, BYTE* InHitData, INT* InHitSize) {
+void UOpenGLRenderDevice::LockNoRecord(FPlane InFlashScale, FPlane InFlashFog, FPlane ScreenClear, DWORD RenderLockFlags, BYTE* InHitData, INT* InHitSize) {
 	guard(UOpenGLRenderDevice::Lock);
 	check(SetContext() == 0);
 	check(LockCount == 0);
@@ -2408,6 +3533,9 @@ void UOpenGLRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane Sc
 	UTGLR_DEBUG_CALL_COUNT(Lock);
 
 
+	//Frame profiler CPU time includes Lock
+	m_profLockTime = appSeconds();
+
 	//Reset stats
 	BindCycles = ImageCycles = ComplexCycles = GouraudCycles = TileCycles = 0;
 
@@ -2420,6 +3548,61 @@ void UOpenGLRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane Sc
 	m_sceneNodeHackCount = 0;
 	m_stat0Count = 0;
 	m_stat1Count = 0;
+	m_streamVBOBytes = 0;
+	m_streamVBOStallCount = 0;
+	m_glslSwitchCount = 0;
+	m_glslUBOUpdateCount = 0;
+	m_dcsSurfaceCount = 0;
+	m_dcsDrawCount = 0;
+	m_texUploadCount = 0;
+	m_asyncTexQueueCount = 0;
+	m_asyncTexUploadCount = 0;
+	m_texDiskCacheHitCount = 0;
+	m_texDiskCacheWriteCount = 0;
+	m_texCompressCount = 0;
+	m_drawCallCount = 0;
+	m_texBindCount = 0;
+	m_texUploadBytes = 0;
+
+	//Timedemo starts with its warmup frames at the next lock
+	if (m_timeDemoArmed) {
+		m_timeDemoArmed = false;
+		m_timeDemoActive = true;
+		m_timeDemoFrameIndex = -m_timeDemoWarmup;
+		m_timeDemoPrevTime = appSeconds();
+		m_timeDemoTimes.Empty();
+		m_timeDemoChecksums.Empty();
+	}
+
+	//Hitch benchmark frames are timed from the first lock after the flush
+	//The worst frame index stays negative until then
+	if (m_hitchBenchActive && (m_hitchBenchWorstFrame < 0)) {
+		m_hitchBenchPrevTime = appSeconds();
+		m_hitchBenchWorstFrame = 0;
+	}
+
+	//Vertex buffering benchmark captures all of the next frame
+	if (m_vertBenchArmed) {
+		m_vertBenchArmed = false;
+		m_vertBenchCapturing = true;
+		m_vertBenchVerts.Empty();
+		m_vertBenchNumPts.Empty();
+	}
+
+	//Frame profiler is switched before the clear so that its timestamps cover all of the frame
+	if (UseProfiler != PL_UseProfiler) {
+		PL_UseProfiler = UseProfiler;
+		if (UseProfiler) {
+			InitProfilerSafe();
+		}
+		else {
+			//Keeps the frame ring for the dump command
+			ShutdownProfiler();
+		}
+	}
+	if (m_profActive) {
+		BeginProfFrame();
+	}
 
 
 	// Clear the Z buffer if needed.
@@ -2501,6 +3684,18 @@ void UOpenGLRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane Sc
 		PL_TexDXT1ToDXT3 = TexDXT1ToDXT3;
 		flushTextures = true;
 	}
+	if (CompressTextures != PL_CompressTextures) {
+		PL_CompressTextures = CompressTextures;
+		flushTextures = true;
+	}
+	//The bind lookup can only be switched while it is empty, Flush updates PL_UseBindHash
+	if (UseBindHash != PL_UseBindHash) {
+		flushTextures = true;
+	}
+	if (UseLightMapAtlas != PL_UseLightMapAtlas) {
+		PL_UseLightMapAtlas = UseLightMapAtlas;
+		flushTextures = true;
+	}
 	//MaxAnisotropy cannot be negative
 	if (MaxAnisotropy < 0) {
 		MaxAnisotropy = 0;
@@ -2627,14 +3822,60 @@ void UOpenGLRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane Sc
 		PL_UseSSE2 = UseSSE2;
 	}
 
-
-	//Shared fragment program parameters
-	if (UseFragmentProgram) {
-		//Lightmap blend scale factor
+	if (UseStreamingVBO != PL_UseStreamingVBO) {
+		PL_UseStreamingVBO = UseStreamingVBO;
+		if (UseStreamingVBO) {
+			InitStreamVBOSafe();
+		}
+		else {
+			//Free streaming VBO and go back to client memory vertex arrays
+			ShutdownStreamVBO();
+			SetClientArrayPointers();
+		}
 	}
 
-	//Precalculate complex surface color
-	m_complexSurfaceColor3f_1f[0] = 1.0f;
+	if (UseGLSL != PL_UseGLSL) {
+		PL_UseGLSL = UseGLSL;
+		if (UseGLSL) {
+			//Attempt to initialize GLSL mode
+			TryInitializeGLSLMode();
+		}
+		else {
+			//Free GLSL programs if they were allocated and leave GLSL mode if necessary
+			ShutdownGLSLMode();
+		}
+	}
+
+	//The render thread must not create or destroy the worker pool, Lock handles these changes without it
+	if ((UseAsyncTextures != PL_UseAsyncTextures) && !m_renderThreadReplaying) {
+		PL_UseAsyncTextures = UseAsyncTextures;
+		if (UseAsyncTextures) {
+			InitTextureConversionSafe();
+		}
+		else {
+			//Uploads any textures still waiting for their conversion
+			ShutdownTextureConversion();
+		}
+	}
+
+	if (UseTextureDiskCache != PL_UseTextureDiskCache) {
+		PL_UseTextureDiskCache = UseTextureDiskCache;
+		if (UseTextureDiskCache) {
+			InitTexDiskCacheSafe();
+		}
+		else {
+			ShutdownTexDiskCache();
+		}
+	}
+
+
+	//Shared fragment program parameters
+	if (UseFragmentProgram) {
+		//Lightmap blend scale factor
+	}
+
+	//Precalculate complex surface color
+	m_complexSurfaceColor3f_1f[0] = 1.0f;
 	m_complexSurfaceColor3f_1f[1] = 1.0f;
 	m_complexSurfaceColor3f_1f[2] = 1.0f;
 	//Alpha used for fragment program lightmap blend scaling
@@ -2646,23 +3887,33 @@ void UOpenGLRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane Sc
 	m_pBuffer3ColoredVertsProc = Buffer3ColoredVerts;
 	m_pBuffer3FoggedVertsProc = Buffer3FoggedVerts;
 
+	m_pBufferColoredPolyVertsProc = NULL;
+	m_pBufferFoggedPolyVertsProc = NULL;
+
 #ifdef UTGLR_INCLUDE_SSE_CODE
 	//Initialize SSE buffer verts proc pointers
+#ifdef UTGLR_USE_ASM_CODE
 	if (UseSSE) {
 		m_pBuffer3ColoredVertsProc = Buffer3ColoredVerts_SSE;
 		m_pBuffer3FoggedVertsProc = Buffer3FoggedVerts_SSE;
 	}
+#endif
 	if (UseSSE2) {
-		m_pBuffer3ColoredVertsProc = Buffer3ColoredVerts_SSE2;
-		m_pBuffer3FoggedVertsProc = Buffer3FoggedVerts_SSE2;
+		m_pBufferColoredPolyVertsProc = BufferColoredPolyVerts_SSE2;
+		m_pBufferFoggedPolyVertsProc = BufferFoggedPolyVerts_SSE2;
 	}
 #endif //UTGLR_INCLUDE_SSE_CODE
 
 	m_pBuffer3VertsProc = NULL;
+	m_pBufferPolyVertsProc = NULL;
 
 
 	//Initialize render passes no check proc pointers
-	if (UseFragmentProgram) {
+	if (UseGLSL) {
+		m_pRenderPassesNoCheckSetupProc = &UOpenGLRenderDevice::RenderPassesNoCheckSetup_GLSL;
+		m_pRenderPassesNoCheckSetup_SingleOrDualTextureAndDetailTextureProc = &UOpenGLRenderDevice::RenderPassesNoCheckSetup_SingleOrDualTextureAndDetailTexture_GLSL;
+	}
+	else if (UseFragmentProgram) {
 		m_pRenderPassesNoCheckSetupProc = &UOpenGLRenderDevice::RenderPassesNoCheckSetup_FP;
 		m_pRenderPassesNoCheckSetup_SingleOrDualTextureAndDetailTextureProc = &UOpenGLRenderDevice::RenderPassesNoCheckSetup_SingleOrDualTextureAndDetailTexture_FP;
 	}
@@ -2671,6 +3922,13 @@ void UOpenGLRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane Sc
 		m_pRenderPassesNoCheckSetup_SingleOrDualTextureAndDetailTextureProc = &UOpenGLRenderDevice::RenderPassesNoCheckSetup_SingleOrDualTextureAndDetailTexture;
 	}
 
+	//Deferred complex surfaces use generated tex coords, so only the fixed function path can merge them
+	//Lists may not be allocated yet if deferring was enabled after SetRes
+	if (DeferComplexSurfaces) {
+		InitDeferredComplexSurfacesSafe();
+	}
+	m_dcsActive = (DeferComplexSurfaces && !UseFragmentProgram && !UseGLSL) ? true : false;
+
 	//Initialize buffer detail texture data proc pointer
 	m_pBufferDetailTextureDataProc = &UOpenGLRenderDevice::BufferDetailTextureData;
 #ifdef UTGLR_INCLUDE_SSE_CODE
@@ -2728,13 +3986,18 @@ void UOpenGLRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane Sc
 
 	//Flush textures if necessary due to config change
 	if (flushTextures) {
-		Flush(1);
+		FlushNoRecord(1);
+	}
+
+	//Upload textures whose conversion completed since the last frame
+	if (m_texConvertQueue) {
+		FinishTextureConversions(false);
 	}
 
 	unguard;
 }
 
-void UOpenGLRenderDevice::SetSceneNode(FSceneNode* Frame) {
+void UOpenGLRenderDevice::SetSceneNodeNoRecord(FSceneNode* Frame) {
 	guard(UOpenGLRenderDevice::SetSceneNode);
 	check(SetContext() == 0);
 	UTGLR_DEBUG_CALL_COUNT(SetSceneNode);
@@ -2749,10 +4012,13 @@ void UOpenGLRenderDevice::SetSceneNode(FSceneNode* Frame) {
 	SetDefaultShaderState();
 	SetDefaultTextureState();
 
+	FGLSceneNodeView View;
+	GetSceneNodeView(Frame, View);
+
 	// Precompute stuff.
 	FLOAT rcpFrameFX = 1.0f / Frame->FX;
 	m_Aspect = Frame->FY * rcpFrameFX;
-	m_RProjZ = appTan(Viewport->Actor->FovAngle * PI / 360.0);
+	m_RProjZ = appTan(View.FovAngle * PI / 360.0);
 	m_RFX2 = 2.0f * m_RProjZ * rcpFrameFX;
 	m_RFY2 = 2.0f * m_RProjZ * rcpFrameFX;
 
@@ -2761,7 +4027,7 @@ void UOpenGLRenderDevice::SetSceneNode(FSceneNode* Frame) {
 	m_sceneNodeY = Frame->Y;
 
 	// Set viewport.
-	glViewport(Frame->XB, Viewport->SizeY - Frame->Y - Frame->YB, Frame->X, Frame->Y);
+	glViewport(Frame->XB, View.ViewportSizeY - Frame->Y - Frame->YB, Frame->X, Frame->Y);
 
 	//Decide whether or not to use Z range hack
 	m_useZRangeHack = false;
@@ -2770,7 +4036,7 @@ void UOpenGLRenderDevice::SetSceneNode(FSceneNode* Frame) {
 	}
 
 	// Set projection.
-	if (Frame->Viewport->IsOrtho()) {
+	if (View.IsOrtho) {
 		//Don't use Z range hack if ortho projection
 		m_useZRangeHack = false;
 
@@ -2781,8 +4047,9 @@ void UOpenGLRenderDevice::SetSceneNode(FSceneNode* Frame) {
 	}
 
 	//Set clip planes if doing selection
+	//Hit frames are never recorded, so the live hit rect is current here
 	if (m_HitData) {
-		if (Frame->Viewport->IsOrtho()) {
+		if (View.IsOrtho) {
 			float cp[4];
 			FLOAT nX = Viewport->HitX - Frame->FX2;
 			FLOAT pX = nX + Viewport->HitXL;
@@ -2849,7 +4116,7 @@ void UOpenGLRenderDevice::SetSceneNode(FSceneNode* Frame) {
 	unguard;
 }
 
-void UOpenGLRenderDevice::Unlock(UBOOL Blit) {
+void UOpenGLRenderDevice::UnlockNoRecord(UBOOL Blit) {
 	guard(UOpenGLRenderDevice::Unlock);
 	check(SetContext() == 0);
 	UTGLR_DEBUG_CALL_COUNT(Unlock);
@@ -2862,6 +4129,11 @@ void UOpenGLRenderDevice::Unlock(UBOOL Blit) {
 	SetDefaultShaderState();
 	SetDefaultTextureState();
 
+	//End the profiled frame before reading it back and swapping
+	if (m_profActive) {
+		EndProfFrame();
+	}
+
 	// Unlock and render.
 	check(LockCount == 1);
 
@@ -2870,8 +4142,31 @@ void UOpenGLRenderDevice::Unlock(UBOOL Blit) {
 	if (Blit) {
 		CheckGLErrorFlag(TEXT("please report this bug"));
 
-		//Swap buffers
-		SDL_GL_SwapWindow( GetWindow() );
+		//Read the finished frame before it is swapped out
+		if (m_capture) {
+			CaptureFrame();
+		}
+
+		//Time the frame and checksum it before it is swapped out
+		if (m_timeDemoActive) {
+			RecordTimeDemoFrame();
+		}
+	}
+
+	//Evenly spaced deadlines before the swap give the steadiest presentation
+	if (!FramePaceBeforeInput) {
+		PaceFrame();
+	}
+
+	if (Blit) {
+		if (m_offscreenActive) {
+			//Nothing is presented, so only make sure the frame is submitted
+			glFlush();
+		}
+		else {
+			//Swap buffers
+			SDL_GL_SwapWindow( GetWindow() );
+		}
 	}
 
 	--LockCount;
@@ -2900,34 +4195,54 @@ void UOpenGLRenderDevice::Unlock(UBOOL Blit) {
 	//Increment current frame count
 	m_currentFrameCount++;
 
-	//Check for optional frame rate limit
-	if (FrameRateLimit >= 20) {
+	//Record hitch benchmark frame
+	if (m_hitchBenchActive && (m_hitchBenchWorstFrame >= 0)) {
 #if defined UTGLR_DX_BUILD || defined UTGLR_RUNE_BUILD
-		FLOAT curFrameTimestamp;
+		FLOAT curTime;
 #else
-		FTime curFrameTimestamp;
+		FTime curTime;
 #endif
-		float timeDiff;
-		float rcpFrameRateLimit;
+		FLOAT frameTime;
+		INT frameIndex = m_hitchBenchFrames - m_hitchBenchFramesLeft;
 
-		//First time timer init if necessary
-		InitFrameRateLimitTimerSafe();
-
-		curFrameTimestamp = appSeconds();
-		timeDiff = curFrameTimestamp - m_prevFrameTimestamp;
-		m_prevFrameTimestamp = curFrameTimestamp;
-
-		rcpFrameRateLimit = 1.0f / FrameRateLimit;
-		if (timeDiff < rcpFrameRateLimit) {
-			float sleepTime;
+		curTime = appSeconds();
+		frameTime = curTime - m_hitchBenchPrevTime;
+		m_hitchBenchPrevTime = curTime;
 
-			sleepTime = rcpFrameRateLimit - timeDiff;
-			appSleep(sleepTime);
+		m_hitchBenchTotal += frameTime;
+		if (frameTime > m_hitchBenchWorst) {
+			m_hitchBenchWorst = frameTime;
+			m_hitchBenchWorstFrame = frameIndex;
+		}
+		if (frameTime > 0.05f) {
+			m_hitchBenchSlowFrames++;
+		}
+		m_hitchBenchSyncUploads += m_texUploadCount;
+		m_hitchBenchAsyncUploads += m_asyncTexUploadCount;
+		m_hitchBenchDiskCacheHits += m_texDiskCacheHitCount;
 
-			m_prevFrameTimestamp = appSeconds();
+		if (--m_hitchBenchFramesLeft <= 0) {
+			m_hitchBenchActive = false;
+			new(m_deferredLog)FString(FString::Printf(TEXT("HITCHBENCH: %i frames, worst %.2f ms (frame %i), average %.2f ms, %i frames over 50 ms, %u sync uploads, %u async uploads, %u disk cache hits"),
+				m_hitchBenchFrames,
+				m_hitchBenchWorst * 1000.0f,
+				m_hitchBenchWorstFrame,
+				m_hitchBenchTotal * 1000.0f / m_hitchBenchFrames,
+				m_hitchBenchSlowFrames,
+				m_hitchBenchSyncUploads,
+				m_hitchBenchAsyncUploads,
+				m_hitchBenchDiskCacheHits));
 		}
 	}
 
+	//Replay the captured frame for the vertex buffering benchmark
+	if (m_vertBenchCapturing) {
+		m_vertBenchCapturing = false;
+		RunVertBench();
+		m_vertBenchVerts.Empty();
+		m_vertBenchNumPts.Empty();
+	}
+
 
 #if 0
 	dbgPrintf("VP enable count = %u\n", m_vpEnableCount);
@@ -2939,16 +4254,37 @@ void UOpenGLRenderDevice::Unlock(UBOOL Blit) {
 	dbgPrintf("Scene node hack count = %u\n", m_sceneNodeHackCount);
 	dbgPrintf("Stat 0 count = %u\n", m_stat0Count);
 	dbgPrintf("Stat 1 count = %u\n", m_stat1Count);
+	dbgPrintf("Stream VBO bytes = %u\n", m_streamVBOBytes);
+	dbgPrintf("Stream VBO stall count = %u\n", m_streamVBOStallCount);
+	dbgPrintf("GLSL switch count = %u\n", m_glslSwitchCount);
+	dbgPrintf("GLSL UBO update count = %u\n", m_glslUBOUpdateCount);
+	dbgPrintf("Deferred complex surface count = %u\n", m_dcsSurfaceCount);
+	dbgPrintf("Deferred complex surface draw count = %u\n", m_dcsDrawCount);
+	dbgPrintf("Texture upload count = %u\n", m_texUploadCount);
+	dbgPrintf("Async texture queue count = %u\n", m_asyncTexQueueCount);
+	dbgPrintf("Async texture upload count = %u\n", m_asyncTexUploadCount);
+	dbgPrintf("Texture disk cache hit count = %u\n", m_texDiskCacheHitCount);
+	dbgPrintf("Texture disk cache write count = %u\n", m_texDiskCacheWriteCount);
+	dbgPrintf("Compressed texture count = %u\n", m_texCompressCount);
+	dbgPrintf("Draw call count = %u\n", m_drawCallCount);
+	dbgPrintf("Texture bind count = %u\n", m_texBindCount);
+	dbgPrintf("Texture upload bytes = %u\n", m_texUploadBytes);
 #endif
 
 
 	unguard;
 }
 
-void UOpenGLRenderDevice::Flush(UBOOL AllowPrecache) {
+void UOpenGLRenderDevice::FlushNoRecord(UBOOL AllowPrecache) {
 	guard(UOpenGLRenderDevice::Flush);
 	check(SetContext() == 0);
 
+	//Deferred complex surfaces reference cached textures
+	FlushDeferredComplexSurfaces();
+
+	//Pending conversions reference cached textures too
+	DiscardTextureConversions();
+
 	unsigned int u;
 	TArray<GLuint> Binds;
 
@@ -2963,11 +4299,39 @@ void UOpenGLRenderDevice::Flush(UBOOL AllowPrecache) {
 	for (u = 0; u < NUM_CTTree_TREES; u++) {
 		QWORD_CTTree_t *nonZeroPrefixBindTree = &m_nonZeroPrefixBindTrees[u];
 		for (QWORD_CTTree_t::node_t *nzpbmPtr = nonZeroPrefixBindTree->begin(); nzpbmPtr != nonZeroPrefixBindTree->end(); nzpbmPtr = nonZeroPrefixBindTree->next_node(nzpbmPtr)) {
-			Binds.AddItem(nzpbmPtr->data.Id);
+			//Atlas pages are freed separately
+			if (nzpbmPtr->data.atlasPage == LMA_NO_PAGE) {
+				Binds.AddItem(nzpbmPtr->data.Id);
+			}
 		}
 		nonZeroPrefixBindTree->clear(&m_QWORD_CTTree_Allocator);
 	}
 
+	//Cached textures found through the bind hash are only referenced by it
+	for (u = 0; u < m_bindHash->get_num_slots(); u++) {
+		FCachedTexture *pBind = m_bindHash->get_slot_data(u);
+		if (pBind == NULL) {
+			continue;
+		}
+
+		//Atlas pages are freed separately
+		if (pBind->atlasPage == LMA_NO_PAGE) {
+			Binds.AddItem(pBind->Id);
+		}
+
+		//Free the bind tree node holding the cached texture
+		if (pBind->bindType == BIND_TYPE_ZERO_PREFIX) {
+			m_DWORD_CTTree_Allocator.free_node((DWORD_CTTree_t::node_t *)((BYTE *)pBind - (uintptr_t)&(((DWORD_CTTree_t::node_t *)0)->data)));
+		}
+		else {
+			m_QWORD_CTTree_Allocator.free_node((QWORD_CTTree_t::node_t *)((BYTE *)pBind - (uintptr_t)&(((QWORD_CTTree_t::node_t *)0)->data)));
+		}
+	}
+	m_bindHash->clear();
+
+	//Nothing is cached now, so the bind lookup may be switched
+	PL_UseBindHash = UseBindHash;
+
 	m_nonZeroPrefixBindChain->mark_as_clear();
 
 	while (QWORD_CTTree_NodePool_t::node_t *nzptipPtr = m_nonZeroPrefixTexIdPool->try_remove()) {
@@ -2990,35 +4354,61 @@ void UOpenGLRenderDevice::Flush(UBOOL AllowPrecache) {
 	if (Binds.Num()) {
 		glDeleteTextures(Binds.Num(), (GLuint*)&Binds(0));
 	}
+	FreeLightMapAtlas();
 	AllocatedTextures = 0;
 
 	//Reset current texture ids to hopefully unused values
 	for (u = 0; u < MAX_TMUNITS; u++) {
 		TexInfo[u].CurrentCacheID = TEX_CACHE_ID_UNUSED;
 		TexInfo[u].pBind = NULL;
+		TexInfo[u].UAtlasPan = 0.0f;
+		TexInfo[u].VAtlasPan = 0.0f;
 	}
 
 	if (AllowPrecache && UsePrecache && !GIsEditor) {
 		PrecacheOnFlip = 1;
 	}
 
+	//Level entry starts with a flush, so an armed hitch benchmark begins here
+	if (m_hitchBenchArmed) {
+		m_hitchBenchArmed = false;
+		m_hitchBenchActive = true;
+		m_hitchBenchFramesLeft = m_hitchBenchFrames;
+		m_hitchBenchWorst = 0.0f;
+		m_hitchBenchTotal = 0.0f;
+		m_hitchBenchWorstFrame = -1;
+		m_hitchBenchSlowFrames = 0;
+		m_hitchBenchSyncUploads = 0;
+		m_hitchBenchAsyncUploads = 0;
+		m_hitchBenchDiskCacheHits = 0;
+	}
+
 	SetGamma(Viewport->GetOuterUClient()->Brightness);
 
 	unguard;
 }
 
 
-void UOpenGLRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet) {
+void UOpenGLRenderDevice::DrawComplexSurfaceNoRecord(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet) {
 	guard(UOpenGLRenderDevice::DrawComplexSurface);
 	check(SetContext() == 0);
 	UTGLR_DEBUG_CALL_COUNT(DrawComplexSurface);
 
-	EndBuffering();
+	//Opaque complex surfaces can be drawn in any order, so deferred ones are only flushed before others
+	if (Surface.PolyFlags & (PF_Translucent | PF_Modulated | PF_Highlighted)) {
+		FlushDeferredComplexSurfaces();
+	}
+	if (BufferedVerts > 0) {
+		EndGouraudPolygonBufferingNoCheck();
+	}
+	if (BufferedTileVerts > 0) {
+		EndTileBufferingNoCheck();
+	}
 
 	if (SceneNodeHack) {
 		if ((Frame->X != m_sceneNodeX) || (Frame->Y != m_sceneNodeY)) {
 			m_sceneNodeHackCount++;
-			SetSceneNode(Frame);
+			SetSceneNodeNoRecord(Frame);
 		}
 	}
 
@@ -3032,37 +4422,67 @@ void UOpenGLRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 
 	//Hit select path
 	if (m_HitData) {
-		for (FSavedPoly* Poly = Facet.Polys; Poly; Poly = Poly->Next) {
-			INT NumPts = Poly->NumPts;
-			CGClip::vec3_t triPts[3];
-			INT i;
-			const FTransform* Pt;
+		INT numPts = 0;
+		INT numPolys = 0;
+		FSavedPoly* Poly;
 
-			Pt = Poly->Pts[0];
-			triPts[0].x = Pt->Point.X;
-			triPts[0].y = Pt->Point.Y;
-			triPts[0].z = Pt->Point.Z;
+		//Each point is copied once, the clipper makes the fan triangles
+		//The arrays only grow, so they are not reallocated for every facet
+		for (Poly = Facet.Polys; Poly; Poly = Poly->Next) {
+			numPts += Poly->NumPts;
+			numPolys++;
+		}
+		if (numPts == 0) {
+			return;
+		}
+		if (m_hitPts.Num() < numPts) {
+			m_hitPts.Add(numPts - m_hitPts.Num());
+		}
+		if (m_hitNumPts.Num() < numPolys) {
+			m_hitNumPts.Add(numPolys - m_hitNumPts.Num());
+		}
 
-			for (i = 2; i < NumPts; i++) {
-				Pt = Poly->Pts[i - 1];
-				triPts[1].x = Pt->Point.X;
-				triPts[1].y = Pt->Point.Y;
-				triPts[1].z = Pt->Point.Z;
+		numPts = 0;
+		numPolys = 0;
+		for (Poly = Facet.Polys; Poly; Poly = Poly->Next) {
+			INT NumPts = Poly->NumPts;
+			INT i;
 
-				Pt = Poly->Pts[i];
-				triPts[2].x = Pt->Point.X;
-				triPts[2].y = Pt->Point.Y;
-				triPts[2].z = Pt->Point.Z;
+			for (i = 0; i < NumPts; i++) {
+				const FTransform* Pt = Poly->Pts[i];
+				CGClip::vec3_t &hitPt = m_hitPts(numPts + i);
 
-				m_gclip.SelectDrawTri(triPts);
+				hitPt.x = Pt->Point.X;
+				hitPt.y = Pt->Point.Y;
+				hitPt.z = Pt->Point.Z;
 			}
+			m_hitNumPts(numPolys) = NumPts;
+			numPts += NumPts;
+			numPolys++;
 		}
 
+		m_gclip.SelectDrawPolys(&m_hitPts(0), &m_hitNumPts(0), numPolys);
+
 		return;
 	}
 
 	cycle(ComplexCycles);
 
+	SetProfCategory(PROF_CAT_COMPLEX);
+
+	//Make room in the deferred list first, as flushing it reuses the vertex arrays
+	if (m_dcsNumSurfaces > 0) {
+		INT numPolys = 0;
+		INT numPts = 0;
+		for (FSavedPoly* Poly = Facet.Polys; Poly; Poly = Poly->Next) {
+			numPolys++;
+			numPts += Poly->NumPts;
+		}
+		if ((m_dcsNumSurfaces >= DCS_MAX_SURFACES) || ((m_dcsNumPolys + numPolys) > DCS_MAX_POLYS) || ((m_dcsNumVerts + numPts) > DCS_MAX_VERTS)) {
+			FlushDeferredComplexSurfacesNoCheck();
+		}
+	}
+
 	//Calculate UDot and VDot intermediates for complex surface
 	m_csUDot = Facet.MapCoords.XAxis | Facet.MapCoords.Origin;
 	m_csVDot = Facet.MapCoords.YAxis | Facet.MapCoords.Origin;
@@ -3072,7 +4492,7 @@ void UOpenGLRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 	//m_csPtCount set later from return value
 	//Sets MultiDrawFirstArray and MultiDrawCountArray
 	INT numVerts;
-	if (UseFragmentProgram) {
+	if (UseFragmentProgram || UseGLSL) {
 		numVerts = BufferStaticComplexSurfaceGeometry_VP(Facet);
 	}
 	else {
@@ -3110,6 +4530,14 @@ void UOpenGLRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 
 	DWORD PolyFlags = Surface.PolyFlags;
 
+	//Record the surface for a later state sorted draw if possible
+	if (m_dcsActive && !drawDetailTexture) {
+		if (DeferComplexSurface(Surface, PolyFlags)) {
+			uncycle(ComplexCycles);
+			return;
+		}
+	}
+
 	//Initialize render passes state information
 	m_rpPassCount = 0;
 	m_rpTMUnits = TMUnits;
@@ -3119,7 +4547,16 @@ void UOpenGLRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 
 
 	//Do static render passes state setup
-	if (UseFragmentProgram) {
+	if (UseGLSL) {
+		const FVector &XAxis = Facet.MapCoords.XAxis;
+		const FVector &YAxis = Facet.MapCoords.YAxis;
+		FLOAT *pXAxis = m_glslSurfaceState.XAxis;
+		FLOAT *pYAxis = m_glslSurfaceState.YAxis;
+
+		pXAxis[0] = XAxis.X; pXAxis[1] = XAxis.Y; pXAxis[2] = XAxis.Z; pXAxis[3] = -m_csUDot;
+		pYAxis[0] = YAxis.X; pYAxis[1] = YAxis.Y; pYAxis[2] = YAxis.Z; pYAxis[3] = -m_csVDot;
+	}
+	else if (UseFragmentProgram) {
 		const FVector &XAxis = Facet.MapCoords.XAxis;
 		const FVector &YAxis = Facet.MapCoords.YAxis;
 
@@ -3137,12 +4574,13 @@ void UOpenGLRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 		AddRenderPass(Surface.LightMap, PF_Modulated, -0.5f);
 	}
 
+	bool separateFogPass = false;
 	if (Surface.FogMap) {
 		bool useFragmentProgramSinglePassFog = false;
 
 		//Check if can do single pass fragment program fog
 		//Fog must always be the last layer as it currently is (no detail texture allowed if fog map texture)
-		if (UseFragmentProgram && DCV.SinglePassFog) {
+		if ((UseFragmentProgram || UseGLSL) && DCV.SinglePassFog) {
 			if ((m_rpPassCount == 1) || (m_rpPassCount == 2)) {
 				useFragmentProgramSinglePassFog = true;
 			}
@@ -3152,6 +4590,7 @@ void UOpenGLRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 			//Make fog first pass if no SetTexEnv support for it, or if single pass mode is disabled
 			if (!SinglePassFog) {
 				RenderPasses();
+				separateFogPass = true;
 			}
 		}
 
@@ -3179,6 +4618,8 @@ void UOpenGLRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 		else {
 			RenderPasses();
 
+			SetProfCategory(PROF_CAT_DETAIL);
+
 			bool clipDetailTexture = (DetailClipping != 0);
 
 			if (m_rpMasked) {
@@ -3193,7 +4634,10 @@ void UOpenGLRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 			}
 
 			//This function should only be called if at least one polygon will be detail textured
-			if (UseFragmentProgram) {
+			if (UseGLSL) {
+				DrawDetailTexture_GLSL(*Surface.DetailTexture);
+			}
+			else if (UseFragmentProgram) {
 				DrawDetailTexture_FP(*Surface.DetailTexture);
 			}
 			else {
@@ -3202,6 +4646,10 @@ void UOpenGLRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 		}
 	}
 	else {
+		//Only the fog map is left when it has its own pass
+		if (separateFogPass) {
+			SetProfCategory(PROF_CAT_FOG);
+		}
 		RenderPasses();
 	}
 
@@ -3400,7 +4848,8 @@ void UOpenGLRenderDevice::DrawGouraudPolygonOld(FSceneNode* Frame, FTextureInfo&
 	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 #endif
 
-	glDrawArrays(GL_TRIANGLE_FAN, 0, Index);
+	m_drawCallCount++;
+	glDrawArrays(GL_TRIANGLE_FAN, StreamVertexArrays(0, Index), Index);
 
 #ifdef UTGLR_RUNE_BUILD
 	if ((PolyFlags & (PF_RenderFog | PF_Translucent | PF_Modulated | PF_AlphaBlend)) == PF_RenderFog) {
@@ -3424,7 +4873,8 @@ void UOpenGLRenderDevice::DrawGouraudPolygonOld(FSceneNode* Frame, FTextureInfo&
 			Index++;
 		}
 
-		glDrawArrays(GL_TRIANGLE_FAN, 0, Index);
+		m_drawCallCount++;
+		glDrawArrays(GL_TRIANGLE_FAN, StreamVertexArrays(0, Index), Index);
 	}
 
 #ifdef UTGLR_DEBUG_ACTOR_WIREFRAME
@@ -3435,7 +4885,7 @@ void UOpenGLRenderDevice::DrawGouraudPolygonOld(FSceneNode* Frame, FTextureInfo&
 	unguard;
 }
 
-void UOpenGLRenderDevice::DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& Info, FTransTexture** Pts, INT NumPts, DWORD PolyFlags, FSpanBuffer* Span) {
+void UOpenGLRenderDevice::DrawGouraudPolygonNoRecord(FSceneNode* Frame, FTextureInfo& Info, FTransTexture** Pts, INT NumPts, DWORD PolyFlags, FSpanBuffer* Span) {
 	guard(UOpenGLRenderDevice::DrawGouraudPolygon);
 	check(SetContext() == 0);
 	UTGLR_DEBUG_CALL_COUNT(DrawGouraudPolygon);
@@ -3443,12 +4893,13 @@ void UOpenGLRenderDevice::DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& In
 	//DrawGouraudPolygon only uses PolyFlags2 locally
 	DWORD PolyFlags2 = 0;
 
+	FlushDeferredComplexSurfaces();
 	EndTileBuffering();
 
 	if (SceneNodeHack) {
 		if ((Frame->X != m_sceneNodeX) || (Frame->Y != m_sceneNodeY)) {
 			m_sceneNodeHackCount++;
-			SetSceneNode(Frame);
+			SetSceneNodeNoRecord(Frame);
 		}
 	}
 
@@ -3459,32 +4910,27 @@ void UOpenGLRenderDevice::DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& In
 
 	//Hit select path
 	if (m_HitData) {
-		CGClip::vec3_t triPts[3];
-		const FTransTexture* Pt;
 		INT i;
 
-		Pt = Pts[0];
-		triPts[0].x = Pt->Point.X;
-		triPts[0].y = Pt->Point.Y;
-		triPts[0].z = Pt->Point.Z;
-
-		for (i = 2; i < NumPts; i++) {
-			Pt = Pts[i - 1];
-			triPts[1].x = Pt->Point.X;
-			triPts[1].y = Pt->Point.Y;
-			triPts[1].z = Pt->Point.Z;
-
-			Pt = Pts[i];
-			triPts[2].x = Pt->Point.X;
-			triPts[2].y = Pt->Point.Y;
-			triPts[2].z = Pt->Point.Z;
+		if (m_hitPts.Num() < NumPts) {
+			m_hitPts.Add(NumPts - m_hitPts.Num());
+		}
+		for (i = 0; i < NumPts; i++) {
+			const FTransTexture* Pt = Pts[i];
+			CGClip::vec3_t &hitPt = m_hitPts(i);
 
-			m_gclip.SelectDrawTri(triPts);
+			hitPt.x = Pt->Point.X;
+			hitPt.y = Pt->Point.Y;
+			hitPt.z = Pt->Point.Z;
 		}
 
+		m_gclip.SelectDrawPoly(&m_hitPts(0), NumPts);
+
 		return;
 	}
 
+	SetProfCategory(PROF_CAT_GOURAUD);
+
 	if (NumPts > m_bufferActorTrisCutoff) {
 		EndBuffering();
 
@@ -3591,47 +5037,64 @@ void UOpenGLRenderDevice::DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& In
 		//Select a buffer verts proc
 		if (m_requestedColorFlags & CF_DUAL_COLOR_ARRAY) {
 			m_pBuffer3VertsProc = m_pBuffer3FoggedVertsProc;
+			m_pBufferPolyVertsProc = m_pBufferFoggedPolyVertsProc;
 		}
 		else if (m_requestedColorFlags & CF_COLOR_ARRAY) {
 			m_pBuffer3VertsProc = m_pBuffer3ColoredVertsProc;
+			m_pBufferPolyVertsProc = m_pBufferColoredPolyVertsProc;
 		}
 		else {
 			m_pBuffer3VertsProc = m_pBuffer3BasicVertsProc;
+			m_pBufferPolyVertsProc = NULL;
 		}
 #ifdef UTGLR_RUNE_BUILD
 		m_gpAlpha = 255;
 		if (PolyFlags & PF_AlphaBlend) {
 			m_gpAlpha = appRound(Info.Texture->Alpha * 255.0f);
 			m_pBuffer3VertsProc = Buffer3Verts;
+			m_pBufferPolyVertsProc = NULL;
 		}
 #endif
 	}
 
-	//Buffer 3 vertices from the first (and perhaps only) triangle
-	(m_pBuffer3VertsProc)(this, Pts);
+	if (m_vertBenchCapturing) {
+		CaptureVertBenchPoly(Pts, NumPts);
+	}
+
+	if (m_pBufferPolyVertsProc) {
+		//Buffer all vertices of the (perhaps clipped) triangle at once
+		(m_pBufferPolyVertsProc)(this, Pts, NumPts);
+	}
+	else {
+		//Buffer 3 vertices from the first (and perhaps only) triangle
+		(m_pBuffer3VertsProc)(this, Pts);
 
-	if (NumPts > 3) {
-		//Buffer additional vertices from a clipped triangle
-		BufferAdditionalClippedVerts(Pts, NumPts);
+		if (NumPts > 3) {
+			//Buffer additional vertices from a clipped triangle
+			BufferAdditionalClippedVerts(Pts, NumPts);
+		}
 	}
 
 	unguard;
 }
 
-void UOpenGLRenderDevice::DrawTile(FSceneNode* Frame, FTextureInfo& Info, FLOAT X, FLOAT Y, FLOAT XL, FLOAT YL, FLOAT U, FLOAT V, FLOAT UL, FLOAT VL, class FSpanBuffer* Span, FLOAT Z, FPlane Color, FPlane Fog, DWORD PolyFlags) {
+void UOpenGLRenderDevice::DrawTileNoRecord(FSceneNode* Frame, FTextureInfo& Info, FLOAT X, FLOAT Y, FLOAT XL, FLOAT YL, FLOAT U, FLOAT V, FLOAT UL, FLOAT VL, class FSpanBuffer* Span, FLOAT Z, FPlane Color, FPlane Fog, DWORD PolyFlags) {
 	guard(UOpenGLRenderDevice::DrawTile);
+	FGLSceneNodeView View;
+	GetSceneNodeView(Frame, View);
 	check(SetContext() == 0);
 	UTGLR_DEBUG_CALL_COUNT(DrawTile);
 
 	//DrawTile does not use PolyFlags2
 	const DWORD PolyFlags2 = 0;
 
+	FlushDeferredComplexSurfaces();
 	EndGouraudPolygonBuffering();
 
 	if (SceneNodeHack) {
 		if ((Frame->X != m_sceneNodeX) || (Frame->Y != m_sceneNodeY)) {
 			m_sceneNodeHackCount++;
-			SetSceneNode(Frame);
+			SetSceneNodeNoRecord(Frame);
 		}
 	}
 
@@ -3651,7 +5114,7 @@ void UOpenGLRenderDevice::DrawTile(FSceneNode* Frame, FTextureInfo& Info, FLOAT
 	FLOAT RPX2 = m_RFX2 * PX2;
 	FLOAT RPY1 = m_RFY2 * PY1;
 	FLOAT RPY2 = m_RFY2 * PY2;
-	if (!Frame->Viewport->IsOrtho()) {
+	if (!View.IsOrtho) {
 		RPX1 *= Z;
 		RPX2 *= Z;
 		RPY1 *= Z;
@@ -3866,6 +5329,8 @@ void UOpenGLRenderDevice::DrawTile(FSceneNode* Frame, FTextureInfo& Info, FLOAT
 
 		cycle(TileCycles);
 
+		SetProfCategory(PROF_CAT_TILE);
+
 		if (NoAATiles) {
 			SetDisabledAAState();
 		}
@@ -3920,6 +5385,7 @@ void UOpenGLRenderDevice::DrawTile(FSceneNode* Frame, FTextureInfo& Info, FLOAT
 		FLOAT SV1 = (V) * TexInfoVMult;
 		FLOAT SV2 = (V + VL) * TexInfoVMult;
 
+		m_drawCallCount++;
 		glBegin(GL_TRIANGLE_FAN);
 
 		glTexCoord2f(SU1, SV1);
@@ -3942,12 +5408,15 @@ void UOpenGLRenderDevice::DrawTile(FSceneNode* Frame, FTextureInfo& Info, FLOAT
 	unguard;
 }
 
-void UOpenGLRenderDevice::Draw3DLine(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2) {
+void UOpenGLRenderDevice::Draw3DLineNoRecord(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2) {
 	guard(UOpenGLRenderDevice::Draw3DLine);
+	FGLSceneNodeView View;
+	GetSceneNodeView(Frame, View);
 	check(SetContext() == 0);
 	UTGLR_DEBUG_CALL_COUNT(Draw3DLine);
 
 	EndBuffering();
+	SetProfCategory(PROF_CAT_OTHER);
 
 	SetDefaultAAState();
 	SetDefaultProjectionState();
@@ -3957,7 +5426,7 @@ void UOpenGLRenderDevice::Draw3DLine(FSceneNode* Frame, FPlane Color, DWORD Line
 
 	P1 = P1.TransformPointBy(Frame->Coords);
 	P2 = P2.TransformPointBy(Frame->Coords);
-	if (Frame->Viewport->IsOrtho()) {
+	if (View.IsOrtho) {
 		// Zoom.
 		FLOAT rcpZoom = 1.0f / Frame->Zoom;
 		P1.X = (P1.X * rcpZoom) + Frame->FX2;
@@ -3968,10 +5437,10 @@ void UOpenGLRenderDevice::Draw3DLine(FSceneNode* Frame, FPlane Color, DWORD Line
 
 		// See if points form a line parallel to our line of sight (i.e. line appears as a dot).
 		if (Abs(P2.X - P1.X) + Abs(P2.Y - P1.Y) >= 0.2f) {
-			Draw2DLine(Frame, Color, LineFlags, P1, P2);
+			Draw2DLineNoRecord(Frame, Color, LineFlags, P1, P2);
 		}
-		else if (Frame->Viewport->Actor->OrthoZoom < ORTHO_LOW_DETAIL) {
-			Draw2DPoint(Frame, Color, LINE_None, P1.X - 1.0f, P1.Y - 1.0f, P1.X + 1.0f, P1.Y + 1.0f, P1.Z);
+		else if (View.OrthoZoom < ORTHO_LOW_DETAIL) {
+			Draw2DPointNoRecord(Frame, Color, LINE_None, P1.X - 1.0f, P1.Y - 1.0f, P1.X + 1.0f, P1.Y + 1.0f, P1.Z);
 		}
 	}
 	else {
@@ -4004,12 +5473,15 @@ void UOpenGLRenderDevice::Draw3DLine(FSceneNode* Frame, FPlane Color, DWORD Line
 	unguard;
 }
 
-void UOpenGLRenderDevice::Draw2DLine(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2) {
+void UOpenGLRenderDevice::Draw2DLineNoRecord(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2) {
 	guard(UOpenGLRenderDevice::Draw2DLine);
+	FGLSceneNodeView View;
+	GetSceneNodeView(Frame, View);
 	check(SetContext() == 0);
 	UTGLR_DEBUG_CALL_COUNT(Draw2DLine);
 
 	EndBuffering();
+	SetProfCategory(PROF_CAT_OTHER);
 
 	SetDefaultAAState();
 	SetDefaultProjectionState();
@@ -4026,7 +5498,7 @@ void UOpenGLRenderDevice::Draw2DLine(FSceneNode* Frame, FPlane Color, DWORD Line
 	FLOAT Y1Pos = m_RFY2 * (P1.Y - Frame->FY2);
 	FLOAT X2Pos = m_RFX2 * (P2.X - Frame->FX2);
 	FLOAT Y2Pos = m_RFY2 * (P2.Y - Frame->FY2);
-	if (!Frame->Viewport->IsOrtho()) {
+	if (!View.IsOrtho) {
 		X1Pos *= P1.Z;
 		Y1Pos *= P1.Z;
 		X2Pos *= P2.Z;
@@ -4058,12 +5530,15 @@ void UOpenGLRenderDevice::Draw2DLine(FSceneNode* Frame, FPlane Color, DWORD Line
 	unguard;
 }
 
-void UOpenGLRenderDevice::Draw2DPoint(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FLOAT X1, FLOAT Y1, FLOAT X2, FLOAT Y2, FLOAT Z) {
+void UOpenGLRenderDevice::Draw2DPointNoRecord(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FLOAT X1, FLOAT Y1, FLOAT X2, FLOAT Y2, FLOAT Z) {
 	guard(UOpenGLRenderDevice::Draw2DPoint);
+	FGLSceneNodeView View;
+	GetSceneNodeView(Frame, View);
 	check(SetContext() == 0);
 	UTGLR_DEBUG_CALL_COUNT(Draw2DPoint);
 
 	EndBuffering();
+	SetProfCategory(PROF_CAT_OTHER);
 
 	SetDefaultAAState();
 	SetDefaultProjectionState();
@@ -4085,7 +5560,7 @@ void UOpenGLRenderDevice::Draw2DPoint(FSceneNode* Frame, FPlane Color, DWORD Lin
 	FLOAT Y1Pos = m_RFY2 * (Y1 - Frame->FY2);
 	FLOAT X2Pos = m_RFX2 * (X2 - Frame->FX2);
 	FLOAT Y2Pos = m_RFY2 * (Y2 - Frame->FY2);
-	if (!Frame->Viewport->IsOrtho()) {
+	if (!View.IsOrtho) {
 		X1Pos *= Z;
 		Y1Pos *= Z;
 		X2Pos *= Z;
@@ -4138,12 +5613,13 @@ void UOpenGLRenderDevice::Draw2DPoint(FSceneNode* Frame, FPlane Color, DWORD Lin
 }
 
 
-void UOpenGLRenderDevice::ClearZ(FSceneNode* Frame) {
+void UOpenGLRenderDevice::ClearZNoRecord(FSceneNode* Frame) {
 	guard(UOpenGLRenderDevice::ClearZ);
 	check(SetContext() == 0);
 	UTGLR_DEBUG_CALL_COUNT(ClearZ);
 
 	EndBuffering();
+	SetProfCategory(PROF_CAT_OTHER);
 
 	//Default AA state not required for glClear
 	//Default projection state not required for glClear
@@ -4162,6 +5638,11 @@ void UOpenGLRenderDevice::PushHit(const BYTE* Data, INT Count) {
 
 	INT i;
 
+	//Hit testing frames are never recorded
+	if (m_pRecordBuffer) {
+		return;
+	}
+
 	EndBuffering();
 
 	//Add to stack
@@ -4176,6 +5657,11 @@ void UOpenGLRenderDevice::PushHit(const BYTE* Data, INT Count) {
 void UOpenGLRenderDevice::PopHit(INT Count, UBOOL bForce) {
 	guard(UOpenGLRenderDevice::PopHit);
 
+	//Hit testing frames are never recorded
+	if (m_pRecordBuffer) {
+		return;
+	}
+
 	EndBuffering();
 
 	INT i;
@@ -4217,52 +5703,88 @@ void UOpenGLRenderDevice::GetStats(TCHAR* Result) {
 		msPerCycle * GouraudCycles,
 		msPerCycle * TileCycles
 	);
+	if (m_dcsActive) {
+		appSprintf(Result + appStrlen(Result), TEXT(" DeferredCS=%u DeferredCSDraws=%u"), m_dcsSurfaceCount, m_dcsDrawCount);
+	}
+	if (UseLightMapAtlas) {
+		appSprintf(Result + appStrlen(Result), TEXT(" LightMapPages=%d"), m_lightMapAtlas->NumPages);
+	}
+	if (m_texConvertQueue) {
+		appSprintf(Result + appStrlen(Result), TEXT(" AsyncTexQueued=%u AsyncTexUploaded=%u AsyncTexPending=%d"), m_asyncTexQueueCount, m_asyncTexUploadCount, m_texConvertQueue->Jobs.Num());
+	}
+	if (m_texDiskCacheActive) {
+		appSprintf(Result + appStrlen(Result), TEXT(" TexDiskCacheHits=%u TexDiskCacheWrites=%u"), m_texDiskCacheHitCount, m_texDiskCacheWriteCount);
+	}
+	if (CompressTextures) {
+		appSprintf(Result + appStrlen(Result), TEXT(" CompressedTextures=%u"), m_texCompressCount);
+	}
+	if (UseProfiler) {
+		FGLProfFrame Avg;
+		INT numGPUFrames;
+
+		//Profiler times are averages, as GPU times arrive a few frames late
+		if (GetProfAverage(PROF_AVERAGE_FRAMES, Avg, numGPUFrames) > 0) {
+			appSprintf(Result + appStrlen(Result), TEXT(" ProfFrame=%04.1f ProfCPU=%04.1f ProfGPU=%04.1f GPUComplex=%04.1f GPUGouraud=%04.1f GPUTile=%04.1f GPUDetail=%04.1f GPUFog=%04.1f"),
+				Avg.FrameMs, Avg.CPUMs, Avg.GPUMs,
+				Avg.GPUCatMs[PROF_CAT_COMPLEX], Avg.GPUCatMs[PROF_CAT_GOURAUD], Avg.GPUCatMs[PROF_CAT_TILE],
+				Avg.GPUCatMs[PROF_CAT_DETAIL], Avg.GPUCatMs[PROF_CAT_FOG]);
+		}
+	}
+	appSprintf(Result + appStrlen(Result), TEXT(" Draws=%u Binds=%u UploadKB=%u"), m_drawCallCount, m_texBindCount, m_texUploadBytes / 1024);
 
 	unguard;
 }
 
 void UOpenGLRenderDevice::ReadPixels(FColor* Pixels) {
 	guard(UOpenGLRenderDevice::ReadPixels);
+
+	//Read the frame after the render thread has drawn it
+	SyncRenderThread();
+
 	check(SetContext() == 0);
 
-	INT x, y;
+	INT y;
 	INT SizeX, SizeY;
+	INT RowBytes;
+	TArray<BYTE> Row;
 
 	SizeX = Viewport->SizeX;
 	SizeY = Viewport->SizeY;
+	RowBytes = SizeX * sizeof(FColor);
 
-	glReadPixels(0, 0, SizeX, SizeY, GL_RGBA, GL_UNSIGNED_BYTE, Pixels);
+	//Screenshots are stored as BGRA, so reading BGRA leaves only the row order to fix
+	glReadPixels(0, 0, SizeX, SizeY, SUPPORTS_GL_EXT_bgra ? GL_BGRA_EXT : GL_RGBA, GL_UNSIGNED_BYTE, Pixels);
+	Row.Add(RowBytes);
 	for (y = 0; y < SizeY / 2; y++) {
-		for (x = 0; x < SizeX; x++) {
-			Exchange(Pixels[x + y * SizeX].R, Pixels[x + (SizeY - 1 - y) * SizeX].B);
-			Exchange(Pixels[x + y * SizeX].G, Pixels[x + (SizeY - 1 - y) * SizeX].G);
-			Exchange(Pixels[x + y * SizeX].B, Pixels[x + (SizeY - 1 - y) * SizeX].R);
-		}
+		BYTE *pTop = (BYTE *)&Pixels[y * SizeX];
+		BYTE *pBottom = (BYTE *)&Pixels[(SizeY - 1 - y) * SizeX];
+
+		appMemcpy(&Row(0), pTop, RowBytes);
+		appMemcpy(pTop, pBottom, RowBytes);
+		appMemcpy(pBottom, &Row(0), RowBytes);
+	}
+	if (!SUPPORTS_GL_EXT_bgra) {
+		CPixConv::SwapRB((BYTE *)Pixels, (BYTE *)Pixels, SizeX * SizeY, PL_UseSSE2 != 0);
 	}
 
 	//Gamma correct screenshots if the option is true and the gamma ramp was set successfully
 	if (GammaCorrectScreenshots && m_setGammaRampSucceeded) {
 		FByteGammaRamp gammaByteRamp;
 		BuildGammaRamp(SavedGammaCorrection, SavedGammaCorrection, SavedGammaCorrection, Brightness, gammaByteRamp);
-		for (y = 0; y < SizeY; y++) {
-			for (x = 0; x < SizeX; x++) {
-				Pixels[x + y * SizeX].R = gammaByteRamp.red[Pixels[x + y * SizeX].R];
-				Pixels[x + y * SizeX].G = gammaByteRamp.green[Pixels[x + y * SizeX].G];
-				Pixels[x + y * SizeX].B = gammaByteRamp.blue[Pixels[x + y * SizeX].B];
-			}
-		}
+		CPixConv::ApplyRamp((BYTE *)Pixels, (BYTE *)Pixels, SizeX * SizeY, gammaByteRamp.red, gammaByteRamp.green, gammaByteRamp.blue);
 	}
 
 	unguard;
 }
 
-void UOpenGLRenderDevice::EndFlash() {
+void UOpenGLRenderDevice::EndFlashNoRecord() {
 	guard(UOpenGLRenderDevice::EndFlash);
 	check(SetContext() == 0);
 	UTGLR_DEBUG_CALL_COUNT(EndFlash);
 
 	if ((FlashScale != FPlane(0.5f, 0.5f, 0.5f, 0.0f)) || (FlashFog != FPlane(0.0f, 0.0f, 0.0f, 0.0f))) {
 		EndBuffering();
+		SetProfCategory(PROF_CAT_OTHER);
 
 		SetDefaultAAState();
 		SetDefaultProjectionState();
@@ -4270,35 +5792,1479 @@ void UOpenGLRenderDevice::EndFlash() {
 		SetDefaultShaderState();
 		SetDefaultTextureState();
 
-		SetBlend(PF_Highlighted);
-		SetNoTexture(0);
+		SetBlend(PF_Highlighted);
+		SetNoTexture(0);
+
+		glColor4f(FlashFog.X, FlashFog.Y, FlashFog.Z, 1.0f - Min(FlashScale.X * 2.0f, 1.0f));
+
+		FLOAT RFX2 = m_RProjZ;
+		FLOAT RFY2 = m_RProjZ * m_Aspect;
+
+		//Adjust Z coordinate if Z range hack is active
+		FLOAT ZCoord = 1.0f;
+		if (m_useZRangeHack) {
+			ZCoord = (((ZCoord - 0.5f) / 7.5f) * 4.0f) + 4.0f;
+		}
+
+		glBegin(GL_TRIANGLE_FAN);
+		glVertex3f(RFX2 * (-1.0f * ZCoord), RFY2 * (-1.0f * ZCoord), ZCoord);
+		glVertex3f(RFX2 * (+1.0f * ZCoord), RFY2 * (-1.0f * ZCoord), ZCoord);
+		glVertex3f(RFX2 * (+1.0f * ZCoord), RFY2 * (+1.0f * ZCoord), ZCoord);
+		glVertex3f(RFX2 * (-1.0f * ZCoord), RFY2 * (+1.0f * ZCoord), ZCoord);
+		glEnd();
+	}
+	unguard;
+}
+
+void UOpenGLRenderDevice::PrecacheTextureNoRecord(FTextureInfo& Info, DWORD PolyFlags) {
+	guard(UOpenGLRenderDevice::PrecacheTexture);
+	check(SetContext() == 0);
+
+	SetTextureNoPanBias(0, Info, PolyFlags);
+
+	unguard;
+}
+
+void FGLRenderThreadTask::DoWork() {
+	pDevice->ReplayCommands(*pBuffer);
+}
+
+//Starts the render thread, which replays the frames recorded by the game thread
+void UOpenGLRenderDevice::StartRenderThread(void) {
+	guard(UOpenGLRenderDevice::StartRenderThread);
+	unsigned int u;
+
+	//Return early if already started
+	if (m_renderThread) {
+		return;
+	}
+
+	for (u = 0; u < 2; u++) {
+		m_renderThreadTasks[u].pDevice = this;
+		m_renderThreadTasks[u].pBuffer = &m_cmdBuffers[u];
+	}
+	m_cmdBufferIndex = 0;
+	m_pRecordBuffer = NULL;
+
+	m_renderThread = new FThreadPool(1);
+
+	unguard;
+}
+
+//Waits for queued frames and stops the render thread if it was started
+//The game thread owns the context again afterwards
+void UOpenGLRenderDevice::StopRenderThread(void) {
+	guard(UOpenGLRenderDevice::StopRenderThread);
+
+	if (!m_renderThread) {
+		return;
+	}
+
+	SyncRenderThread();
+
+	delete m_renderThread;
+	m_renderThread = NULL;
+	m_pRecordBuffer = NULL;
+
+	FreeRecordedMaps();
+
+	unguard;
+}
+
+//Waits until the render thread has replayed every submitted frame
+//The render thread releases the context after each frame, so the game thread may use it afterwards
+void UOpenGLRenderDevice::SyncRenderThread(void) {
+	guard(UOpenGLRenderDevice::SyncRenderThread);
+
+	if (m_renderThread && !m_renderThread->Wait()) {
+		appErrorf(TEXT("OpenGL render thread failed"));
+	}
+
+	unguard;
+}
+
+//Hands the recorded frame to the render thread
+//Waits for the previous frame first, so at most one frame is queued while the next one is recorded
+void UOpenGLRenderDevice::SubmitRenderThreadFrame(void) {
+	guard(UOpenGLRenderDevice::SubmitRenderThreadFrame);
+
+	SyncRenderThread();
+
+	//Log lines and timedemo results of the frame just replayed
+	FlushDeferredLog();
+	PollTimeDemo();
+
+	//The context may only be current on one thread
+	SDL_GL_MakeCurrent(GetWindow(), NULL);
+
+	FGLRenderThreadTask &Task = m_renderThreadTasks[m_cmdBufferIndex];
+	Task.pBuffer = m_pRecordBuffer;
+	m_pRecordBuffer = NULL;
+	m_cmdBufferIndex ^= 1;
+
+	m_renderThread->AddTask(&Task);
+
+	unguard;
+}
+
+//Size of the source data of a mipmap, as copied when recording and hashed for the disk cache
+DWORD UOpenGLRenderDevice::GetRecordedMipSize(BYTE Format, const FMipmapBase *Mip) {
+	DWORD NumTexels = Mip->USize * Mip->VSize;
+
+	switch (Format) {
+	case TEXF_P8:
+		return NumTexels;
+	case TEXF_RGBA7:
+	case TEXF_RGBA8:
+		return NumTexels * 4;
+	case TEXF_RGB16:
+		return NumTexels * 2;
+	case TEXF_RGB8:
+		return NumTexels * 3;
+	case TEXF_DXT1:
+		return Max(1, Mip->USize / 4) * Max(1, Mip->VSize / 4) * 8;
+	default:
+		return 0;
+	}
+}
+
+//Gets the viewport state a scene node is drawn with
+//The replay uses the state recorded with the scene node instead of the live viewport
+void UOpenGLRenderDevice::GetSceneNodeView(const FSceneNode *Frame, FGLSceneNodeView &View) {
+	if (m_renderThreadReplaying) {
+		View = m_replayView;
+		return;
+	}
+
+	View.FovAngle = Viewport->Actor->FovAngle;
+	View.OrthoZoom = Frame->Viewport->Actor->OrthoZoom;
+	View.ViewportSizeY = Viewport->SizeY;
+	View.IsOrtho = Frame->Viewport->IsOrtho();
+}
+
+//Returns the offset of the recorded scene node, which is followed by its viewport state
+//Consecutive calls for the same unchanged scene node share one record
+DWORD UOpenGLRenderDevice::RecordSceneNode(FSceneNode *Frame) {
+	FGLCmdBuffer &Buffer = *m_pRecordBuffer;
+	FGLSceneNodeView View;
+	DWORD Offset;
+
+	GetSceneNodeView(Frame, View);
+	if ((Buffer.pLastFrame == Frame) && (appMemcmp(Buffer.GetPtr(Buffer.LastFrameOffset), Frame, sizeof(FSceneNode)) == 0) &&
+		(appMemcmp(Buffer.GetPtr(Buffer.LastFrameOffset + sizeof(FSceneNode)), &View, sizeof(FGLSceneNodeView)) == 0))
+	{
+		return Buffer.LastFrameOffset;
+	}
+
+	Offset = Buffer.Alloc(RT_CMD_DATA, sizeof(FSceneNode) + sizeof(FGLSceneNodeView));
+	appMemcpy(Buffer.GetPtr(Offset), Frame, sizeof(FSceneNode));
+	appMemcpy(Buffer.GetPtr(Offset + sizeof(FSceneNode)), &View, sizeof(FGLSceneNodeView));
+
+	Buffer.pLastFrame = Frame;
+	Buffer.LastFrameOffset = Offset;
+
+	return Offset;
+}
+
+//Returns the offset of the recorded texture
+//Light maps and fog maps live in the cache and may be replaced before the replay, so they refer to a copy of their data
+//Changed realtime textures are copied into the frame, so that the replay uploads this frame's contents
+//Other texture data is persistent and only referenced
+DWORD UOpenGLRenderDevice::RecordTexture(FTextureInfo &Info) {
+	FGLCmdBuffer &Buffer = *m_pRecordBuffer;
+	bool CopyData = (Info.Texture != NULL) && Info.bRealtimeChanged;
+	FGLRecordedMap *pMap = NULL;
+	DWORD CacheIndex = 0;
+	DWORD Offset;
+	DWORD DataOffset;
+	DWORD DataSize;
+	FGLCmdTexture *pTex;
+	INT i;
+
+	if (Info.Texture == NULL) {
+		pMap = RecordMap(Info);
+	}
+
+	//Textures drawn repeatedly from the same unchanged info share one record
+	if (!Info.bRealtimeChanged) {
+		CacheIndex = ((size_t)&Info >> 4) & (FGLCmdBuffer::TEX_CACHE_SIZE - 1);
+		if (Buffer.TexCache[CacheIndex].pInfo == &Info) {
+			Offset = Buffer.TexCache[CacheIndex].Offset;
+			if (appMemcmp(&((FGLCmdTexture *)Buffer.GetPtr(Offset))->Info, &Info, sizeof(FTextureInfo)) == 0) {
+				return Offset;
+			}
+		}
+	}
+
+	DataSize = 0;
+	if (CopyData) {
+		for (i = 0; i < Info.NumMips; i++) {
+			if (Info.Mips[i] && Info.Mips[i]->DataPtr) {
+				DataSize += (GetRecordedMipSize(Info.Format, Info.Mips[i]) + (FGLCmdBuffer::ALIGN - 1)) & ~(FGLCmdBuffer::ALIGN - 1);
+			}
+		}
+		if (Info.Palette) {
+			DataSize += 256 * sizeof(FColor);
+		}
+	}
+
+	Offset = Buffer.Alloc(RT_CMD_DATA, sizeof(FGLCmdTexture) + DataSize);
+	pTex = (FGLCmdTexture *)Buffer.GetPtr(Offset);
+	pTex->Info = Info;
+	pTex->PaletteOffset = 0;
+	pTex->Resolved = false;
+	if (pMap) {
+		pTex->Info.Palette = pMap->Palette;
+	}
+
+	DataOffset = Offset + ((sizeof(FGLCmdTexture) + (FGLCmdBuffer::ALIGN - 1)) & ~(FGLCmdBuffer::ALIGN - 1));
+	for (i = 0; i < MAX_MIPS; i++) {
+		pTex->MipDataOffsets[i] = 0;
+		if ((i >= Info.NumMips) || !Info.Mips[i]) {
+			continue;
+		}
+
+		pTex->Mips[i] = *Info.Mips[i];
+		if (pMap) {
+			pTex->Mips[i].DataPtr = pMap->MipData[i];
+		}
+		else if (CopyData && Info.Mips[i]->DataPtr) {
+			DWORD Size = GetRecordedMipSize(Info.Format, Info.Mips[i]);
+
+			appMemcpy(Buffer.GetPtr(DataOffset), Info.Mips[i]->DataPtr, Size);
+			pTex->MipDataOffsets[i] = DataOffset;
+			DataOffset += (Size + (FGLCmdBuffer::ALIGN - 1)) & ~(FGLCmdBuffer::ALIGN - 1);
+		}
+	}
+	if (CopyData && Info.Palette) {
+		appMemcpy(Buffer.GetPtr(DataOffset), Info.Palette, 256 * sizeof(FColor));
+		pTex->PaletteOffset = DataOffset;
+	}
+
+	if (Info.bRealtimeChanged) {
+		//The replay uploads the copy, as the device would have done now
+		Info.bRealtimeChanged = 0;
+	}
+	else {
+		Buffer.TexCache[CacheIndex].pInfo = &Info;
+		Buffer.TexCache[CacheIndex].Offset = Offset;
+	}
+
+	return Offset;
+}
+
+//Returns the copy of a light or fog map, copying its data if the cache id is new or the map changed
+FGLRecordedMap *UOpenGLRenderDevice::RecordMap(FTextureInfo &Info) {
+	FGLRecordedMap *pMap = m_recordedMaps.find(Info.CacheID);
+	DWORD HeaderSize = (sizeof(FGLRecordedMap) + (FGLCmdBuffer::ALIGN - 1)) & ~(FGLCmdBuffer::ALIGN - 1);
+	DWORD DataSize;
+	BYTE *pData;
+	INT i;
+
+	//The frame being replayed may still use the old copy, so it is retired instead of overwritten
+	if (pMap && Info.bRealtimeChanged) {
+		m_recordedMaps.remove(Info.CacheID);
+		pMap->Retired = true;
+		pMap = NULL;
+	}
+
+	if (!pMap) {
+		DataSize = HeaderSize;
+		for (i = 0; i < Info.NumMips; i++) {
+			if (Info.Mips[i] && Info.Mips[i]->DataPtr) {
+				DataSize += (GetRecordedMipSize(Info.Format, Info.Mips[i]) + (FGLCmdBuffer::ALIGN - 1)) & ~(FGLCmdBuffer::ALIGN - 1);
+			}
+		}
+		if (Info.Palette) {
+			DataSize += 256 * sizeof(FColor);
+		}
+
+		pMap = (FGLRecordedMap *)appMalloc(DataSize, TEXT("OpenGLRecordedMap"));
+		pMap->CacheID = Info.CacheID;
+		pMap->Retired = false;
+		pMap->Palette = NULL;
+
+		pData = (BYTE *)pMap + HeaderSize;
+		for (i = 0; i < MAX_MIPS; i++) {
+			pMap->MipData[i] = NULL;
+			if ((i < Info.NumMips) && Info.Mips[i] && Info.Mips[i]->DataPtr) {
+				DWORD Size = GetRecordedMipSize(Info.Format, Info.Mips[i]);
+
+				appMemcpy(pData, Info.Mips[i]->DataPtr, Size);
+				pMap->MipData[i] = pData;
+				pData += (Size + (FGLCmdBuffer::ALIGN - 1)) & ~(FGLCmdBuffer::ALIGN - 1);
+			}
+		}
+		if (Info.Palette) {
+			appMemcpy(pData, Info.Palette, 256 * sizeof(FColor));
+			pMap->Palette = (FColor *)pData;
+		}
+
+		m_recordedMaps.insert(Info.CacheID, pMap);
+		m_recordedMapList.AddItem(pMap);
+	}
+
+	pMap->LastFrame = m_recordFrameCount;
+
+	return pMap;
+}
+
+//Frees map copies that no frame in flight can use any more
+//Recording frame N waits for frame N - 2 to be replayed, so older copies are unused
+void UOpenGLRenderDevice::ExpireRecordedMaps(void) {
+	INT i;
+
+	for (i = 0; i < m_recordedMapList.Num(); ) {
+		FGLRecordedMap *pMap = m_recordedMapList(i);
+		DWORD Age = m_recordFrameCount - pMap->LastFrame;
+
+		if ((Age >= 2) && (pMap->Retired || (Age > RECORDED_MAP_KEEP_FRAMES))) {
+			if (!pMap->Retired) {
+				m_recordedMaps.remove(pMap->CacheID);
+			}
+			appFree(pMap);
+
+			//Order does not matter, so the last entry fills the gap
+			m_recordedMapList(i) = m_recordedMapList.Last();
+			m_recordedMapList.Pop();
+			continue;
+		}
+		i++;
+	}
+}
+
+//Frees every map copy, the render thread must be idle
+void UOpenGLRenderDevice::FreeRecordedMaps(void) {
+	INT i;
+
+	for (i = 0; i < m_recordedMapList.Num(); i++) {
+		appFree(m_recordedMapList(i));
+	}
+	m_recordedMapList.Empty();
+	m_recordedMaps.clear();
+}
+
+//Returns a recorded scene node and makes its recorded viewport state current for the replay
+FSceneNode *UOpenGLRenderDevice::GetReplaySceneNode(FGLCmdBuffer &Buffer, DWORD Offset) {
+	appMemcpy(&m_replayView, Buffer.GetPtr(Offset + sizeof(FSceneNode)), sizeof(FGLSceneNodeView));
+	return (FSceneNode *)Buffer.GetPtr(Offset);
+}
+
+//Points a recorded texture at its recorded mipmaps and data on first use
+FTextureInfo *UOpenGLRenderDevice::GetReplayTexture(FGLCmdBuffer &Buffer, DWORD Offset) {
+	FGLCmdTexture *pTex;
+	INT i;
+
+	if (Offset == 0) {
+		return NULL;
+	}
+
+	pTex = (FGLCmdTexture *)Buffer.GetPtr(Offset);
+	if (!pTex->Resolved) {
+		for (i = 0; i < pTex->Info.NumMips; i++) {
+			if (!pTex->Info.Mips[i]) {
+				continue;
+			}
+			if (pTex->MipDataOffsets[i]) {
+				pTex->Mips[i].DataPtr = Buffer.GetPtr(pTex->MipDataOffsets[i]);
+			}
+			pTex->Info.Mips[i] = &pTex->Mips[i];
+		}
+		if (pTex->PaletteOffset) {
+			pTex->Info.Palette = (FColor *)Buffer.GetPtr(pTex->PaletteOffset);
+		}
+		pTex->Resolved = true;
+	}
+
+	return &pTex->Info;
+}
+
+//Replays a recorded frame on the render thread
+void UOpenGLRenderDevice::ReplayCommands(FGLCmdBuffer &Buffer) {
+	guard(UOpenGLRenderDevice::ReplayCommands);
+	DWORD Offset;
+
+	m_renderThreadReplaying = true;
+
+	for (Offset = FGLCmdBuffer::ALIGN; (Offset < Buffer.Used) && !m_renderThreadAbort; Offset += ((FGLCmdHeader *)Buffer.GetPtr(Offset))->Size) {
+		DWORD Type = ((FGLCmdHeader *)Buffer.GetPtr(Offset))->Type;
+		BYTE *pPayload = Buffer.GetPtr(Offset + sizeof(FGLCmdHeader));
+
+		switch (Type) {
+		case RT_CMD_DATA:
+			break;
+
+		case RT_CMD_LOCK:
+			{
+				FGLCmdLock *pCmd = (FGLCmdLock *)pPayload;
+				LockNoRecord(pCmd->FlashScale, pCmd->FlashFog, pCmd->ScreenClear, pCmd->RenderLockFlags, NULL, NULL);
+			}
+			break;
+
+		case RT_CMD_UNLOCK:
+			UnlockNoRecord(((FGLCmdUnlock *)pPayload)->Blit);
+			break;
+
+		case RT_CMD_SET_SCENE_NODE:
+			SetSceneNodeNoRecord(GetReplaySceneNode(Buffer, ((FGLCmdSceneNode *)pPayload)->FrameOffset));
+			break;
+
+		case RT_CMD_CLEAR_Z:
+			ClearZNoRecord(GetReplaySceneNode(Buffer, ((FGLCmdSceneNode *)pPayload)->FrameOffset));
+			break;
+
+		case RT_CMD_DRAW_COMPLEX_SURFACE:
+			{
+				FGLCmdComplexSurface *pCmd = (FGLCmdComplexSurface *)pPayload;
+				FSavedPoly *Poly;
+				INT i;
+
+				pCmd->Surface.Texture = GetReplayTexture(Buffer, pCmd->TextureOffsets[0]);
+				pCmd->Surface.LightMap = GetReplayTexture(Buffer, pCmd->TextureOffsets[1]);
+				pCmd->Surface.MacroTexture = GetReplayTexture(Buffer, pCmd->TextureOffsets[2]);
+				pCmd->Surface.DetailTexture = GetReplayTexture(Buffer, pCmd->TextureOffsets[3]);
+				pCmd->Surface.FogMap = GetReplayTexture(Buffer, pCmd->TextureOffsets[4]);
+
+				//Polygon links and vertex pointers were recorded as offsets
+				pCmd->Facet.Polys = (pCmd->PolysOffset != 0) ? (FSavedPoly *)Buffer.GetPtr(pCmd->PolysOffset) : NULL;
+				for (Poly = pCmd->Facet.Polys; Poly; Poly = Poly->Next) {
+					for (i = 0; i < Poly->NumPts; i++) {
+						Poly->Pts[i] = (FTransform *)Buffer.GetPtr((DWORD)(size_t)Poly->Pts[i]);
+					}
+					if (Poly->Next) {
+						Poly->Next = (FSavedPoly *)Buffer.GetPtr((DWORD)(size_t)Poly->Next);
+					}
+				}
+
+				DrawComplexSurfaceNoRecord(GetReplaySceneNode(Buffer, pCmd->FrameOffset), pCmd->Surface, pCmd->Facet);
+			}
+			break;
+
+		case RT_CMD_DRAW_GOURAUD_POLYGON:
+			{
+				FGLCmdGouraudPolygon *pCmd = (FGLCmdGouraudPolygon *)pPayload;
+				FTransTexture *pVerts = (FTransTexture *)Buffer.GetPtr(pCmd->PtsOffset);
+				FTransTexture **Pts = (FTransTexture **)(pVerts + pCmd->NumPts);
+				INT i;
+
+				for (i = 0; i < pCmd->NumPts; i++) {
+					Pts[i] = &pVerts[i];
+				}
+
+				DrawGouraudPolygonNoRecord(GetReplaySceneNode(Buffer, pCmd->FrameOffset), *GetReplayTexture(Buffer, pCmd->TextureOffset), Pts, pCmd->NumPts, pCmd->PolyFlags, NULL);
+			}
+			break;
+
+		case RT_CMD_DRAW_TILE:
+			{
+				FGLCmdTile *pCmd = (FGLCmdTile *)pPayload;
+				DrawTileNoRecord(GetReplaySceneNode(Buffer, pCmd->FrameOffset), *GetReplayTexture(Buffer, pCmd->TextureOffset),
+					pCmd->X, pCmd->Y, pCmd->XL, pCmd->YL, pCmd->U, pCmd->V, pCmd->UL, pCmd->VL, NULL, pCmd->Z, pCmd->Color, pCmd->Fog, pCmd->PolyFlags);
+			}
+			break;
+
+		case RT_CMD_DRAW_3D_LINE:
+			{
+				FGLCmdLine *pCmd = (FGLCmdLine *)pPayload;
+				Draw3DLineNoRecord(GetReplaySceneNode(Buffer, pCmd->FrameOffset), pCmd->Color, pCmd->LineFlags, pCmd->P1, pCmd->P2);
+			}
+			break;
+
+		case RT_CMD_DRAW_2D_LINE:
+			{
+				FGLCmdLine *pCmd = (FGLCmdLine *)pPayload;
+				Draw2DLineNoRecord(GetReplaySceneNode(Buffer, pCmd->FrameOffset), pCmd->Color, pCmd->LineFlags, pCmd->P1, pCmd->P2);
+			}
+			break;
+
+		case RT_CMD_DRAW_2D_POINT:
+			{
+				FGLCmdPoint *pCmd = (FGLCmdPoint *)pPayload;
+				Draw2DPointNoRecord(GetReplaySceneNode(Buffer, pCmd->FrameOffset), pCmd->Color, pCmd->LineFlags, pCmd->X1, pCmd->Y1, pCmd->X2, pCmd->Y2, pCmd->Z);
+			}
+			break;
+
+		case RT_CMD_END_FLASH:
+			EndFlashNoRecord();
+			break;
+
+		case RT_CMD_PRECACHE_TEXTURE:
+			{
+				FGLCmdPrecacheTexture *pCmd = (FGLCmdPrecacheTexture *)pPayload;
+				PrecacheTextureNoRecord(*GetReplayTexture(Buffer, pCmd->TextureOffset), pCmd->PolyFlags);
+			}
+			break;
+
+		default:
+			appErrorf(TEXT("Unknown OpenGL render thread command %i"), (INT)Type);
+		}
+	}
+
+	m_renderThreadReplaying = false;
+
+	//Release the context so that the game thread may use it after syncing
+	SDL_GL_MakeCurrent(GetWindow(), NULL);
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane ScreenClear, DWORD RenderLockFlags, BYTE* InHitData, INT* InHitSize) {
+	guard(UOpenGLRenderDevice::Lock);
+
+	//Hit testing needs its results at the end of the frame and the editor uses the context between frames
+	//Changing the async textures option creates or destroys the worker pool, which only the game thread may do
+	bool threaded = UseRenderThread && !InHitData && !GIsEditor && (UseAsyncTextures == PL_UseAsyncTextures);
+#ifdef UTGLR_RUNE_BUILD
+	//Fog surface calls are not recorded
+	threaded = false;
+#endif
+#ifndef UTGLR_SUPPORTS_RENDER_THREAD
+	//The context may only be used from the main thread on this platform
+	threaded = false;
+#endif
+
+	if (!threaded) {
+		if (!UseRenderThread || (UseAsyncTextures != PL_UseAsyncTextures)) {
+			StopRenderThread();
+		}
+		else {
+			SyncRenderThread();
+		}
+
+		LockNoRecord(InFlashScale, InFlashFog, ScreenClear, RenderLockFlags, InHitData, InHitSize);
+		return;
+	}
+
+	StartRenderThread();
+
+	//Map copies only used by frames that have been replayed by now may be freed
+	m_recordFrameCount++;
+	ExpireRecordedMaps();
+
+	m_pRecordBuffer = &m_cmdBuffers[m_cmdBufferIndex];
+	m_pRecordBuffer->Reset();
+
+	FGLCmdLock *pCmd = (FGLCmdLock *)m_pRecordBuffer->GetPtr(m_pRecordBuffer->Alloc(RT_CMD_LOCK, sizeof(FGLCmdLock)));
+	pCmd->FlashScale = InFlashScale;
+	pCmd->FlashFog = InFlashFog;
+	pCmd->ScreenClear = ScreenClear;
+	pCmd->RenderLockFlags = RenderLockFlags;
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::Unlock(UBOOL Blit) {
+	guard(UOpenGLRenderDevice::Unlock);
+
+	if (!m_pRecordBuffer) {
+		UnlockNoRecord(Blit);
+		FlushDeferredLog();
+		PollTimeDemo();
+	}
+	else {
+		FGLCmdUnlock *pCmd = (FGLCmdUnlock *)m_pRecordBuffer->GetPtr(m_pRecordBuffer->Alloc(RT_CMD_UNLOCK, sizeof(FGLCmdUnlock)));
+		pCmd->Blit = Blit;
+
+		SubmitRenderThreadFrame();
+	}
+
+	//Timedemo camera path turns the view one full circle over the timed frames
+	//The step is 16.16 fixed point, so any frame count adds up to within one unit of the circle
+	if (m_timeDemoPanning && Viewport->Actor) {
+		m_timeDemoPanAccum += ((QWORD)65536 << 16) / m_timeDemoFrames;
+		Viewport->Actor->ViewRotation.Yaw += (INT)(m_timeDemoPanAccum >> 16);
+		m_timeDemoPanAccum &= 0xFFFF;
+	}
+
+	//Waiting here, just before the engine reads input for the next frame, keeps input latency lowest
+	if (FramePaceBeforeInput) {
+		PaceFrame();
+	}
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::Flush(UBOOL AllowPrecache) {
+	guard(UOpenGLRenderDevice::Flush);
+
+	//Flushes are rare, so they are not recorded
+	SyncRenderThread();
+
+	FlushNoRecord(AllowPrecache);
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::SetSceneNode(FSceneNode* Frame) {
+	guard(UOpenGLRenderDevice::SetSceneNode);
+
+	if (!m_pRecordBuffer) {
+		SetSceneNodeNoRecord(Frame);
+		return;
+	}
+
+	DWORD FrameOffset = RecordSceneNode(Frame);
+	FGLCmdSceneNode *pCmd = (FGLCmdSceneNode *)m_pRecordBuffer->GetPtr(m_pRecordBuffer->Alloc(RT_CMD_SET_SCENE_NODE, sizeof(FGLCmdSceneNode)));
+	pCmd->FrameOffset = FrameOffset;
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet) {
+	guard(UOpenGLRenderDevice::DrawComplexSurface);
+
+	if (!m_pRecordBuffer) {
+		DrawComplexSurfaceNoRecord(Frame, Surface, Facet);
+		return;
+	}
+
+	FGLCmdBuffer &Buffer = *m_pRecordBuffer;
+	DWORD FrameOffset = RecordSceneNode(Frame);
+	DWORD TextureOffsets[5];
+	DWORD PolysOffset = 0;
+	DWORD PrevPolyOffset = 0;
+	FSavedPoly *Poly;
+	INT i;
+
+	TextureOffsets[0] = Surface.Texture ? RecordTexture(*Surface.Texture) : 0;
+	TextureOffsets[1] = Surface.LightMap ? RecordTexture(*Surface.LightMap) : 0;
+	TextureOffsets[2] = Surface.MacroTexture ? RecordTexture(*Surface.MacroTexture) : 0;
+	TextureOffsets[3] = Surface.DetailTexture ? RecordTexture(*Surface.DetailTexture) : 0;
+	TextureOffsets[4] = Surface.FogMap ? RecordTexture(*Surface.FogMap) : 0;
+
+	//Polygons are recorded with offsets in place of their links and vertex pointers
+	for (Poly = Facet.Polys; Poly; Poly = Poly->Next) {
+		DWORD PtsOffset = Buffer.Alloc(RT_CMD_DATA, Poly->NumPts * sizeof(FTransform));
+		FTransform *pPts = (FTransform *)Buffer.GetPtr(PtsOffset);
+		for (i = 0; i < Poly->NumPts; i++) {
+			pPts[i] = *Poly->Pts[i];
+		}
+
+		DWORD PolyOffset = Buffer.Alloc(RT_CMD_DATA, sizeof(FSavedPoly) + Poly->NumPts * sizeof(FTransform *));
+		FSavedPoly *pPoly = (FSavedPoly *)Buffer.GetPtr(PolyOffset);
+		pPoly->Next = NULL;
+		pPoly->iNode = Poly->iNode;
+		pPoly->User = Poly->User;
+		pPoly->NumPts = Poly->NumPts;
+		for (i = 0; i < Poly->NumPts; i++) {
+			pPoly->Pts[i] = (FTransform *)(size_t)(PtsOffset + i * sizeof(FTransform));
+		}
+
+		if (PrevPolyOffset != 0) {
+			((FSavedPoly *)Buffer.GetPtr(PrevPolyOffset))->Next = (FSavedPoly *)(size_t)PolyOffset;
+		}
+		else {
+			PolysOffset = PolyOffset;
+		}
+		PrevPolyOffset = PolyOffset;
+	}
+
+	FGLCmdComplexSurface *pCmd = (FGLCmdComplexSurface *)Buffer.GetPtr(Buffer.Alloc(RT_CMD_DRAW_COMPLEX_SURFACE, sizeof(FGLCmdComplexSurface)));
+	pCmd->FrameOffset = FrameOffset;
+	for (i = 0; i < 5; i++) {
+		pCmd->TextureOffsets[i] = TextureOffsets[i];
+	}
+	pCmd->PolysOffset = PolysOffset;
+	pCmd->Surface = Surface;
+	pCmd->Facet = Facet;
+	pCmd->Facet.Span = NULL;
+	pCmd->Facet.Polys = NULL;
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& Info, FTransTexture** Pts, INT NumPts, DWORD PolyFlags, FSpanBuffer* Span) {
+	guard(UOpenGLRenderDevice::DrawGouraudPolygon);
+
+	if (!m_pRecordBuffer) {
+		DrawGouraudPolygonNoRecord(Frame, Info, Pts, NumPts, PolyFlags, Span);
+		return;
+	}
+
+	FGLCmdBuffer &Buffer = *m_pRecordBuffer;
+	DWORD FrameOffset = RecordSceneNode(Frame);
+	DWORD TextureOffset = RecordTexture(Info);
+	INT i;
+
+	//Vertex copies followed by room for the pointer array built on replay
+	DWORD PtsOffset = Buffer.Alloc(RT_CMD_DATA, NumPts * (sizeof(FTransTexture) + sizeof(FTransTexture *)));
+	FTransTexture *pVerts = (FTransTexture *)Buffer.GetPtr(PtsOffset);
+	for (i = 0; i < NumPts; i++) {
+		pVerts[i] = *Pts[i];
+	}
+
+	FGLCmdGouraudPolygon *pCmd = (FGLCmdGouraudPolygon *)Buffer.GetPtr(Buffer.Alloc(RT_CMD_DRAW_GOURAUD_POLYGON, sizeof(FGLCmdGouraudPolygon)));
+	pCmd->FrameOffset = FrameOffset;
+	pCmd->TextureOffset = TextureOffset;
+	pCmd->PtsOffset = PtsOffset;
+	pCmd->NumPts = NumPts;
+	pCmd->PolyFlags = PolyFlags;
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::DrawTile(FSceneNode* Frame, FTextureInfo& Info, FLOAT X, FLOAT Y, FLOAT XL, FLOAT YL, FLOAT U, FLOAT V, FLOAT UL, FLOAT VL, class FSpanBuffer* Span, FLOAT Z, FPlane Color, FPlane Fog, DWORD PolyFlags) {
+	guard(UOpenGLRenderDevice::DrawTile);
+
+	if (!m_pRecordBuffer) {
+		DrawTileNoRecord(Frame, Info, X, Y, XL, YL, U, V, UL, VL, Span, Z, Color, Fog, PolyFlags);
+		return;
+	}
+
+	DWORD FrameOffset = RecordSceneNode(Frame);
+	DWORD TextureOffset = RecordTexture(Info);
+
+	FGLCmdTile *pCmd = (FGLCmdTile *)m_pRecordBuffer->GetPtr(m_pRecordBuffer->Alloc(RT_CMD_DRAW_TILE, sizeof(FGLCmdTile)));
+	pCmd->FrameOffset = FrameOffset;
+	pCmd->TextureOffset = TextureOffset;
+	pCmd->X = X;
+	pCmd->Y = Y;
+	pCmd->XL = XL;
+	pCmd->YL = YL;
+	pCmd->U = U;
+	pCmd->V = V;
+	pCmd->UL = UL;
+	pCmd->VL = VL;
+	pCmd->Z = Z;
+	pCmd->Color = Color;
+	pCmd->Fog = Fog;
+	pCmd->PolyFlags = PolyFlags;
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::Draw3DLine(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2) {
+	guard(UOpenGLRenderDevice::Draw3DLine);
+
+	if (!m_pRecordBuffer) {
+		Draw3DLineNoRecord(Frame, Color, LineFlags, P1, P2);
+		return;
+	}
+
+	DWORD FrameOffset = RecordSceneNode(Frame);
+	FGLCmdLine *pCmd = (FGLCmdLine *)m_pRecordBuffer->GetPtr(m_pRecordBuffer->Alloc(RT_CMD_DRAW_3D_LINE, sizeof(FGLCmdLine)));
+	pCmd->FrameOffset = FrameOffset;
+	pCmd->Color = Color;
+	pCmd->LineFlags = LineFlags;
+	pCmd->P1 = P1;
+	pCmd->P2 = P2;
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::Draw2DLine(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2) {
+	guard(UOpenGLRenderDevice::Draw2DLine);
+
+	if (!m_pRecordBuffer) {
+		Draw2DLineNoRecord(Frame, Color, LineFlags, P1, P2);
+		return;
+	}
+
+	DWORD FrameOffset = RecordSceneNode(Frame);
+	FGLCmdLine *pCmd = (FGLCmdLine *)m_pRecordBuffer->GetPtr(m_pRecordBuffer->Alloc(RT_CMD_DRAW_2D_LINE, sizeof(FGLCmdLine)));
+	pCmd->FrameOffset = FrameOffset;
+	pCmd->Color = Color;
+	pCmd->LineFlags = LineFlags;
+	pCmd->P1 = P1;
+	pCmd->P2 = P2;
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::Draw2DPoint(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FLOAT X1, FLOAT Y1, FLOAT X2, FLOAT Y2, FLOAT Z) {
+	guard(UOpenGLRenderDevice::Draw2DPoint);
+
+	if (!m_pRecordBuffer) {
+		Draw2DPointNoRecord(Frame, Color, LineFlags, X1, Y1, X2, Y2, Z);
+		return;
+	}
+
+	DWORD FrameOffset = RecordSceneNode(Frame);
+	FGLCmdPoint *pCmd = (FGLCmdPoint *)m_pRecordBuffer->GetPtr(m_pRecordBuffer->Alloc(RT_CMD_DRAW_2D_POINT, sizeof(FGLCmdPoint)));
+	pCmd->FrameOffset = FrameOffset;
+	pCmd->Color = Color;
+	pCmd->LineFlags = LineFlags;
+	pCmd->X1 = X1;
+	pCmd->Y1 = Y1;
+	pCmd->X2 = X2;
+	pCmd->Y2 = Y2;
+	pCmd->Z = Z;
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::ClearZ(FSceneNode* Frame) {
+	guard(UOpenGLRenderDevice::ClearZ);
+
+	if (!m_pRecordBuffer) {
+		ClearZNoRecord(Frame);
+		return;
+	}
+
+	DWORD FrameOffset = RecordSceneNode(Frame);
+	FGLCmdSceneNode *pCmd = (FGLCmdSceneNode *)m_pRecordBuffer->GetPtr(m_pRecordBuffer->Alloc(RT_CMD_CLEAR_Z, sizeof(FGLCmdSceneNode)));
+	pCmd->FrameOffset = FrameOffset;
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::EndFlash() {
+	guard(UOpenGLRenderDevice::EndFlash);
+
+	if (!m_pRecordBuffer) {
+		EndFlashNoRecord();
+		return;
+	}
+
+	m_pRecordBuffer->Alloc(RT_CMD_END_FLASH, 0);
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::PrecacheTexture(FTextureInfo& Info, DWORD PolyFlags) {
+	guard(UOpenGLRenderDevice::PrecacheTexture);
+
+	if (!m_pRecordBuffer) {
+		//Precaching usually happens outside of frames, while the render thread may still be drawing
+		SyncRenderThread();
+		PrecacheTextureNoRecord(Info, PolyFlags);
+		return;
+	}
+
+	DWORD TextureOffset = RecordTexture(Info);
+	FGLCmdPrecacheTexture *pCmd = (FGLCmdPrecacheTexture *)m_pRecordBuffer->GetPtr(m_pRecordBuffer->Alloc(RT_CMD_PRECACHE_TEXTURE, sizeof(FGLCmdPrecacheTexture)));
+	pCmd->TextureOffset = TextureOffset;
+	pCmd->PolyFlags = PolyFlags;
+
+	unguard;
+}
+
+FGLCapture::FGLCapture() {
+	Ar = NULL;
+	Exiting = false;
+	Head = 0;
+	NumQueued = 0;
+	SizeX = 0;
+	SizeY = 0;
+	Y4M = false;
+	NumFrames = 0;
+	NumStalls = 0;
+}
+
+FGLCapture::~FGLCapture() {
+	Stop();
+}
+
+bool FGLCapture::Start(const TCHAR *pFilename, INT InSizeX, INT InSizeY, INT FrameRate, bool InSwapRB,
+	const BYTE *pRampR, const BYTE *pRampG, const BYTE *pRampB, bool InUseSSE2)
+{
+	guard(FGLCapture::Start);
+	FString Filename = pFilename;
+	INT u;
+
+	Ar = GFileManager->CreateFileWriter(pFilename);
+	if (!Ar) {
+		return false;
+	}
+
+	SizeX = InSizeX;
+	SizeY = InSizeY;
+	Y4M = (appStricmp(*Filename.Right(4), TEXT(".y4m")) == 0);
+	SwapRB = InSwapRB;
+	UseSSE2 = InUseSSE2;
+	UseGamma = (pRampR != NULL);
+	if (UseGamma) {
+		appMemcpy(GammaRamp[0], pRampR, 256);
+		appMemcpy(GammaRamp[1], pRampG, 256);
+		appMemcpy(GammaRamp[2], pRampB, 256);
+	}
+
+	if (Y4M) {
+		//Full range 4:4:4, as the conversion does not subsample chroma
+		FString Header = FString::Printf(TEXT("YUV4MPEG2 W%i H%i F%i:1 Ip A1:1 C444 XCOLORRANGE=FULL\n"), SizeX, SizeY, FrameRate);
+		Ar->Serialize((void *)appToAnsi(*Header), Header.Len());
+	}
+
+	//Everything the capture thread uses is allocated up front
+	for (u = 0; u < NUM_SLOTS; u++) {
+		Slots[u].Add(SizeX * SizeY * 4);
+	}
+	RowBuf.Add(SizeX * 4);
+	Out.Add(SizeX * SizeY * (Y4M ? 3 : 4));
+
+	Exiting = false;
+	Head = 0;
+	NumQueued = 0;
+	NumFrames = 0;
+	NumStalls = 0;
+	if (!Thread.Start(ThreadMain, this)) {
+		delete Ar;
+		Ar = NULL;
+		return false;
+	}
+
+	return true;
+	unguard;
+}
+
+void FGLCapture::Stop(void) {
+	guard(FGLCapture::Stop);
+
+	if (!Ar) {
+		return;
+	}
+
+	Section.Lock();
+	Exiting = true;
+	WorkReady.Signal();
+	Section.Unlock();
+	Thread.Join();
+
+	Ar->Close();
+	delete Ar;
+	Ar = NULL;
+
+	unguard;
+}
+
+BYTE *FGLCapture::BeginFrame(void) {
+	FScopeLock Lock(Section);
+
+	if (NumQueued == NUM_SLOTS) {
+		NumStalls++;
+		while (NumQueued == NUM_SLOTS) {
+			WorkDone.Wait(Section);
+		}
+	}
+
+	return &Slots[Head](0);
+}
+
+void FGLCapture::EndFrame(void) {
+	FScopeLock Lock(Section);
+
+	Head = (Head + 1) % NUM_SLOTS;
+	NumQueued++;
+	NumFrames++;
+	WorkReady.Signal();
+}
+
+void FGLCapture::ThreadMain(void *Arg) {
+	FGLCapture *pCapture = (FGLCapture *)Arg;
+
+	pCapture->Section.Lock();
+	for (;;) {
+		while ((pCapture->NumQueued == 0) && !pCapture->Exiting) {
+			pCapture->WorkReady.Wait(pCapture->Section);
+		}
+		if (pCapture->NumQueued == 0) {
+			break;
+		}
+
+		//Queued frames end just before the head
+		INT Slot = (pCapture->Head + NUM_SLOTS - pCapture->NumQueued) % NUM_SLOTS;
+		pCapture->Section.Unlock();
+
+		pCapture->WriteFrame(&pCapture->Slots[Slot](0));
+
+		pCapture->Section.Lock();
+		pCapture->NumQueued--;
+		pCapture->WorkDone.Signal();
+	}
+	pCapture->Section.Unlock();
+}
+
+//Flips, swizzles and gamma corrects a frame, then converts it to the file format and writes it
+void FGLCapture::WriteFrame(const BYTE *pSrc) {
+	INT RowBytes = SizeX * 4;
+	INT y;
+
+	for (y = 0; y < SizeY; y++) {
+		const BYTE *pRow = pSrc + (SizeY - 1 - y) * RowBytes;
+		BYTE *pDst = Y4M ? &RowBuf(0) : &Out(y * RowBytes);
+
+		if (SwapRB) {
+			CPixConv::SwapRB(pRow, pDst, SizeX, UseSSE2);
+			pRow = pDst;
+		}
+		if (UseGamma) {
+			CPixConv::ApplyRamp(pRow, pDst, SizeX, GammaRamp[0], GammaRamp[1], GammaRamp[2]);
+			pRow = pDst;
+		}
+
+		if (Y4M) {
+			CPixConv::ToYUV444(pRow, SizeX, &Out(y * SizeX), &Out((SizeY + y) * SizeX), &Out((2 * SizeY + y) * SizeX), UseSSE2);
+		}
+		else if (pRow != pDst) {
+			appMemcpy(pDst, pRow, RowBytes);
+		}
+	}
+
+	if (Y4M) {
+		Ar->Serialize((void *)"FRAME\n", 6);
+	}
+	Ar->Serialize(&Out(0), Out.Num());
+}
+
+//Starts capturing every frame to a file
+void UOpenGLRenderDevice::StartCapture(const TCHAR *pFilename, INT FrameRate) {
+	guard(UOpenGLRenderDevice::StartCapture);
+	FByteGammaRamp gammaByteRamp;
+	bool useGamma = false;
+	INT SizeX, SizeY;
+	DWORD u;
+
+	StopCapture();
+
+	SizeX = Viewport->SizeX;
+	SizeY = Viewport->SizeY;
+
+	//Gamma correct captures like screenshots
+	if (GammaCorrectScreenshots && m_setGammaRampSucceeded) {
+		BuildGammaRamp(SavedGammaCorrection, SavedGammaCorrection, SavedGammaCorrection, Brightness, gammaByteRamp);
+		useGamma = true;
+	}
+
+	m_capture = new FGLCapture;
+	if (!m_capture->Start(pFilename, SizeX, SizeY, FrameRate, !SUPPORTS_GL_EXT_bgra,
+		useGamma ? gammaByteRamp.red : NULL, gammaByteRamp.green, gammaByteRamp.blue, PL_UseSSE2 != 0))
+	{
+		debugf(TEXT("CAPTURE failed to open %s"), pFilename);
+		delete m_capture;
+		m_capture = NULL;
+		return;
+	}
+
+	m_capturePBOActive = (SUPPORTS_GL_ARB_pixel_buffer_object && SUPPORTS_GL_ARB_vertex_buffer_object && SUPPORTS_GL_ARB_map_buffer_range) ? true : false;
+	if (m_capturePBOActive) {
+		glGenBuffersARB(CAPTURE_PBO_RING_SIZE, m_capturePBOs);
+		for (u = 0; u < CAPTURE_PBO_RING_SIZE; u++) {
+			glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, m_capturePBOs[u]);
+			glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, SizeX * SizeY * 4, NULL, GL_STREAM_READ_ARB);
+		}
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+	}
+	m_capturePBOIndex = 0;
+	m_capturePBOPending = 0;
+
+	debugf(TEXT("CAPTURE %ix%i at %i fps to %s as %s, %s read back"), SizeX, SizeY, FrameRate, pFilename,
+		m_capture->Y4M ? TEXT("Y4M") : TEXT("raw BGRA"), m_capturePBOActive ? TEXT("PBO") : TEXT("synchronous"));
+
+	unguard;
+}
+
+//Writes the frames still in flight and closes the capture
+void UOpenGLRenderDevice::StopCapture(void) {
+	guard(UOpenGLRenderDevice::StopCapture);
+
+	if (!m_capture) {
+		return;
+	}
+
+	if (m_capturePBOActive) {
+		while (m_capturePBOPending > 0) {
+			ReadCapturePBO((m_capturePBOIndex + CAPTURE_PBO_RING_SIZE - m_capturePBOPending) % CAPTURE_PBO_RING_SIZE);
+			m_capturePBOPending--;
+		}
+		glDeleteBuffersARB(CAPTURE_PBO_RING_SIZE, m_capturePBOs);
+		m_capturePBOActive = false;
+	}
+
+	m_capture->Stop();
+	debugf(TEXT("CAPTURE stopped after %u frames, %u waited for the capture thread"), m_capture->NumFrames, m_capture->NumStalls);
+
+	delete m_capture;
+	m_capture = NULL;
+
+	unguard;
+}
+
+//Reads the back buffer of a finished frame for the capture
+void UOpenGLRenderDevice::CaptureFrame(void) {
+	guard(UOpenGLRenderDevice::CaptureFrame);
+	GLenum format = SUPPORTS_GL_EXT_bgra ? GL_BGRA_EXT : GL_RGBA;
+	INT SizeX = m_capture->SizeX;
+	INT SizeY = m_capture->SizeY;
+
+	//The capture has a fixed size
+	if ((Viewport->SizeX != SizeX) || (Viewport->SizeY != SizeY)) {
+		debugf(TEXT("CAPTURE ended by a resolution change"));
+		StopCapture();
+		return;
+	}
+
+	//Without pixel pack buffers the read waits for the frame to be drawn
+	if (!m_capturePBOActive) {
+		glReadPixels(0, 0, SizeX, SizeY, format, GL_UNSIGNED_BYTE, m_capture->BeginFrame());
+		m_capture->EndFrame();
+		return;
+	}
+
+	//When the ring is full, the oldest frame is passed on before its buffer is reused
+	if (m_capturePBOPending == CAPTURE_PBO_RING_SIZE) {
+		ReadCapturePBO(m_capturePBOIndex);
+		m_capturePBOPending--;
+	}
+
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, m_capturePBOs[m_capturePBOIndex]);
+	glReadPixels(0, 0, SizeX, SizeY, format, GL_UNSIGNED_BYTE, 0);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+	m_capturePBOIndex = (m_capturePBOIndex + 1) % CAPTURE_PBO_RING_SIZE;
+	m_capturePBOPending++;
+
+	unguard;
+}
+
+//Passes a frame read into a pixel pack buffer to the capture thread
+void UOpenGLRenderDevice::ReadCapturePBO(DWORD Index) {
+	DWORD Size = m_capture->SizeX * m_capture->SizeY * 4;
+	const BYTE *pSrc;
+
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, m_capturePBOs[Index]);
+	pSrc = (const BYTE *)glMapBufferRange(GL_PIXEL_PACK_BUFFER_ARB, 0, Size, GL_MAP_READ_BIT);
+	if (pSrc != NULL) {
+		appMemcpy(m_capture->BeginFrame(), pSrc, Size);
+		m_capture->EndFrame();
+		glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+	}
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+}
+
+
+//Frame profiler
+//Timestamp query sets are reused in a ring, so reading the results rarely waits for the GPU
+void UOpenGLRenderDevice::InitProfilerSafe(void) {
+	guard(UOpenGLRenderDevice::InitProfiler);
+	INT i;
+
+	//Only initialize once
+	if (m_profActive) {
+		return;
+	}
+
+	if (!SUPPORTS_GL_ARB_timer_query) {
+		debugf(TEXT("Frame profiler: GL_ARB_timer_query not supported"));
+		UseProfiler = 0;
+		PL_UseProfiler = 0;
+		return;
+	}
+
+	for (i = 0; i < PROF_QUERY_FRAMES; i++) {
+		glGenQueries(FGLProfQuerySet::MAX_QUERIES, m_profQuerySets[i].Ids);
+		m_profQuerySets[i].NumQueries = 0;
+	}
+	m_profQuerySetIndex = 0;
+	m_profCategory = PROF_CAT_OTHER;
+	m_profFrameActive = false;
+	m_profPrevUnlockValid = false;
+
+	//Start with an empty frame ring
+	{
+		FScopeLock Lock(m_profSection);
+		m_profFrameHead = 0;
+		m_profFrameCount = 0;
+	}
+
+	m_profActive = true;
+
+	debugf(NAME_Init, TEXT("Frame profiler enabled"));
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::ShutdownProfiler(void) {
+	guard(UOpenGLRenderDevice::ShutdownProfiler);
+	INT i;
+
+	//Only shutdown once
+	if (!m_profActive) {
+		return;
+	}
+
+	//Keep the GPU times of the frames still waiting for them
+	for (i = 1; i <= PROF_QUERY_FRAMES; i++) {
+		ResolveProfQuerySet(m_profQuerySets[(m_profQuerySetIndex + i) % PROF_QUERY_FRAMES], true);
+	}
+
+	for (i = 0; i < PROF_QUERY_FRAMES; i++) {
+		glDeleteQueries(FGLProfQuerySet::MAX_QUERIES, m_profQuerySets[i].Ids);
+	}
+
+	m_profActive = false;
+	m_profFrameActive = false;
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::BeginProfFrame(void) {
+	FGLProfQuerySet &Set = m_profQuerySets[m_profQuerySetIndex];
+
+	//The set is normally resolved while it waits for its turn
+	if (Set.NumQueries > 0) {
+		ResolveProfQuerySet(Set, true);
+	}
+
+	glQueryCounter(Set.Ids[0], GL_TIMESTAMP);
+	Set.Cats[0] = PROF_CAT_OTHER;
+	Set.NumQueries = 1;
+
+	m_profCategory = PROF_CAT_OTHER;
+	m_profFrameActive = true;
+}
+
+void UOpenGLRenderDevice::EndProfFrame(void) {
+	FGLProfQuerySet &Set = m_profQuerySets[m_profQuerySetIndex];
+	double msPerCycle = GSecondsPerCycle * 1000.0f;
+#if defined UTGLR_DX_BUILD || defined UTGLR_RUNE_BUILD
+	FLOAT curTime;
+#else
+	FTime curTime;
+#endif
+	INT i;
+
+	//A query is always kept free for the end of the frame
+	glQueryCounter(Set.Ids[Set.NumQueries], GL_TIMESTAMP);
+	Set.Cats[Set.NumQueries] = PROF_CAT_OTHER;
+	Set.NumQueries++;
+	m_profFrameActive = false;
+
+	curTime = appSeconds();
+
+	{
+		FScopeLock Lock(m_profSection);
+		FGLProfFrame &Frame = m_profFrames[m_profFrameHead];
+
+		Frame.Frame = m_currentFrameCount;
+		Frame.FrameMs = (m_profPrevUnlockValid) ? (curTime - m_profPrevUnlockTime) * 1000.0f : 0.0f;
+		Frame.CPUMs = (curTime - m_profLockTime) * 1000.0f;
+		Frame.BindMs = msPerCycle * BindCycles;
+		Frame.ImageMs = msPerCycle * ImageCycles;
+		Frame.ComplexMs = msPerCycle * ComplexCycles;
+		Frame.GouraudMs = msPerCycle * GouraudCycles;
+		Frame.TileMs = msPerCycle * TileCycles;
+		Frame.GPUValid = false;
+		Frame.GPUMs = 0.0f;
+		for (i = 0; i < PROF_NUM_CATS; i++) {
+			Frame.GPUCatMs[i] = 0.0f;
+		}
+		Frame.DrawCalls = m_drawCallCount;
+		Frame.TexBinds = m_texBindCount;
+		Frame.StateSwitches = m_vpSwitchCount + m_fpSwitchCount + m_glslSwitchCount + m_AASwitchCount;
+		Frame.TexUploads = m_texUploadCount + m_asyncTexUploadCount;
+		Frame.UploadBytes = m_texUploadBytes;
+		Frame.StreamBytes = m_streamVBOBytes;
+
+		Set.RingIndex = m_profFrameHead;
+		Set.Frame = m_currentFrameCount;
+
+		m_profFrameHead = (m_profFrameHead + 1) % PROF_RING_SIZE;
+		if (m_profFrameCount < PROF_RING_SIZE) {
+			m_profFrameCount++;
+		}
+	}
+
+	m_profPrevUnlockTime = curTime;
+	m_profPrevUnlockValid = true;
+
+	//Read the results that are ready, oldest first
+	m_profQuerySetIndex = (m_profQuerySetIndex + 1) % PROF_QUERY_FRAMES;
+	for (i = 0; i < PROF_QUERY_FRAMES; i++) {
+		if (!ResolveProfQuerySet(m_profQuerySets[(m_profQuerySetIndex + i) % PROF_QUERY_FRAMES], false)) {
+			break;
+		}
+	}
+}
+
+//Returns false if the results are not available yet and Wait is not set
+bool UOpenGLRenderDevice::ResolveProfQuerySet(FGLProfQuerySet &Set, bool Wait) {
+	FLOAT catMs[PROF_NUM_CATS];
+	GLuint64 startTime, prevTime, curTime;
+	INT i;
+
+	if (Set.NumQueries == 0) {
+		return true;
+	}
+
+	//Queries complete in order, so the last one covers the set
+	if (!Wait) {
+		GLint available = 0;
+
+		glGetQueryObjectiv(Set.Ids[Set.NumQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			return false;
+		}
+	}
+
+	for (i = 0; i < PROF_NUM_CATS; i++) {
+		catMs[i] = 0.0f;
+	}
+	glGetQueryObjectui64v(Set.Ids[0], GL_QUERY_RESULT, &startTime);
+	prevTime = startTime;
+	for (i = 1; i < Set.NumQueries; i++) {
+		glGetQueryObjectui64v(Set.Ids[i], GL_QUERY_RESULT, &curTime);
+		catMs[Set.Cats[i - 1]] += (FLOAT)((double)(curTime - prevTime) * 1.0e-6);
+		prevTime = curTime;
+	}
+	Set.NumQueries = 0;
+
+	//The ring entry belongs to another frame if the ring was restarted since
+	FScopeLock Lock(m_profSection);
+	FGLProfFrame &Frame = m_profFrames[Set.RingIndex];
+	if (Frame.Frame == Set.Frame) {
+		Frame.GPUValid = true;
+		Frame.GPUMs = (FLOAT)((double)(prevTime - startTime) * 1.0e-6);
+		for (i = 0; i < PROF_NUM_CATS; i++) {
+			Frame.GPUCatMs[i] = catMs[i];
+		}
+	}
+
+	return true;
+}
+
+void UOpenGLRenderDevice::SetProfCategoryNoCheck(BYTE Category) {
+	FGLProfQuerySet &Set = m_profQuerySets[m_profQuerySetIndex];
+
+	//Past the query limit, the rest of the frame goes to the current category
+	if (Set.NumQueries >= (FGLProfQuerySet::MAX_QUERIES - 1)) {
+		return;
+	}
+
+	glQueryCounter(Set.Ids[Set.NumQueries], GL_TIMESTAMP);
+	Set.Cats[Set.NumQueries] = Category;
+	Set.NumQueries++;
+
+	m_profCategory = Category;
+}
+
+//Averages the most recent frames of the ring and returns how many there were
+//GPU times are averaged over the frames that have them
+INT UOpenGLRenderDevice::GetProfAverage(INT NumFrames, FGLProfFrame &Avg, INT &NumGPUFrames) {
+	FScopeLock Lock(m_profSection);
+	INT i, j;
+
+	appMemzero(&Avg, sizeof(Avg));
+	NumGPUFrames = 0;
+
+	NumFrames = Min(NumFrames, m_profFrameCount);
+	for (i = 0; i < NumFrames; i++) {
+		const FGLProfFrame &Frame = m_profFrames[(m_profFrameHead + PROF_RING_SIZE - 1 - i) % PROF_RING_SIZE];
+
+		Avg.FrameMs += Frame.FrameMs;
+		Avg.CPUMs += Frame.CPUMs;
+		Avg.BindMs += Frame.BindMs;
+		Avg.ImageMs += Frame.ImageMs;
+		Avg.ComplexMs += Frame.ComplexMs;
+		Avg.GouraudMs += Frame.GouraudMs;
+		Avg.TileMs += Frame.TileMs;
+		Avg.DrawCalls += Frame.DrawCalls;
+		Avg.TexBinds += Frame.TexBinds;
+		Avg.StateSwitches += Frame.StateSwitches;
+		Avg.TexUploads += Frame.TexUploads;
+		Avg.UploadBytes += Frame.UploadBytes;
+		Avg.StreamBytes += Frame.StreamBytes;
+		if (Frame.GPUValid) {
+			Avg.GPUMs += Frame.GPUMs;
+			for (j = 0; j < PROF_NUM_CATS; j++) {
+				Avg.GPUCatMs[j] += Frame.GPUCatMs[j];
+			}
+			NumGPUFrames++;
+		}
+	}
+
+	if (NumFrames > 0) {
+		FLOAT rcpNumFrames = 1.0f / NumFrames;
+
+		Avg.FrameMs *= rcpNumFrames;
+		Avg.CPUMs *= rcpNumFrames;
+		Avg.BindMs *= rcpNumFrames;
+		Avg.ImageMs *= rcpNumFrames;
+		Avg.ComplexMs *= rcpNumFrames;
+		Avg.GouraudMs *= rcpNumFrames;
+		Avg.TileMs *= rcpNumFrames;
+		Avg.DrawCalls /= NumFrames;
+		Avg.TexBinds /= NumFrames;
+		Avg.StateSwitches /= NumFrames;
+		Avg.TexUploads /= NumFrames;
+		Avg.UploadBytes /= NumFrames;
+		Avg.StreamBytes /= NumFrames;
+	}
+	if (NumGPUFrames > 0) {
+		FLOAT rcpNumGPUFrames = 1.0f / NumGPUFrames;
+
+		Avg.GPUValid = true;
+		Avg.GPUMs *= rcpNumGPUFrames;
+		for (j = 0; j < PROF_NUM_CATS; j++) {
+			Avg.GPUCatMs[j] *= rcpNumGPUFrames;
+		}
+	}
+
+	return NumFrames;
+}
+
+//Writes the frame ring oldest first, one line per frame
+bool UOpenGLRenderDevice::WriteProfCSV(const TCHAR *pFilename) {
+	guard(UOpenGLRenderDevice::WriteProfCSV);
+	FString Text;
+	INT i;
+
+	//Wait for the GPU times still outstanding
+	if (m_profActive && !m_profFrameActive) {
+		for (i = 1; i <= PROF_QUERY_FRAMES; i++) {
+			ResolveProfQuerySet(m_profQuerySets[(m_profQuerySetIndex + i) % PROF_QUERY_FRAMES], true);
+		}
+	}
+
+	Text = TEXT("frame,frame_ms,cpu_ms,bind_ms,image_ms,complex_ms,gouraud_ms,tile_ms,")
+		TEXT("gpu_valid,gpu_ms,gpu_other_ms,gpu_complex_ms,gpu_gouraud_ms,gpu_tile_ms,gpu_detail_ms,gpu_fog_ms,")
+		TEXT("draw_calls,tex_binds,state_switches,tex_uploads,upload_bytes,stream_bytes\r\n");
 
-		glColor4f(FlashFog.X, FlashFog.Y, FlashFog.Z, 1.0f - Min(FlashScale.X * 2.0f, 1.0f));
+	{
+		FScopeLock Lock(m_profSection);
 
-		FLOAT RFX2 = m_RProjZ;
-		FLOAT RFY2 = m_RProjZ * m_Aspect;
+		for (i = 0; i < m_profFrameCount; i++) {
+			const FGLProfFrame &Frame = m_profFrames[(m_profFrameHead + PROF_RING_SIZE - m_profFrameCount + i) % PROF_RING_SIZE];
 
-		//Adjust Z coordinate if Z range hack is active
-		FLOAT ZCoord = 1.0f;
-		if (m_useZRangeHack) {
-			ZCoord = (((ZCoord - 0.5f) / 7.5f) * 4.0f) + 4.0f;
+			Text += FString::Printf(TEXT("%u,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%i,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%u,%u,%u,%u,%u,%u\r\n"),
+				Frame.Frame, Frame.FrameMs, Frame.CPUMs,
+				Frame.BindMs, Frame.ImageMs, Frame.ComplexMs, Frame.GouraudMs, Frame.TileMs,
+				Frame.GPUValid ? 1 : 0, Frame.GPUMs,
+				Frame.GPUCatMs[PROF_CAT_OTHER], Frame.GPUCatMs[PROF_CAT_COMPLEX], Frame.GPUCatMs[PROF_CAT_GOURAUD],
+				Frame.GPUCatMs[PROF_CAT_TILE], Frame.GPUCatMs[PROF_CAT_DETAIL], Frame.GPUCatMs[PROF_CAT_FOG],
+				Frame.DrawCalls, Frame.TexBinds, Frame.StateSwitches, Frame.TexUploads, Frame.UploadBytes, Frame.StreamBytes);
 		}
-
-		glBegin(GL_TRIANGLE_FAN);
-		glVertex3f(RFX2 * (-1.0f * ZCoord), RFY2 * (-1.0f * ZCoord), ZCoord);
-		glVertex3f(RFX2 * (+1.0f * ZCoord), RFY2 * (-1.0f * ZCoord), ZCoord);
-		glVertex3f(RFX2 * (+1.0f * ZCoord), RFY2 * (+1.0f * ZCoord), ZCoord);
-		glVertex3f(RFX2 * (-1.0f * ZCoord), RFY2 * (+1.0f * ZCoord), ZCoord);
-		glEnd();
 	}
+
+	return appSaveStringToFile(Text, pFilename) ? true : false;
+
 	unguard;
 }
 
-void UOpenGLRenderDevice::PrecacheTexture(FTextureInfo& Info, DWORD PolyFlags) {
-	guard(UOpenGLRenderDevice::PrecacheTexture);
-	check(SetContext() == 0);
+void UOpenGLRenderDevice::DrawStats(FSceneNode* Frame) {
+	guard(UOpenGLRenderDevice::DrawStats);
+	UCanvas *Canvas = Frame->Viewport->Canvas;
+	FGLProfFrame Avg;
+	INT numFrames, numGPUFrames;
 
-	SetTextureNoPanBias(0, Info, PolyFlags);
+	if (!UseProfiler) {
+		return;
+	}
+
+	numFrames = GetProfAverage(PROF_AVERAGE_FRAMES, Avg, numGPUFrames);
+	if (numFrames == 0) {
+		return;
+	}
+
+	Canvas->WrappedPrintf(Canvas->SmallFont, 0, TEXT("OpenGL profile, %i frames: Frame %.2f ms  CPU %.2f ms  GPU %.2f ms%s"),
+		numFrames, Avg.FrameMs, Avg.CPUMs, Avg.GPUMs,
+		(numGPUFrames == 0) ? TEXT("") : ((Avg.GPUMs > Avg.CPUMs) ? TEXT("  (GPU bound)") : TEXT("  (CPU bound)")));
+	Canvas->WrappedPrintf(Canvas->SmallFont, 0, TEXT("GPU: Complex %.2f  Gouraud %.2f  Tile %.2f  Detail %.2f  Fog %.2f  Other %.2f"),
+		Avg.GPUCatMs[PROF_CAT_COMPLEX], Avg.GPUCatMs[PROF_CAT_GOURAUD], Avg.GPUCatMs[PROF_CAT_TILE],
+		Avg.GPUCatMs[PROF_CAT_DETAIL], Avg.GPUCatMs[PROF_CAT_FOG], Avg.GPUCatMs[PROF_CAT_OTHER]);
+	Canvas->WrappedPrintf(Canvas->SmallFont, 0, TEXT("CPU: Bind %.2f  Image %.2f  Complex %.2f  Gouraud %.2f  Tile %.2f"),
+		Avg.BindMs, Avg.ImageMs, Avg.ComplexMs, Avg.GouraudMs, Avg.TileMs);
+	Canvas->WrappedPrintf(Canvas->SmallFont, 0, TEXT("Draws %u  Binds %u  Switches %u  Uploads %u (%u KB)  Stream %u KB"),
+		Avg.DrawCalls, Avg.TexBinds, Avg.StateSwitches, Avg.TexUploads, Avg.UploadBytes / 1024, Avg.StreamBytes / 1024);
 
 	unguard;
 }
@@ -4408,20 +7374,43 @@ void UOpenGLRenderDevice::ScanForOldTextures(void) {
 	while (pCT != m_nonZeroPrefixBindChain->end()) {
 		DWORD numFramesSinceUsed = m_currentFrameCount - pCT->LastUsedFrameCount;
 		if (numFramesSinceUsed > DynamicTexIdRecycleLevel) {
+			//Textures still waiting for their conversion only have placeholder storage
+			bool placeholderOnly = (pCT->pConvertJob != NULL);
+			DetachTextureConversion(pCT);
+
+			//Return atlas cells to their page, the page texture stays allocated
+			if (pCT->atlasPage != LMA_NO_PAGE) {
+				FreeLightMapAtlasCell(pCT);
+
+				//Remove node from linked list
+				m_nonZeroPrefixBindChain->unlink(pCT);
+
+				//Get pointer to node in bind map
+				QWORD_CTTree_t::node_t *pNode = (QWORD_CTTree_t::node_t *)((BYTE *)pCT - (uintptr_t)&(((QWORD_CTTree_t::node_t *)0)->data));
+				//Advanced cached texture pointer to next entry in linked list
+				pCT = pCT->pNext;
+
+				//Remove node from bind map
+				RemoveNonZeroPrefixBind(pNode);
+
+				//Add node to free list
+				m_nonZeroPrefixNodePool.add(pNode);
+
+				continue;
+			}
+
 			//See if the tex pool is not enabled, or the tex format is not RGBA8, or the texture has mipmaps
-			if (!UseTexPool || (pCT->texInternalFormat != GL_RGBA8) || (pCT->texParams.hasMipmaps)) {
+			if (!UseTexPool || (pCT->texInternalFormat != GL_RGBA8) || (pCT->texParams.hasMipmaps) || placeholderOnly) {
 				//Remove node from linked list
 				m_nonZeroPrefixBindChain->unlink(pCT);
 
 				//Get pointer to node in bind map
 				QWORD_CTTree_t::node_t *pNode = (QWORD_CTTree_t::node_t *)((BYTE *)pCT - (uintptr_t)&(((QWORD_CTTree_t::node_t *)0)->data));
-				//Extract tree index
-				BYTE treeIndex = pCT->treeIndex;
 				//Advanced cached texture pointer to next entry in linked list
 				pCT = pCT->pNext;
 
 				//Remove node from bind map
-				m_nonZeroPrefixBindTrees[treeIndex].remove(pNode);
+				RemoveNonZeroPrefixBind(pNode);
 
 				//Add node plus texture id to texture id pool
 				m_nonZeroPrefixTexIdPool->add(pNode);
@@ -4447,13 +7436,11 @@ void UOpenGLRenderDevice::ScanForOldTextures(void) {
 
 				//Get pointer to node in bind map
 				QWORD_CTTree_t::node_t *pNode = (QWORD_CTTree_t::node_t *)((BYTE *)pCT - (uintptr_t)&(((QWORD_CTTree_t::node_t *)0)->data));
-				//Extract tree index
-				BYTE treeIndex = pCT->treeIndex;
 				//Advanced cached texture pointer to next entry in linked list
 				pCT = pCT->pNext;
 
 				//Remove node from bind map
-				m_nonZeroPrefixBindTrees[treeIndex].remove(pNode);
+				RemoveNonZeroPrefixBind(pNode);
 
 				//See if the key does not yet exist
 				texPoolPtr = m_RGBA8TexPool->find(texPoolKey);
@@ -4490,6 +7477,7 @@ void UOpenGLRenderDevice::SetNoTextureNoCheck(INT Multi) {
 
 	//Set texture
 	glBindTexture(GL_TEXTURE_2D, m_noTextureId);
+	m_texBindCount++;
 
 	TexInfo[Multi].CurrentCacheID = TEX_CACHE_ID_NO_TEX;
 	TexInfo[Multi].pBind = NULL;
@@ -4507,6 +7495,7 @@ void UOpenGLRenderDevice::SetAlphaTextureNoCheck(INT Multi) {
 
 	//Set texture
 	glBindTexture(GL_TEXTURE_2D, m_alphaTextureId);
+	m_texBindCount++;
 
 	TexInfo[Multi].CurrentCacheID = TEX_CACHE_ID_ALPHA_TEX;
 	TexInfo[Multi].pBind = NULL;
@@ -4517,6 +7506,10 @@ void UOpenGLRenderDevice::SetAlphaTextureNoCheck(INT Multi) {
 }
 
 FCachedTexture *UOpenGLRenderDevice::FindCachedTexture(QWORD CacheID) {
+	if (PL_UseBindHash) {
+		return m_bindHash->find(CacheID);
+	}
+
 	bool isZeroPrefixCacheID = ((CacheID & 0xFFFFFFFF00000000ULL) == 0) ? true : false;
 	FCachedTexture *pBind = NULL;
 
@@ -4543,6 +7536,363 @@ FCachedTexture *UOpenGLRenderDevice::FindCachedTexture(QWORD CacheID) {
 	return pBind;
 }
 
+void UOpenGLRenderDevice::RemoveNonZeroPrefixBind(QWORD_CTTree_t::node_t *pNode) {
+	if (PL_UseBindHash) {
+		m_bindHash->remove(pNode->key);
+	}
+	else {
+		m_nonZeroPrefixBindTrees[pNode->data.treeIndex].remove(pNode);
+	}
+}
+
+//Times hit testing every BSP polygon of the level against a box around the player
+//Compares one triangle at a time with the batched triangle and polygon paths
+void UOpenGLRenderDevice::RunHitBench(INT Passes) {
+	guard(UOpenGLRenderDevice::RunHitBench);
+	enum { BOX_HALF_SIZE = 256 };
+	static const TCHAR *s_methodNames[] = { TEXT("tri"), TEXT("batched tris"), TEXT("batched polys") };
+	TArray<CGClip::vec3_t> polyPts;
+	TArray<CGClip::vec3_t> triPts;
+	TArray<unsigned int> polyNumPts;
+	CGClip gclip;
+	FVector Center;
+	INT numTris;
+	INT method;
+	INT i, j;
+
+	if (!Viewport->Actor || !Viewport->Actor->XLevel || !Viewport->Actor->XLevel->Model) {
+		debugf(TEXT("HITBENCH: no level"));
+		return;
+	}
+	UModel *Model = Viewport->Actor->XLevel->Model;
+
+	//World space points of every node polygon, and the same polygons as fan triangles
+	for (i = 0; i < Model->Nodes.Num(); i++) {
+		const FBspNode &Node = Model->Nodes(i);
+		INT NumPts = Node.NumVertices;
+		INT firstPt = polyPts.Num();
+
+		if (NumPts < 3) {
+			continue;
+		}
+
+		polyPts.Add(NumPts);
+		for (j = 0; j < NumPts; j++) {
+			const FVector &Point = Model->Points(Model->Verts(Node.iVertPool + j).pVertex);
+			CGClip::vec3_t &pt = polyPts(firstPt + j);
+
+			pt.x = Point.X;
+			pt.y = Point.Y;
+			pt.z = Point.Z;
+		}
+		polyNumPts.AddItem(NumPts);
+
+		for (j = 2; j < NumPts; j++) {
+			triPts.AddItem(polyPts(firstPt));
+			triPts.AddItem(polyPts(firstPt + j - 1));
+			triPts.AddItem(polyPts(firstPt + j));
+		}
+	}
+	numTris = triPts.Num() / 3;
+	if (numTris == 0) {
+		debugf(TEXT("HITBENCH: level has no polygons"));
+		return;
+	}
+
+	//All six planes in use, like a selection frustum
+	Center = Viewport->Actor->Location;
+	for (i = 0; i < 3; i++) {
+		float cp[4];
+
+		cp[0] = (i == 0) ? 1.0f : 0.0f;
+		cp[1] = (i == 1) ? 1.0f : 0.0f;
+		cp[2] = (i == 2) ? 1.0f : 0.0f;
+		cp[3] = BOX_HALF_SIZE - Center.Component(i);
+		gclip.SetCp(i * 2, cp);
+		gclip.SetCpEnable(i * 2, true);
+
+		cp[0] = -cp[0];
+		cp[1] = -cp[1];
+		cp[2] = -cp[2];
+		cp[3] = BOX_HALF_SIZE + Center.Component(i);
+		gclip.SetCp(i * 2 + 1, cp);
+		gclip.SetCpEnable(i * 2 + 1, true);
+	}
+
+	debugf(TEXT("HITBENCH: %i polygons, %i triangles, %i passes"), polyNumPts.Num(), numTris, Passes);
+
+	for (method = 0; method < 3; method++) {
+		DWORD benchCycles = 0;
+		INT pass;
+
+		cycle(benchCycles);
+		for (pass = 0; pass < Passes; pass++) {
+			gclip.SelectModeStart();
+			gclip.PushHitName(1);
+			switch (method) {
+			case 0:
+				for (i = 0; i < numTris; i++) {
+					gclip.SelectDrawTri(&triPts(i * 3));
+				}
+				break;
+			case 1:
+				gclip.SelectDrawTris(&triPts(0), numTris);
+				break;
+			default:
+				gclip.SelectDrawPolys(&polyPts(0), &polyNumPts(0), polyNumPts.Num());
+				break;
+			}
+		}
+		uncycle(benchCycles);
+
+		debugf(TEXT("HITBENCH: %s %.1f ns per triangle, hit [%i], nearest depth %f"),
+			s_methodNames[method],
+			benchCycles * GSecondsPerCycle * 1000000000.0 / ((double)Passes * numTris),
+			gclip.CheckNewSelectHit() ? 1 : 0,
+			gclip.GetSelectClosestDepth());
+		gclip.SelectModeEnd();
+	}
+
+	unguard;
+}
+
+//Records one timedemo frame, called before the swap
+//Checksum readbacks are not counted in the next frame time
+void UOpenGLRenderDevice::RecordTimeDemoFrame(void) {
+	guard(UOpenGLRenderDevice::RecordTimeDemoFrame);
+#if defined UTGLR_DX_BUILD || defined UTGLR_RUNE_BUILD
+	FLOAT curTime;
+#else
+	FTime curTime;
+#endif
+	DWORD checksum = 0;
+
+	curTime = appSeconds();
+	if (m_timeDemoFrameIndex >= 0) {
+		m_timeDemoTimes.AddItem(curTime - m_timeDemoPrevTime);
+
+		if ((m_timeDemoChecksumInterval > 0) && ((m_timeDemoFrameIndex % m_timeDemoChecksumInterval) == 0)) {
+			INT size = Viewport->SizeX * Viewport->SizeY * 4;
+
+			if (m_timeDemoPixels.Num() != size) {
+				m_timeDemoPixels.Empty();
+				m_timeDemoPixels.Add(size);
+			}
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glReadPixels(0, 0, Viewport->SizeX, Viewport->SizeY, GL_RGBA, GL_UNSIGNED_BYTE, &m_timeDemoPixels(0));
+			checksum = appMemCrc(&m_timeDemoPixels(0), size, 0);
+			new(m_deferredLog)FString(FString::Printf(TEXT("TIMEDEMO: frame %i checksum %08X"), m_timeDemoFrameIndex, checksum));
+			curTime = appSeconds();
+		}
+		m_timeDemoChecksums.AddItem(checksum);
+	}
+	m_timeDemoPrevTime = curTime;
+
+	if (++m_timeDemoFrameIndex >= m_timeDemoFrames) {
+		FinishTimeDemo();
+	}
+
+	unguard;
+}
+
+//Logs the lines queued by frame rendering, called on the game thread while the render thread is idle
+void UOpenGLRenderDevice::FlushDeferredLog(void) {
+	guard(UOpenGLRenderDevice::FlushDeferredLog);
+	INT i;
+
+	if (m_streamVBOMapFailed) {
+		m_streamVBOMapFailed = false;
+		debugf(TEXT("Streaming VBO map failed, using client memory vertex arrays"));
+	}
+
+	for (i = 0; i < m_deferredLog.Num(); i++) {
+		debugf(TEXT("%s"), *m_deferredLog(i));
+	}
+	m_deferredLog.Empty();
+
+	unguard;
+}
+
+//Game thread side of the timedemo, called while the render thread is idle
+//Writes the frame times file and latches the pan and exit state
+void UOpenGLRenderDevice::PollTimeDemo(void) {
+	guard(UOpenGLRenderDevice::PollTimeDemo);
+
+	if (m_timeDemoCsv.Len() > 0) {
+		if (!appSaveStringToFile(m_timeDemoCsv, *m_timeDemoFilename)) {
+			debugf(TEXT("TIMEDEMO: cannot write %s"), *m_timeDemoFilename);
+		}
+		m_timeDemoCsv.Empty();
+	}
+
+	//Only the timed frames turn the view, not the warmup
+	m_timeDemoPanning = (m_timeDemoActive && m_timeDemoPan && (m_timeDemoFrameIndex >= 0)) ? true : false;
+	if (!m_timeDemoPanning) {
+		m_timeDemoPanAccum = 0;
+	}
+
+	if (m_timeDemoExitRequested) {
+		m_timeDemoExitRequested = false;
+		appRequestExit(0);
+	}
+
+	unguard;
+}
+
+static INT CDECL CompareTimeDemoTimes(const FLOAT *A, const FLOAT *B) {
+	return (*A < *B) ? -1 : ((*A > *B) ? 1 : 0);
+}
+
+void UOpenGLRenderDevice::FinishTimeDemo(void) {
+	guard(UOpenGLRenderDevice::FinishTimeDemo);
+	TArray<FLOAT> sorted;
+	FLOAT total = 0.0f;
+	INT numFrames = m_timeDemoTimes.Num();
+	INT i;
+
+	m_timeDemoActive = false;
+
+	if (numFrames > 0) {
+		sorted = m_timeDemoTimes;
+		appQsort(&sorted(0), numFrames, sizeof(FLOAT), (QSORT_COMPARE)CompareTimeDemoTimes);
+		for (i = 0; i < numFrames; i++) {
+			total += sorted(i);
+		}
+
+		new(m_deferredLog)FString(FString::Printf(TEXT("TIMEDEMO: %i frames, average %.2f ms (%.1f fps), min %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms"),
+			numFrames,
+			total * 1000.0f / numFrames,
+			(total > 0.0f) ? (numFrames / total) : 0.0f,
+			sorted(0) * 1000.0f,
+			sorted(numFrames / 2) * 1000.0f,
+			sorted(Min(numFrames - 1, (INT)(numFrames * 0.99f))) * 1000.0f,
+			sorted(numFrames - 1) * 1000.0f));
+
+		//Per frame times in the order they were rendered
+		if (m_timeDemoFilename.Len() > 0) {
+			m_timeDemoCsv = TEXT("frame,ms,checksum\r\n");
+			for (i = 0; i < numFrames; i++) {
+				m_timeDemoCsv += FString::Printf(TEXT("%i,%.3f,%08X\r\n"), i, m_timeDemoTimes(i) * 1000.0f, m_timeDemoChecksums(i));
+			}
+		}
+	}
+
+	m_timeDemoTimes.Empty();
+	m_timeDemoChecksums.Empty();
+	m_timeDemoPixels.Empty();
+
+	//Exit is requested from the game thread
+	if (m_timeDemoExit) {
+		m_timeDemoExitRequested = true;
+	}
+
+	unguard;
+}
+
+//Times FindCachedTexture with the bind trees and with the bind hash
+//Uses separate bind lookups filled with generated cache ids, so the texture cache is not disturbed
+void UOpenGLRenderDevice::RunBindBench(void) {
+	guard(UOpenGLRenderDevice::RunBindBench);
+	static const INT s_numResident[] = { 2000, 10000, 50000 };
+	enum { NUM_LOOKUPS = 1 << 18 };
+	enum { NUM_PASSES = 4 };
+	DWORD_CTTree_t *savedZeroPrefixBindTrees = m_zeroPrefixBindTrees;
+	QWORD_CTTree_t *savedNonZeroPrefixBindTrees = m_nonZeroPrefixBindTrees;
+	CTHash_t *savedBindHash = m_bindHash;
+	UBOOL savedUseBindHash = PL_UseBindHash;
+	INT sizeIndex;
+
+	for (sizeIndex = 0; sizeIndex < ARRAY_COUNT(s_numResident); sizeIndex++) {
+		INT numResident = s_numResident[sizeIndex];
+		DWORD_CTTree_t *zeroPrefixBindTrees = new DWORD_CTTree_t[NUM_CTTree_TREES];
+		QWORD_CTTree_t *nonZeroPrefixBindTrees = new QWORD_CTTree_t[NUM_CTTree_TREES];
+		CTHash_t bindHash;
+		TArray<QWORD> CacheIDs(numResident);
+		TArray<QWORD> LookupIDs(NUM_LOOKUPS);
+		DOUBLE lookupTime[2];
+		DWORD randState = 1;
+		INT i;
+
+		//Cache ids are made like the engine makes them
+		//Every fourth one is a texture with a zero prefix, the others are surface light and fog maps
+		for (i = 0; i < numResident; i++) {
+			QWORD CacheID;
+
+			if ((i & 3) == 0) {
+				DWORD_CTTree_t::node_t *pNode = m_DWORD_CTTree_Allocator.alloc_node();
+
+				CacheID = CID_RenderTexture + ((QWORD)(1000 + i) << 8);
+				pNode->key = (DWORD)CacheID;
+				pNode->data.bindType = BIND_TYPE_ZERO_PREFIX;
+				zeroPrefixBindTrees[CTZeroPrefixCacheIDSuffixToTreeIndex(pNode->key)].insert(pNode);
+				bindHash.insert(CacheID, &pNode->data);
+			}
+			else {
+				QWORD_CTTree_t::node_t *pNode = m_QWORD_CTTree_Allocator.alloc_node();
+
+				CacheID = CID_StaticMap + ((QWORD)(i & 0xFFFF) << 16) + ((QWORD)(2000 + (i >> 16)) << 32);
+				pNode->key = CacheID;
+				pNode->data.bindType = BIND_TYPE_NON_ZERO_PREFIX;
+				nonZeroPrefixBindTrees[CTNonZeroPrefixCacheIDSuffixToTreeIndex((DWORD)CacheID)].insert(pNode);
+				bindHash.insert(CacheID, &pNode->data);
+			}
+			CacheIDs(i) = CacheID;
+		}
+
+		//Random lookups of resident textures
+		for (i = 0; i < NUM_LOOKUPS; i++) {
+			randState = randState * 1664525 + 1013904223;
+			LookupIDs(i) = CacheIDs((randState >> 8) % numResident);
+		}
+
+		m_zeroPrefixBindTrees = zeroPrefixBindTrees;
+		m_nonZeroPrefixBindTrees = nonZeroPrefixBindTrees;
+		m_bindHash = &bindHash;
+
+		for (INT useBindHash = 0; useBindHash < 2; useBindHash++) {
+			DWORD benchCycles = 0;
+			INT numFound = 0;
+			INT pass;
+
+			PL_UseBindHash = useBindHash;
+
+			cycle(benchCycles);
+			for (pass = 0; pass < NUM_PASSES; pass++) {
+				for (i = 0; i < NUM_LOOKUPS; i++) {
+					if (FindCachedTexture(LookupIDs(i)) != NULL) {
+						numFound++;
+					}
+				}
+			}
+			uncycle(benchCycles);
+
+			if (numFound != (NUM_PASSES * NUM_LOOKUPS)) {
+				debugf(TEXT("BINDBENCH: lookup failed, %i of %i found"), numFound, NUM_PASSES * NUM_LOOKUPS);
+			}
+			lookupTime[useBindHash] = benchCycles * GSecondsPerCycle / (NUM_PASSES * NUM_LOOKUPS);
+		}
+
+		m_zeroPrefixBindTrees = savedZeroPrefixBindTrees;
+		m_nonZeroPrefixBindTrees = savedNonZeroPrefixBindTrees;
+		m_bindHash = savedBindHash;
+		PL_UseBindHash = savedUseBindHash;
+
+		debugf(TEXT("BINDBENCH: %i resident textures, tree %.1f ns, hash %.1f ns per lookup"),
+			numResident, lookupTime[0] * 1000000000.0, lookupTime[1] * 1000000000.0);
+
+		//The trees own the nodes
+		bindHash.clear();
+		for (i = 0; i < NUM_CTTree_TREES; i++) {
+			zeroPrefixBindTrees[i].clear(&m_DWORD_CTTree_Allocator);
+			nonZeroPrefixBindTrees[i].clear(&m_QWORD_CTTree_Allocator);
+		}
+		delete [] zeroPrefixBindTrees;
+		delete [] nonZeroPrefixBindTrees;
+	}
+
+	unguard;
+}
+
 UOpenGLRenderDevice::QWORD_CTTree_NodePool_t::node_t *UOpenGLRenderDevice::TryAllocFromTexPool(TexPoolMapKey_t texPoolKey) {
 	TexPoolMap_t::node_t *texPoolPtr;
 
@@ -4571,6 +7921,137 @@ UOpenGLRenderDevice::QWORD_CTTree_NodePool_t::node_t *UOpenGLRenderDevice::TryAl
 	return NULL;
 }
 
+//Places a new light or fog map in a free cell of an atlas page for its size class
+//Returns false if the texture must get its own texture object
+bool UOpenGLRenderDevice::AllocLightMapAtlasCell(FCachedTexture *pBind) {
+	FGLLightMapAtlas *pAtlas = m_lightMapAtlas;
+	INT page;
+
+	//Only small single level RGBA8 textures are placed in the atlas
+	if ((pBind->texType != TEX_TYPE_NORMAL) || (pBind->BaseMip != 0)) {
+		return false;
+	}
+	if ((pBind->UBits > LMA_MAX_CELL_BITS) || (pBind->VBits > LMA_MAX_CELL_BITS)) {
+		return false;
+	}
+
+	//Small textures are padded to the minimum cell size
+	BYTE cellUBits = Max<BYTE>(pBind->UBits, LMA_MIN_CELL_BITS);
+	BYTE cellVBits = Max<BYTE>(pBind->VBits, LMA_MIN_CELL_BITS);
+
+	//Find a page of the same size class with a free cell
+	for (page = 0; page < pAtlas->NumPages; page++) {
+		const FGLLightMapAtlasPage &Page = pAtlas->Pages[page];
+		if ((Page.CellUBits == cellUBits) && (Page.CellVBits == cellVBits) && (Page.FreeCells.Num() > 0)) {
+			break;
+		}
+	}
+
+	//Allocate a new page if none found
+	if (page == pAtlas->NumPages) {
+		if (page >= LMA_MAX_PAGES) {
+			return false;
+		}
+
+		FGLLightMapAtlasPage &Page = pAtlas->Pages[page];
+		INT numCells = ((1 << LMA_PAGE_BITS) / ((1 << cellUBits) + 2 * LMA_GUTTER)) * ((1 << LMA_PAGE_BITS) / ((1 << cellVBits) + 2 * LMA_GUTTER));
+		INT cell;
+
+		Page.CellUBits = cellUBits;
+		Page.CellVBits = cellVBits;
+
+		//Cells are taken from the end of the free list
+		Page.FreeCells.Empty(numCells);
+		for (cell = numCells - 1; cell >= 0; cell--) {
+			Page.FreeCells.AddItem((_WORD)cell);
+		}
+
+		//The caller binds the page before uploading to it
+		glGenTextures(1, &Page.Id);
+		glBindTexture(GL_TEXTURE_2D, Page.Id);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1 << LMA_PAGE_BITS, 1 << LMA_PAGE_BITS, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		AllocatedTextures++;
+
+		//All cells share the page texture object, so its state is set once here and never per cell
+		//Anisotropic filtering is left off, as its footprint can reach past the gutter
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, NoFiltering ? GL_NEAREST : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, NoFiltering ? GL_NEAREST : GL_LINEAR);
+
+		pAtlas->NumPages++;
+	}
+
+	FGLLightMapAtlasPage &Page = pAtlas->Pages[page];
+	_WORD cell = Page.FreeCells.Pop();
+	GLint xOffset, yOffset;
+
+	pBind->Id = Page.Id;
+	pBind->atlasPage = (BYTE)page;
+	pBind->atlasCell = cell;
+
+	//Scale texture coordinates to the page, and offset them to the cell through panning
+	GetLightMapAtlasCellOffset(Page, cell, xOffset, yOffset);
+	pBind->UMult *= 1.0f / (FLOAT)(1 << (LMA_PAGE_BITS - pBind->UBits));
+	pBind->VMult *= 1.0f / (FLOAT)(1 << (LMA_PAGE_BITS - pBind->VBits));
+	pBind->UAtlasPan = (FLOAT)xOffset / ((FLOAT)(1 << LMA_PAGE_BITS) * pBind->UMult);
+	pBind->VAtlasPan = (FLOAT)yOffset / ((FLOAT)(1 << LMA_PAGE_BITS) * pBind->VMult);
+
+	return true;
+}
+
+//Gets the texel offset of a cell within its page, inside the gutter
+void UOpenGLRenderDevice::GetLightMapAtlasCellOffset(const FGLLightMapAtlasPage &Page, INT cell, GLint &xOffset, GLint &yOffset) {
+	INT cellWidth = (1 << Page.CellUBits) + 2 * LMA_GUTTER;
+	INT cellHeight = (1 << Page.CellVBits) + 2 * LMA_GUTTER;
+	INT rowCells = (1 << LMA_PAGE_BITS) / cellWidth;
+
+	xOffset = (cell % rowCells) * cellWidth + LMA_GUTTER;
+	yOffset = (cell / rowCells) * cellHeight + LMA_GUTTER;
+}
+
+//Copies the border texels of a cell into the gutter around it
+//The texture is bound, and Src holds its RGBA8 base level
+void UOpenGLRenderDevice::UploadLightMapAtlasGutter(FCachedTexture *pBind, const BYTE *Src, GLint xOffset, GLint yOffset, INT texWidth, INT texHeight) {
+	GLenum format = pBind->texSourceFormat;
+	const BYTE *pLastRow = Src + (texHeight - 1) * texWidth * 4;
+	const BYTE *pLastCol = Src + (texWidth - 1) * 4;
+
+	//Top and bottom rows
+	glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset, yOffset - 1, texWidth, 1, format, GL_UNSIGNED_BYTE, Src);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset, yOffset + texHeight, texWidth, 1, format, GL_UNSIGNED_BYTE, pLastRow);
+
+	//Left and right columns
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, texWidth);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset - 1, yOffset, 1, texHeight, format, GL_UNSIGNED_BYTE, Src);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset + texWidth, yOffset, 1, texHeight, format, GL_UNSIGNED_BYTE, pLastCol);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	//Corners
+	glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset - 1, yOffset - 1, 1, 1, format, GL_UNSIGNED_BYTE, Src);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset + texWidth, yOffset - 1, 1, 1, format, GL_UNSIGNED_BYTE, pLastCol);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset - 1, yOffset + texHeight, 1, 1, format, GL_UNSIGNED_BYTE, pLastRow);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset + texWidth, yOffset + texHeight, 1, 1, format, GL_UNSIGNED_BYTE, pLastRow + (texWidth - 1) * 4);
+}
+
+void UOpenGLRenderDevice::FreeLightMapAtlasCell(FCachedTexture *pBind) {
+	m_lightMapAtlas->Pages[pBind->atlasPage].FreeCells.AddItem(pBind->atlasCell);
+	pBind->atlasPage = LMA_NO_PAGE;
+}
+
+void UOpenGLRenderDevice::FreeLightMapAtlas(void) {
+	FGLLightMapAtlas *pAtlas = m_lightMapAtlas;
+	INT page;
+
+	for (page = 0; page < pAtlas->NumPages; page++) {
+		FGLLightMapAtlasPage &Page = pAtlas->Pages[page];
+
+		glDeleteTextures(1, &Page.Id);
+		Page.Id = 0;
+		Page.FreeCells.Empty();
+	}
+	pAtlas->NumPages = 0;
+}
+
 BYTE UOpenGLRenderDevice::GenerateTexFilterParams(DWORD PolyFlags, FCachedTexture *pBind) {
 	BYTE texFilter;
 
@@ -4659,14 +8140,18 @@ void UOpenGLRenderDevice::SetTextureNoCheck(FTexInfo& Tex, FTextureInfo& Info, D
 	pBind = FindCachedTexture(Tex.CurrentCacheID);
 
 	if (pBind) {
-		//Update when texture last referenced
-		pBind->LastUsedFrameCount = m_currentFrameCount;
+		//Textures already used this frame are in the tail part of the LRU list that is sorted by frame
+		//Skipping these keeps repeated binds from touching the list neighbors
+		if (pBind->LastUsedFrameCount != m_currentFrameCount) {
+			//Update when texture last referenced
+			pBind->LastUsedFrameCount = m_currentFrameCount;
 
-		//Check if texture is in LRU list
-		if (pBind->bindType == BIND_TYPE_NON_ZERO_PREFIX_LRU_LIST) {
-			//Move node to tail of linked list
-			m_nonZeroPrefixBindChain->unlink(pBind);
-			m_nonZeroPrefixBindChain->link_to_tail(pBind);
+			//Check if texture is in LRU list
+			if (pBind->bindType == BIND_TYPE_NON_ZERO_PREFIX_LRU_LIST) {
+				//Move node to tail of linked list
+				m_nonZeroPrefixBindChain->unlink(pBind);
+				m_nonZeroPrefixBindChain->link_to_tail(pBind);
+			}
 		}
 
 		existingBind = true;
@@ -4682,13 +8167,24 @@ void UOpenGLRenderDevice::SetTextureNoCheck(FTexInfo& Tex, FTextureInfo& Info, D
 			//Insert new texture info
 			pNewNode = m_DWORD_CTTree_Allocator.alloc_node();
 			pNewNode->key = CacheIDSuffix;
-			zeroPrefixBindTree->insert(pNewNode);
+			if (PL_UseBindHash) {
+				m_bindHash->insert(Tex.CurrentCacheID, &pNewNode->data);
+			}
+			else {
+				zeroPrefixBindTree->insert(pNewNode);
+			}
 			pBind = &pNewNode->data;
 			pBind->LastUsedFrameCount = m_currentFrameCount;
 
 			//Set bind type
 			pBind->bindType = BIND_TYPE_ZERO_PREFIX;
 
+			//Not in the lightmap atlas
+			pBind->atlasPage = LMA_NO_PAGE;
+			pBind->UAtlasPan = 0.0f;
+			pBind->VAtlasPan = 0.0f;
+			pBind->pConvertJob = NULL;
+
 			//Set default tex params
 			pBind->texParams = CT_DEFAULT_TEX_PARAMS;
 			pBind->dynamicTexBits = (PolyFlags & PF_NoSmooth) ? DT_NO_SMOOTH_BIT : 0;
@@ -4715,7 +8211,12 @@ void UOpenGLRenderDevice::SetTextureNoCheck(FTexInfo& Tex, FTextureInfo& Info, D
 
 			//Insert new texture info
 			pNewNode->key = Tex.CurrentCacheID;
-			nonZeroPrefixBindTree->insert(pNewNode);
+			if (PL_UseBindHash) {
+				m_bindHash->insert(Tex.CurrentCacheID, &pNewNode->data);
+			}
+			else {
+				nonZeroPrefixBindTree->insert(pNewNode);
+			}
 			pBind = &pNewNode->data;
 			pBind->LastUsedFrameCount = m_currentFrameCount;
 
@@ -4728,6 +8229,12 @@ void UOpenGLRenderDevice::SetTextureNoCheck(FTexInfo& Tex, FTextureInfo& Info, D
 			//Save tree index
 			pBind->treeIndex = (BYTE)treeIndex;
 
+			//Not in the lightmap atlas unless placed there below
+			pBind->atlasPage = LMA_NO_PAGE;
+			pBind->UAtlasPan = 0.0f;
+			pBind->VAtlasPan = 0.0f;
+			pBind->pConvertJob = NULL;
+
 			//Set default tex params
 			pBind->texParams = CT_DEFAULT_TEX_PARAMS;
 			pBind->dynamicTexBits = (PolyFlags & PF_NoSmooth) ? DT_NO_SMOOTH_BIT : 0;
@@ -4741,9 +8248,15 @@ void UOpenGLRenderDevice::SetTextureNoCheck(FTexInfo& Tex, FTextureInfo& Info, D
 			//Cache texture info for the new texture
 			CacheTextureInfo(pBind, Info, PolyFlags);
 
-			//See if the tex pool is enabled
+			//See if the texture can be placed in the lightmap atlas
 			bool needTexIdAllocate = true;
-			if (UseTexPool) {
+			if (UseLightMapAtlas && (Info.Format == TEXF_RGBA7) && (Info.NumMips == 1) && !AlwaysMipmap && AllocLightMapAtlasCell(pBind)) {
+				//Page texture already has storage for the cell
+				needTexIdAllocate = false;
+				needTexAllocate = false;
+			}
+			//See if the tex pool is enabled
+			else if (UseTexPool) {
 				//See if the format will be RGBA8
 				//Only textures without mipmaps are stored in the tex pool
 				if ((pBind->texType == TEX_TYPE_NORMAL) && (Info.NumMips == 1)) {
@@ -4794,14 +8307,24 @@ void UOpenGLRenderDevice::SetTextureNoCheck(FTexInfo& Tex, FTextureInfo& Info, D
 		}
 	}
 
+	//Set texture
+	//Atlas cells share their page texture, which may already be bound
+	if ((Tex.pBind == NULL) || (Tex.pBind->Id != pBind->Id)) {
+		glBindTexture(GL_TEXTURE_2D, pBind->Id);
+		m_texBindCount++;
+	}
+
 	//Save pointer to current texture bind for current texture unit
 	Tex.pBind = pBind;
 
-	//Set texture
-	glBindTexture(GL_TEXTURE_2D, pBind->Id);
-
 	uncycle(BindCycles);
 
+	//Replace the atlas offset SetTexture applied for the previous texture
+	Tex.UPan += Tex.UAtlasPan - pBind->UAtlasPan;
+	Tex.VPan += Tex.VAtlasPan - pBind->VAtlasPan;
+	Tex.UAtlasPan = pBind->UAtlasPan;
+	Tex.VAtlasPan = pBind->VAtlasPan;
+
 	// Account for all the impact on scale normalization.
 	Tex.UMult = pBind->UMult;
 	Tex.VMult = pBind->VMult;
@@ -4810,8 +8333,9 @@ void UOpenGLRenderDevice::SetTextureNoCheck(FTexInfo& Tex, FTextureInfo& Info, D
 	{
 		BYTE desiredDynamicTexBits;
 
+		//Atlas cells use the state of their page
 		desiredDynamicTexBits = (PolyFlags & PF_NoSmooth) ? DT_NO_SMOOTH_BIT : 0;
-		if (desiredDynamicTexBits != pBind->dynamicTexBits) {
+		if ((desiredDynamicTexBits != pBind->dynamicTexBits) && (pBind->atlasPage == LMA_NO_PAGE)) {
 			BYTE dynamicTexBitsXor;
 
 			dynamicTexBitsXor = desiredDynamicTexBits ^ pBind->dynamicTexBits;
@@ -4833,14 +8357,78 @@ void UOpenGLRenderDevice::SetTextureNoCheck(FTexInfo& Tex, FTextureInfo& Info, D
 
 	// Upload if needed.
 	if (!existingBind || Info.bRealtimeChanged) {
-		UploadTextureExec(Info, PolyFlags, pBind, existingBind, needTexAllocate);
+		FGLTexDiskCacheKey diskCacheKey;
+		const FGLTexDiskCacheKey *pDiskCacheKey = NULL;
+		bool uploaded = false;
+
+		//New textures may be read from the disk cache
+		//Otherwise they may be converted on a worker thread, showing a placeholder until then
+		if (!existingBind) {
+			if (m_texDiskCacheActive && GetTexDiskCacheKey(Tex.CurrentCacheID, Info, PolyFlags, pBind, diskCacheKey)) {
+				pDiskCacheKey = &diskCacheKey;
+				uploaded = UploadTextureFromDiskCache(diskCacheKey, Info, PolyFlags, pBind);
+			}
+			if (!uploaded && m_texConvertQueue) {
+				uploaded = QueueTextureConversion(Tex.CurrentCacheID, Info, PolyFlags, pBind, pDiskCacheKey);
+			}
+		}
+		if (!uploaded) {
+			UploadTextureExec(Info, PolyFlags, pBind, existingBind, needTexAllocate, pDiskCacheKey);
+		}
 	}
 
 	unguard;
 }
 
-void UOpenGLRenderDevice::UploadTextureExec(FTextureInfo& Info, DWORD PolyFlags, FCachedTexture *pBind, bool existingBind, bool needTexAllocate) {
+//Sets the texture object state of a new texture, with the texture bound
+void UOpenGLRenderDevice::InitNewTextureState(FTextureInfo& Info, DWORD PolyFlags, FCachedTexture *pBind) {
+	UBOOL SkipMipmaps = (Info.NumMips == 1) && !AlwaysMipmap;
+	INT MaxLevel = pBind->MaxLevel;
+	DWORD texMaxLevel;
+	BYTE texFilter;
+
+	//Set tex max level param
+	//This is set once for new textures and never changed afterwards
+	texMaxLevel = 1000;
+	if (!SkipMipmaps) {
+		texMaxLevel = MaxLevel;
+	}
+	else {
+		texMaxLevel = 0;
+	}
+	//Update if different than default for new textures
+	if (texMaxLevel != 1000) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texMaxLevel);
+	}
+
+	//Flag indicating if texture has mipmaps
+	//This is set once for new textures and never changed afterwards
+	pBind->texParams.hasMipmaps = (!SkipMipmaps) ? true : false;
+
+	//Texture filter params set once for each texture
+	pBind->texParams.texObjFilter = 0;
+#ifdef UTGLR_UNREAL_227_BUILD
+	// Check if clamped or wrapped (f.e. for Skyboxes). Smirftsch
+	if (Info.UClampMode) {
+		pBind->texParams.texObjFilter |= CT_ADDRESS_U_CLAMP;
+	}
+	if (Info.VClampMode) {
+		pBind->texParams.texObjFilter |= CT_ADDRESS_V_CLAMP;
+	}
+#endif
+
+
+	//Generate tex filter params
+	texFilter = GenerateTexFilterParams(PolyFlags, pBind);
+
+	//Set tex filter state
+	SetTexFilter(pBind, texFilter);
+}
+
+void UOpenGLRenderDevice::UploadTextureExec(FTextureInfo& Info, DWORD PolyFlags, FCachedTexture *pBind, bool existingBind, bool needTexAllocate, const FGLTexDiskCacheKey *pDiskCacheKey) {
 	FColor paletteIndex0;
+	TArray<BYTE> diskCacheData;
+	DWORD diskCacheLevelSizes[TEX_DISK_CACHE_MAX_LEVELS];
 
 	// Cleanup texture flags.
 	if (SupportsLazyTextures) {
@@ -4848,6 +8436,15 @@ void UOpenGLRenderDevice::UploadTextureExec(FTextureInfo& Info, DWORD PolyFlags,
 	}
 	Info.bRealtimeChanged = 0;
 
+	//A texture still waiting for its conversion only has placeholder storage
+	if (pBind->pConvertJob) {
+		DetachTextureConversion(pBind);
+		needTexAllocate = true;
+	}
+	if (!existingBind) {
+		m_texUploadCount++;
+	}
+
 	//Set palette index 0 to black for masked paletted textures
 	if (Info.Palette && (PolyFlags & PF_Masked)) {
 		paletteIndex0 = Info.Palette[0];
@@ -4863,12 +8460,26 @@ void UOpenGLRenderDevice::UploadTextureExec(FTextureInfo& Info, DWORD PolyFlags,
 
 	// width * height * 4 bytes per pixel
 	DWORD memAllocSize = 1 << (pBind->UBits + pBind->VBits + 2);
-	if (memAllocSize > LOCAL_TEX_COMPOSE_BUFFER_SIZE) {
-		m_texComposeMemMark = FMemMark(GMem);
-		m_texConvertCtx.pCompose = New<BYTE>(GMem, memAllocSize);
+	//Compressed levels are encoded after the RGBA8 data
+	DWORD compressOffset = memAllocSize;
+	if (pBind->texCompress != TEX_COMPRESS_NONE) {
+		memAllocSize *= 2;
+	}
+	bool usedMemStack = false;
+	if (memAllocSize <= LOCAL_TEX_COMPOSE_BUFFER_SIZE) {
+		m_texConvertCtx.pCompose = m_localTexComposeBuffer;
+	}
+	else if (m_renderThreadReplaying) {
+		//Grows to the largest texture and is kept until UnsetRes
+		if ((DWORD)m_renderThreadComposeBuffer.Num() < memAllocSize + 16) {
+			m_renderThreadComposeBuffer.Add(memAllocSize + 16 - m_renderThreadComposeBuffer.Num());
+		}
+		m_texConvertCtx.pCompose = (BYTE *)AlignMemPtr(&m_renderThreadComposeBuffer(0), 16);
 	}
 	else {
-		m_texConvertCtx.pCompose = m_localTexComposeBuffer;
+		m_texComposeMemMark = FMemMark(GMem);
+		m_texConvertCtx.pCompose = New<BYTE>(GMem, memAllocSize);
+		usedMemStack = true;
 	}
 
 	m_texConvertCtx.pBind = pBind;
@@ -4877,46 +8488,9 @@ void UOpenGLRenderDevice::UploadTextureExec(FTextureInfo& Info, DWORD PolyFlags,
 	INT MaxLevel = pBind->MaxLevel;
 
 	//Only update texture state for new textures
-	if (!existingBind) {
-		DWORD texMaxLevel;
-		BYTE texFilter;
-
-		//Set tex max level param
-		//This is set once for new textures and never changed afterwards
-		texMaxLevel = 1000;
-		if (!SkipMipmaps) {
-			texMaxLevel = MaxLevel;
-		}
-		else {
-			texMaxLevel = 0;
-		}
-		//Update if different than default for new textures
-		if (texMaxLevel != 1000) {
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texMaxLevel);
-		}
-
-		//Flag indicating if texture has mipmaps
-		//This is set once for new textures and never changed afterwards
-		pBind->texParams.hasMipmaps = (!SkipMipmaps) ? true : false;
-
-		//Texture filter params set once for each texture
-		pBind->texParams.texObjFilter = 0;
-#ifdef UTGLR_UNREAL_227_BUILD
-		// Check if clamped or wrapped (f.e. for Skyboxes). Smirftsch
-		if (Info.UClampMode) {
-			pBind->texParams.texObjFilter |= CT_ADDRESS_U_CLAMP;
-		}
-		if (Info.VClampMode) {
-			pBind->texParams.texObjFilter |= CT_ADDRESS_V_CLAMP;
-		}
-#endif
-
-
-		//Generate tex filter params
-		texFilter = GenerateTexFilterParams(PolyFlags, pBind);
-
-		//Set tex filter state
-		SetTexFilter(pBind, texFilter);
+	//Atlas cells use the state set when their page was allocated
+	if (!existingBind && (pBind->atlasPage == LMA_NO_PAGE)) {
+		InitNewTextureState(Info, PolyFlags, pBind);
 	}
 
 
@@ -4927,6 +8501,13 @@ void UOpenGLRenderDevice::UploadTextureExec(FTextureInfo& Info, DWORD PolyFlags,
 	}
 
 
+	//Atlas cells are updated in place within their page
+	GLint texXOffset = 0;
+	GLint texYOffset = 0;
+	if (pBind->atlasPage != LMA_NO_PAGE) {
+		GetLightMapAtlasCellOffset(m_lightMapAtlas->Pages[pBind->atlasPage], pBind->atlasCell, texXOffset, texYOffset);
+	}
+
 	//Set initial texture width and height in the context structure
 	//Setup code must ensure that both UBits and VBits are greater than or equal to 0
 	m_texConvertCtx.texWidthPow2 = 1 << pBind->UBits;
@@ -4965,17 +8546,17 @@ void UOpenGLRenderDevice::UploadTextureExec(FTextureInfo& Info, DWORD PolyFlags,
 
 			case TEX_TYPE_COMPRESSED_DXT1_TO_DXT3:
 				guard(ConvertDXT1_DXT3);
-				ConvertDXT1_DXT3(Mip, Level);
+				ConvertDXT1_DXT3(m_texConvertCtx, Mip, Level);
 				unguard;
 				break;
 
 			case TEX_TYPE_PALETTED:
 				guard(ConvertP8_P8);
 				if (stepBits == 0) {
-					ConvertP8_P8_NoStep(Mip, Level);
+					ConvertP8_P8_NoStep(m_texConvertCtx, Mip, Level);
 				}
 				else {
-					ConvertP8_P8(Mip, Level);
+					ConvertP8_P8(m_texConvertCtx, Mip, Level);
 				}
 				unguard;
 				break;
@@ -4983,17 +8564,17 @@ void UOpenGLRenderDevice::UploadTextureExec(FTextureInfo& Info, DWORD PolyFlags,
 			case TEX_TYPE_HAS_PALETTE:
 				guard(ConvertP8_RGBA8888);
 				if (stepBits == 0) {
-					ConvertP8_RGBA8888_NoStep(Mip, Info.Palette, Level);
+					ConvertP8_RGBA8888_NoStep(m_texConvertCtx, Mip, Info.Palette, Level);
 				}
 				else {
-					ConvertP8_RGBA8888(Mip, Info.Palette, Level);
+					ConvertP8_RGBA8888(m_texConvertCtx, Mip, Info.Palette, Level);
 				}
 				unguard;
 				break;
 
 			default:
 				guard(ConvertBGRA7777);
-				(this->*pBind->pConvertBGRA7777)(Mip, Level);
+				(this->*pBind->pConvertBGRA7777)(m_texConvertCtx, Mip, Level);
 				unguard;
 			}
 
@@ -5010,6 +8591,24 @@ void UOpenGLRenderDevice::UploadTextureExec(FTextureInfo& Info, DWORD PolyFlags,
 			m_texConvertCtx.texWidthPow2 = (texWidth & 0x1) | (texWidth >> 1);
 			m_texConvertCtx.texHeightPow2 = (texHeight & 0x1) | (texHeight >> 1);
 
+			if (pBind->texCompress != TEX_COMPRESS_NONE) {
+				guard(CompressMipRGBA);
+				CompressMipRGBA(pBind, Src, texWidth, texHeight, Src + compressOffset, PL_UseSSE2 != 0);
+				unguard;
+				Src += compressOffset;
+			}
+
+			//Collect converted levels for the disk cache
+			if (pDiskCacheKey) {
+				DWORD levelSize = GetConvertedLevelSize(pBind, texWidth, texHeight);
+				INT dataIndex = diskCacheData.Add(levelSize);
+
+				appMemcpy(&diskCacheData(dataIndex), Src, levelSize);
+				diskCacheLevelSizes[Level] = levelSize;
+			}
+
+			m_texUploadBytes += GetUploadLevelSize(pBind, texWidth, texHeight);
+
 			if (!needTexAllocate) {
 				//Update existing texture
 				switch (pBind->texType) {
@@ -5039,24 +8638,43 @@ void UOpenGLRenderDevice::UploadTextureExec(FTextureInfo& Info, DWORD PolyFlags,
 					break;
 
 				default:
-					guard(glTexSubImage2D);
+					if (pBind->texCompress != TEX_COMPRESS_NONE) {
+						guard(glCompressedTexSubImage2D);
+						glCompressedTexSubImage2DARB(
+							GL_TEXTURE_2D,
+							Level,
+							0,
+							0,
+							texWidth,
+							texHeight,
+							pBind->texInternalFormat,
+							GetConvertedLevelSize(pBind, texWidth, texHeight),
+							Src);
+						unguard;
+					}
+					else {
+						guard(glTexSubImage2D);
 #if 0
 {
 	static unsigned int s_c;
 	dbgPrintf("utglr: glTexSubImage2D = %u\n", s_c++);
 }
 #endif
-					glTexSubImage2D(
-						GL_TEXTURE_2D,
-						Level,
-						0,
-						0,
-						texWidth,
-						texHeight,
-						pBind->texSourceFormat,
-						GL_UNSIGNED_BYTE,
-						Src);
-					unguard;
+						glTexSubImage2D(
+							GL_TEXTURE_2D,
+							Level,
+							texXOffset,
+							texYOffset,
+							texWidth,
+							texHeight,
+							pBind->texSourceFormat,
+							GL_UNSIGNED_BYTE,
+							Src);
+						if (pBind->atlasPage != LMA_NO_PAGE) {
+							UploadLightMapAtlasGutter(pBind, Src, texXOffset, texYOffset, texWidth, texHeight);
+						}
+						unguard;
+					}
 				}
 			}
 			else {
@@ -5087,46 +8705,784 @@ void UOpenGLRenderDevice::UploadTextureExec(FTextureInfo& Info, DWORD PolyFlags,
 					break;
 
 				default:
-					guard(glTexImage2D);
+					if (pBind->texCompress != TEX_COMPRESS_NONE) {
+						guard(glCompressedTexImage2D);
+						glCompressedTexImage2DARB(
+							GL_TEXTURE_2D,
+							Level,
+							pBind->texInternalFormat,
+							texWidth,
+							texHeight,
+							0,
+							GetConvertedLevelSize(pBind, texWidth, texHeight),
+							Src);
+						unguard;
+					}
+					else {
+						guard(glTexImage2D);
 #if 0
 {
 	static unsigned int s_c;
 	dbgPrintf("utglr: glTexImage2D = %u\n", s_c++);
 }
 #endif
-					glTexImage2D(
-						GL_TEXTURE_2D,
-						Level,
-						pBind->texInternalFormat,
-						texWidth,
-						texHeight,
-						0,
-						pBind->texSourceFormat,
-						GL_UNSIGNED_BYTE,
-						Src);
-					unguard;
-				}
-			}
+						glTexImage2D(
+							GL_TEXTURE_2D,
+							Level,
+							pBind->texInternalFormat,
+							texWidth,
+							texHeight,
+							0,
+							pBind->texSourceFormat,
+							GL_UNSIGNED_BYTE,
+							Src);
+						unguard;
+					}
+				}
+			}
+		}
+	}
+
+	if (usedMemStack) {
+		m_texComposeMemMark.Pop();
+	}
+
+	uncycle(ImageCycles);
+
+	//Only complete mipmap chains are written to the disk cache
+	if (pDiskCacheKey && (Level > MaxUploadLevel)) {
+		WriteTexDiskCacheEntry(*pDiskCacheKey, Level, diskCacheLevelSizes, &diskCacheData(0));
+	}
+
+	//Restore palette index 0 for masked paletted textures
+	if (Info.Palette && (PolyFlags & PF_Masked)) {
+		Info.Palette[0] = paletteIndex0;
+	}
+
+	// Cleanup.
+	if (SupportsLazyTextures) {
+		Info.Unload();
+	}
+
+	return;
+}
+
+//Converts a mipmap of a texture that is expanded to RGBA8
+//Only reads the context, mipmap and palette, so it is safe to call from the conversion workers
+void UOpenGLRenderDevice::ConvertMipRGBA(FTexConvertCtx &Ctx, const FMipmapBase *Mip, const FColor *Palette, INT Level) {
+	if (Ctx.pBind->texType == TEX_TYPE_HAS_PALETTE) {
+		if (Ctx.stepBits == 0) {
+			ConvertP8_RGBA8888_NoStep(Ctx, Mip, Palette, Level);
+		}
+		else {
+			ConvertP8_RGBA8888(Ctx, Mip, Palette, Level);
+		}
+	}
+	else {
+		(this->*Ctx.pBind->pConvertBGRA7777)(Ctx, Mip, Level);
+	}
+}
+
+//Size of a converted level as uploaded
+DWORD UOpenGLRenderDevice::GetConvertedLevelSize(const FCachedTexture *pBind, DWORD texWidth, DWORD texHeight) {
+	switch (pBind->texCompress) {
+	case TEX_COMPRESS_BC1:
+		return CBCEnc::GetBC1Size(texWidth, texHeight);
+
+	case TEX_COMPRESS_BC3:
+		return CBCEnc::GetBC3Size(texWidth, texHeight);
+
+	default:
+		;
+	}
+
+	if (pBind->texType == TEX_TYPE_COMPRESSED_DXT1_TO_DXT3) {
+		return texWidth * texHeight;
+	}
+	return texWidth * texHeight * 4;
+}
+
+//Size of a level as passed to GL, including levels that were not converted
+DWORD UOpenGLRenderDevice::GetUploadLevelSize(const FCachedTexture *pBind, DWORD texWidth, DWORD texHeight) {
+	switch (pBind->texType) {
+	case TEX_TYPE_COMPRESSED_DXT1:
+		return texWidth * texHeight / 2;
+
+	case TEX_TYPE_COMPRESSED_DXT3:
+	case TEX_TYPE_COMPRESSED_DXT5:
+	case TEX_TYPE_PALETTED:
+		return texWidth * texHeight;
+
+	default:
+		;
+	}
+
+	return GetConvertedLevelSize(pBind, texWidth, texHeight);
+}
+
+//Encodes a level converted to RGBA8 for a compressed texture
+//Safe to call from the conversion workers
+void UOpenGLRenderDevice::CompressMipRGBA(const FCachedTexture *pBind, const BYTE *pSrc, DWORD texWidth, DWORD texHeight, BYTE *pDst, bool useSSE2) {
+	if (pBind->texCompress == TEX_COMPRESS_BC3) {
+		CBCEnc::EncodeBC3(pSrc, texWidth, texHeight, pDst, useSSE2);
+	}
+	else {
+		CBCEnc::EncodeBC1(pSrc, texWidth, texHeight, pDst, useSSE2);
+	}
+}
+
+void FGLTexConvertJob::DoWork() {
+	FTexConvertCtx Ctx;
+	INT Level;
+
+	Ctx.pBind = &ConvertBind;
+	Ctx.texWidthPow2 = 1 << ConvertBind.UBits;
+	Ctx.texHeightPow2 = 1 << ConvertBind.VBits;
+
+	for (Level = 0; Level < NumLevels; Level++) {
+		BYTE *pLevel = pData + LevelOffsets[Level];
+		bool compress = (ConvertBind.texCompress != UOpenGLRenderDevice::TEX_COMPRESS_NONE);
+
+		//Compressed levels are converted to RGBA8 first, then encoded into place
+		Ctx.pCompose = (compress) ? (pData + CompressOffset) : pLevel;
+		Ctx.stepBits = LevelStepBits[Level];
+
+		pDevice->ConvertMipRGBA(Ctx, &SrcMips[LevelMipIndex[Level]], Palette, Level);
+		if (compress) {
+			UOpenGLRenderDevice::CompressMipRGBA(&ConvertBind, Ctx.pCompose, Ctx.texWidthPow2, Ctx.texHeightPow2, pLevel, CompressUseSSE2);
+		}
+
+		//Both are divided by two down to a floor of 1
+		Ctx.texWidthPow2 = (Ctx.texWidthPow2 & 0x1) | (Ctx.texWidthPow2 >> 1);
+		Ctx.texHeightPow2 = (Ctx.texHeightPow2 & 0x1) | (Ctx.texHeightPow2 >> 1);
+	}
+
+	FScopeLock Lock(pQueue->Section);
+	Done = 1;
+}
+
+//Queues the conversion of a new texture, which must be bound
+//Returns false if the texture should be uploaded immediately instead
+bool UOpenGLRenderDevice::QueueTextureConversion(QWORD CacheID, FTextureInfo& Info, DWORD PolyFlags, FCachedTexture *pBind, const FGLTexDiskCacheKey *pDiskCacheKey) {
+	guard(UOpenGLRenderDevice::QueueTextureConversion);
+	FGLTexConvertQueue *pQueue = m_texConvertQueue;
+	FGLTexConvertJob *pJob;
+	DWORD texelBytes;
+
+	//Only textures expanded to RGBA8 are converted by the workers
+	if (pBind->texType == TEX_TYPE_HAS_PALETTE) {
+		texelBytes = 1;
+	}
+	else if ((pBind->texType == TEX_TYPE_NORMAL) && (Info.Format == TEXF_RGBA7)) {
+		texelBytes = 4;
+	}
+	else {
+		return false;
+	}
+	//Realtime textures change every frame and atlas cells are small updates of an existing page
+	if (Info.bRealtime || (pBind->atlasPage != LMA_NO_PAGE)) {
+		return false;
+	}
+	//Small textures are cheaper to convert than to queue
+	if ((pBind->UBits + pBind->VBits) < ASYNC_TEX_MIN_LOG_TEXELS) {
+		return false;
+	}
+	if (pQueue->PendingBytes >= ASYNC_TEX_MAX_PENDING_BYTES) {
+		return false;
+	}
+
+	UBOOL SkipMipmaps = (Info.NumMips == 1) && !AlwaysMipmap;
+	INT MaxUploadLevel = pBind->MaxLevel;
+	if (SkipMipmaps) {
+		MaxUploadLevel = 0;
+	}
+	if (MaxUploadLevel >= ASYNC_TEX_MAX_LEVELS) {
+		return false;
+	}
+
+	cycle(ImageCycles);
+
+	pJob = new FGLTexConvertJob;
+
+	//Lay out the converted levels the same way UploadTextureExec walks them
+	DWORD texWidth = 1 << pBind->UBits;
+	DWORD texHeight = 1 << pBind->VBits;
+	DWORD dataSize = 0;
+	INT Level;
+	for (Level = 0; Level <= MaxUploadLevel; Level++) {
+		INT MipIndex = pBind->BaseMip + Level;
+		INT stepBits = 0;
+		if (MipIndex >= Info.NumMips) {
+			stepBits = MipIndex - (Info.NumMips - 1);
+			MipIndex = Info.NumMips - 1;
+		}
+
+		FMipmapBase* Mip = Info.Mips[MipIndex];
+		if (!Mip || !Mip->DataPtr) {
+			//Skip looking at any subsequent mipmap pointers
+			break;
+		}
+
+		pJob->LevelMipIndex[Level] = MipIndex;
+		pJob->LevelStepBits[Level] = stepBits;
+		pJob->LevelOffsets[Level] = dataSize;
+		dataSize += GetConvertedLevelSize(pBind, texWidth, texHeight);
+
+		texWidth = (texWidth & 0x1) | (texWidth >> 1);
+		texHeight = (texHeight & 0x1) | (texHeight >> 1);
+	}
+	pJob->NumLevels = Level;
+	if (pJob->NumLevels == 0) {
+		delete pJob;
+		uncycle(ImageCycles);
+		return false;
+	}
+
+	//The source mipmaps are copied after the converted levels
+	INT FirstMip = pJob->LevelMipIndex[0];
+	INT LastMip = pJob->LevelMipIndex[pJob->NumLevels - 1];
+	DWORD allocSize = dataSize;
+	INT MipIndex;
+	for (MipIndex = FirstMip; MipIndex <= LastMip; MipIndex++) {
+		allocSize += Info.Mips[MipIndex]->USize * Info.Mips[MipIndex]->VSize * texelBytes;
+	}
+	//Compressed levels need room for the first level in RGBA8
+	pJob->CompressOffset = allocSize;
+	if (pBind->texCompress != TEX_COMPRESS_NONE) {
+		allocSize += 1 << (pBind->UBits + pBind->VBits + 2);
+	}
+
+	pJob->pData = (BYTE *)appMalloc(allocSize, TEXT("OpenGLTexConvert"));
+	BYTE *pSrcCopy = pJob->pData + dataSize;
+	for (MipIndex = FirstMip; MipIndex <= LastMip; MipIndex++) {
+		const FMipmapBase *Mip = Info.Mips[MipIndex];
+		DWORD mipSize = Mip->USize * Mip->VSize * texelBytes;
+
+		pJob->SrcMips[MipIndex] = *Mip;
+		pJob->SrcMips[MipIndex].DataPtr = pSrcCopy;
+		appMemcpy(pSrcCopy, Mip->DataPtr, mipSize);
+		pSrcCopy += mipSize;
+	}
+
+	if (Info.Palette) {
+		appMemcpy(pJob->Palette, Info.Palette, sizeof(pJob->Palette));
+
+		//Set palette index 0 to black for masked paletted textures
+		if (PolyFlags & PF_Masked) {
+			pJob->Palette[0] = FColor(0,0,0,0);
+		}
+	}
+
+	pJob->pDevice = this;
+	pJob->pQueue = pQueue;
+	pJob->pBind = pBind;
+	pJob->CacheID = CacheID;
+	pJob->ConvertBind = *pBind;
+	pJob->DataSize = dataSize;
+	pJob->AllocSize = allocSize;
+	pJob->CompressUseSSE2 = (PL_UseSSE2 != 0);
+	pJob->Done = 0;
+	pJob->WriteDiskCache = (pDiskCacheKey != NULL);
+	if (pDiskCacheKey) {
+		pJob->DiskCacheKey = *pDiskCacheKey;
+	}
+
+	//The placeholder is the first texel of the smallest level
+	{
+		FCachedTexture placeholderBind = *pBind;
+		FTexConvertCtx placeholderCtx;
+		DWORD placeholderTexel;
+
+		placeholderBind.UBits = 0;
+		placeholderBind.VBits = 0;
+		placeholderCtx.pCompose = (BYTE *)&placeholderTexel;
+		placeholderCtx.stepBits = 0;
+		placeholderCtx.texWidthPow2 = 1;
+		placeholderCtx.texHeightPow2 = 1;
+		placeholderCtx.pBind = &placeholderBind;
+		ConvertMipRGBA(placeholderCtx, &pJob->SrcMips[LastMip], pJob->Palette, 0);
+
+		InitNewTextureState(Info, PolyFlags, pBind);
+
+		//Keep the texture complete with a single level until the converted mipmaps arrive
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glTexImage2D(GL_TEXTURE_2D, 0, pBind->texInternalFormat, 1, 1, 0, pBind->texSourceFormat, GL_UNSIGNED_BYTE, &placeholderTexel);
+	}
+
+	Info.bRealtimeChanged = 0;
+	pBind->pConvertJob = pJob;
+
+	pQueue->Jobs.AddItem(pJob);
+	pQueue->PendingBytes += allocSize;
+	m_asyncTexQueueCount++;
+
+	//Runs the job immediately if no worker thread could be started
+	pQueue->Pool.AddTask(pJob);
+
+	uncycle(ImageCycles);
+
+	return true;
+
+	unguard;
+}
+
+//Uploads the textures whose conversion completed, a limited amount per frame unless waiting for all
+void UOpenGLRenderDevice::FinishTextureConversions(bool waitAll) {
+	guard(UOpenGLRenderDevice::FinishTextureConversions);
+	FGLTexConvertQueue *pQueue = m_texConvertQueue;
+	DWORD uploadBytes = 0;
+	INT i;
+
+	if (waitAll) {
+		pQueue->Pool.Wait();
+	}
+
+	for (i = 0; i < pQueue->Jobs.Num(); ) {
+		FGLTexConvertJob *pJob = pQueue->Jobs(i);
+		UBOOL done;
+
+		{
+			FScopeLock Lock(pQueue->Section);
+			done = pJob->Done;
+		}
+		if (!done) {
+			i++;
+			continue;
+		}
+
+		if (pJob->pBind) {
+			//Jobs that no texture waits for are still freed when over the upload limit
+			if (!waitAll && (uploadBytes >= ASYNC_TEX_UPLOAD_BYTES_PER_FRAME)) {
+				i++;
+				continue;
+			}
+
+			//Another context sharing the texture cache may have removed the texture
+			if (FindCachedTexture(pJob->CacheID) == pJob->pBind) {
+				UploadConvertedTexture(pJob);
+				uploadBytes += pJob->DataSize;
+			}
+		}
+
+		FreeTextureConversion(pJob);
+		pQueue->Jobs.Remove(i);
+	}
+
+	unguard;
+}
+
+//Drops all pending conversions, leaving their textures with the placeholder
+void UOpenGLRenderDevice::DiscardTextureConversions(void) {
+	guard(UOpenGLRenderDevice::DiscardTextureConversions);
+	FGLTexConvertQueue *pQueue = m_texConvertQueue;
+	INT i;
+
+	if (!pQueue) {
+		return;
+	}
+
+	//Workers may still be using the jobs
+	pQueue->Pool.Wait();
+
+	for (i = 0; i < pQueue->Jobs.Num(); i++) {
+		FGLTexConvertJob *pJob = pQueue->Jobs(i);
+
+		if (pJob->pBind) {
+			DetachTextureConversion(pJob->pBind);
+		}
+		FreeTextureConversion(pJob);
+	}
+	pQueue->Jobs.Empty();
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::UploadConvertedTexture(FGLTexConvertJob *pJob) {
+	guard(UOpenGLRenderDevice::UploadConvertedTexture);
+	FCachedTexture *pBind = pJob->pBind;
+	uintptr_t srcBase = (uintptr_t)pJob->pData;
+	bool usePBO = false;
+	INT Level;
+
+	cycle(ImageCycles);
+
+	//Uploads go through texture unit 0, which binds its texture again on next use
+	//Another unit may have been left active, so select unit 0 to keep its cached bind valid
+	if (SUPPORTS_GL_ARB_multitexture) {
+		glActiveTextureARB(GL_TEXTURE0_ARB);
+	}
+	glBindTexture(GL_TEXTURE_2D, pBind->Id);
+	TexInfo[0].CurrentCacheID = TEX_CACHE_ID_UNUSED;
+	TexInfo[0].pBind = NULL;
+
+	//Copy into the next buffer of the ring, orphaning the storage of its previous upload
+	//Texture updates are then sourced from the buffer without waiting for the copy
+	if (m_texPBOActive) {
+		BYTE *pDst;
+
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, m_texPBOs[m_texPBOIndex]);
+		m_texPBOIndex = (m_texPBOIndex + 1) % TEX_PBO_RING_SIZE;
+
+		glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, pJob->DataSize, NULL, GL_STREAM_DRAW_ARB);
+		pDst = (BYTE *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, 0, pJob->DataSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (pDst != NULL) {
+			appMemcpy(pDst, pJob->pData, pJob->DataSize);
+			glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+
+			//Level data is now addressed by buffer offset
+			srcBase = 0;
+			usePBO = true;
+		}
+		else {
+			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+		}
+	}
+
+	DWORD texWidth = 1 << pBind->UBits;
+	DWORD texHeight = 1 << pBind->VBits;
+	for (Level = 0; Level < pJob->NumLevels; Level++) {
+		if (pBind->texCompress != TEX_COMPRESS_NONE) {
+			guard(glCompressedTexImage2D);
+			glCompressedTexImage2DARB(
+				GL_TEXTURE_2D,
+				Level,
+				pBind->texInternalFormat,
+				texWidth,
+				texHeight,
+				0,
+				GetConvertedLevelSize(pBind, texWidth, texHeight),
+				(const GLvoid *)(srcBase + pJob->LevelOffsets[Level]));
+			unguard;
+		}
+		else {
+			guard(glTexImage2D);
+			glTexImage2D(
+				GL_TEXTURE_2D,
+				Level,
+				pBind->texInternalFormat,
+				texWidth,
+				texHeight,
+				0,
+				pBind->texSourceFormat,
+				GL_UNSIGNED_BYTE,
+				(const GLvoid *)(srcBase + pJob->LevelOffsets[Level]));
+			unguard;
+		}
+
+		texWidth = (texWidth & 0x1) | (texWidth >> 1);
+		texHeight = (texHeight & 0x1) | (texHeight >> 1);
+	}
+
+	if (usePBO) {
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	}
+
+	//Restore the mipmap levels the placeholder went without
+	if (pBind->texParams.hasMipmaps) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, pBind->MaxLevel);
+	}
+
+	pBind->pConvertJob = NULL;
+	m_asyncTexUploadCount++;
+	m_texUploadBytes += pJob->DataSize;
+
+	uncycle(ImageCycles);
+
+	if (pJob->WriteDiskCache) {
+		DWORD levelSizes[TEX_DISK_CACHE_MAX_LEVELS];
+
+		for (Level = 0; Level < pJob->NumLevels; Level++) {
+			DWORD levelEnd = (Level + 1 < pJob->NumLevels) ? pJob->LevelOffsets[Level + 1] : pJob->DataSize;
+			levelSizes[Level] = levelEnd - pJob->LevelOffsets[Level];
+		}
+		WriteTexDiskCacheEntry(pJob->DiskCacheKey, pJob->NumLevels, levelSizes, pJob->pData);
+	}
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::FreeTextureConversion(FGLTexConvertJob *pJob) {
+	m_texConvertQueue->PendingBytes -= pJob->AllocSize;
+	appFree(pJob->pData);
+	delete pJob;
+}
+
+//Maps a texture disk cache entry for reading
+//Returns NULL if the entry does not exist
+static const BYTE *MapTexDiskCacheFile(const TCHAR *pFilename, DWORD &Size) {
+#if defined(__LINUX__) || defined(__APPLE__)
+	struct stat fileStat;
+	void *pMap;
+	int fd;
+
+	fd = open(appToAnsi(pFilename), O_RDONLY);
+	if (fd == -1) {
+		return NULL;
+	}
+	if ((fstat(fd, &fileStat) != 0) || (fileStat.st_size <= 0) || (fileStat.st_size > MAXINT)) {
+		close(fd);
+		return NULL;
+	}
+	Size = (DWORD)fileStat.st_size;
+	pMap = mmap(NULL, Size, PROT_READ, MAP_PRIVATE, fd, 0);
+	//The mapping stays valid after the descriptor is closed
+	close(fd);
+	if (pMap == MAP_FAILED) {
+		return NULL;
+	}
+	//Entries are read front to back once
+	madvise(pMap, Size, MADV_SEQUENTIAL);
+
+	return (const BYTE *)pMap;
+#else
+	FArchive *Ar = GFileManager->CreateFileReader(pFilename);
+	BYTE *pData;
+
+	if (!Ar) {
+		return NULL;
+	}
+	Size = Ar->TotalSize();
+	pData = (BYTE *)appMalloc(Max<DWORD>(Size, 1), TEXT("OpenGLTexDiskCache"));
+	Ar->Serialize(pData, Size);
+	if (!Ar->Close()) {
+		appFree(pData);
+		pData = NULL;
+	}
+	delete Ar;
+
+	return pData;
+#endif
+}
+
+static void UnmapTexDiskCacheFile(const BYTE *pData, DWORD Size) {
+#if defined(__LINUX__) || defined(__APPLE__)
+	munmap((void *)pData, Size);
+#else
+	appFree((void *)pData);
+#endif
+}
+
+//Builds the disk cache key of a new texture
+//Returns false if the texture should not be cached
+bool UOpenGLRenderDevice::GetTexDiskCacheKey(QWORD CacheID, const FTextureInfo &Info, DWORD PolyFlags, const FCachedTexture *pBind, FGLTexDiskCacheKey &Key) {
+	guard(UOpenGLRenderDevice::GetTexDiskCacheKey);
+	DWORD Settings[12];
+
+	//Only textures that need converting are cached
+	switch (pBind->texType) {
+	case TEX_TYPE_COMPRESSED_DXT1_TO_DXT3:
+	case TEX_TYPE_HAS_PALETTE:
+	case TEX_TYPE_NORMAL:
+		break;
+
+	default:
+		return false;
+	}
+	//Lightmaps and other generated textures have no texture object to name them
+	if (!Info.Texture || Info.bRealtime || (pBind->atlasPage != LMA_NO_PAGE)) {
+		return false;
+	}
+	const FMipmapBase *Mip = Info.Mips[0];
+	if (!Mip || !Mip->DataPtr) {
+		return false;
+	}
+
+	UBOOL SkipMipmaps = (Info.NumMips == 1) && !AlwaysMipmap;
+	INT MaxUploadLevel = pBind->MaxLevel;
+	if (SkipMipmaps) {
+		MaxUploadLevel = 0;
+	}
+	if (MaxUploadLevel >= TEX_DISK_CACHE_MAX_LEVELS) {
+		return false;
+	}
+
+	//Everything the converted data depends on
+	//Config settings such as texture size limits, 16-bit textures and BGRA are folded into the bind
+	//Only the type and flag bits of the cache id are kept, the rest holds the object index
+	Settings[0] = (DWORD)(CacheID & 0xFF);
+	Settings[1] = pBind->texType;
+	Settings[2] = pBind->texInternalFormat;
+	Settings[3] = pBind->texSourceFormat;
+	Settings[4] = pBind->UBits | (pBind->VBits << 8) | (pBind->BaseMip << 16) | (MaxUploadLevel << 24);
+	Settings[5] = pBind->UClampVal;
+	Settings[6] = pBind->VClampVal;
+	Settings[7] = PolyFlags & PF_Masked;
+	Settings[8] = Info.Format;
+	Settings[9] = Info.USize | (Info.VSize << 16);
+	Settings[10] = Info.NumMips;
+	Settings[11] = (Info.Palette) ? 1 : 0;
+
+	Key.NameCrc = appStrCrc(Info.Texture->GetPathName());
+	Key.SettingsCrc = appMemCrc(Settings, sizeof(Settings));
+	Key.PaletteCrc = (Info.Palette) ? appMemCrc(Info.Palette, 256 * sizeof(FColor)) : 0;
+
+	//Every source level that is uploaded, so a texture changed under the same name never matches an old entry
+	Key.DataCrc = 0;
+	for (INT Level = 0; Level <= MaxUploadLevel; Level++) {
+		INT MipIndex = Min(pBind->BaseMip + Level, Info.NumMips - 1);
+		const FMipmapBase *LevelMip = Info.Mips[MipIndex];
+		if (!LevelMip || !LevelMip->DataPtr) {
+			break;
+		}
+		DWORD mipSize = GetRecordedMipSize(Info.Format, LevelMip);
+		if (mipSize == 0) {
+			return false;
+		}
+		Key.DataCrc = appMemCrc(LevelMip->DataPtr, mipSize, Key.DataCrc);
+
+		//Levels past the last mipmap are stepped down from it
+		if (MipIndex == Info.NumMips - 1) {
+			break;
 		}
 	}
 
-	if (memAllocSize > LOCAL_TEX_COMPOSE_BUFFER_SIZE) {
-		m_texComposeMemMark.Pop();
+	return true;
+
+	unguard;
+}
+
+FString UOpenGLRenderDevice::GetTexDiskCacheFilename(const FGLTexDiskCacheKey &Key) {
+	return m_texDiskCachePath * FString::Printf(TEXT("%08X%08X.gltex"), Key.NameCrc, Key.SettingsCrc ^ Key.PaletteCrc);
+}
+
+//Uploads a new texture from its disk cache entry, which must be bound
+//Returns false if there is no valid entry
+bool UOpenGLRenderDevice::UploadTextureFromDiskCache(const FGLTexDiskCacheKey &Key, FTextureInfo &Info, DWORD PolyFlags, FCachedTexture *pBind) {
+	guard(UOpenGLRenderDevice::UploadTextureFromDiskCache);
+	const FGLTexDiskCacheHeader *pHeader;
+	const BYTE *pMap;
+	const BYTE *pSrc;
+	DWORD mapSize;
+	DWORD dataSize;
+	DWORD texWidth, texHeight;
+	DWORD Level;
+	bool valid;
+
+	pMap = MapTexDiskCacheFile(*GetTexDiskCacheFilename(Key), mapSize);
+	if (pMap == NULL) {
+		return false;
+	}
+
+	//Check the entry belongs to this texture and has the expected level sizes
+	pHeader = (const FGLTexDiskCacheHeader *)pMap;
+	valid = (mapSize >= sizeof(FGLTexDiskCacheHeader))
+		&& (pHeader->Magic == TEX_DISK_CACHE_MAGIC)
+		&& (pHeader->Version == TEX_DISK_CACHE_VERSION)
+		&& (appMemcmp(&pHeader->Key, &Key, sizeof(Key)) == 0)
+		&& (pHeader->NumLevels >= 1)
+		&& (pHeader->NumLevels <= TEX_DISK_CACHE_MAX_LEVELS);
+	dataSize = 0;
+	texWidth = 1 << pBind->UBits;
+	texHeight = 1 << pBind->VBits;
+	for (Level = 0; valid && (Level < pHeader->NumLevels); Level++) {
+		DWORD levelSize = GetConvertedLevelSize(pBind, texWidth, texHeight);
+
+		valid = (pHeader->LevelSizes[Level] == levelSize);
+		dataSize += levelSize;
+
+		texWidth = (texWidth & 0x1) | (texWidth >> 1);
+		texHeight = (texHeight & 0x1) | (texHeight >> 1);
+	}
+	if (valid) {
+		valid = (dataSize <= (mapSize - sizeof(FGLTexDiskCacheHeader)));
+	}
+	if (!valid) {
+		UnmapTexDiskCacheFile(pMap, mapSize);
+		return false;
+	}
+
+	cycle(ImageCycles);
+
+	Info.bRealtimeChanged = 0;
+	InitNewTextureState(Info, PolyFlags, pBind);
+
+	//Levels are uploaded straight from the mapping
+	pSrc = pMap + sizeof(FGLTexDiskCacheHeader);
+	texWidth = 1 << pBind->UBits;
+	texHeight = 1 << pBind->VBits;
+	for (Level = 0; Level < pHeader->NumLevels; Level++) {
+		if ((pBind->texType == TEX_TYPE_COMPRESSED_DXT1_TO_DXT3) || (pBind->texCompress != TEX_COMPRESS_NONE)) {
+			guard(glCompressedTexImage2D);
+			glCompressedTexImage2DARB(
+				GL_TEXTURE_2D,
+				Level,
+				pBind->texInternalFormat,
+				texWidth,
+				texHeight,
+				0,
+				pHeader->LevelSizes[Level],
+				pSrc);
+			unguard;
+		}
+		else {
+			guard(glTexImage2D);
+			glTexImage2D(
+				GL_TEXTURE_2D,
+				Level,
+				pBind->texInternalFormat,
+				texWidth,
+				texHeight,
+				0,
+				pBind->texSourceFormat,
+				GL_UNSIGNED_BYTE,
+				pSrc);
+			unguard;
+		}
+		pSrc += pHeader->LevelSizes[Level];
+
+		texWidth = (texWidth & 0x1) | (texWidth >> 1);
+		texHeight = (texHeight & 0x1) | (texHeight >> 1);
 	}
 
 	uncycle(ImageCycles);
 
-	//Restore palette index 0 for masked paletted textures
-	if (Info.Palette && (PolyFlags & PF_Masked)) {
-		Info.Palette[0] = paletteIndex0;
+	UnmapTexDiskCacheFile(pMap, mapSize);
+
+	m_texDiskCacheHitCount++;
+	m_texUploadBytes += dataSize;
+
+	return true;
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::WriteTexDiskCacheEntry(const FGLTexDiskCacheKey &Key, INT NumLevels, const DWORD *LevelSizes, const BYTE *pData) {
+	guard(UOpenGLRenderDevice::WriteTexDiskCacheEntry);
+	FGLTexDiskCacheHeader Header;
+	FString Filename = GetTexDiskCacheFilename(Key);
+	FString TempFilename = Filename + TEXT(".tmp");
+	DWORD dataSize = 0;
+	FArchive *Ar;
+	INT Level;
+
+	appMemzero(&Header, sizeof(Header));
+	Header.Magic = TEX_DISK_CACHE_MAGIC;
+	Header.Version = TEX_DISK_CACHE_VERSION;
+	Header.Key = Key;
+	Header.NumLevels = NumLevels;
+	for (Level = 0; Level < NumLevels; Level++) {
+		Header.LevelSizes[Level] = LevelSizes[Level];
+		dataSize += LevelSizes[Level];
 	}
 
-	// Cleanup.
-	if (SupportsLazyTextures) {
-		Info.Unload();
+	//Written under a temporary name, so a partly written entry is never read
+	Ar = GFileManager->CreateFileWriter(*TempFilename);
+	if (!Ar) {
+		return;
 	}
+	Ar->Serialize(&Header, sizeof(Header));
+	Ar->Serialize((void *)pData, dataSize);
+	UBOOL written = Ar->Close();
+	delete Ar;
 
-	return;
+	if (written && GFileManager->Move(*Filename, *TempFilename)) {
+		m_texDiskCacheWriteCount++;
+	}
+	else {
+		GFileManager->Delete(*TempFilename);
+	}
+
+	unguard;
 }
 
 void UOpenGLRenderDevice::CacheTextureInfo(FCachedTexture *pBind, const FTextureInfo &Info, DWORD PolyFlags) {
@@ -5314,14 +9670,33 @@ void UOpenGLRenderDevice::CacheTextureInfo(FCachedTexture *pBind, const FTexture
 		pBind->texInternalFormat = GL_RGBA8;
 	}
 
+	//Compress large paletted textures instead of expanding them to RGBA8
+	//Masked, 16-bit and realtime textures are left alone, as are textures without mipmaps, which are mostly UI
+	pBind->texCompress = TEX_COMPRESS_NONE;
+	if (CompressTextures && SupportsTC && (pBind->texType == TEX_TYPE_HAS_PALETTE) && Info.Texture && !Info.bRealtime &&
+		(Info.NumMips > 1) && !(PolyFlags & (PF_Masked | PF_Memorized)) && ((UBits + VBits) >= TEX_COMPRESS_MIN_LOG_TEXELS))
+	{
+		//BC3 only if the palette has translucent entries
+		pBind->texCompress = TEX_COMPRESS_BC1;
+		pBind->texInternalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		for (INT i = 0; i < 256; i++) {
+			if (Info.Palette[i].A != 255) {
+				pBind->texCompress = TEX_COMPRESS_BC3;
+				pBind->texInternalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+				break;
+			}
+		}
+		m_texCompressCount++;
+	}
+
 	return;
 }
 
 
-void UOpenGLRenderDevice::ConvertDXT1_DXT3(const FMipmapBase *Mip, INT Level) {
+void UOpenGLRenderDevice::ConvertDXT1_DXT3(FTexConvertCtx &Ctx, const FMipmapBase *Mip, INT Level) {
 	DWORD *pSrc = (DWORD *)Mip->DataPtr;
-	DWORD *pDest = (DWORD *)m_texConvertCtx.pCompose;
-	DWORD numBlocks = 1 << (Max(0, (INT)m_texConvertCtx.pBind->UBits - Level - 2) + Max(0, (INT)m_texConvertCtx.pBind->VBits - Level - 2));
+	DWORD *pDest = (DWORD *)Ctx.pCompose;
+	DWORD numBlocks = 1 << (Max(0, (INT)Ctx.pBind->UBits - Level - 2) + Max(0, (INT)Ctx.pBind->VBits - Level - 2));
 	for (DWORD block = 0; block < numBlocks; block++) {
 		*pDest = 0xFFFFFFFF;
 		*(pDest + 1) = 0xFFFFFFFF;
@@ -5334,14 +9709,14 @@ void UOpenGLRenderDevice::ConvertDXT1_DXT3(const FMipmapBase *Mip, INT Level) {
 	UTGLR_DEBUG_TEX_CONVERT_COUNT(ConvertDXT1_DXT3);
 }
 
-void UOpenGLRenderDevice::ConvertP8_P8(const FMipmapBase *Mip, INT Level) {
-	BYTE* Ptr = (BYTE*)m_texConvertCtx.pCompose;
-	INT StepBits = m_texConvertCtx.stepBits;
+void UOpenGLRenderDevice::ConvertP8_P8(FTexConvertCtx &Ctx, const FMipmapBase *Mip, INT Level) {
+	BYTE* Ptr = (BYTE*)Ctx.pCompose;
+	INT StepBits = Ctx.stepBits;
 	DWORD UMask = Mip->USize - 1;
 	DWORD VMask = Mip->VSize - 1;
 	INT ij_inc = 1 << StepBits;
-	INT i_stop = 1 << Max(0, (INT)m_texConvertCtx.pBind->VBits - Level + StepBits);
-	INT j_stop = 1 << Max(0, (INT)m_texConvertCtx.pBind->UBits - Level + StepBits);
+	INT i_stop = 1 << Max(0, (INT)Ctx.pBind->VBits - Level + StepBits);
+	INT j_stop = 1 << Max(0, (INT)Ctx.pBind->UBits - Level + StepBits);
 	INT i = 0;
 	do { //i_stop always >= 1
 		BYTE* Base = (BYTE*)Mip->DataPtr + (i & VMask) * Mip->USize;
@@ -5354,12 +9729,12 @@ void UOpenGLRenderDevice::ConvertP8_P8(const FMipmapBase *Mip, INT Level) {
 	UTGLR_DEBUG_TEX_CONVERT_COUNT(ConvertP8_P8);
 }
 
-void UOpenGLRenderDevice::ConvertP8_P8_NoStep(const FMipmapBase *Mip, INT Level) {
-	BYTE* Ptr = (BYTE*)m_texConvertCtx.pCompose;
+void UOpenGLRenderDevice::ConvertP8_P8_NoStep(FTexConvertCtx &Ctx, const FMipmapBase *Mip, INT Level) {
+	BYTE* Ptr = (BYTE*)Ctx.pCompose;
 	DWORD UMask = Mip->USize - 1;
 	DWORD VMask = Mip->VSize - 1;
-	INT i_stop = m_texConvertCtx.texHeightPow2;
-	INT j_stop = m_texConvertCtx.texWidthPow2;
+	INT i_stop = Ctx.texHeightPow2;
+	INT j_stop = Ctx.texWidthPow2;
 	INT i = 0;
 	do { //i_stop always >= 1
 		BYTE* Base = (BYTE*)Mip->DataPtr + (i & VMask) * Mip->USize;
@@ -5372,14 +9747,14 @@ void UOpenGLRenderDevice::ConvertP8_P8_NoStep(const FMipmapBase *Mip, INT Level)
 	UTGLR_DEBUG_TEX_CONVERT_COUNT(ConvertP8_P8_NoStep);
 }
 
-void UOpenGLRenderDevice::ConvertP8_RGBA8888(const FMipmapBase *Mip, const FColor *Palette, INT Level) {
-	FColor* Ptr = (FColor*)m_texConvertCtx.pCompose;
-	INT StepBits = m_texConvertCtx.stepBits;
+void UOpenGLRenderDevice::ConvertP8_RGBA8888(FTexConvertCtx &Ctx, const FMipmapBase *Mip, const FColor *Palette, INT Level) {
+	FColor* Ptr = (FColor*)Ctx.pCompose;
+	INT StepBits = Ctx.stepBits;
 	DWORD UMask = Mip->USize - 1;
 	DWORD VMask = Mip->VSize - 1;
 	INT ij_inc = 1 << StepBits;
-	INT i_stop = 1 << Max(0, (INT)m_texConvertCtx.pBind->VBits - Level + StepBits);
-	INT j_stop = 1 << Max(0, (INT)m_texConvertCtx.pBind->UBits - Level + StepBits);
+	INT i_stop = 1 << Max(0, (INT)Ctx.pBind->VBits - Level + StepBits);
+	INT j_stop = 1 << Max(0, (INT)Ctx.pBind->UBits - Level + StepBits);
 	INT i = 0;
 	do { //i_stop always >= 1
 		BYTE* Base = (BYTE*)Mip->DataPtr + (i & VMask) * Mip->USize;
@@ -5392,12 +9767,12 @@ void UOpenGLRenderDevice::ConvertP8_RGBA8888(const FMipmapBase *Mip, const FColo
 	UTGLR_DEBUG_TEX_CONVERT_COUNT(ConvertP8_RGBA8888);
 }
 
-void UOpenGLRenderDevice::ConvertP8_RGBA8888_NoStep(const FMipmapBase *Mip, const FColor *Palette, INT Level) {
-	FColor* Ptr = (FColor*)m_texConvertCtx.pCompose;
+void UOpenGLRenderDevice::ConvertP8_RGBA8888_NoStep(FTexConvertCtx &Ctx, const FMipmapBase *Mip, const FColor *Palette, INT Level) {
+	FColor* Ptr = (FColor*)Ctx.pCompose;
 	DWORD UMask = Mip->USize - 1;
 	DWORD VMask = Mip->VSize - 1;
-	INT i_stop = m_texConvertCtx.texHeightPow2;
-	INT j_stop = m_texConvertCtx.texWidthPow2;
+	INT i_stop = Ctx.texHeightPow2;
+	INT j_stop = Ctx.texWidthPow2;
 	INT i = 0;
 	do { //i_stop always >= 1
 		BYTE* Base = (BYTE*)Mip->DataPtr + (i & VMask) * Mip->USize;
@@ -5410,16 +9785,16 @@ void UOpenGLRenderDevice::ConvertP8_RGBA8888_NoStep(const FMipmapBase *Mip, cons
 	UTGLR_DEBUG_TEX_CONVERT_COUNT(ConvertP8_RGBA8888_NoStep);
 }
 
-void UOpenGLRenderDevice::ConvertBGRA7777_BGRA8888(const FMipmapBase *Mip, INT Level) {
-	FColor* Ptr = (FColor*)m_texConvertCtx.pCompose;
-	INT StepBits = m_texConvertCtx.stepBits;
+void UOpenGLRenderDevice::ConvertBGRA7777_BGRA8888(FTexConvertCtx &Ctx, const FMipmapBase *Mip, INT Level) {
+	FColor* Ptr = (FColor*)Ctx.pCompose;
+	INT StepBits = Ctx.stepBits;
 	DWORD VMask = Mip->VSize - 1;
-	DWORD VClampVal = m_texConvertCtx.pBind->VClampVal;
+	DWORD VClampVal = Ctx.pBind->VClampVal;
 	DWORD UMask = Mip->USize - 1;
-	DWORD UClampVal = m_texConvertCtx.pBind->UClampVal;
+	DWORD UClampVal = Ctx.pBind->UClampVal;
 	INT ij_inc = 1 << StepBits;
-	INT i_stop = 1 << Max(0, (INT)m_texConvertCtx.pBind->VBits - Level + StepBits);
-	INT j_stop = 1 << Max(0, (INT)m_texConvertCtx.pBind->UBits - Level + StepBits);
+	INT i_stop = 1 << Max(0, (INT)Ctx.pBind->VBits - Level + StepBits);
+	INT j_stop = 1 << Max(0, (INT)Ctx.pBind->UBits - Level + StepBits);
 	INT i = 0;
 	do { //i_stop always >= 1
 		FColor* Base = (FColor*)Mip->DataPtr + Min<DWORD>(i & VMask, VClampVal) * Mip->USize;
@@ -5434,14 +9809,14 @@ void UOpenGLRenderDevice::ConvertBGRA7777_BGRA8888(const FMipmapBase *Mip, INT L
 	UTGLR_DEBUG_TEX_CONVERT_COUNT(ConvertBGRA7777_BGRA8888);
 }
 
-void UOpenGLRenderDevice::ConvertBGRA7777_BGRA8888_NoClamp(const FMipmapBase *Mip, INT Level) {
-	FColor* Ptr = (FColor*)m_texConvertCtx.pCompose;
-	INT StepBits = m_texConvertCtx.stepBits;
+void UOpenGLRenderDevice::ConvertBGRA7777_BGRA8888_NoClamp(FTexConvertCtx &Ctx, const FMipmapBase *Mip, INT Level) {
+	FColor* Ptr = (FColor*)Ctx.pCompose;
+	INT StepBits = Ctx.stepBits;
 	DWORD VMask = Mip->VSize - 1;
 	DWORD UMask = Mip->USize - 1;
 	INT ij_inc = 1 << StepBits;
-	INT i_stop = 1 << Max(0, (INT)m_texConvertCtx.pBind->VBits - Level + StepBits);
-	INT j_stop = 1 << Max(0, (INT)m_texConvertCtx.pBind->UBits - Level + StepBits);
+	INT i_stop = 1 << Max(0, (INT)Ctx.pBind->VBits - Level + StepBits);
+	INT j_stop = 1 << Max(0, (INT)Ctx.pBind->UBits - Level + StepBits);
 	INT i = 0;
 	do { //i_stop always >= 1
 		FColor* Base = (FColor*)Mip->DataPtr + (DWORD)(i & VMask) * Mip->USize;
@@ -5456,16 +9831,16 @@ void UOpenGLRenderDevice::ConvertBGRA7777_BGRA8888_NoClamp(const FMipmapBase *Mi
 	UTGLR_DEBUG_TEX_CONVERT_COUNT(ConvertBGRA7777_BGRA8888_NoClamp);
 }
 
-void UOpenGLRenderDevice::ConvertBGRA7777_RGBA8888(const FMipmapBase *Mip, INT Level) {
-	FColor* Ptr = (FColor*)m_texConvertCtx.pCompose;
-	INT StepBits = m_texConvertCtx.stepBits;
+void UOpenGLRenderDevice::ConvertBGRA7777_RGBA8888(FTexConvertCtx &Ctx, const FMipmapBase *Mip, INT Level) {
+	FColor* Ptr = (FColor*)Ctx.pCompose;
+	INT StepBits = Ctx.stepBits;
 	DWORD VMask = Mip->VSize - 1;
-	DWORD VClampVal = m_texConvertCtx.pBind->VClampVal;
+	DWORD VClampVal = Ctx.pBind->VClampVal;
 	DWORD UMask = Mip->USize - 1;
-	DWORD UClampVal = m_texConvertCtx.pBind->UClampVal;
+	DWORD UClampVal = Ctx.pBind->UClampVal;
 	INT ij_inc = 1 << StepBits;
-	INT i_stop = 1 << Max(0, (INT)m_texConvertCtx.pBind->VBits - Level + StepBits);
-	INT j_stop = 1 << Max(0, (INT)m_texConvertCtx.pBind->UBits - Level + StepBits);
+	INT i_stop = 1 << Max(0, (INT)Ctx.pBind->VBits - Level + StepBits);
+	INT j_stop = 1 << Max(0, (INT)Ctx.pBind->UBits - Level + StepBits);
 	INT i = 0;
 	do { //i_stop always >= 1
 		FColor* Base = (FColor*)Mip->DataPtr + Min<DWORD>(i & VMask, VClampVal) * Mip->USize;
@@ -5806,6 +10181,59 @@ void UOpenGLRenderDevice::SetFragmentProgramNoCheck(GLuint fpId) {
 }
 
 
+void UOpenGLRenderDevice::SetGLSLProgramNoCheck(GLuint programId) {
+	//Check if no program and need to leave GLSL mode
+	if (programId == 0) {
+		//Id of 0 marks GLSL mode as disabled
+		m_glslCurrent = 0;
+
+		glUseProgram(0);
+
+		//Go back to the fixed function vertex array for positions
+		glDisableVertexAttribArray(0);
+
+		return;
+	}
+
+	//Check if need to enter GLSL mode
+	if (m_glslCurrent == 0) {
+		//Positions come from generic attribute 0, which shares the vertex array
+		//The streaming VBO points it at each copy as it is made
+		glEnableVertexAttribArray(0);
+		if (!m_streamVBOActive) {
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(FGLVertex), &VertexArray[0].x);
+		}
+	}
+
+	//Save the new current program
+	m_glslCurrent = programId;
+
+	//Bind the program
+	glUseProgram(programId);
+
+	m_glslSwitchCount++;
+
+	return;
+}
+
+//Uploads the surface uniform block, and the frame uniform block if the projection changed
+void UOpenGLRenderDevice::UpdateGLSLSurfaceState(void) {
+	if (m_glslFrameStateDirty) {
+		m_glslFrameStateDirty = false;
+
+		glBindBufferARB(GL_UNIFORM_BUFFER, m_glslFrameUBO);
+		glBufferSubDataARB(GL_UNIFORM_BUFFER, 0, sizeof(FGLSLFrameState), &m_glslFrameState);
+	}
+
+	glBindBufferARB(GL_UNIFORM_BUFFER, m_glslSurfaceUBO);
+	glBufferSubDataARB(GL_UNIFORM_BUFFER, 0, sizeof(FGLSLSurfaceState), &m_glslSurfaceState);
+
+	m_glslUBOUpdateCount++;
+
+	return;
+}
+
+
 void UOpenGLRenderDevice::SetDefaultColorStateNoCheck(void) {
 	//Check for normal array
 	if (m_currentColorFlags & CF_NORMAL_ARRAY) {
@@ -5822,7 +10250,10 @@ void UOpenGLRenderDevice::SetDefaultColorStateNoCheck(void) {
 		glDisableClientState(GL_SECONDARY_COLOR_ARRAY_EXT);
 
 		//Reset color array pointer to default when not using dual color array
-		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(FGLSingleColor), &SingleColorArray[0].color);
+		//Streaming sets its own pointers for every draw
+		if (!m_streamVBOActive) {
+			glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(FGLSingleColor), &SingleColorArray[0].color);
+		}
 	}
 
 	//Check for color array
@@ -5866,13 +10297,17 @@ void UOpenGLRenderDevice::SetColorStateNoCheck(void) {
 			glEnableClientState(GL_SECONDARY_COLOR_ARRAY_EXT);
 
 			//Set up color array pointer for dual color array
-			glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(FGLDoubleColor), &DoubleColorArray[0].color);
+			if (!m_streamVBOActive) {
+				glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(FGLDoubleColor), &DoubleColorArray[0].color);
+			}
 		}
 		else {
 			glDisableClientState(GL_SECONDARY_COLOR_ARRAY_EXT);
 
 			//Reset color array pointer to default when not using dual color array
-			glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(FGLSingleColor), &SingleColorArray[0].color);
+			if (!m_streamVBOActive) {
+				glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(FGLSingleColor), &SingleColorArray[0].color);
+			}
 		}
 	}
 
@@ -6218,9 +10653,232 @@ void UOpenGLRenderDevice::ShutdownFragmentProgramMode(void) {
 }
 
 
+//Returns the shader id, or 0 if it failed to compile
+GLuint UOpenGLRenderDevice::LoadGLSLShader(GLenum type, const char *pSource, const char *pName) {
+	GLuint shaderId;
+	GLint iStatus = GL_FALSE;
+
+	shaderId = glCreateShader(type);
+	if (shaderId == 0) {
+		return 0;
+	}
+
+	glShaderSource(shaderId, 1, (const GLchar **)&pSource, NULL);
+	glCompileShader(shaderId);
+
+	glGetShaderiv(shaderId, GL_COMPILE_STATUS, &iStatus);
+
+	if (iStatus != GL_TRUE) {
+		if (DebugBit(DEBUG_BIT_BASIC)) {
+			GLchar infoLog[1024];
+
+			infoLog[0] = '\0';
+			glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+			dbgPrintf("utglr: GLSL %s shader \"%s\" failed to compile:\n%s\n", (type == GL_VERTEX_SHADER) ? "vertex" : "fragment", pName, infoLog);
+		}
+
+		glDeleteShader(shaderId);
+
+		return 0;
+	}
+
+	return shaderId;
+}
+
+//Returns the program id, or 0 if it failed to compile or link
+GLuint UOpenGLRenderDevice::LoadGLSLProgram(const char *pVertexSource, const char *pFragmentSource, const char *pName) {
+	GLuint vsId;
+	GLuint fsId;
+	GLuint programId;
+	GLint iStatus = GL_FALSE;
+
+	if (DebugBit(DEBUG_BIT_BASIC)) {
+		dbgPrintf("utglr: Loading GLSL program \"%s\"\n", pName);
+	}
+
+	vsId = LoadGLSLShader(GL_VERTEX_SHADER, pVertexSource, pName);
+	if (vsId == 0) {
+		return 0;
+	}
+	fsId = LoadGLSLShader(GL_FRAGMENT_SHADER, pFragmentSource, pName);
+	if (fsId == 0) {
+		glDeleteShader(vsId);
+		return 0;
+	}
+
+	programId = glCreateProgram();
+	if (programId != 0) {
+		glAttachShader(programId, vsId);
+		glAttachShader(programId, fsId);
+		glLinkProgram(programId);
+
+		glGetProgramiv(programId, GL_LINK_STATUS, &iStatus);
+
+		if (iStatus != GL_TRUE) {
+			if (DebugBit(DEBUG_BIT_BASIC)) {
+				GLchar infoLog[1024];
+
+				infoLog[0] = '\0';
+				glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+				dbgPrintf("utglr: GLSL program \"%s\" failed to link:\n%s\n", pName, infoLog);
+			}
+
+			glDeleteProgram(programId);
+			programId = 0;
+		}
+	}
+
+	//Shaders are only flagged for deletion while still attached
+	glDeleteShader(vsId);
+	glDeleteShader(fsId);
+
+	return programId;
+}
+
+bool UOpenGLRenderDevice::InitializeGLSLPrograms(void) {
+	static const char *samplerNames[MAX_TMUNITS] = { "uTexture0", "uTexture1", "uTexture2", "uTexture3" };
+	const char *pVersion;
+	INT majorVersion = 0;
+	INT minorVersion = 0;
+	GLuint frameBlockIndex;
+	GLuint surfaceBlockIndex;
+	INT u;
+
+	//Programs are written against GLSL 3.30
+	pVersion = (const char *)glGetString(GL_SHADING_LANGUAGE_VERSION);
+	if ((pVersion == NULL) || (sscanf(pVersion, "%d.%d", &majorVersion, &minorVersion) != 2) || (((majorVersion * 100) + minorVersion) < 330)) {
+		if (DebugBit(DEBUG_BIT_BASIC)) dbgPrintf("utglr: GLSL 3.30 not supported\n");
+		return false;
+	}
+
+	m_glslComplexSurface = LoadGLSLProgram(g_glslComplexSurfaceVS, g_glslComplexSurfaceFS, "ComplexSurface");
+	if (m_glslComplexSurface == 0) {
+		return false;
+	}
+
+	//Uniform blocks use fixed binding points
+	frameBlockIndex = glGetUniformBlockIndex(m_glslComplexSurface, "FrameState");
+	surfaceBlockIndex = glGetUniformBlockIndex(m_glslComplexSurface, "SurfaceState");
+	if ((frameBlockIndex == GL_INVALID_INDEX) || (surfaceBlockIndex == GL_INVALID_INDEX)) {
+		return false;
+	}
+	glUniformBlockBinding(m_glslComplexSurface, frameBlockIndex, GLSL_UBO_BINDING_FRAME);
+	glUniformBlockBinding(m_glslComplexSurface, surfaceBlockIndex, GLSL_UBO_BINDING_SURFACE);
+
+	//Samplers always read the texture unit of the same number
+	//Only called while no program is current
+	glUseProgram(m_glslComplexSurface);
+	for (u = 0; u < MAX_TMUNITS; u++) {
+		GLint location = glGetUniformLocation(m_glslComplexSurface, samplerNames[u]);
+		if (location != -1) {
+			glUniform1i(location, u);
+		}
+	}
+	glUseProgram(0);
+
+	//Allocate uniform buffers
+	glGenBuffersARB(1, &m_glslFrameUBO);
+	glBindBufferARB(GL_UNIFORM_BUFFER, m_glslFrameUBO);
+	glBufferDataARB(GL_UNIFORM_BUFFER, sizeof(FGLSLFrameState), NULL, GL_DYNAMIC_DRAW_ARB);
+	glBindBufferBase(GL_UNIFORM_BUFFER, GLSL_UBO_BINDING_FRAME, m_glslFrameUBO);
+
+	glGenBuffersARB(1, &m_glslSurfaceUBO);
+	glBindBufferARB(GL_UNIFORM_BUFFER, m_glslSurfaceUBO);
+	glBufferDataARB(GL_UNIFORM_BUFFER, sizeof(FGLSLSurfaceState), NULL, GL_STREAM_DRAW_ARB);
+	glBindBufferBase(GL_UNIFORM_BUFFER, GLSL_UBO_BINDING_SURFACE, m_glslSurfaceUBO);
+
+	//Upload the current projection with the first surface
+	m_glslFrameStateDirty = true;
+
+	return true;
+}
+
+//Safe to call even if the programs were never or only partially allocated
+void UOpenGLRenderDevice::FreeGLSLPrograms(void) {
+	if (m_glslComplexSurface != 0) {
+		glDeleteProgram(m_glslComplexSurface);
+		m_glslComplexSurface = 0;
+	}
+	if (m_glslFrameUBO != 0) {
+		glDeleteBuffersARB(1, &m_glslFrameUBO);
+		m_glslFrameUBO = 0;
+	}
+	if (m_glslSurfaceUBO != 0) {
+		glDeleteBuffersARB(1, &m_glslSurfaceUBO);
+		m_glslSurfaceUBO = 0;
+	}
+
+	return;
+}
+
+//Attempts to initialize GLSL mode
+//Safe to call multiple times as any existing programs are freed first
+void UOpenGLRenderDevice::TryInitializeGLSLMode(void) {
+	ShutdownGLSLMode();
+
+	if (InitializeGLSLPrograms() == false) {
+		//Free anything allocated before the failure
+		FreeGLSLPrograms();
+
+		//Disable GLSL mode
+		UseGLSL = 0;
+		PL_UseGLSL = 0;
+
+		if (DebugBit(DEBUG_BIT_BASIC)) dbgPrintf("utglr: GLSL initialization failed\n");
+	}
+
+	return;
+}
+
+//Leaves GLSL mode if it is active and frees the programs
+//Safe to call even if GLSL mode is not supported or was never initialized
+void UOpenGLRenderDevice::ShutdownGLSLMode(void) {
+	if (m_glslCurrent != 0) {
+		SetGLSLProgramNoCheck(0);
+	}
+
+	FreeGLSLPrograms();
+
+	return;
+}
+
+//Mirrors the fixed function projection, combined with the modelview scale, for the GLSL frame uniform block
+//Matrix is column major
+void UOpenGLRenderDevice::SetGLSLProjection(FLOAT xMax, FLOAT yMax, FLOAT zNear, FLOAT zFar, FLOAT zScale, bool ortho) {
+	FLOAT *pMVP = m_glslFrameState.MVP;
+	FLOAT rDepth = 1.0f / (zFar - zNear);
+	INT i;
+
+	for (i = 0; i < 16; i++) {
+		pMVP[i] = 0.0f;
+	}
+
+	//Modelview scale of (1, -1, -1) negates the y and z columns
+	if (ortho) {
+		pMVP[0] = 1.0f / xMax;
+		pMVP[5] = -1.0f / yMax;
+		pMVP[10] = 2.0f * rDepth * zScale;
+		pMVP[14] = -(zFar + zNear) * rDepth * zScale;
+		pMVP[15] = 1.0f;
+	}
+	else {
+		pMVP[0] = zNear / xMax;
+		pMVP[5] = -zNear / yMax;
+		pMVP[10] = (zFar + zNear) * rDepth * zScale;
+		pMVP[11] = 1.0f;
+		pMVP[14] = -2.0f * zFar * zNear * rDepth * zScale;
+	}
+
+	m_glslFrameStateDirty = true;
+
+	return;
+}
+
+
 void UOpenGLRenderDevice::SetProjectionStateNoCheck(bool requestNearZRangeHackProjection) {
 	FLOAT zNear;
 	FLOAT zFar;
+	FLOAT zScale = 1.0f;
 
 	//Save new Z range hack projection state
 	m_nearZRangeHackProjectionActive = requestNearZRangeHackProjection;
@@ -6237,7 +10895,8 @@ void UOpenGLRenderDevice::SetProjectionStateNoCheck(bool requestNearZRangeHackPr
 		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 #endif
 
-		glScalef(1, 1, 0.125 * 0.125);
+		zScale = 0.125f * 0.125f;
+		glScalef(1, 1, zScale);
 		zNear = 4.0f;
 	}
 	else {
@@ -6259,6 +10918,9 @@ void UOpenGLRenderDevice::SetProjectionStateNoCheck(bool requestNearZRangeHackPr
 
 	glFrustum(-m_RProjZ * zNear, +m_RProjZ * zNear, -m_Aspect*m_RProjZ * zNear, +m_Aspect*m_RProjZ * zNear, 1.0 * zNear, zFar);
 
+	//Keep the GLSL copy in sync
+	SetGLSLProjection(m_RProjZ * zNear, m_Aspect*m_RProjZ * zNear, zNear, zFar, zScale, false);
+
 	return;
 }
 
@@ -6272,6 +10934,9 @@ void UOpenGLRenderDevice::SetOrthoProjection(void) {
 
 	glOrtho(-m_RProjZ * 0.5, +m_RProjZ * 0.5, -m_Aspect*m_RProjZ * 0.5, +m_Aspect*m_RProjZ * 0.5, 1.0 * 0.5, 32768.0);
 
+	//Keep the GLSL copy in sync
+	SetGLSLProjection(m_RProjZ * 0.5f, m_Aspect*m_RProjZ * 0.5f, 0.5f, 32768.0f, 1.0f, true);
+
 	return;
 }
 
@@ -6292,11 +10957,15 @@ void UOpenGLRenderDevice::RenderPassesExec(void) {
 	m_rpTMUnits = 1;
 	m_rpForceSingle = true;
 
+	//All polygons start from vertex zero
+	StreamVertexArrays(0, m_csPtCount);
 
 	if (UseMultiDrawArrays && (m_csPolyCount > 1)) {
+		m_drawCallCount++;
 		glMultiDrawArraysEXT(GL_TRIANGLE_FAN, MultiDrawFirstArray, MultiDrawCountArray, m_csPolyCount);
 	}
 	else {
+		m_drawCallCount += m_csPolyCount;
 		for (INT PolyNum = 0; PolyNum < m_csPolyCount; PolyNum++) {
 			glDrawArrays(GL_TRIANGLE_FAN, MultiDrawFirstArray[PolyNum], MultiDrawCountArray[PolyNum]);
 		}
@@ -6308,9 +10977,11 @@ void UOpenGLRenderDevice::RenderPassesExec(void) {
 	SetBlend(PF_Modulated);
 
 	if (UseMultiDrawArrays && (m_csPolyCount > 1)) {
+		m_drawCallCount++;
 		glMultiDrawArraysEXT(GL_TRIANGLE_FAN, MultiDrawFirstArray, MultiDrawCountArray, m_csPolyCount);
 	}
 	else {
+		m_drawCallCount += m_csPolyCount;
 		for (INT PolyNum = 0; PolyNum < m_csPolyCount; PolyNum++) {
 			glDrawArrays(GL_TRIANGLE_FAN, MultiDrawFirstArray[PolyNum], MultiDrawCountArray[PolyNum]);
 		}
@@ -6347,11 +11018,15 @@ void UOpenGLRenderDevice::RenderPassesExec_SingleOrDualTextureAndDetailTexture(F
 
 	//Single texture rendering does not need to be forced here since the detail texture is always the last pass
 
+	//All polygons start from vertex zero
+	StreamVertexArrays(0, m_csPtCount);
 
 	if (UseMultiDrawArrays && (m_csPolyCount > 1)) {
+		m_drawCallCount++;
 		glMultiDrawArraysEXT(GL_TRIANGLE_FAN, MultiDrawFirstArray, MultiDrawCountArray, m_csPolyCount);
 	}
 	else {
+		m_drawCallCount += m_csPolyCount;
 		for (INT PolyNum = 0; PolyNum < m_csPolyCount; PolyNum++) {
 			glDrawArrays(GL_TRIANGLE_FAN, MultiDrawFirstArray[PolyNum], MultiDrawCountArray[PolyNum]);
 		}
@@ -6363,9 +11038,11 @@ void UOpenGLRenderDevice::RenderPassesExec_SingleOrDualTextureAndDetailTexture(F
 	SetBlend(PF_Modulated);
 
 	if (UseMultiDrawArrays && (m_csPolyCount > 1)) {
+		m_drawCallCount++;
 		glMultiDrawArraysEXT(GL_TRIANGLE_FAN, MultiDrawFirstArray, MultiDrawCountArray, m_csPolyCount);
 	}
 	else {
+		m_drawCallCount += m_csPolyCount;
 		for (INT PolyNum = 0; PolyNum < m_csPolyCount; PolyNum++) {
 			glDrawArrays(GL_TRIANGLE_FAN, MultiDrawFirstArray[PolyNum], MultiDrawCountArray[PolyNum]);
 		}
@@ -6520,12 +11197,66 @@ void UOpenGLRenderDevice::RenderPassesNoCheckSetup_FP(void) {
 		}
 	}
 
-	//Check if found a fragment program to use
-	//All possible combinations are supposed to have a fragment program
-	if (fpId == 0) {
-		fpId = m_fpComplexSurfaceSingleTexture;
+	//Check if found a fragment program to use
+	//All possible combinations are supposed to have a fragment program
+	if (fpId == 0) {
+		fpId = m_fpComplexSurfaceSingleTexture;
+	}
+	SetShaderState(m_vpComplexSurface[m_rpPassCount - 1], fpId);
+
+	i = 0;
+	do {
+		if (i != 0) {
+			DWORD texBit;
+
+			glActiveTextureARB(GL_TEXTURE0_ARB + i);
+
+			texBit = 1 << i;
+			if ((m_texEnableBits & texBit) == 0) {
+				m_texEnableBits |= texBit;
+
+				glEnable(GL_TEXTURE_2D);
+			}
+
+			//No TexEnv setup for fragment program
+			if (fpId == 0) {
+				SetTexEnv(i, MultiPass.TMU[i].PolyFlags);
+			}
+		}
+
+		SetTexture(i, *MultiPass.TMU[i].Info, MultiPass.TMU[i].PolyFlags, MultiPass.TMU[i].PanBias);
+
+		glVertexAttrib4fARB(i + 8, TexInfo[i].UPan, TexInfo[i].VPan, TexInfo[i].UMult, TexInfo[i].VMult);
+	} while (++i < m_rpPassCount);
+
+	//Check for additional enabled texture units that should be disabled
+	DisableSubsequentTextures(m_rpPassCount);
+	//Disable all client textures for this vertex program path
+	DisableSubsequentClientTextures(0);
+
+	return;
+}
+
+//Must be called with (m_rpPassCount > 0)
+void UOpenGLRenderDevice::RenderPassesNoCheckSetup_GLSL(void) {
+	INT i;
+	INT *pMode = m_glslSurfaceState.Mode;
+
+	//One program handles every pass combination
+	SetGLSLProgram(m_glslComplexSurface);
+
+	SetBlend(MultiPass.TMU[0].PolyFlags);
+
+	//Fog map is always the last layer if present
+	pMode[0] = m_rpPassCount;
+	pMode[1] = 0;
+	pMode[2] = 0;
+	pMode[3] = 0;
+	if ((m_rpPassCount > 1) && (MultiPass.TMU[m_rpPassCount - 1].PolyFlags == PF_Highlighted)) {
+		pMode[0] = m_rpPassCount - 1;
+		pMode[1] = 1;
 	}
-	SetShaderState(m_vpComplexSurface[m_rpPassCount - 1], fpId);
+	SetGLSLColor(m_complexSurfaceColor3f_1f);
 
 	i = 0;
 	do {
@@ -6541,22 +11272,21 @@ void UOpenGLRenderDevice::RenderPassesNoCheckSetup_FP(void) {
 				glEnable(GL_TEXTURE_2D);
 			}
 
-			//No TexEnv setup for fragment program
-			if (fpId == 0) {
-				SetTexEnv(i, MultiPass.TMU[i].PolyFlags);
-			}
+			//No TexEnv setup for GLSL
 		}
 
 		SetTexture(i, *MultiPass.TMU[i].Info, MultiPass.TMU[i].PolyFlags, MultiPass.TMU[i].PanBias);
 
-		glVertexAttrib4fARB(i + 8, TexInfo[i].UPan, TexInfo[i].VPan, TexInfo[i].UMult, TexInfo[i].VMult);
+		SetGLSLTexInfo(i);
 	} while (++i < m_rpPassCount);
 
 	//Check for additional enabled texture units that should be disabled
 	DisableSubsequentTextures(m_rpPassCount);
-	//Disable all client textures for this vertex program path
+	//Disable all client textures for the GLSL path
 	DisableSubsequentClientTextures(0);
 
+	UpdateGLSLSurfaceState();
+
 	return;
 }
 
@@ -6806,6 +11536,75 @@ void UOpenGLRenderDevice::RenderPassesNoCheckSetup_SingleOrDualTextureAndDetailT
 	return;
 }
 
+//Must be called with (m_rpPassCount > 0)
+void UOpenGLRenderDevice::RenderPassesNoCheckSetup_SingleOrDualTextureAndDetailTexture_GLSL(FTextureInfo &DetailTextureInfo) {
+	INT i;
+	DWORD detailTexUnit;
+	INT *pMode = m_glslSurfaceState.Mode;
+
+	//One extra texture unit used for detail texture
+	m_rpPassCount += 1;
+
+	//Detail texture is in the last texture unit
+	detailTexUnit = (m_rpPassCount - 1);
+
+	SetGLSLProgram(m_glslComplexSurface);
+
+	pMode[0] = detailTexUnit;
+	pMode[1] = 0;
+	pMode[2] = (DetailMax >= 2) ? 2 : 1;
+	pMode[3] = 0;
+	SetGLSLColor(m_detailTextureColor3f_1f);
+
+	SetBlend(MultiPass.TMU[0].PolyFlags);
+
+	//First one or two textures in first two texture units
+	i = 0;
+	do {
+		if (i != 0) {
+			DWORD texBit;
+
+			glActiveTextureARB(GL_TEXTURE0_ARB + i);
+
+			texBit = 1 << i;
+			if ((m_texEnableBits & texBit) == 0) {
+				m_texEnableBits |= texBit;
+
+				glEnable(GL_TEXTURE_2D);
+			}
+
+			//No TexEnv setup for GLSL
+			//Only works with modulated
+		}
+
+		SetTexture(i, *MultiPass.TMU[i].Info, MultiPass.TMU[i].PolyFlags, MultiPass.TMU[i].PanBias);
+
+		SetGLSLTexInfo(i);
+	} while (++i < detailTexUnit);
+
+	//Detail texture in second or third texture unit
+	glActiveTextureARB(GL_TEXTURE0_ARB + detailTexUnit);
+	SetTextureNoPanBias(detailTexUnit, DetailTextureInfo, PF_Modulated);
+	{
+		DWORD texBit = 1 << detailTexUnit;
+		if ((m_texEnableBits & texBit) == 0) {
+			m_texEnableBits |= texBit;
+
+			glEnable(GL_TEXTURE_2D);
+		}
+	}
+	SetGLSLTexInfo(detailTexUnit);
+
+	//Check for additional enabled texture units that should be disabled
+	DisableSubsequentTextures(m_rpPassCount);
+	//Disable all client textures for the GLSL path
+	DisableSubsequentClientTextures(0);
+
+	UpdateGLSLSurfaceState();
+
+	return;
+}
+
 //Modified this routine to always set up detail texture state
 //It should only be called if at least one polygon will be detail textured
 void UOpenGLRenderDevice::DrawDetailTexture(FTextureInfo &DetailTextureInfo, INT BaseClipIndex, bool clipDetailTexture) {
@@ -6937,7 +11736,8 @@ void UOpenGLRenderDevice::DrawDetailTexture(FTextureInfo &DetailTextureInfo, INT
 					Index++;
 				}
 
-				glDrawArrays(GL_TRIANGLE_FAN, StartIndex, NumPts);
+				m_drawCallCount++;
+				glDrawArrays(GL_TRIANGLE_FAN, StreamVertexArrays(StartIndex, NumPts), NumPts);
 			}
 			//Otherwise, no clipping required, or clipping required, but DetailClipping not enabled
 			else if ((clipDetailTexture == false) || (isNearBits == allPtsBits)) {
@@ -6955,7 +11755,14 @@ void UOpenGLRenderDevice::DrawDetailTexture(FTextureInfo &DetailTextureInfo, INT
 					Index++;
 				}
 
-				glDrawArrays(GL_TRIANGLE_FAN, StartIndex, NumPts);
+				m_drawCallCount++;
+				//Color array is enabled directly rather than through the color state
+				if (m_streamVBOActive && StreamVertexArraysNoCheck(StartIndex, NumPts, NULL, CF_COLOR_ARRAY)) {
+					glDrawArrays(GL_TRIANGLE_FAN, 0, NumPts);
+				}
+				else {
+					glDrawArrays(GL_TRIANGLE_FAN, StartIndex, NumPts);
+				}
 			}
 			//Otherwise, clipping required and DetailClipping enabled
 			else {
@@ -7023,7 +11830,14 @@ void UOpenGLRenderDevice::DrawDetailTexture(FTextureInfo &DetailTextureInfo, INT
 					Index++;
 				}
 
-				glDrawElements(GL_TRIANGLE_FAN, NextIndex, GL_UNSIGNED_INT, IndexList);
+				m_drawCallCount++;
+				//Streaming gathers the indexed vertices
+				if (m_streamVBOActive && StreamVertexArraysNoCheck(0, NextIndex, IndexList, CF_COLOR_ARRAY)) {
+					glDrawArrays(GL_TRIANGLE_FAN, 0, NextIndex);
+				}
+				else {
+					glDrawElements(GL_TRIANGLE_FAN, NextIndex, GL_UNSIGNED_INT, IndexList);
+				}
 			}
 		}
 	} while (++detailPassNum < DetailMax);
@@ -7074,6 +11888,8 @@ void UOpenGLRenderDevice::DrawDetailTexture_FP(FTextureInfo &DetailTextureInfo)
 	DisableSubsequentTextures(1);
 	DisableSubsequentClientTextures(0);
 
+	//Vertex positions are all the fragment program path uses, so stream every polygon at once
+	StreamVertexArrays(0, m_csPtCount);
 
 	INT *pNumPts = &MultiDrawCountArray[0];
 	DWORD *pDetailTextureIsNear = DetailTextureIsNearArray;
@@ -7088,6 +11904,7 @@ void UOpenGLRenderDevice::DrawDetailTexture_FP(FTextureInfo &DetailTextureInfo)
 			continue;
 		}
 
+		m_drawCallCount++;
 		glDrawArrays(GL_TRIANGLE_FAN, Index, NumPts);
 		Index += NumPts;
 	}
@@ -7102,6 +11919,59 @@ void UOpenGLRenderDevice::DrawDetailTexture_FP(FTextureInfo &DetailTextureInfo)
 	return;
 }
 
+void UOpenGLRenderDevice::DrawDetailTexture_GLSL(FTextureInfo &DetailTextureInfo) {
+	INT Index = 0;
+	INT *pMode = m_glslSurfaceState.Mode;
+
+	//Setup detail texture state
+	SetBlend(PF_Modulated);
+
+	SetGLSLProgram(m_glslComplexSurface);
+
+	//No base layers selects the detail texture pass
+	pMode[0] = 0;
+	pMode[1] = 0;
+	pMode[2] = (DetailMax >= 2) ? 2 : 1;
+	pMode[3] = 0;
+	SetGLSLColor(m_detailTextureColor3f_1f);
+	m_glslSurfaceState.Color[3] = 1.0f;
+
+	if (SUPPORTS_GL_ARB_multitexture) {
+		glActiveTextureARB(GL_TEXTURE0_ARB);
+	}
+	SetTextureNoPanBias(0, DetailTextureInfo, PF_Modulated);
+	SetGLSLTexInfo(0);
+
+	//Check for additional enabled texture units that should be disabled
+	DisableSubsequentTextures(1);
+	DisableSubsequentClientTextures(0);
+
+	UpdateGLSLSurfaceState();
+
+	//Vertex positions are all the GLSL path uses, so stream every polygon at once
+	StreamVertexArrays(0, m_csPtCount);
+
+	INT *pNumPts = &MultiDrawCountArray[0];
+	DWORD *pDetailTextureIsNear = DetailTextureIsNearArray;
+	DWORD csPolyCount = m_csPolyCount;
+	for (DWORD PolyNum = 0; PolyNum < csPolyCount; PolyNum++, pNumPts++, pDetailTextureIsNear++) {
+		DWORD NumPts = *pNumPts;
+		DWORD isNearBits = *pDetailTextureIsNear;
+
+		//Skip the polygon if it will not be detail textured
+		if (isNearBits == 0) {
+			Index += NumPts;
+			continue;
+		}
+
+		m_drawCallCount++;
+		glDrawArrays(GL_TRIANGLE_FAN, Index, NumPts);
+		Index += NumPts;
+	}
+
+	return;
+}
+
 INT UOpenGLRenderDevice::BufferStaticComplexSurfaceGeometry(const FSurfaceFacet& Facet) {
 	INT numVerts = 0;
 
@@ -7179,6 +12049,256 @@ INT UOpenGLRenderDevice::BufferStaticComplexSurfaceGeometry_VP(const FSurfaceFac
 	return numVerts;
 }
 
+//Records an opaque complex surface in the deferred list
+//Returns false if the surface must be drawn immediately
+bool UOpenGLRenderDevice::DeferComplexSurface(FSurfaceInfo &Surface, DWORD PolyFlags) {
+	//Only opaque surfaces that fit in a single pass are deferred
+	if (PolyFlags & (PF_Translucent | PF_Modulated | PF_Highlighted | PF_Selected | PF_FlatShaded)) {
+		return false;
+	}
+	if (Surface.FogMap) {
+		return false;
+	}
+	INT numLayers = 1;
+	if (Surface.MacroTexture) {
+		numLayers++;
+	}
+	if (Surface.LightMap) {
+		numLayers++;
+	}
+	if (numLayers > TMUnits) {
+		return false;
+	}
+
+	//Space was reserved before the geometry was buffered
+	FGLDeferredSurface &DS = m_dcsSurfaces[m_dcsNumSurfaces];
+	DS.PolyFlags = PolyFlags;
+	DS.NumLayers = numLayers;
+	DS.FirstVert = m_dcsNumVerts;
+	DS.NumVerts = m_csPtCount;
+	DS.FirstPoly = m_dcsNumPolys;
+	DS.NumPolys = m_csPolyCount;
+	DS.Order = m_dcsNumSurfaces;
+
+	INT layer = 0;
+	DeferComplexSurfaceLayer(DS, layer++, *Surface.Texture, PolyFlags, 0.0f);
+	if (Surface.MacroTexture) {
+		DeferComplexSurfaceLayer(DS, layer++, *Surface.MacroTexture, PF_Modulated, -0.5f);
+	}
+	if (Surface.LightMap) {
+		DeferComplexSurfaceLayer(DS, layer++, *Surface.LightMap, PF_Modulated, -0.5f);
+	}
+
+	appMemcpy(&m_dcsVerts[DS.FirstVert], &VertexArray[0], DS.NumVerts * sizeof(FGLVertex));
+	appMemcpy(&m_dcsPolyCounts[DS.FirstPoly], &MultiDrawCountArray[0], DS.NumPolys * sizeof(GLsizei));
+
+	m_dcsNumSurfaces++;
+	m_dcsNumVerts += DS.NumVerts;
+	m_dcsNumPolys += DS.NumPolys;
+
+	m_dcsSurfaceCount++;
+
+	return true;
+}
+
+void UOpenGLRenderDevice::DeferComplexSurfaceLayer(FGLDeferredSurface &DS, INT Layer, FTextureInfo &Info, DWORD PolyFlags, FLOAT PanBias) {
+	FGLDeferredLayer &DL = DS.Layers[Layer];
+	const FTexInfo &Tex = TexInfo[0];
+
+	//Resolve and upload the texture now, through texture unit 0
+	//The flush rebinds it to the unit it is drawn from
+	SetTexture(0, Info, PolyFlags, PanBias);
+
+	DL.pBind = Tex.pBind;
+	DL.CacheID = Tex.CurrentCacheID;
+	DL.DynamicPolyFlags = Tex.CurrentDynamicPolyFlags;
+	DL.PolyFlags = PolyFlags;
+
+	//Generate texture coordinates
+	FLOAT UPan = Tex.UPan;
+	FLOAT VPan = Tex.VPan;
+	FLOAT UMult = Tex.UMult;
+	FLOAT VMult = Tex.VMult;
+	const FGLMapDot *pMapDot = &MapDotArray[0];
+	FGLTexCoord *pTexCoord = &m_dcsTexCoords[Layer][DS.FirstVert];
+	INT ptCounter = DS.NumVerts;
+	do {
+		pTexCoord->u = (pMapDot->u - UPan) * UMult;
+		pTexCoord->v = (pMapDot->v - VPan) * VMult;
+		pMapDot++;
+		pTexCoord++;
+	} while (--ptCounter != 0);
+}
+
+INT UOpenGLRenderDevice::CompareDeferredComplexSurfaceState(const FGLDeferredSurface *pA, const FGLDeferredSurface *pB) {
+	if (pA->PolyFlags != pB->PolyFlags) {
+		return (pA->PolyFlags < pB->PolyFlags) ? -1 : 1;
+	}
+	if (pA->NumLayers != pB->NumLayers) {
+		return pA->NumLayers - pB->NumLayers;
+	}
+	for (INT t = 0; t < pA->NumLayers; t++) {
+		const FGLDeferredLayer &A = pA->Layers[t];
+		const FGLDeferredLayer &B = pB->Layers[t];
+
+		//Compare texture objects, as atlas cells of one page can share a draw
+		if (A.pBind->Id != B.pBind->Id) {
+			return (A.pBind->Id < B.pBind->Id) ? -1 : 1;
+		}
+		if (A.DynamicPolyFlags != B.DynamicPolyFlags) {
+			return (A.DynamicPolyFlags < B.DynamicPolyFlags) ? -1 : 1;
+		}
+	}
+
+	return 0;
+}
+
+INT CDECL UOpenGLRenderDevice::CompareDeferredComplexSurfaces(const void *pA, const void *pB) {
+	const FGLDeferredSurface *pDSA = *(const FGLDeferredSurface **)pA;
+	const FGLDeferredSurface *pDSB = *(const FGLDeferredSurface **)pB;
+
+	INT result = CompareDeferredComplexSurfaceState(pDSA, pDSB);
+	if (result != 0) {
+		return result;
+	}
+
+	//Keep submission order within matching state
+	return pDSA->Order - pDSB->Order;
+}
+
+void UOpenGLRenderDevice::FlushDeferredComplexSurfacesNoCheck(void) {
+	guard(UOpenGLRenderDevice::FlushDeferredComplexSurfaces);
+
+	INT numSurfaces = m_dcsNumSurfaces;
+	INT i;
+
+	//Reset the list before drawing
+	m_dcsNumSurfaces = 0;
+	m_dcsNumPolys = 0;
+	m_dcsNumVerts = 0;
+
+	SetProfCategory(PROF_CAT_COMPLEX);
+
+	//Sort by state
+	for (i = 0; i < numSurfaces; i++) {
+		m_dcsSortedSurfaces[i] = &m_dcsSurfaces[i];
+	}
+	appQsort(m_dcsSortedSurfaces, numSurfaces, sizeof(FGLDeferredSurface *), CompareDeferredComplexSurfaces);
+
+	SetDefaultAAState();
+	SetDefaultProjectionState();
+	SetDefaultColorState();
+	SetDefaultShaderState();
+
+	glColor3fv(m_complexSurfaceColor3f_1f);
+
+	i = 0;
+	while (i < numSurfaces) {
+		const FGLDeferredSurface *pRunDS = m_dcsSortedSurfaces[i];
+		INT numVerts = 0;
+		INT numPolys = 0;
+
+		//Gather surfaces with matching state, as many as fit in the vertex arrays
+		do {
+			const FGLDeferredSurface *pDS = m_dcsSortedSurfaces[i];
+
+			if (((numVerts + pDS->NumVerts) > VERTEX_ARRAY_SIZE) || ((numPolys + pDS->NumPolys) > (VERTEX_ARRAY_SIZE / 3))) {
+				break;
+			}
+
+			appMemcpy(&VertexArray[numVerts], &m_dcsVerts[pDS->FirstVert], pDS->NumVerts * sizeof(FGLVertex));
+			for (INT t = 0; t < pDS->NumLayers; t++) {
+				appMemcpy(&TexCoordArray[t][numVerts], &m_dcsTexCoords[t][pDS->FirstVert], pDS->NumVerts * sizeof(FGLTexCoord));
+			}
+
+			const GLsizei *pPolyCount = &m_dcsPolyCounts[pDS->FirstPoly];
+			INT polyCounter = pDS->NumPolys;
+			do {
+				GLsizei count = *pPolyCount++;
+				MultiDrawFirstArray[numPolys] = numVerts;
+				MultiDrawCountArray[numPolys] = count;
+				numPolys++;
+				numVerts += count;
+			} while (--polyCounter != 0);
+		} while ((++i < numSurfaces) && (CompareDeferredComplexSurfaceState(pRunDS, m_dcsSortedSurfaces[i]) == 0));
+
+		DrawDeferredComplexSurfaceRun(*pRunDS, numVerts, numPolys);
+	}
+
+	unguard;
+}
+
+void UOpenGLRenderDevice::DrawDeferredComplexSurfaceRun(const FGLDeferredSurface &DS, INT NumVerts, INT NumPolys) {
+	INT t;
+
+	SetBlend(DS.Layers[0].PolyFlags);
+
+	//Bind the textures resolved when the surfaces were recorded
+	for (t = 0; t < DS.NumLayers; t++) {
+		const FGLDeferredLayer &DL = DS.Layers[t];
+		FTexInfo &Tex = TexInfo[t];
+		DWORD texBit = 1U << t;
+
+		if (t != 0) {
+			glActiveTextureARB(GL_TEXTURE0_ARB + t);
+
+			if ((m_texEnableBits & texBit) == 0) {
+				m_texEnableBits |= texBit;
+				glEnable(GL_TEXTURE_2D);
+			}
+
+			SetTexEnv(t, DL.PolyFlags);
+		}
+		if ((m_clientTexEnableBits & texBit) == 0) {
+			m_clientTexEnableBits |= texBit;
+			if (SUPPORTS_GL_ARB_multitexture) {
+				glClientActiveTextureARB(GL_TEXTURE0_ARB + t);
+			}
+			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		}
+
+		if ((Tex.CurrentCacheID != DL.CacheID) || (Tex.CurrentDynamicPolyFlags != DL.DynamicPolyFlags)) {
+			Tex.CurrentCacheID = DL.CacheID;
+			Tex.CurrentDynamicPolyFlags = DL.DynamicPolyFlags;
+			Tex.UMult = DL.pBind->UMult;
+			Tex.VMult = DL.pBind->VMult;
+			Tex.UAtlasPan = DL.pBind->UAtlasPan;
+			Tex.VAtlasPan = DL.pBind->VAtlasPan;
+			if ((Tex.pBind == NULL) || (Tex.pBind->Id != DL.pBind->Id)) {
+				glBindTexture(GL_TEXTURE_2D, DL.pBind->Id);
+				m_texBindCount++;
+			}
+			Tex.pBind = DL.pBind;
+		}
+	}
+
+	//Disable unused texture units
+	DisableSubsequentTextures(DS.NumLayers);
+	DisableSubsequentClientTextures(DS.NumLayers);
+
+	m_csPtCount = NumVerts;
+	m_csPolyCount = NumPolys;
+
+	StreamVertexArrays(0, NumVerts);
+
+	if (UseMultiDrawArrays && (NumPolys > 1)) {
+		m_drawCallCount++;
+		glMultiDrawArraysEXT(GL_TRIANGLE_FAN, MultiDrawFirstArray, MultiDrawCountArray, NumPolys);
+	}
+	else {
+		m_drawCallCount += NumPolys;
+		for (INT Index = 0; Index < NumPolys; Index++) {
+			glDrawArrays(GL_TRIANGLE_FAN, MultiDrawFirstArray[Index], MultiDrawCountArray[Index]);
+		}
+	}
+
+	if (SUPPORTS_GL_ARB_multitexture) {
+		glActiveTextureARB(GL_TEXTURE0_ARB);
+	}
+
+	m_dcsDrawCount++;
+}
+
 DWORD UOpenGLRenderDevice::BufferDetailTextureData(FLOAT NearZ) {
 	DWORD *pDetailTextureIsNear = DetailTextureIsNearArray;
 	DWORD anyIsNearBits = 0;
@@ -7206,56 +12326,30 @@ DWORD UOpenGLRenderDevice::BufferDetailTextureData(FLOAT NearZ) {
 }
 
 #ifdef UTGLR_INCLUDE_SSE_CODE
-__declspec(naked) DWORD UOpenGLRenderDevice::BufferDetailTextureData_SSE2(FLOAT NearZ) {
-	__asm {
-		movd xmm0, [esp+4]
-
-		push esi
-		push edi
-
-		mov esi, [ecx]this.VertexArray
-		lea edx, [ecx]this.MultiDrawCountArray
-		lea edi, [ecx]this.DetailTextureIsNearArray
-
-		pxor xmm1, xmm1
-
-		mov ecx, [ecx]this.m_csPolyCount
-
-		poly_count_loop:
-			mov eax, [edx]
-			add edx, 4
-
-			pxor xmm2, xmm2
-
-			num_pts_loop:
-				movss xmm3, [esi+8]
-				add esi, TYPE FGLVertex
-
-				pslld xmm2, 1
-
-				cmpltss xmm3, xmm0
-				psrld xmm3, 31
-
-				por xmm2, xmm3
-
-				dec eax
-				jne num_pts_loop
-
-			movd [edi], xmm2
-			add edi, 4
-
-			por xmm1, xmm2
+DWORD UOpenGLRenderDevice::BufferDetailTextureData_SSE2(FLOAT NearZ) {
+	DWORD *pDetailTextureIsNear = DetailTextureIsNearArray;
+	__m128i anyIsNearBits = _mm_setzero_si128();
+	__m128 nearZ = _mm_set_ss(NearZ);
 
-			dec ecx
-			jne poly_count_loop
+	FGLVertex *pVertex = &VertexArray[0];
+	INT *pNumPts = &MultiDrawCountArray[0];
+	DWORD csPolyCount = m_csPolyCount;
+	do {
+		INT NumPts = *pNumPts++;
+		__m128i isNear = _mm_setzero_si128();
 
-		movd eax, xmm1
+		do {
+			//The compare mask is shifted down to a single bit
+			__m128i vertIsNear = _mm_srli_epi32(_mm_castps_si128(_mm_cmplt_ss(_mm_load_ss(&pVertex->z), nearZ)), 31);
+			isNear = _mm_or_si128(_mm_slli_epi32(isNear, 1), vertIsNear);
+			pVertex++;
+		} while (--NumPts != 0);
 
-		pop edi
-		pop esi
+		*pDetailTextureIsNear++ = _mm_cvtsi128_si32(isNear);
+		anyIsNearBits = _mm_or_si128(anyIsNearBits, isNear);
+	} while (--csPolyCount != 0);
 
-		ret 4
-	}
+	return _mm_cvtsi128_si32(anyIsNearBits);
 }
 #endif //UTGLR_INCLUDE_SSE_CODE
 
@@ -7268,6 +12362,8 @@ void UOpenGLRenderDevice::EndGouraudPolygonBufferingNoCheck(void) {
 
 	cycle(GouraudCycles);
 
+	SetProfCategory(PROF_CAT_GOURAUD);
+
 	//Set projection state
 	SetProjectionState(m_requestNearZRangeHackProjection);
 
@@ -7279,7 +12375,8 @@ void UOpenGLRenderDevice::EndGouraudPolygonBufferingNoCheck(void) {
 #endif
 
 	// Actually render the triangles.
-	glDrawArrays(GL_TRIANGLES, 0, BufferedVerts);
+	m_drawCallCount++;
+	glDrawArrays(GL_TRIANGLES, StreamVertexArrays(0, BufferedVerts), BufferedVerts);
 
 #ifdef UTGLR_DEBUG_ACTOR_WIREFRAME
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -7304,11 +12401,14 @@ void UOpenGLRenderDevice::EndTileBufferingNoCheck(void) {
 
 	cycle(TileCycles);
 
+	SetProfCategory(PROF_CAT_TILE);
+
 	//Set color state
 	SetColorState();
 
 	//Draw the quads
-	glDrawArrays(GL_QUADS, 0, BufferedTileVerts);
+	m_drawCallCount++;
+	glDrawArrays(GL_QUADS, StreamVertexArrays(0, BufferedTileVerts), BufferedTileVerts);
 
 	BufferedTileVerts = 0;
 
@@ -7323,9 +12423,11 @@ UBOOL UOpenGLRenderDevice::GLLoaded = false;
 
 UOpenGLRenderDevice::DWORD_CTTree_t UOpenGLRenderDevice::m_sharedZeroPrefixBindTrees[NUM_CTTree_TREES];
 UOpenGLRenderDevice::QWORD_CTTree_t UOpenGLRenderDevice::m_sharedNonZeroPrefixBindTrees[NUM_CTTree_TREES];
+UOpenGLRenderDevice::CTHash_t UOpenGLRenderDevice::m_sharedBindHash;
 CCachedTextureChain UOpenGLRenderDevice::m_sharedNonZeroPrefixBindChain;
 UOpenGLRenderDevice::QWORD_CTTree_NodePool_t UOpenGLRenderDevice::m_sharedNonZeroPrefixTexIdPool;
 UOpenGLRenderDevice::TexPoolMap_t UOpenGLRenderDevice::m_sharedRGBA8TexPool;
+FGLLightMapAtlas UOpenGLRenderDevice::m_sharedLightMapAtlas;
 
 //OpenGL 1.x function pointers for remaining subset to be used with OpenGL 3.2
 #define GL1_PROC(ret, func, params) ret (STDCALL *UOpenGLRenderDevice::func)params;
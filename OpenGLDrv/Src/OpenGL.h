@@ -37,6 +37,13 @@
 #include <stdio.h>
 #include <stdarg.h>
 
+#if defined(__LINUX__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
 
 #include <map>
 #pragma warning(disable : 4663)
@@ -49,6 +56,9 @@
 #pragma warning(disable : 4146)
 
 #include "c_gclip.h"
+#include "c_bcenc.h"
+#include "c_pixconv.h"
+#include "FThreadPool.h"
 
 
 #ifdef _WIN32
@@ -61,6 +71,12 @@
 
 #endif
 
+//SSE code without inline assembly also builds with GCC when SSE2 is enabled for the target
+#if defined(__GNUC__) && defined(__SSE2__)
+#define UTGLR_INCLUDE_SSE_CODE
+#include <cpuid.h>
+#endif
+
 #ifdef UTGLR_INCLUDE_SSE_CODE
 #include <xmmintrin.h>
 #include <emmintrin.h>
@@ -75,6 +91,13 @@
 #endif
 
 
+//Render thread support
+//SDL cannot make the context current or present from another thread with Cocoa and some Windows drivers
+#if !defined(_WIN32) && !defined(__APPLE__)
+#define UTGLR_SUPPORTS_RENDER_THREAD
+#endif
+
+
 //Optional fastcall calling convention usage
 #define UTGLR_USE_FASTCALL
 
@@ -121,6 +144,7 @@
 
 
 #include "c_rbtree.h"
+#include "c_bindhash.h"
 
 
 /*-----------------------------------------------------------------------------
@@ -174,6 +198,19 @@ const tex_params_t CT_DEFAULT_TEX_PARAMS = { CT_MIN_FILTER_NEAREST_MIPMAP_LINEAR
 
 #define DT_NO_SMOOTH_BIT	0x01
 
+struct FCachedTexture;
+class FGLTexConvertJob;
+
+//Texture conversion context
+//Passed to the converters so conversions can also run on worker threads
+struct FTexConvertCtx {
+	BYTE *pCompose;
+	INT stepBits;
+	DWORD texWidthPow2;
+	DWORD texHeightPow2;
+	const FCachedTexture *pBind;
+};
+
 struct FCachedTexture {
 	GLuint Id;
 	DWORD LastUsedFrameCount;
@@ -183,19 +220,383 @@ struct FCachedTexture {
 	DWORD UClampVal, VClampVal;
 	FLOAT UMult, VMult;
 	BYTE texType;
+	BYTE texCompress;
 	BYTE bindType;
 	BYTE treeIndex;
 	BYTE dynamicTexBits;
 	tex_params_t texParams;
 	GLenum texSourceFormat;
 	GLenum texInternalFormat;
+	BYTE atlasPage;
+	_WORD atlasCell;
+	FLOAT UAtlasPan, VAtlasPan;
+	FGLTexConvertJob *pConvertJob;
 	union {
-		void (FASTCALL UOpenGLRenderDevice::*pConvertBGRA7777)(const FMipmapBase *, INT);
+		void (FASTCALL UOpenGLRenderDevice::*pConvertBGRA7777)(FTexConvertCtx &, const FMipmapBase *, INT);
 	};
 	FCachedTexture *pPrev;
 	FCachedTexture *pNext;
 };
 
+//Lightmap atlas
+//Light and fog maps of one size class share the cells of a page texture
+enum { LMA_PAGE_BITS = 9 };
+enum { LMA_MIN_CELL_BITS = 3 };
+enum { LMA_MAX_CELL_BITS = 7 };
+enum { LMA_MAX_PAGES = 64 };
+enum { LMA_NO_PAGE = 0xFF };
+//Cells are surrounded by a gutter of duplicated border texels so filtering does not read their neighbours
+enum { LMA_GUTTER = 1 };
+
+struct FGLLightMapAtlasPage {
+	GLuint Id;
+	BYTE CellUBits, CellVBits;
+	TArray<_WORD> FreeCells;
+};
+
+struct FGLLightMapAtlas {
+	INT NumPages;
+	FGLLightMapAtlasPage Pages[LMA_MAX_PAGES];
+};
+
+//Converted texture disk cache
+//Each entry file holds the ready to upload mipmap chain of one texture
+//Cache ids are not stable between runs, so entries are keyed by texture name and conversion settings
+enum { TEX_DISK_CACHE_MAGIC = 0x43544C47 };
+enum { TEX_DISK_CACHE_VERSION = 2 };
+enum { TEX_DISK_CACHE_MAX_LEVELS = 16 };
+
+struct FGLTexDiskCacheKey {
+	DWORD NameCrc;
+	DWORD SettingsCrc;
+	DWORD PaletteCrc;
+	DWORD DataCrc;
+};
+
+struct FGLTexDiskCacheHeader {
+	DWORD Magic;
+	DWORD Version;
+	FGLTexDiskCacheKey Key;
+	DWORD NumLevels;
+	DWORD LevelSizes[TEX_DISK_CACHE_MAX_LEVELS];
+};
+
+//Asynchronous texture conversion
+//Jobs convert private copies of the source mipmaps, so workers never touch engine data
+enum { ASYNC_TEX_MAX_LEVELS = 16 };
+
+struct FGLTexConvertQueue;
+
+class FGLTexConvertJob : public FThreadTask {
+public:
+	UOpenGLRenderDevice *pDevice;
+	FGLTexConvertQueue *pQueue;
+	//Render thread only, cleared when the texture stops waiting for the job
+	FCachedTexture *pBind;
+	QWORD CacheID;
+	//Copy of the bind for the converters to read
+	FCachedTexture ConvertBind;
+	FColor Palette[256];
+	FMipmapBase SrcMips[MAX_MIPS];
+	INT NumLevels;
+	INT LevelMipIndex[ASYNC_TEX_MAX_LEVELS];
+	INT LevelStepBits[ASYNC_TEX_MAX_LEVELS];
+	DWORD LevelOffsets[ASYNC_TEX_MAX_LEVELS];
+	//Converted levels, followed by the source copies and the RGBA8 buffer of compressed levels
+	BYTE *pData;
+	DWORD CompressOffset;
+	bool CompressUseSSE2;
+	DWORD DataSize;
+	DWORD AllocSize;
+	//Set by the worker under the queue lock
+	UBOOL Done;
+	//Converted levels are also written to the disk cache
+	bool WriteDiskCache;
+	FGLTexDiskCacheKey DiskCacheKey;
+
+	void DoWork();
+};
+
+struct FGLTexConvertQueue {
+	FGLTexConvertQueue(INT NumThreads) : Pool(NumThreads), PendingBytes(0) {
+	}
+
+	FThreadPool Pool;
+	FCriticalSection Section;
+	//Render thread only
+	TArray<FGLTexConvertJob *> Jobs;
+	DWORD PendingBytes;
+};
+
+//Render thread
+//Frames are recorded into a command buffer with copies of the data they use
+//A thread that owns the GL context while it runs replays them
+enum rt_cmd_t {
+	RT_CMD_DATA,
+	RT_CMD_LOCK,
+	RT_CMD_UNLOCK,
+	RT_CMD_SET_SCENE_NODE,
+	RT_CMD_DRAW_COMPLEX_SURFACE,
+	RT_CMD_DRAW_GOURAUD_POLYGON,
+	RT_CMD_DRAW_TILE,
+	RT_CMD_DRAW_3D_LINE,
+	RT_CMD_DRAW_2D_LINE,
+	RT_CMD_DRAW_2D_POINT,
+	RT_CMD_CLEAR_Z,
+	RT_CMD_END_FLASH,
+	RT_CMD_PRECACHE_TEXTURE
+};
+
+//Every record starts with a header, data records are skipped on replay
+//Records refer to each other by buffer offset, as the buffer may move while recording
+struct FGLCmdHeader {
+	DWORD Type;
+	DWORD Size;
+	DWORD Reserved[2];
+};
+
+//Texture info with its own copy of the mipmap headers
+//Data that may change or go away before the replay is copied too
+struct FGLCmdTexture {
+	FTextureInfo Info;
+	FMipmapBase Mips[MAX_MIPS];
+	DWORD MipDataOffsets[MAX_MIPS];
+	DWORD PaletteOffset;
+	bool Resolved;
+};
+
+//Copy of a light or fog map referenced by recorded frames
+//Made once per cache id and kept while recent frames use it, instead of copying the map into every frame
+//The mipmap data and palette follow the structure
+struct FGLRecordedMap {
+	QWORD CacheID;
+	DWORD LastFrame;
+	bool Retired;
+	BYTE *MipData[MAX_MIPS];
+	FColor *Palette;
+};
+
+struct FGLCmdLock {
+	FPlane FlashScale;
+	FPlane FlashFog;
+	FPlane ScreenClear;
+	DWORD RenderLockFlags;
+};
+
+struct FGLCmdUnlock {
+	UBOOL Blit;
+};
+
+//Set scene node and clear Z
+struct FGLCmdSceneNode {
+	DWORD FrameOffset;
+};
+
+//Viewport state a scene node is drawn with
+//Recorded after the scene node, as the game thread may change or free the viewport and its actor before the replay
+struct FGLSceneNodeView {
+	FLOAT FovAngle;
+	FLOAT OrthoZoom;
+	INT ViewportSizeY;
+	UBOOL IsOrtho;
+};
+
+struct FGLCmdComplexSurface {
+	DWORD FrameOffset;
+	//Texture, light map, macro texture, detail texture and fog map
+	DWORD TextureOffsets[5];
+	DWORD PolysOffset;
+	FSurfaceInfo Surface;
+	FSurfaceFacet Facet;
+};
+
+struct FGLCmdGouraudPolygon {
+	DWORD FrameOffset;
+	DWORD TextureOffset;
+	DWORD PtsOffset;
+	INT NumPts;
+	DWORD PolyFlags;
+};
+
+struct FGLCmdTile {
+	DWORD FrameOffset;
+	DWORD TextureOffset;
+	FLOAT X, Y, XL, YL;
+	FLOAT U, V, UL, VL;
+	FLOAT Z;
+	FPlane Color;
+	FPlane Fog;
+	DWORD PolyFlags;
+};
+
+//3D and 2D lines
+struct FGLCmdLine {
+	DWORD FrameOffset;
+	FPlane Color;
+	DWORD LineFlags;
+	FVector P1, P2;
+};
+
+struct FGLCmdPoint {
+	DWORD FrameOffset;
+	FPlane Color;
+	DWORD LineFlags;
+	FLOAT X1, Y1, X2, Y2;
+	FLOAT Z;
+};
+
+struct FGLCmdPrecacheTexture {
+	DWORD TextureOffset;
+	DWORD PolyFlags;
+};
+
+class FGLCmdBuffer {
+public:
+	enum { ALIGN = 16 };
+	enum { TEX_CACHE_SIZE = 64 }; //Must be a power of 2
+
+	FGLCmdBuffer() {
+		Reset();
+	}
+
+	void Reset(void) {
+		//Offset 0 is never used, so it can mean no record
+		Used = ALIGN;
+		pLastFrame = NULL;
+		LastFrameOffset = 0;
+		appMemzero(TexCache, sizeof(TexCache));
+	}
+
+	//Returns the offset of the payload, pointers to earlier records are invalid after this
+	DWORD FASTCALL Alloc(DWORD Type, DWORD PayloadSize) {
+		DWORD Offset = Used;
+		DWORD Size = (sizeof(FGLCmdHeader) + PayloadSize + (ALIGN - 1)) & ~(ALIGN - 1);
+
+		Used += Size;
+		if (Used > (DWORD)Data.Num()) {
+			Data.Add(Max<INT>(Used - Data.Num(), Data.Num()));
+		}
+
+		FGLCmdHeader *pHeader = (FGLCmdHeader *)&Data(Offset);
+		pHeader->Type = Type;
+		pHeader->Size = Size;
+
+		return Offset + sizeof(FGLCmdHeader);
+	}
+
+	inline BYTE *GetPtr(DWORD Offset) {
+		return &Data(Offset);
+	}
+
+	TArray<BYTE> Data;
+	DWORD Used;
+
+	//Repeated scene nodes and textures are only recorded once
+	const FSceneNode *pLastFrame;
+	DWORD LastFrameOffset;
+	struct {
+		const FTextureInfo *pInfo;
+		DWORD Offset;
+	} TexCache[TEX_CACHE_SIZE];
+};
+
+class FGLRenderThreadTask : public FThreadTask {
+public:
+	UOpenGLRenderDevice *pDevice;
+	FGLCmdBuffer *pBuffer;
+
+	void DoWork();
+};
+
+//Frame capture
+//Frames read back by the GL thread are converted and written to the file on a capture thread
+//The capture thread never allocates
+class FGLCapture {
+public:
+	enum { NUM_SLOTS = 3 };
+
+	FGLCapture();
+	~FGLCapture();
+
+	//The file is Y4M when its name ends in .y4m, otherwise raw top down BGRA
+	//Frames are read back bottom up, as RGBA if SwapRB is set or else as BGRA
+	bool Start(const TCHAR *pFilename, INT InSizeX, INT InSizeY, INT FrameRate, bool InSwapRB,
+		const BYTE *pRampR, const BYTE *pRampG, const BYTE *pRampB, bool InUseSSE2);
+	//Writes the queued frames and closes the file
+	void Stop(void);
+
+	//Returns the buffer for the next frame, waiting for the capture thread if all are queued
+	BYTE *BeginFrame(void);
+	void EndFrame(void);
+
+	INT SizeX, SizeY;
+	bool Y4M;
+	DWORD NumFrames;
+	DWORD NumStalls;
+
+private:
+	static void ThreadMain(void *Arg);
+	void WriteFrame(const BYTE *pSrc);
+
+	FArchive *Ar;
+	FThread Thread;
+	FCriticalSection Section;
+	FCondition WorkReady;
+	FCondition WorkDone;
+	bool Exiting;
+	INT Head;
+	INT NumQueued;
+	TArray<BYTE> Slots[NUM_SLOTS];
+	TArray<BYTE> RowBuf;
+	TArray<BYTE> Out;
+	bool SwapRB;
+	bool UseGamma;
+	bool UseSSE2;
+	BYTE GammaRamp[3][256];
+};
+
+//Frame profiler draw categories
+//GPU time is split at the timestamps taken whenever the category changes
+enum prof_cat_t {
+	PROF_CAT_OTHER,
+	PROF_CAT_COMPLEX,
+	PROF_CAT_GOURAUD,
+	PROF_CAT_TILE,
+	PROF_CAT_DETAIL,
+	PROF_CAT_FOG,
+	PROF_NUM_CATS
+};
+
+//One frame of the profiler ring
+//Times are in milliseconds
+struct FGLProfFrame {
+	DWORD Frame;
+	FLOAT FrameMs;		//Unlock to Unlock
+	FLOAT CPUMs;		//Lock to Unlock, without the swap
+	FLOAT BindMs, ImageMs, ComplexMs, GouraudMs, TileMs;
+	bool GPUValid;		//GPU times arrive a few frames later
+	FLOAT GPUMs;
+	FLOAT GPUCatMs[PROF_NUM_CATS];
+	DWORD DrawCalls;
+	DWORD TexBinds;
+	DWORD StateSwitches;
+	DWORD TexUploads;
+	DWORD UploadBytes;
+	DWORD StreamBytes;
+};
+
+//Timestamp queries issued during one frame
+//Each query starts the interval of the category stored with it, the last one ends the frame
+struct FGLProfQuerySet {
+	enum { MAX_QUERIES = 1024 };
+
+	GLuint Ids[MAX_QUERIES];
+	BYTE Cats[MAX_QUERIES];
+	INT NumQueries;
+	INT RingIndex;
+	DWORD Frame;
+};
+
 class CCachedTextureChain {
 public:
 	CCachedTextureChain() {
@@ -291,6 +692,8 @@ struct FTexInfo {
 	FLOAT VMult;
 	FLOAT UPan;
 	FLOAT VPan;
+	FLOAT UAtlasPan;
+	FLOAT VAtlasPan;
 };
 
 //Geometry
@@ -383,19 +786,22 @@ class UOpenGLRenderDevice : public URenderDevice {
 		TEX_TYPE_HAS_PALETTE,
 		TEX_TYPE_NORMAL
 	};
+	//Load time compression of textures that would be expanded to RGBA8
+	enum tex_compress_t {
+		TEX_COMPRESS_NONE,
+		TEX_COMPRESS_BC1,
+		TEX_COMPRESS_BC3
+	};
+	enum { TEX_COMPRESS_MIN_LOG_TEXELS = 12 };
 	#define TEX_FLAG_NO_CLAMP	0x00000001
 
-	struct FTexConvertCtx {
-		BYTE *pCompose;
-		INT stepBits;
-		DWORD texWidthPow2;
-		DWORD texHeightPow2;
-		const FCachedTexture *pBind;
-	} m_texConvertCtx;
+	FTexConvertCtx m_texConvertCtx;
 
 	FMemMark m_texComposeMemMark;
 	enum { LOCAL_TEX_COMPOSE_BUFFER_SIZE = 16384 };
 	BYTE m_localTexComposeBuffer[LOCAL_TEX_COMPOSE_BUFFER_SIZE + 16];
+	//Large textures replayed on the render thread are composed here, as GMem is only used by the game thread
+	TArray<BYTE> m_renderThreadComposeBuffer;
 
 
 	inline void * FASTCALL AlignMemPtr(void *ptr, size_t align) {
@@ -434,6 +840,174 @@ class UOpenGLRenderDevice : public URenderDevice {
 	DWORD m_csPolyCount;
 	INT m_csPtCount;
 
+	//Deferred complex surface list
+	//Opaque surfaces are recorded with resolved textures and generated tex coords,
+	//then sorted by state and drawn in merged runs when the list is flushed
+	enum { DCS_MAX_LAYERS = 3 };
+	enum { DCS_MAX_SURFACES = 1024 };
+	enum { DCS_MAX_POLYS = 4096 };
+	enum { DCS_MAX_VERTS = 8192 };
+	struct FGLDeferredLayer {
+		FCachedTexture *pBind;
+		QWORD CacheID;
+		DWORD DynamicPolyFlags;
+		DWORD PolyFlags;
+	};
+	struct FGLDeferredSurface {
+		DWORD PolyFlags;
+		INT NumLayers;
+		FGLDeferredLayer Layers[DCS_MAX_LAYERS];
+		INT FirstVert;
+		INT NumVerts;
+		INT FirstPoly;
+		INT NumPolys;
+		INT Order;
+	};
+	bool m_dcsActive;
+	INT m_dcsNumSurfaces;
+	INT m_dcsNumPolys;
+	INT m_dcsNumVerts;
+	//Lists are allocated at SetRes only when deferring is enabled
+	FGLDeferredSurface *m_dcsSurfaces;
+	FGLDeferredSurface **m_dcsSortedSurfaces;
+	GLsizei *m_dcsPolyCounts;
+	FGLVertex *m_dcsVerts;
+	FGLTexCoord *m_dcsTexCoords[DCS_MAX_LAYERS];
+
+	//Streaming vertex buffer ring
+	//Segments are fenced as they fill, so one draw must fit in a segment
+	enum { STREAM_VBO_NUM_SEGMENTS = 4 };
+	enum { STREAM_VBO_SEGMENT_SIZE = 1024 * 1024 };
+	enum { STREAM_VBO_ALIGN = 64 };
+	bool m_streamVBOActive;
+	bool m_streamVBOPersistent;
+	GLuint m_streamVBO;
+	BYTE *m_streamVBOMappedPtr;
+	DWORD m_streamVBOOffset;
+	DWORD m_streamVBOSegment;
+	GLsync m_streamVBOFences[STREAM_VBO_NUM_SEGMENTS];
+
+	//Asynchronous texture conversion
+	//New textures show a one texel placeholder until their converted mipmaps are uploaded
+	enum { ASYNC_TEX_MIN_LOG_TEXELS = 12 };
+	enum { ASYNC_TEX_MAX_PENDING_BYTES = 64 * 1024 * 1024 };
+	enum { ASYNC_TEX_UPLOAD_BYTES_PER_FRAME = 4 * 1024 * 1024 };
+	enum { TEX_PBO_RING_SIZE = 4 };
+	FGLTexConvertQueue *m_texConvertQueue;
+	bool m_texPBOActive;
+	GLuint m_texPBOs[TEX_PBO_RING_SIZE];
+	DWORD m_texPBOIndex;
+
+	//Render thread
+	//One frame is replayed while the next one is recorded into the other buffer
+	FThreadPool *m_renderThread;
+	FGLCmdBuffer m_cmdBuffers[2];
+	FGLRenderThreadTask m_renderThreadTasks[2];
+	INT m_cmdBufferIndex;
+	FGLCmdBuffer *m_pRecordBuffer;
+	bool m_renderThreadReplaying;
+	FGLSceneNodeView m_replayView;
+	volatile bool m_renderThreadAbort;
+
+	//Log lines from frame rendering, which may run on the render thread
+	//Logged by the game thread while the render thread is idle
+	TArray<FString> m_deferredLog;
+	bool m_streamVBOMapFailed;
+
+	//Light and fog map copies, only used by the game thread
+	enum { RECORDED_MAP_KEEP_FRAMES = 30 };
+	bind_hash<FGLRecordedMap> m_recordedMaps;
+	TArray<FGLRecordedMap *> m_recordedMapList;
+	DWORD m_recordFrameCount;
+
+	//Frame capture
+	//Frames are read into a ring of pixel pack buffers and mapped when the ring wraps, so reading does not stall
+	enum { CAPTURE_PBO_RING_SIZE = 3 };
+	FGLCapture *m_capture;
+	bool m_capturePBOActive;
+	GLuint m_capturePBOs[CAPTURE_PBO_RING_SIZE];
+	DWORD m_capturePBOIndex;
+	DWORD m_capturePBOPending;
+
+	//Frame profiler
+	//Query results are read once available, so GPU times lag the frame ring by a few frames
+	enum { PROF_RING_SIZE = 256 };
+	enum { PROF_QUERY_FRAMES = 4 };
+	enum { PROF_AVERAGE_FRAMES = 30 };
+	bool m_profActive;
+	bool m_profFrameActive;
+	BYTE m_profCategory;
+	FGLProfQuerySet m_profQuerySets[PROF_QUERY_FRAMES];
+	INT m_profQuerySetIndex;
+	//Written by the thread running the device, read by DrawStats and the dump command
+	FCriticalSection m_profSection;
+	FGLProfFrame m_profFrames[PROF_RING_SIZE];
+	INT m_profFrameHead;
+	INT m_profFrameCount;
+#if defined UTGLR_DX_BUILD || defined UTGLR_RUNE_BUILD
+	FLOAT m_profLockTime;
+	FLOAT m_profPrevUnlockTime;
+#else
+	FTime m_profLockTime;
+	FTime m_profPrevUnlockTime;
+#endif
+	bool m_profPrevUnlockValid;
+
+	//Converted texture disk cache
+	bool m_texDiskCacheActive;
+	FString m_texDiskCachePath;
+
+	//Offscreen rendering
+	//Frames are drawn into a framebuffer object and the hidden window is never swapped
+	bool m_offscreenActive;
+	GLuint m_offscreenFBO;
+	GLuint m_offscreenColorRB;
+	GLuint m_offscreenDepthRB;
+
+	//Timedemo benchmark
+	//Times a fixed number of frames after a warmup and checksums the image every few frames
+	bool m_timeDemoArmed;
+	bool m_timeDemoActive;
+	bool m_timeDemoPan;
+	bool m_timeDemoExit;
+	bool m_timeDemoExitRequested;
+	INT m_timeDemoFrames;
+	INT m_timeDemoWarmup;
+	INT m_timeDemoChecksumInterval;
+	INT m_timeDemoFrameIndex;
+	FString m_timeDemoFilename;
+#if defined UTGLR_DX_BUILD || defined UTGLR_RUNE_BUILD
+	FLOAT m_timeDemoPrevTime;
+#else
+	FTime m_timeDemoPrevTime;
+#endif
+	TArray<FLOAT> m_timeDemoTimes;
+	TArray<DWORD> m_timeDemoChecksums;
+	TArray<BYTE> m_timeDemoPixels;
+	//Game thread side, as the frames may be replayed on the render thread
+	//The frame times file is written and the pan and exit state latched while the render thread is idle
+	FString m_timeDemoCsv;
+	bool m_timeDemoPanning;
+	QWORD m_timeDemoPanAccum;
+
+	//Hitch benchmark
+	bool m_hitchBenchArmed;
+	bool m_hitchBenchActive;
+	INT m_hitchBenchFrames;
+	INT m_hitchBenchFramesLeft;
+#if defined UTGLR_DX_BUILD || defined UTGLR_RUNE_BUILD
+	FLOAT m_hitchBenchPrevTime;
+#else
+	FTime m_hitchBenchPrevTime;
+#endif
+	FLOAT m_hitchBenchWorst;
+	FLOAT m_hitchBenchTotal;
+	INT m_hitchBenchWorstFrame;
+	INT m_hitchBenchSlowFrames;
+	DWORD m_hitchBenchSyncUploads;
+	DWORD m_hitchBenchAsyncUploads;
+	DWORD m_hitchBenchDiskCacheHits;
+
 	FLOAT m_csUDot;
 	FLOAT m_csVDot;
 
@@ -484,6 +1058,36 @@ class UOpenGLRenderDevice : public URenderDevice {
 	GLuint m_fpDualTextureAndDetailTexture;
 	GLuint m_fpDualTextureAndDetailTextureTwoLayer;
 
+	//GLSL uniform block contents
+	//Layouts match the std140 blocks in the GLSL complex surface program
+	struct FGLSLFrameState {
+		FLOAT MVP[16];
+	};
+	struct FGLSLSurfaceState {
+		FLOAT XAxis[4];
+		FLOAT YAxis[4];
+		FLOAT TexInfo[MAX_TMUNITS][4];
+		FLOAT Color[4];
+		INT Mode[4];
+	};
+	enum {
+		GLSL_UBO_BINDING_FRAME		= 0,
+		GLSL_UBO_BINDING_SURFACE	= 1
+	};
+
+	//GLSL program cache information
+	GLuint m_glslCurrent;
+
+	//GLSL program and uniform buffer ids
+	GLuint m_glslComplexSurface;
+	GLuint m_glslFrameUBO;
+	GLuint m_glslSurfaceUBO;
+
+	//GLSL uniform block shadow copies
+	FGLSLFrameState m_glslFrameState;
+	FGLSLSurfaceState m_glslSurfaceState;
+	bool m_glslFrameStateDirty;
+
 
 	struct FGammaRamp {
 		_WORD red[256];
@@ -510,6 +1114,9 @@ class UOpenGLRenderDevice : public URenderDevice {
 	typedef _WORD TexPoolMapKey_t;
 	typedef rbtree<TexPoolMapKey_t, QWORD_CTTree_NodePool_t> TexPoolMap_t;
 	typedef rbtree_allocator<TexPoolMap_t> TexPoolMap_Allocator_t;
+	//Alternative to the bind trees, finds both zero and non zero prefix binds
+	//Cached textures are still held in bind tree nodes, so the tex id pools work the same with either
+	typedef bind_hash<FCachedTexture> CTHash_t;
 
 	enum { NUM_CTTree_TREES = 16 }; //Must be a power of 2
 	inline DWORD FASTCALL CTZeroPrefixCacheIDSuffixToTreeIndex(DWORD CacheIDSuffix) {
@@ -524,9 +1131,11 @@ class UOpenGLRenderDevice : public URenderDevice {
 
 	DWORD_CTTree_t m_localZeroPrefixBindTrees[NUM_CTTree_TREES], *m_zeroPrefixBindTrees;
 	QWORD_CTTree_t m_localNonZeroPrefixBindTrees[NUM_CTTree_TREES], *m_nonZeroPrefixBindTrees;
+	CTHash_t m_localBindHash, *m_bindHash;
 	CCachedTextureChain m_localNonZeroPrefixBindChain, *m_nonZeroPrefixBindChain;
 	QWORD_CTTree_NodePool_t m_localNonZeroPrefixTexIdPool, *m_nonZeroPrefixTexIdPool;
 	TexPoolMap_t m_localRGBA8TexPool, *m_RGBA8TexPool;
+	FGLLightMapAtlas m_localLightMapAtlas, *m_lightMapAtlas;
 
 	DWORD_CTTree_Allocator_t m_DWORD_CTTree_Allocator;
 	QWORD_CTTree_Allocator_t m_QWORD_CTTree_Allocator;
@@ -555,6 +1164,21 @@ class UOpenGLRenderDevice : public URenderDevice {
 	DWORD m_sceneNodeHackCount;
 	DWORD m_stat0Count;
 	DWORD m_stat1Count;
+	DWORD m_streamVBOBytes;
+	DWORD m_streamVBOStallCount;
+	DWORD m_glslSwitchCount;
+	DWORD m_glslUBOUpdateCount;
+	DWORD m_dcsSurfaceCount;
+	DWORD m_dcsDrawCount;
+	DWORD m_texUploadCount;
+	DWORD m_asyncTexQueueCount;
+	DWORD m_asyncTexUploadCount;
+	DWORD m_texDiskCacheHitCount;
+	DWORD m_texDiskCacheWriteCount;
+	DWORD m_texCompressCount;
+	DWORD m_drawCallCount;
+	DWORD m_texBindCount;
+	DWORD m_texUploadBytes;
 
 
 	// Hardware constraints.
@@ -608,13 +1232,42 @@ class UOpenGLRenderDevice : public URenderDevice {
 	UBOOL TexDXT1ToDXT3;
 	UBOOL UseMultiDrawArrays;
 	UBOOL UseFragmentProgram;
+	UBOOL UseStreamingVBO;
+	UBOOL UseGLSL;
+	UBOOL DeferComplexSurfaces;
+	UBOOL UseLightMapAtlas;
+	UBOOL UseAsyncTextures;
+	INT AsyncTextureThreads;
+	UBOOL UseTextureDiskCache;
+	UBOOL CompressTextures;
+	UBOOL UseBindHash;
+	UBOOL UseRenderThread;
+	UBOOL UseProfiler;
+	UBOOL FramePaceBeforeInput;
+	UBOOL Offscreen;
+	INT OffscreenSizeX;
+	INT OffscreenSizeY;
 	INT SwapInterval;
 	INT FrameRateLimit;
+
+	//Frame pacer
+	//Each frame waits for a deadline one period after the previous one, sleeping and then spinning for the last part
+	//The histogram holds the intervals between paced frames in 50 us buckets, the last bucket counts longer ones
+	enum { PACE_HIST_BUCKETS = 2000 };
 #if defined UTGLR_DX_BUILD || defined UTGLR_RUNE_BUILD
-	FLOAT m_prevFrameTimestamp;
+	FLOAT m_paceDeadline;
+	FLOAT m_pacePrevTime;
 #else
-	FTime m_prevFrameTimestamp;
+	FTime m_paceDeadline;
+	FTime m_pacePrevTime;
 #endif
+	bool m_paceDeadlineValid;
+	bool m_pacePrevTimeValid;
+	FLOAT m_paceSleepMargin;
+	DWORD m_paceHist[PACE_HIST_BUCKETS + 1];
+	DWORD m_paceNumFrames;
+	DWORD m_paceLateFrames;
+	FLOAT m_paceMaxMs;
 	UBOOL SceneNodeHack;
 	UBOOL SmoothMaskedTextures;
 	UBOOL MaskedTextureHack;
@@ -649,6 +1302,7 @@ class UOpenGLRenderDevice : public URenderDevice {
 	UBOOL PL_UseTrilinear;
 	UBOOL PL_Use16BitTextures;
 	UBOOL PL_TexDXT1ToDXT3;
+	UBOOL PL_UseLightMapAtlas;
 	INT PL_MaxAnisotropy;
 	UBOOL PL_SmoothMaskedTextures;
 	UBOOL PL_MaskedTextureHack;
@@ -660,6 +1314,14 @@ class UOpenGLRenderDevice : public URenderDevice {
 	UBOOL PL_UseFragmentProgram;
 	UBOOL PL_UseSSE;
 	UBOOL PL_UseSSE2;
+	UBOOL PL_UseStreamingVBO;
+	UBOOL PL_UseGLSL;
+	UBOOL PL_UseAsyncTextures;
+	UBOOL PL_UseTextureDiskCache;
+	UBOOL PL_CompressTextures;
+	//Also selects which bind lookup holds the cached textures
+	UBOOL PL_UseBindHash;
+	UBOOL PL_UseProfiler;
 
 	bool m_setGammaRampSucceeded;
 	FLOAT SavedGammaCorrection;
@@ -686,6 +1348,10 @@ class UOpenGLRenderDevice : public URenderDevice {
 	INT m_HitCount;
 	CGClip m_gclip;
 
+	//Hit select points of a whole facet, tested in one batch
+	TArray<CGClip::vec3_t> m_hitPts;
+	TArray<unsigned int> m_hitNumPts;
+
 
 	DWORD m_currentFrameCount;
 
@@ -740,15 +1406,32 @@ class UOpenGLRenderDevice : public URenderDevice {
 
 	void (FASTCALL *m_pBuffer3VertsProc)(UOpenGLRenderDevice *, FTransTexture **);
 
+	//Buffer all triangles of a polygon in one call, NULL if there is no such proc for the current state
+	void (FASTCALL *m_pBufferColoredPolyVertsProc)(UOpenGLRenderDevice *, FTransTexture **, INT);
+	void (FASTCALL *m_pBufferFoggedPolyVertsProc)(UOpenGLRenderDevice *, FTransTexture **, INT);
+
+	void (FASTCALL *m_pBufferPolyVertsProc)(UOpenGLRenderDevice *, FTransTexture **, INT);
+
+	//Vertex buffering benchmark
+	//Captures the gouraud polygons of one frame and replays them through each buffer verts proc
+	enum { VERT_BENCH_MAX_VERTS = 65536 };
+	bool m_vertBenchArmed;
+	bool m_vertBenchCapturing;
+	INT m_vertBenchPasses;
+	TArray<FTransTexture> m_vertBenchVerts;
+	TArray<INT> m_vertBenchNumPts;
+
 	GLuint m_noTextureId;
 	GLuint m_alphaTextureId;
 
 	// Static variables.
 	static DWORD_CTTree_t m_sharedZeroPrefixBindTrees[NUM_CTTree_TREES];
 	static QWORD_CTTree_t m_sharedNonZeroPrefixBindTrees[NUM_CTTree_TREES];
+	static CTHash_t m_sharedBindHash;
 	static CCachedTextureChain m_sharedNonZeroPrefixBindChain;
 	static QWORD_CTTree_NodePool_t m_sharedNonZeroPrefixTexIdPool;
 	static TexPoolMap_t m_sharedRGBA8TexPool;
+	static FGLLightMapAtlas m_sharedLightMapAtlas;
 	static INT NumDevices;
 	static INT LockCount;
 
@@ -1002,6 +1685,15 @@ class UOpenGLRenderDevice : public URenderDevice {
 
 	void InitFrameRateLimitTimerSafe(void);
 	void ShutdownFrameRateLimitTimer(void);
+	void PaceFrame(void);
+	void ResetPaceStats(void);
+	FLOAT FASTCALL GetPacePercentileMs(FLOAT Fraction);
+
+	void InitStreamVBOSafe(void);
+	void ShutdownStreamVBO(void);
+	void InitDeferredComplexSurfacesSafe(void);
+	void ShutdownDeferredComplexSurfaces(void);
+	void SetClientArrayPointers(void);
 
 	void BuildGammaRamp(float redGamma, float greenGamma, float blueGamma, int brightness, FGammaRamp &ramp);
 	void BuildGammaRamp(float redGamma, float greenGamma, float blueGamma, int brightness, FByteGammaRamp &ramp);
@@ -1037,11 +1729,16 @@ class UOpenGLRenderDevice : public URenderDevice {
 
 	UBOOL Exec(const TCHAR* Cmd, FOutputDevice& Ar);
 	void Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane ScreenClear, DWORD RenderLockFlags, BYTE* InHitData, INT* InHitSize);
+	void LockNoRecord(FPlane InFlashScale, FPlane InFlashFog, FPlane ScreenClear, DWORD RenderLockFlags, BYTE* InHitData, INT* InHitSize);
 	void SetSceneNode(FSceneNode* Frame);
+	void SetSceneNodeNoRecord(FSceneNode* Frame);
 	void Unlock(UBOOL Blit);
+	void UnlockNoRecord(UBOOL Blit);
 	void Flush(UBOOL AllowPrecache);
+	void FlushNoRecord(UBOOL AllowPrecache);
 
 	void DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet);
+	void DrawComplexSurfaceNoRecord(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet);
 #ifdef UTGLR_RUNE_BUILD
 	void PreDrawFogSurface();
 	void PostDrawFogSurface();
@@ -1051,18 +1748,60 @@ class UOpenGLRenderDevice : public URenderDevice {
 #endif
 	void DrawGouraudPolygonOld(FSceneNode* Frame, FTextureInfo& Info, FTransTexture** Pts, INT NumPts, DWORD PolyFlags, FSpanBuffer* Span);
 	void DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& Info, FTransTexture** Pts, INT NumPts, DWORD PolyFlags, FSpanBuffer* Span);
+	void DrawGouraudPolygonNoRecord(FSceneNode* Frame, FTextureInfo& Info, FTransTexture** Pts, INT NumPts, DWORD PolyFlags, FSpanBuffer* Span);
 	void DrawTile(FSceneNode* Frame, FTextureInfo& Info, FLOAT X, FLOAT Y, FLOAT XL, FLOAT YL, FLOAT U, FLOAT V, FLOAT UL, FLOAT VL, class FSpanBuffer* Span, FLOAT Z, FPlane Color, FPlane Fog, DWORD PolyFlags);
+	void DrawTileNoRecord(FSceneNode* Frame, FTextureInfo& Info, FLOAT X, FLOAT Y, FLOAT XL, FLOAT YL, FLOAT U, FLOAT V, FLOAT UL, FLOAT VL, class FSpanBuffer* Span, FLOAT Z, FPlane Color, FPlane Fog, DWORD PolyFlags);
 	void Draw3DLine(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2);
+	void Draw3DLineNoRecord(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2);
 	void Draw2DLine(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2);
+	void Draw2DLineNoRecord(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2);
 	void Draw2DPoint(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FLOAT X1, FLOAT Y1, FLOAT X2, FLOAT Y2, FLOAT Z);
+	void Draw2DPointNoRecord(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FLOAT X1, FLOAT Y1, FLOAT X2, FLOAT Y2, FLOAT Z);
 
 	void ClearZ(FSceneNode* Frame);
+	void ClearZNoRecord(FSceneNode* Frame);
 	void PushHit(const BYTE* Data, INT Count);
 	void PopHit(INT Count, UBOOL bForce);
 	void GetStats(TCHAR* Result);
 	void ReadPixels(FColor* Pixels);
 	void EndFlash();
+	void EndFlashNoRecord();
 	void PrecacheTexture(FTextureInfo& Info, DWORD PolyFlags);
+	void PrecacheTextureNoRecord(FTextureInfo& Info, DWORD PolyFlags);
+
+	void StartRenderThread(void);
+	void StopRenderThread(void);
+	void SyncRenderThread(void);
+	void SubmitRenderThreadFrame(void);
+	static DWORD FASTCALL GetRecordedMipSize(BYTE Format, const FMipmapBase *Mip);
+	void FASTCALL GetSceneNodeView(const FSceneNode *Frame, FGLSceneNodeView &View);
+	DWORD FASTCALL RecordSceneNode(FSceneNode *Frame);
+	FSceneNode * FASTCALL GetReplaySceneNode(FGLCmdBuffer &Buffer, DWORD Offset);
+	DWORD FASTCALL RecordTexture(FTextureInfo &Info);
+	FGLRecordedMap * FASTCALL RecordMap(FTextureInfo &Info);
+	void ExpireRecordedMaps(void);
+	void FreeRecordedMaps(void);
+	FTextureInfo * FASTCALL GetReplayTexture(FGLCmdBuffer &Buffer, DWORD Offset);
+	void ReplayCommands(FGLCmdBuffer &Buffer);
+	void StartCapture(const TCHAR *pFilename, INT FrameRate);
+	void StopCapture(void);
+	void CaptureFrame(void);
+	void FASTCALL ReadCapturePBO(DWORD Index);
+	void DrawStats(FSceneNode* Frame);
+
+	void InitProfilerSafe(void);
+	void ShutdownProfiler(void);
+	void BeginProfFrame(void);
+	void EndProfFrame(void);
+	bool FASTCALL ResolveProfQuerySet(FGLProfQuerySet &Set, bool Wait);
+	INT FASTCALL GetProfAverage(INT NumFrames, FGLProfFrame &Avg, INT &NumGPUFrames);
+	bool FASTCALL WriteProfCSV(const TCHAR *pFilename);
+	void FASTCALL SetProfCategoryNoCheck(BYTE Category);
+	inline void FASTCALL SetProfCategory(BYTE Category) {
+		if (m_profFrameActive && (Category != m_profCategory)) {
+			SetProfCategoryNoCheck(Category);
+		}
+	}
 
 
 	void InitNoTextureSafe(void);
@@ -1091,8 +1830,9 @@ class UOpenGLRenderDevice : public URenderDevice {
 		DWORD DynamicPolyFlags;
 
 		// Set panning.
-		Tex.UPan = Info.Pan.X + (PanBias * Info.UScale);
-		Tex.VPan = Info.Pan.Y + (PanBias * Info.VScale);
+		//Includes the atlas offset of the current texture, which SetTextureNoCheck corrects on a change
+		Tex.UPan = Info.Pan.X + (PanBias * Info.UScale) - Tex.UAtlasPan;
+		Tex.VPan = Info.Pan.Y + (PanBias * Info.VScale) - Tex.VAtlasPan;
 
 		//PF_Memorized used internally to indicate 16-bit texture
 		PolyFlags &= ~PF_Memorized;
@@ -1137,8 +1877,9 @@ class UOpenGLRenderDevice : public URenderDevice {
 		DWORD DynamicPolyFlags;
 
 		// Set panning.
-		Tex.UPan = Info.Pan.X;
-		Tex.VPan = Info.Pan.Y;
+		//Includes the atlas offset of the current texture, which SetTextureNoCheck corrects on a change
+		Tex.UPan = Info.Pan.X - Tex.UAtlasPan;
+		Tex.VPan = Info.Pan.Y - Tex.VAtlasPan;
 
 		//PF_Memorized used internally to indicate 16-bit texture
 		PolyFlags &= ~PF_Memorized;
@@ -1184,21 +1925,63 @@ class UOpenGLRenderDevice : public URenderDevice {
 	}
 
 	FCachedTexture *FindCachedTexture(QWORD CacheID);
+	void FASTCALL RemoveNonZeroPrefixBind(QWORD_CTTree_t::node_t *pNode);
+	void RunBindBench(void);
+	void RunHitBench(INT Passes);
+	void RecordTimeDemoFrame(void);
+	void FinishTimeDemo(void);
+	void FlushDeferredLog(void);
+	void PollTimeDemo(void);
 	QWORD_CTTree_NodePool_t::node_t * FASTCALL TryAllocFromTexPool(TexPoolMapKey_t texPoolKey);
+	bool FASTCALL AllocLightMapAtlasCell(FCachedTexture *pBind);
+	void FASTCALL FreeLightMapAtlasCell(FCachedTexture *pBind);
+	void FreeLightMapAtlas(void);
+	void FASTCALL GetLightMapAtlasCellOffset(const FGLLightMapAtlasPage &Page, INT cell, GLint &xOffset, GLint &yOffset);
+	void FASTCALL UploadLightMapAtlasGutter(FCachedTexture *pBind, const BYTE *Src, GLint xOffset, GLint yOffset, INT texWidth, INT texHeight);
 	BYTE FASTCALL GenerateTexFilterParams(DWORD PolyFlags, FCachedTexture *pBind);
 	void FASTCALL SetTexFilterNoCheck(FCachedTexture *pBind, BYTE texFilter);
 	void FASTCALL SetTextureNoCheck(FTexInfo& Tex, FTextureInfo& Info, DWORD PolyFlags);
-	void FASTCALL UploadTextureExec(FTextureInfo& Info, DWORD PolyFlags, FCachedTexture *pBind, bool existingBind, bool needTexAllocate);
+	void FASTCALL InitNewTextureState(FTextureInfo& Info, DWORD PolyFlags, FCachedTexture *pBind);
+	void FASTCALL UploadTextureExec(FTextureInfo& Info, DWORD PolyFlags, FCachedTexture *pBind, bool existingBind, bool needTexAllocate, const FGLTexDiskCacheKey *pDiskCacheKey);
+	void FASTCALL ConvertMipRGBA(FTexConvertCtx &Ctx, const FMipmapBase *Mip, const FColor *Palette, INT Level);
+	static DWORD FASTCALL GetConvertedLevelSize(const FCachedTexture *pBind, DWORD texWidth, DWORD texHeight);
+	static DWORD FASTCALL GetUploadLevelSize(const FCachedTexture *pBind, DWORD texWidth, DWORD texHeight);
+	static void FASTCALL CompressMipRGBA(const FCachedTexture *pBind, const BYTE *pSrc, DWORD texWidth, DWORD texHeight, BYTE *pDst, bool useSSE2);
+	bool FASTCALL QueueTextureConversion(QWORD CacheID, FTextureInfo& Info, DWORD PolyFlags, FCachedTexture *pBind, const FGLTexDiskCacheKey *pDiskCacheKey);
+	void FinishTextureConversions(bool waitAll);
+	void DiscardTextureConversions(void);
+	void FASTCALL UploadConvertedTexture(FGLTexConvertJob *pJob);
+	void FASTCALL FreeTextureConversion(FGLTexConvertJob *pJob);
+	void InitTextureConversionSafe(void);
+	void ShutdownTextureConversion(void);
+
+	void InitTexDiskCacheSafe(void);
+	void ShutdownTexDiskCache(void);
+
+	bool InitOffscreenSafe(INT SizeX, INT SizeY);
+	void ShutdownOffscreen(void);
+	bool FASTCALL GetTexDiskCacheKey(QWORD CacheID, const FTextureInfo &Info, DWORD PolyFlags, const FCachedTexture *pBind, FGLTexDiskCacheKey &Key);
+	FString FASTCALL GetTexDiskCacheFilename(const FGLTexDiskCacheKey &Key);
+	bool FASTCALL UploadTextureFromDiskCache(const FGLTexDiskCacheKey &Key, FTextureInfo &Info, DWORD PolyFlags, FCachedTexture *pBind);
+	void FASTCALL WriteTexDiskCacheEntry(const FGLTexDiskCacheKey &Key, INT NumLevels, const DWORD *LevelSizes, const BYTE *pData);
+
+	//Stops a texture waiting for its conversion, the job is freed when it completes
+	inline void FASTCALL DetachTextureConversion(FCachedTexture *pBind) {
+		if (pBind->pConvertJob) {
+			pBind->pConvertJob->pBind = NULL;
+			pBind->pConvertJob = NULL;
+		}
+	}
 	void FASTCALL CacheTextureInfo(FCachedTexture *pBind, const FTextureInfo &Info, DWORD PolyFlags);
 
-	void FASTCALL ConvertDXT1_DXT3(const FMipmapBase *Mip, INT Level);
-	void FASTCALL ConvertP8_P8(const FMipmapBase *Mip, INT Level);
-	void FASTCALL ConvertP8_P8_NoStep(const FMipmapBase *Mip, INT Level);
-	void FASTCALL ConvertP8_RGBA8888(const FMipmapBase *Mip, const FColor *Palette, INT Level);
-	void FASTCALL ConvertP8_RGBA8888_NoStep(const FMipmapBase *Mip, const FColor *Palette, INT Level);
-	void FASTCALL ConvertBGRA7777_BGRA8888(const FMipmapBase *Mip, INT Level);
-	void FASTCALL ConvertBGRA7777_BGRA8888_NoClamp(const FMipmapBase *Mip, INT Level);
-	void FASTCALL ConvertBGRA7777_RGBA8888(const FMipmapBase *Mip, INT Level);
+	void FASTCALL ConvertDXT1_DXT3(FTexConvertCtx &Ctx, const FMipmapBase *Mip, INT Level);
+	void FASTCALL ConvertP8_P8(FTexConvertCtx &Ctx, const FMipmapBase *Mip, INT Level);
+	void FASTCALL ConvertP8_P8_NoStep(FTexConvertCtx &Ctx, const FMipmapBase *Mip, INT Level);
+	void FASTCALL ConvertP8_RGBA8888(FTexConvertCtx &Ctx, const FMipmapBase *Mip, const FColor *Palette, INT Level);
+	void FASTCALL ConvertP8_RGBA8888_NoStep(FTexConvertCtx &Ctx, const FMipmapBase *Mip, const FColor *Palette, INT Level);
+	void FASTCALL ConvertBGRA7777_BGRA8888(FTexConvertCtx &Ctx, const FMipmapBase *Mip, INT Level);
+	void FASTCALL ConvertBGRA7777_BGRA8888_NoClamp(FTexConvertCtx &Ctx, const FMipmapBase *Mip, INT Level);
+	void FASTCALL ConvertBGRA7777_RGBA8888(FTexConvertCtx &Ctx, const FMipmapBase *Mip, INT Level);
 
 	inline void FASTCALL SetBlend(DWORD PolyFlags) {
 #ifdef UTGLR_RUNE_BUILD
@@ -1354,6 +2137,11 @@ class UOpenGLRenderDevice : public URenderDevice {
 	}
 
 	inline void SetDefaultShaderState(void) {
+		//Leave GLSL mode if the complex surface program is bound
+		if (m_glslCurrent != 0) {
+			SetGLSLProgramNoCheck(0);
+		}
+
 		//Keep vertex programs enabled if using vertex program mode
 		GLuint vpId = (UseFragmentProgram) ? m_vpDefaultRenderingState : 0;
 		if (m_vpCurrent != vpId) {
@@ -1367,6 +2155,9 @@ class UOpenGLRenderDevice : public URenderDevice {
 		}
 	}
 	inline void FASTCALL SetShaderState(GLuint vpId, GLuint fpId) {
+		if (m_glslCurrent != 0) {
+			SetGLSLProgramNoCheck(0);
+		}
 		if (m_vpCurrent != vpId) {
 			SetVertexProgramNoCheck(vpId);
 		}
@@ -1378,6 +2169,29 @@ class UOpenGLRenderDevice : public URenderDevice {
 	void FASTCALL SetVertexProgramNoCheck(GLuint vpId);
 	void FASTCALL SetFragmentProgramNoCheck(GLuint fpId);
 
+	inline void FASTCALL SetGLSLProgram(GLuint programId) {
+		if (m_glslCurrent != programId) {
+			SetGLSLProgramNoCheck(programId);
+		}
+	}
+	void FASTCALL SetGLSLProgramNoCheck(GLuint programId);
+
+	inline void FASTCALL SetGLSLColor(const FLOAT *pColor) {
+		FLOAT *pDst = m_glslSurfaceState.Color;
+		pDst[0] = pColor[0];
+		pDst[1] = pColor[1];
+		pDst[2] = pColor[2];
+		pDst[3] = pColor[3];
+	}
+	inline void FASTCALL SetGLSLTexInfo(INT t) {
+		FLOAT *pDst = m_glslSurfaceState.TexInfo[t];
+		pDst[0] = TexInfo[t].UPan;
+		pDst[1] = TexInfo[t].VPan;
+		pDst[2] = TexInfo[t].UMult;
+		pDst[3] = TexInfo[t].VMult;
+	}
+	void UpdateGLSLSurfaceState(void);
+
 	inline void SetDefaultColorState(void) {
 		if (m_currentColorFlags != 0) {
 			SetDefaultColorStateNoCheck();
@@ -1427,6 +2241,14 @@ class UOpenGLRenderDevice : public URenderDevice {
 	void TryInitializeFragmentProgramMode(void);
 	void ShutdownFragmentProgramMode(void);
 
+	GLuint FASTCALL LoadGLSLShader(GLenum, const char *, const char *);
+	GLuint FASTCALL LoadGLSLProgram(const char *, const char *, const char *);
+	bool InitializeGLSLPrograms(void);
+	void FreeGLSLPrograms(void);
+	void TryInitializeGLSLMode(void);
+	void ShutdownGLSLMode(void);
+	void FASTCALL SetGLSLProjection(FLOAT, FLOAT, FLOAT, FLOAT, FLOAT, bool);
+
 	void FASTCALL SetProjectionStateNoCheck(bool);
 	void SetOrthoProjection(void);
 
@@ -1460,8 +2282,10 @@ class UOpenGLRenderDevice : public URenderDevice {
 
 	void RenderPassesNoCheckSetup(void);
 	void RenderPassesNoCheckSetup_FP(void);
+	void RenderPassesNoCheckSetup_GLSL(void);
 	void FASTCALL RenderPassesNoCheckSetup_SingleOrDualTextureAndDetailTexture(FTextureInfo &);
 	void FASTCALL RenderPassesNoCheckSetup_SingleOrDualTextureAndDetailTexture_FP(FTextureInfo &);
+	void FASTCALL RenderPassesNoCheckSetup_SingleOrDualTextureAndDetailTexture_GLSL(FTextureInfo &);
 
 	INT FASTCALL BufferStaticComplexSurfaceGeometry(const FSurfaceFacet&);
 	INT FASTCALL BufferStaticComplexSurfaceGeometry_VP(const FSurfaceFacet&);
@@ -1472,6 +2296,7 @@ class UOpenGLRenderDevice : public URenderDevice {
 
 	void FASTCALL DrawDetailTexture(FTextureInfo &, INT, bool);
 	void FASTCALL DrawDetailTexture_FP(FTextureInfo &);
+	void FASTCALL DrawDetailTexture_GLSL(FTextureInfo &);
 
 	inline void EndGouraudPolygonBuffering(void) {
 		if (BufferedVerts > 0) {
@@ -1484,6 +2309,9 @@ class UOpenGLRenderDevice : public URenderDevice {
 		}
 	}
 	inline void EndBuffering(void) {
+		if (m_dcsNumSurfaces > 0) {
+			FlushDeferredComplexSurfacesNoCheck();
+		}
 		if (BufferedVerts > 0) {
 			EndGouraudPolygonBufferingNoCheck();
 		}
@@ -1494,7 +2322,34 @@ class UOpenGLRenderDevice : public URenderDevice {
 	void EndGouraudPolygonBufferingNoCheck(void);
 	void EndTileBufferingNoCheck(void);
 
+	inline void FlushDeferredComplexSurfaces(void) {
+		if (m_dcsNumSurfaces > 0) {
+			FlushDeferredComplexSurfacesNoCheck();
+		}
+	}
+	bool FASTCALL DeferComplexSurface(FSurfaceInfo &Surface, DWORD PolyFlags);
+	void FASTCALL DeferComplexSurfaceLayer(FGLDeferredSurface &DS, INT Layer, FTextureInfo &Info, DWORD PolyFlags, FLOAT PanBias);
+	static INT CompareDeferredComplexSurfaceState(const FGLDeferredSurface *pA, const FGLDeferredSurface *pB);
+	static INT CDECL CompareDeferredComplexSurfaces(const void *pA, const void *pB);
+	void FlushDeferredComplexSurfacesNoCheck(void);
+	void FASTCALL DrawDeferredComplexSurfaceRun(const FGLDeferredSurface &DS, INT NumVerts, INT NumPolys);
+
+	//Copies the enabled vertex arrays into the streaming VBO if it is active
+	//Returns the first vertex index to draw with
+	inline INT FASTCALL StreamVertexArrays(INT firstVert, INT numVerts) {
+		if (m_streamVBOActive && StreamVertexArraysNoCheck(firstVert, numVerts, NULL, m_currentColorFlags)) {
+			return 0;
+		}
+		return firstVert;
+	}
+	BYTE * FASTCALL StreamVBOReserve(DWORD size, DWORD &bufferOffset);
+	bool FASTCALL StreamVertexArraysNoCheck(INT firstVert, INT numVerts, const GLuint *pIndices, BYTE colorFlags);
+
 	void FASTCALL BufferAdditionalClippedVerts(FTransTexture** Pts, INT NumPts);
+
+	void FASTCALL CaptureVertBenchPoly(FTransTexture** Pts, INT NumPts);
+	void RunVertBench(void);
+	DOUBLE FASTCALL TimeVertBenchProcs(void (FASTCALL *pBuffer3VertsProc)(UOpenGLRenderDevice *, FTransTexture **), void (FASTCALL *pBufferPolyVertsProc)(UOpenGLRenderDevice *, FTransTexture **, INT), FTransTexture **pPts);
 };
 
 #ifdef UTGLR_UNREAL_227_BUILD
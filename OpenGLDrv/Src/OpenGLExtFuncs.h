@@ -80,6 +80,79 @@ GL_EXT_PROC(_GL_ARB_vertex_program,void,glVertexAttrib4fARB,(GLuint index, GLflo
 // ARB_fragment_program
 GL_EXT_NAME(_GL_ARB_fragment_program)
 
+// ARB_vertex_buffer_object
+GL_EXT_NAME(_GL_ARB_vertex_buffer_object)
+GL_EXT_PROC(_GL_ARB_vertex_buffer_object,void,glBindBufferARB,(GLenum target, GLuint buffer))
+GL_EXT_PROC(_GL_ARB_vertex_buffer_object,void,glDeleteBuffersARB,(GLsizei n, const GLuint *buffers))
+GL_EXT_PROC(_GL_ARB_vertex_buffer_object,void,glGenBuffersARB,(GLsizei n, GLuint *buffers))
+GL_EXT_PROC(_GL_ARB_vertex_buffer_object,void,glBufferDataARB,(GLenum target, GLsizeiptrARB size, const GLvoid *data, GLenum usage))
+GL_EXT_PROC(_GL_ARB_vertex_buffer_object,void,glBufferSubDataARB,(GLenum target, GLintptrARB offset, GLsizeiptrARB size, const GLvoid *data))
+GL_EXT_PROC(_GL_ARB_vertex_buffer_object,GLboolean,glUnmapBufferARB,(GLenum target))
+
+// ARB_pixel_buffer_object
+// Uses the vertex buffer object entry points
+GL_EXT_NAME(_GL_ARB_pixel_buffer_object)
+
+// ARB_map_buffer_range
+GL_EXT_NAME(_GL_ARB_map_buffer_range)
+GL_EXT_PROC(_GL_ARB_map_buffer_range,GLvoid *,glMapBufferRange,(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access))
+
+// ARB_buffer_storage
+GL_EXT_NAME(_GL_ARB_buffer_storage)
+GL_EXT_PROC(_GL_ARB_buffer_storage,void,glBufferStorage,(GLenum target, GLsizeiptr size, const GLvoid *data, GLbitfield flags))
+
+// ARB_sync
+GL_EXT_NAME(_GL_ARB_sync)
+GL_EXT_PROC(_GL_ARB_sync,GLsync,glFenceSync,(GLenum condition, GLbitfield flags))
+GL_EXT_PROC(_GL_ARB_sync,void,glDeleteSync,(GLsync sync))
+GL_EXT_PROC(_GL_ARB_sync,GLenum,glClientWaitSync,(GLsync sync, GLbitfield flags, GLuint64 timeout))
+
+// ARB_uniform_buffer_object
+// GLSL program objects are core since OpenGL 2.0, so they are loaded along with it
+GL_EXT_NAME(_GL_ARB_uniform_buffer_object)
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,GLuint,glCreateShader,(GLenum type))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glShaderSource,(GLuint shader, GLsizei count, const GLchar **string, const GLint *length))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glCompileShader,(GLuint shader))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glGetShaderiv,(GLuint shader, GLenum pname, GLint *params))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glGetShaderInfoLog,(GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glDeleteShader,(GLuint shader))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,GLuint,glCreateProgram,(void))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glAttachShader,(GLuint program, GLuint shader))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glLinkProgram,(GLuint program))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glGetProgramiv,(GLuint program, GLenum pname, GLint *params))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glGetProgramInfoLog,(GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glUseProgram,(GLuint program))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glDeleteProgram,(GLuint program))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,GLint,glGetUniformLocation,(GLuint program, const GLchar *name))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glUniform1i,(GLint location, GLint v0))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glVertexAttribPointer,(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glEnableVertexAttribArray,(GLuint index))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glDisableVertexAttribArray,(GLuint index))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,GLuint,glGetUniformBlockIndex,(GLuint program, const GLchar *uniformBlockName))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glUniformBlockBinding,(GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding))
+GL_EXT_PROC(_GL_ARB_uniform_buffer_object,void,glBindBufferBase,(GLenum target, GLuint index, GLuint buffer))
+
+// ARB_timer_query
+// Query objects are core since OpenGL 1.5, so they are loaded along with it
+GL_EXT_NAME(_GL_ARB_timer_query)
+GL_EXT_PROC(_GL_ARB_timer_query,void,glGenQueries,(GLsizei n, GLuint *ids))
+GL_EXT_PROC(_GL_ARB_timer_query,void,glDeleteQueries,(GLsizei n, const GLuint *ids))
+GL_EXT_PROC(_GL_ARB_timer_query,void,glGetQueryObjectiv,(GLuint id, GLenum pname, GLint *params))
+GL_EXT_PROC(_GL_ARB_timer_query,void,glQueryCounter,(GLuint id, GLenum target))
+GL_EXT_PROC(_GL_ARB_timer_query,void,glGetQueryObjectui64v,(GLuint id, GLenum pname, GLuint64 *params))
+
+// ARB_framebuffer_object
+GL_EXT_NAME(_GL_ARB_framebuffer_object)
+GL_EXT_PROC(_GL_ARB_framebuffer_object,void,glGenFramebuffers,(GLsizei n, GLuint *framebuffers))
+GL_EXT_PROC(_GL_ARB_framebuffer_object,void,glDeleteFramebuffers,(GLsizei n, const GLuint *framebuffers))
+GL_EXT_PROC(_GL_ARB_framebuffer_object,void,glBindFramebuffer,(GLenum target, GLuint framebuffer))
+GL_EXT_PROC(_GL_ARB_framebuffer_object,GLenum,glCheckFramebufferStatus,(GLenum target))
+GL_EXT_PROC(_GL_ARB_framebuffer_object,void,glFramebufferRenderbuffer,(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer))
+GL_EXT_PROC(_GL_ARB_framebuffer_object,void,glGenRenderbuffers,(GLsizei n, GLuint *renderbuffers))
+GL_EXT_PROC(_GL_ARB_framebuffer_object,void,glDeleteRenderbuffers,(GLsizei n, const GLuint *renderbuffers))
+GL_EXT_PROC(_GL_ARB_framebuffer_object,void,glBindRenderbuffer,(GLenum target, GLuint renderbuffer))
+GL_EXT_PROC(_GL_ARB_framebuffer_object,void,glRenderbufferStorage,(GLenum target, GLenum internalformat, GLsizei width, GLsizei height))
+
 /*-----------------------------------------------------------------------------
 	The End.
 -----------------------------------------------------------------------------*/
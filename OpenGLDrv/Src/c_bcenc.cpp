@@ -0,0 +1,360 @@
+#include "c_bcenc.h"
+
+
+//Maps a texel position along the endpoint line, from color1 to color0, to its BC1 index
+static const unsigned char s_colorIndexMap[4] = { 1, 3, 2, 0 };
+
+//Maps a value position along the endpoint line, from alpha1 to alpha0, to its BC3 alpha index
+static const unsigned char s_alphaIndexMap[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+
+
+static inline unsigned int To565(unsigned int r, unsigned int g, unsigned int b) {
+	return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+}
+
+static inline void Expand565(unsigned int c, int *pRGB) {
+	unsigned int r = (c >> 11) & 0x1F;
+	unsigned int g = (c >> 5) & 0x3F;
+	unsigned int b = c & 0x1F;
+
+	//Replicate the high bits into the low bits like the decoder
+	pRGB[0] = (r << 3) | (r >> 2);
+	pRGB[1] = (g << 2) | (g >> 4);
+	pRGB[2] = (b << 3) | (b >> 2);
+}
+
+
+unsigned int CBCEnc::GetBC1Size(unsigned int width, unsigned int height) {
+	return ((width + 3) >> 2) * ((height + 3) >> 2) * BC1_BLOCK_SIZE;
+}
+
+unsigned int CBCEnc::GetBC3Size(unsigned int width, unsigned int height) {
+	return ((width + 3) >> 2) * ((height + 3) >> 2) * BC3_BLOCK_SIZE;
+}
+
+
+void CBCEnc::EncodeBC1(const unsigned char *pSrc, unsigned int width, unsigned int height, unsigned char *pDst, bool useSSE2) {
+	unsigned char block[BLOCK_TEXELS * 4];
+	unsigned int bx, by;
+
+	for (by = 0; by < height; by += 4) {
+		for (bx = 0; bx < width; bx += 4) {
+			GetBlock(pSrc, width, height, bx, by, block);
+#ifdef C_BCENC_INCLUDE_SSE2_CODE
+			if (useSSE2) {
+				EncodeColorBlock_SSE2(block, pDst);
+			}
+			else
+#endif
+			{
+				EncodeColorBlock(block, pDst);
+			}
+			pDst += BC1_BLOCK_SIZE;
+		}
+	}
+
+	return;
+}
+
+void CBCEnc::EncodeBC3(const unsigned char *pSrc, unsigned int width, unsigned int height, unsigned char *pDst, bool useSSE2) {
+	unsigned char block[BLOCK_TEXELS * 4];
+	unsigned int bx, by;
+
+	for (by = 0; by < height; by += 4) {
+		for (bx = 0; bx < width; bx += 4) {
+			GetBlock(pSrc, width, height, bx, by, block);
+			EncodeAlphaBlock(block, pDst);
+#ifdef C_BCENC_INCLUDE_SSE2_CODE
+			if (useSSE2) {
+				EncodeColorBlock_SSE2(block, pDst + 8);
+			}
+			else
+#endif
+			{
+				EncodeColorBlock(block, pDst + 8);
+			}
+			pDst += BC3_BLOCK_SIZE;
+		}
+	}
+
+	return;
+}
+
+
+void CBCEnc::GetBlock(const unsigned char *pSrc, unsigned int width, unsigned int height, unsigned int bx, unsigned int by, unsigned char *pBlock) {
+	const unsigned int *pSrcTexels = (const unsigned int *)pSrc;
+	unsigned int *pBlockTexels = (unsigned int *)pBlock;
+	unsigned int u, v;
+
+	for (v = 0; v < 4; v++) {
+		unsigned int y = by + v;
+		if (y >= height) {
+			y = height - 1;
+		}
+		for (u = 0; u < 4; u++) {
+			unsigned int x = bx + u;
+			if (x >= width) {
+				x = width - 1;
+			}
+			*pBlockTexels++ = pSrcTexels[y * width + x];
+		}
+	}
+
+	return;
+}
+
+
+//Picks the endpoints from the bounding box of the block colors
+//The box is inset slightly and its diagonal is chosen from the sign of the color covariance
+//Returns the endpoints in 565 format with color0 > color1, unless they are equal
+void CBCEnc::GetColorEndpoints(const unsigned char *pBlock, const unsigned char *pMin, const unsigned char *pMax, unsigned int &color0, unsigned int &color1) {
+	int minRGB[3], maxRGB[3];
+	int mean[3];
+	int covRG, covBG;
+	unsigned int u;
+
+	mean[0] = mean[1] = mean[2] = 0;
+	for (u = 0; u < BLOCK_TEXELS; u++) {
+		mean[0] += pBlock[u * 4 + 0];
+		mean[1] += pBlock[u * 4 + 1];
+		mean[2] += pBlock[u * 4 + 2];
+	}
+	mean[0] = (mean[0] + 8) >> 4;
+	mean[1] = (mean[1] + 8) >> 4;
+	mean[2] = (mean[2] + 8) >> 4;
+
+	//Covariance of red and blue with green, which carries the most weight
+	covRG = 0;
+	covBG = 0;
+	for (u = 0; u < BLOCK_TEXELS; u++) {
+		int g = pBlock[u * 4 + 1] - mean[1];
+		covRG += (pBlock[u * 4 + 0] - mean[0]) * g;
+		covBG += (pBlock[u * 4 + 2] - mean[2]) * g;
+	}
+
+	for (u = 0; u < 3; u++) {
+		int inset = (pMax[u] - pMin[u]) >> 4;
+		minRGB[u] = pMin[u] + inset;
+		maxRGB[u] = pMax[u] - inset;
+	}
+
+	//Use the other diagonal of the box for channels that fall as green rises
+	if (covRG < 0) {
+		int t = minRGB[0]; minRGB[0] = maxRGB[0]; maxRGB[0] = t;
+	}
+	if (covBG < 0) {
+		int t = minRGB[2]; minRGB[2] = maxRGB[2]; maxRGB[2] = t;
+	}
+
+	color0 = To565(maxRGB[0], maxRGB[1], maxRGB[2]);
+	color1 = To565(minRGB[0], minRGB[1], minRGB[2]);
+
+	//Four color mode requires color0 > color1
+	if (color0 < color1) {
+		unsigned int t = color0; color0 = color1; color1 = t;
+	}
+
+	return;
+}
+
+void CBCEnc::WriteColorBlock(unsigned int color0, unsigned int color1, const unsigned char *pTexelIndices, unsigned char *pDst) {
+	unsigned int indices = 0;
+	int u;
+
+	for (u = BLOCK_TEXELS - 1; u >= 0; u--) {
+		indices = (indices << 2) | pTexelIndices[u];
+	}
+
+	pDst[0] = (unsigned char)color0;
+	pDst[1] = (unsigned char)(color0 >> 8);
+	pDst[2] = (unsigned char)color1;
+	pDst[3] = (unsigned char)(color1 >> 8);
+	pDst[4] = (unsigned char)indices;
+	pDst[5] = (unsigned char)(indices >> 8);
+	pDst[6] = (unsigned char)(indices >> 16);
+	pDst[7] = (unsigned char)(indices >> 24);
+
+	return;
+}
+
+
+void CBCEnc::EncodeColorBlock(const unsigned char *pBlock, unsigned char *pDst) {
+	unsigned char minRGB[3] = { 255, 255, 255 };
+	unsigned char maxRGB[3] = { 0, 0, 0 };
+	unsigned char texelIndices[BLOCK_TEXELS];
+	unsigned int color0, color1;
+	int e0[3], e1[3], d[3];
+	int dd;
+	unsigned int u, c;
+
+	for (u = 0; u < BLOCK_TEXELS; u++) {
+		for (c = 0; c < 3; c++) {
+			unsigned char v = pBlock[u * 4 + c];
+			if (v < minRGB[c]) minRGB[c] = v;
+			if (v > maxRGB[c]) maxRGB[c] = v;
+		}
+	}
+
+	GetColorEndpoints(pBlock, minRGB, maxRGB, color0, color1);
+
+	//Project each texel onto the line between the decoded endpoints
+	Expand565(color0, e0);
+	Expand565(color1, e1);
+	d[0] = e0[0] - e1[0];
+	d[1] = e0[1] - e1[1];
+	d[2] = e0[2] - e1[2];
+	dd = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+	for (u = 0; u < BLOCK_TEXELS; u++) {
+		int t = 0;
+
+		if (dd > 0) {
+			int p = (pBlock[u * 4 + 0] - e1[0]) * d[0] + (pBlock[u * 4 + 1] - e1[1]) * d[1] + (pBlock[u * 4 + 2] - e1[2]) * d[2];
+			if (p <= 0) {
+				t = 0;
+			}
+			else {
+				t = (p * 3 + (dd >> 1)) / dd;
+				if (t > 3) t = 3;
+			}
+		}
+		else {
+			//Both endpoints are the same color
+			t = 3;
+		}
+		texelIndices[u] = s_colorIndexMap[t];
+	}
+
+	WriteColorBlock(color0, color1, texelIndices, pDst);
+
+	return;
+}
+
+void CBCEnc::EncodeAlphaBlock(const unsigned char *pBlock, unsigned char *pDst) {
+	unsigned int minA = 255;
+	unsigned int maxA = 0;
+	unsigned int range;
+	unsigned int u;
+
+	for (u = 0; u < BLOCK_TEXELS; u++) {
+		unsigned int a = pBlock[u * 4 + 3];
+		if (a < minA) minA = a;
+		if (a > maxA) maxA = a;
+	}
+
+	//Eight value mode requires alpha0 > alpha1
+	pDst[0] = (unsigned char)maxA;
+	pDst[1] = (unsigned char)minA;
+
+	//Pack the 3-bit indices little endian, 24 bits per half of the block
+	range = maxA - minA;
+	for (u = 0; u < BLOCK_TEXELS; u += 8) {
+		unsigned int indices = 0;
+		int v;
+
+		for (v = 7; v >= 0; v--) {
+			unsigned int t = 0;
+
+			if (range > 0) {
+				t = ((pBlock[(u + v) * 4 + 3] - minA) * 7 + (range >> 1)) / range;
+			}
+			else {
+				//Both endpoints are the same value
+				t = 7;
+			}
+			indices = (indices << 3) | s_alphaIndexMap[t];
+		}
+		pDst[2 + (u >> 3) * 3 + 0] = (unsigned char)indices;
+		pDst[2 + (u >> 3) * 3 + 1] = (unsigned char)(indices >> 8);
+		pDst[2 + (u >> 3) * 3 + 2] = (unsigned char)(indices >> 16);
+	}
+
+	return;
+}
+
+
+#ifdef C_BCENC_INCLUDE_SSE2_CODE
+//Same encoding as EncodeColorBlock, with the bounding box and the projections four texels at a time
+void CBCEnc::EncodeColorBlock_SSE2(const unsigned char *pBlock, unsigned char *pDst) {
+	__m128i row0, row1, row2, row3;
+	__m128i blockMin, blockMax;
+	unsigned char minRGBA[4], maxRGBA[4];
+	unsigned int packedMin, packedMax;
+	unsigned char texelIndices[BLOCK_TEXELS];
+	unsigned int color0, color1;
+	int e0[3], e1[3];
+	int dd;
+	unsigned int u;
+
+	row0 = _mm_loadu_si128((const __m128i *)(pBlock + 0));
+	row1 = _mm_loadu_si128((const __m128i *)(pBlock + 16));
+	row2 = _mm_loadu_si128((const __m128i *)(pBlock + 32));
+	row3 = _mm_loadu_si128((const __m128i *)(pBlock + 48));
+
+	//Per channel minimum and maximum of all 16 texels
+	blockMin = _mm_min_epu8(_mm_min_epu8(row0, row1), _mm_min_epu8(row2, row3));
+	blockMax = _mm_max_epu8(_mm_max_epu8(row0, row1), _mm_max_epu8(row2, row3));
+	blockMin = _mm_min_epu8(blockMin, _mm_shuffle_epi32(blockMin, _MM_SHUFFLE(1, 0, 3, 2)));
+	blockMax = _mm_max_epu8(blockMax, _mm_shuffle_epi32(blockMax, _MM_SHUFFLE(1, 0, 3, 2)));
+	blockMin = _mm_min_epu8(blockMin, _mm_shuffle_epi32(blockMin, _MM_SHUFFLE(2, 3, 0, 1)));
+	blockMax = _mm_max_epu8(blockMax, _mm_shuffle_epi32(blockMax, _MM_SHUFFLE(2, 3, 0, 1)));
+	packedMin = (unsigned int)_mm_cvtsi128_si32(blockMin);
+	packedMax = (unsigned int)_mm_cvtsi128_si32(blockMax);
+	for (u = 0; u < 4; u++) {
+		minRGBA[u] = (unsigned char)(packedMin >> (u * 8));
+		maxRGBA[u] = (unsigned char)(packedMax >> (u * 8));
+	}
+
+	GetColorEndpoints(pBlock, minRGBA, maxRGBA, color0, color1);
+
+	Expand565(color0, e0);
+	Expand565(color1, e1);
+	dd = (e0[0] - e1[0]) * (e0[0] - e1[0]) + (e0[1] - e1[1]) * (e0[1] - e1[1]) + (e0[2] - e1[2]) * (e0[2] - e1[2]);
+	if (dd == 0) {
+		//Both endpoints are the same color
+		for (u = 0; u < BLOCK_TEXELS; u++) {
+			texelIndices[u] = s_colorIndexMap[3];
+		}
+		WriteColorBlock(color0, color1, texelIndices, pDst);
+		return;
+	}
+
+	__m128i zero = _mm_setzero_si128();
+	__m128i base = _mm_set_epi16(0, e1[2], e1[1], e1[0], 0, e1[2], e1[1], e1[0]);
+	__m128i dir = _mm_set_epi16(0, e0[2] - e1[2], e0[1] - e1[1], e0[0] - e1[0], 0, e0[2] - e1[2], e0[1] - e1[1], e0[0] - e1[0]);
+	__m128 scale = _mm_set1_ps(3.0f / (float)dd);
+	__m128i maxT = _mm_set1_epi16(3);
+	const __m128i *pRows[4] = { &row0, &row1, &row2, &row3 };
+
+	for (u = 0; u < 4; u++) {
+		__m128i lo, hi;
+		__m128i dots;
+		__m128i t;
+		unsigned char tBytes[16];
+
+		//Widen to 16 bits, two texels per register, and take the dot product with the endpoint line
+		lo = _mm_sub_epi16(_mm_unpacklo_epi8(*pRows[u], zero), base);
+		hi = _mm_sub_epi16(_mm_unpackhi_epi8(*pRows[u], zero), base);
+		lo = _mm_madd_epi16(lo, dir);
+		hi = _mm_madd_epi16(hi, dir);
+		dots = _mm_add_epi32(
+			_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0))),
+			_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1))));
+
+		//Position along the line in thirds, rounded and clamped to [0, 3]
+		t = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(dots), scale));
+		t = _mm_packs_epi32(t, t);
+		t = _mm_min_epi16(_mm_max_epi16(t, zero), maxT);
+		t = _mm_packus_epi16(t, t);
+		_mm_storeu_si128((__m128i *)tBytes, t);
+
+		texelIndices[u * 4 + 0] = s_colorIndexMap[tBytes[0]];
+		texelIndices[u * 4 + 1] = s_colorIndexMap[tBytes[1]];
+		texelIndices[u * 4 + 2] = s_colorIndexMap[tBytes[2]];
+		texelIndices[u * 4 + 3] = s_colorIndexMap[tBytes[3]];
+	}
+
+	WriteColorBlock(color0, color1, texelIndices, pDst);
+
+	return;
+}
+#endif
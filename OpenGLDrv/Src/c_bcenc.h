@@ -0,0 +1,38 @@
+#ifndef _C_BCENC_
+#define _C_BCENC_
+
+#if defined(_WIN32) || defined(__SSE2__)
+#define C_BCENC_INCLUDE_SSE2_CODE
+#include <emmintrin.h>
+#endif
+
+//Fast BC1 (DXT1) and BC3 (DXT5) block encoder
+//Source texels are 8-bit RGBA in memory order, rows are width texels
+//Levels smaller than a block repeat their edge texels to fill it
+class CBCEnc {
+public:
+	enum { BLOCK_TEXELS = 16 };
+	enum { BC1_BLOCK_SIZE = 8 };
+	enum { BC3_BLOCK_SIZE = 16 };
+
+public:
+	static unsigned int GetBC1Size(unsigned int width, unsigned int height);
+	static unsigned int GetBC3Size(unsigned int width, unsigned int height);
+
+	static void EncodeBC1(const unsigned char *pSrc, unsigned int width, unsigned int height, unsigned char *pDst, bool useSSE2);
+	static void EncodeBC3(const unsigned char *pSrc, unsigned int width, unsigned int height, unsigned char *pDst, bool useSSE2);
+
+private:
+	static void GetBlock(const unsigned char *pSrc, unsigned int width, unsigned int height, unsigned int bx, unsigned int by, unsigned char *pBlock);
+
+	static void GetColorEndpoints(const unsigned char *pBlock, const unsigned char *pMin, const unsigned char *pMax, unsigned int &color0, unsigned int &color1);
+	static void WriteColorBlock(unsigned int color0, unsigned int color1, const unsigned char *pTexelIndices, unsigned char *pDst);
+
+	static void EncodeColorBlock(const unsigned char *pBlock, unsigned char *pDst);
+	static void EncodeAlphaBlock(const unsigned char *pBlock, unsigned char *pDst);
+#ifdef C_BCENC_INCLUDE_SSE2_CODE
+	static void EncodeColorBlock_SSE2(const unsigned char *pBlock, unsigned char *pDst);
+#endif
+};
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef _C_BINDHASH_
+#define _C_BINDHASH_
+
+//Open addressing hash map from 64-bit keys to data pointers
+//Each bucket fills one cache line, so most lookups touch a single line
+//The map does not own the data and never moves it, so data pointers stay valid
+//Buckets come from appMalloc, which does not return on allocation failure
+template <class DataT> class bind_hash {
+public:
+	typedef unsigned long long key_t;
+
+	enum { CACHE_LINE_SIZE = 64 };
+	enum { SLOTS_PER_BUCKET = 4 };
+	enum { MIN_BUCKETS = 16 }; //Must be a power of 2
+
+private:
+	//Slots with no data use the key to tell empty slots from removed ones
+	enum { EMPTY_KEY = 0, REMOVED_KEY = 1 };
+
+	union bucket_t {
+		struct {
+			key_t key[SLOTS_PER_BUCKET];
+			DataT *pData[SLOTS_PER_BUCKET];
+		} s;
+		unsigned char line[CACHE_LINE_SIZE];
+	};
+
+private:
+	bind_hash(const bind_hash &);
+	bind_hash &operator=(const bind_hash &);
+
+public:
+	bind_hash() {
+		m_pMem = 0;
+		m_pBuckets = 0;
+		m_bucketMask = 0;
+		m_size = 0;
+		m_numRemoved = 0;
+	}
+	~bind_hash() {
+		clear();
+	}
+
+	DataT * FASTCALL find(key_t key) const {
+		if (m_pBuckets == 0) {
+			return 0;
+		}
+
+		unsigned int bucketIndex = hash(key) & m_bucketMask;
+		for (;;) {
+			const bucket_t *pBucket = &m_pBuckets[bucketIndex];
+			unsigned int u;
+
+			for (u = 0; u < SLOTS_PER_BUCKET; u++) {
+				DataT *pData = pBucket->s.pData[u];
+				if (pData != 0) {
+					if (pBucket->s.key[u] == key) {
+						return pData;
+					}
+				}
+				else if (pBucket->s.key[u] == EMPTY_KEY) {
+					//Inserts fill the first free slot, so the key cannot be further along
+					return 0;
+				}
+			}
+
+			bucketIndex = (bucketIndex + 1) & m_bucketMask;
+		}
+	}
+
+	//The key must not already be in the map
+	void FASTCALL insert(key_t key, DataT *pData) {
+		//Keep at least one quarter of the slots empty so that probe sequences stay short
+		if (((m_size + m_numRemoved + 1) * 4) > (get_num_slots() * 3)) {
+			rehash(m_size + 1);
+		}
+
+		insert_no_grow(key, pData);
+		m_size++;
+	}
+
+	bool FASTCALL remove(key_t key) {
+		if (m_pBuckets == 0) {
+			return false;
+		}
+
+		unsigned int bucketIndex = hash(key) & m_bucketMask;
+		for (;;) {
+			bucket_t *pBucket = &m_pBuckets[bucketIndex];
+			unsigned int u;
+
+			for (u = 0; u < SLOTS_PER_BUCKET; u++) {
+				if (pBucket->s.pData[u] != 0) {
+					if (pBucket->s.key[u] == key) {
+						//Leave a marker so that later keys in the probe sequence are still found
+						pBucket->s.pData[u] = 0;
+						pBucket->s.key[u] = REMOVED_KEY;
+						m_size--;
+						m_numRemoved++;
+
+						return true;
+					}
+				}
+				else if (pBucket->s.key[u] == EMPTY_KEY) {
+					return false;
+				}
+			}
+
+			bucketIndex = (bucketIndex + 1) & m_bucketMask;
+		}
+	}
+
+	void clear(void) {
+		if (m_pMem) {
+			appFree(m_pMem);
+		}
+		m_pMem = 0;
+		m_pBuckets = 0;
+		m_bucketMask = 0;
+		m_size = 0;
+		m_numRemoved = 0;
+	}
+
+	unsigned int size(void) const {
+		return m_size;
+	}
+
+	//Slot access for walking all entries
+	//Returns NULL for slots without data
+	unsigned int get_num_slots(void) const {
+		return (m_pBuckets != 0) ? ((m_bucketMask + 1) * SLOTS_PER_BUCKET) : 0;
+	}
+	DataT *get_slot_data(unsigned int slot) const {
+		return m_pBuckets[slot / SLOTS_PER_BUCKET].s.pData[slot % SLOTS_PER_BUCKET];
+	}
+
+private:
+	static inline unsigned int hash(key_t key) {
+		//Fibonacci hashing, the high bits of the product depend on all key bits
+		return (unsigned int)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+	}
+
+	void FASTCALL insert_no_grow(key_t key, DataT *pData) {
+		unsigned int bucketIndex = hash(key) & m_bucketMask;
+		for (;;) {
+			bucket_t *pBucket = &m_pBuckets[bucketIndex];
+			unsigned int u;
+
+			for (u = 0; u < SLOTS_PER_BUCKET; u++) {
+				if (pBucket->s.pData[u] == 0) {
+					if (pBucket->s.key[u] == REMOVED_KEY) {
+						m_numRemoved--;
+					}
+					pBucket->s.key[u] = key;
+					pBucket->s.pData[u] = pData;
+
+					return;
+				}
+			}
+
+			bucketIndex = (bucketIndex + 1) & m_bucketMask;
+		}
+	}
+
+	void FASTCALL rehash(unsigned int minSize) {
+		unsigned int numBuckets = MIN_BUCKETS;
+		void *pOldMem = m_pMem;
+		bucket_t *pOldBuckets = m_pBuckets;
+		unsigned int numOldSlots = get_num_slots();
+		unsigned int slot;
+
+		//Size for at most half of the slots in use after the rehash
+		while ((numBuckets * SLOTS_PER_BUCKET) < (minSize * 2)) {
+			numBuckets <<= 1;
+		}
+
+		//Align buckets to cache lines
+		m_pMem = appMalloc((numBuckets + 1) * sizeof(bucket_t), TEXT("BindHash"));
+		m_pBuckets = (bucket_t *)(((size_t)m_pMem + (CACHE_LINE_SIZE - 1)) & ~(size_t)(CACHE_LINE_SIZE - 1));
+		appMemzero(m_pBuckets, numBuckets * sizeof(bucket_t));
+		m_bucketMask = numBuckets - 1;
+		m_numRemoved = 0;
+
+		for (slot = 0; slot < numOldSlots; slot++) {
+			const bucket_t *pOldBucket = &pOldBuckets[slot / SLOTS_PER_BUCKET];
+			if (pOldBucket->s.pData[slot % SLOTS_PER_BUCKET] != 0) {
+				insert_no_grow(pOldBucket->s.key[slot % SLOTS_PER_BUCKET], pOldBucket->s.pData[slot % SLOTS_PER_BUCKET]);
+			}
+		}
+
+		if (pOldMem) {
+			appFree(pOldMem);
+		}
+	}
+
+private:
+	void *m_pMem;
+	bucket_t *m_pBuckets;
+	unsigned int m_bucketMask;
+	unsigned int m_size;
+	unsigned int m_numRemoved;
+};
+
+#endif //_C_BINDHASH_
@@ -13,6 +13,12 @@ CGClip::CGClip() {
 		m_cp[u].n.z = 0.0f;
 		m_cp[u].d = 0.0f;
 	}
+
+	//Deep enough for any hit name nesting, so pushes do not allocate
+	m_hitNameStack.reserve(64);
+
+	m_selClosestDepth = std::numeric_limits<float>::infinity();
+	m_selHit = false;
 }
 
 CGClip::~CGClip() {
@@ -256,17 +262,14 @@ unsigned int CGClip::GetHitNameStackSize(void) {
 
 void CGClip::GetHitNameStackValues(unsigned int *pDst, unsigned int dstSize) {
 	unsigned int numNames;
-	unsigned int u;
-	std::deque<unsigned int>::const_iterator hnIter;
 
 	numNames = m_hitNameStack.size();
 	if (numNames > dstSize) {
 		numNames = dstSize;
 	}
 
-	hnIter = m_hitNameStack.begin();
-	for (u = 0; u < numNames; u++) {
-		*pDst++ = *hnIter++;
+	if (numNames > 0) {
+		memcpy(pDst, &m_hitNameStack[0], numNames * sizeof(unsigned int));
 	}
 
 	return;
@@ -289,12 +292,7 @@ void CGClip::SelectDrawLine(const vec3_t *pLnPts) {
 	ClipLine(clLn);
 
 	for (u = 0; u < clLn.numPts; u++) {
-		float ptZ = clLn.pts[u].z;
-
-		if (ptZ <= m_selClosestDepth) {
-			m_selClosestDepth = ptZ;
-			m_selHit = true;
-		}
+		SelectHitDepth(clLn.pts[u].z);
 	}
 
 	return;
@@ -317,12 +315,209 @@ void CGClip::SelectDrawTri(const vec3_t *pTriPts) {
 	ClipTri(clTri);
 
 	for (u = 0; u < clTri.numPts; u++) {
-		float ptZ = clTri.pts[u].z;
+		SelectHitDepth(clTri.pts[u].z);
+	}
+
+	return;
+}
+
+//Same hits and depths as calling SelectDrawTri for each triangle
+//Points are three per triangle
+void CGClip::SelectDrawTris(const vec3_t *pTriPts, unsigned int numTris) {
+	unsigned int u;
+
+	//Discard if hit name stack empty
+	if (m_hitNameStack.empty() || (numTris == 0)) {
+		return;
+	}
+
+	ComputeOutCodes(pTriPts, numTris * 3);
+
+	for (u = 0; u < numTris; u++) {
+		const unsigned int *pOutCodes = &m_outCodes[u * 3];
+
+		SelectDrawTriOutCodes(pTriPts[0], pTriPts[1], pTriPts[2], pOutCodes[0], pOutCodes[1], pOutCodes[2]);
+		pTriPts += 3;
+	}
+
+	return;
+}
+
+//Same hits and depths as calling SelectDrawTri for each triangle of the fan
+void CGClip::SelectDrawPoly(const vec3_t *pPts, unsigned int numPts) {
+	SelectDrawPolys(pPts, &numPts, 1);
+
+	return;
+}
+
+//Polygon points follow each other, pNumPts has the number of points of each polygon
+//Each point is tested against the planes only once
+void CGClip::SelectDrawPolys(const vec3_t *pPts, const unsigned int *pNumPts, unsigned int numPolys) {
+	unsigned int totalPts;
+	unsigned int polyNum;
+	const unsigned int *pOutCodes;
+	unsigned int u;
+
+	//Discard if hit name stack empty
+	if (m_hitNameStack.empty()) {
+		return;
+	}
+
+	totalPts = 0;
+	for (polyNum = 0; polyNum < numPolys; polyNum++) {
+		totalPts += pNumPts[polyNum];
+	}
+	if (totalPts == 0) {
+		return;
+	}
 
-		if (ptZ <= m_selClosestDepth) {
-			m_selClosestDepth = ptZ;
-			m_selHit = true;
+	ComputeOutCodes(pPts, totalPts);
+
+	pOutCodes = &m_outCodes[0];
+	for (polyNum = 0; polyNum < numPolys; polyNum++) {
+		unsigned int numPts = pNumPts[polyNum];
+
+		for (u = 2; u < numPts; u++) {
+			SelectDrawTriOutCodes(pPts[0], pPts[u - 1], pPts[u], pOutCodes[0], pOutCodes[u - 1], pOutCodes[u]);
 		}
+		pPts += numPts;
+		pOutCodes += numPts;
+	}
+
+	return;
+}
+
+float CGClip::GetSelectClosestDepth(void) {
+	return m_selClosestDepth;
+}
+
+
+void CGClip::ComputeOutCodes(const vec3_t *pPts, unsigned int numPts) {
+	unsigned int cpBitsRemain;
+	unsigned int cpBit;
+	unsigned int cpNum;
+	unsigned int ptNum;
+	unsigned int *pOutCodes;
+
+	if (m_outCodes.size() < numPts) {
+		m_outCodes.resize(numPts);
+	}
+	pOutCodes = &m_outCodes[0];
+
+	ptNum = 0;
+
+#ifdef CGCLIP_USE_SSE
+	if (numPts >= 4) {
+		__m128 cpNX[NUM_CP], cpNY[NUM_CP], cpNZ[NUM_CP], cpNegD[NUM_CP], cpBits[NUM_CP];
+		unsigned int numEnabled = 0;
+		unsigned int u;
+
+		//Broadcast the enabled planes once
+		//Plane bits are kept in float registers only for bitwise operations
+		cpBitsRemain = m_cpEnableBits;
+		for (cpNum = 0, cpBit = 0x1; cpBitsRemain != 0; cpNum++, cpBit <<= 1) {
+			if (cpBit & cpBitsRemain) {
+				const plane_t &clPlane = m_cp[cpNum];
+				union { unsigned int u; float f; } bitCast;
+
+				cpBitsRemain -= cpBit;
+
+				bitCast.u = cpBit;
+				cpNX[numEnabled] = _mm_set1_ps(clPlane.n.x);
+				cpNY[numEnabled] = _mm_set1_ps(clPlane.n.y);
+				cpNZ[numEnabled] = _mm_set1_ps(clPlane.n.z);
+				cpNegD[numEnabled] = _mm_set1_ps(-clPlane.d);
+				cpBits[numEnabled] = _mm_set1_ps(bitCast.f);
+				numEnabled++;
+			}
+		}
+
+		//Four points at a time
+		//Dot products are summed in the same order as Dot3, so the results match the scalar path
+		for (; (ptNum + 4) <= numPts; ptNum += 4) {
+			const float *pF = &pPts[ptNum].x;
+			__m128 a, b, c, t0, t1;
+			__m128 ptsX, ptsY, ptsZ;
+			__m128 outCodes;
+
+			//x0 y0 z0 x1, y1 z1 x2 y2, z2 x3 y3 z3
+			a = _mm_loadu_ps(pF);
+			b = _mm_loadu_ps(pF + 4);
+			c = _mm_loadu_ps(pF + 8);
+
+			t0 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2));
+			ptsX = _mm_shuffle_ps(a, t0, _MM_SHUFFLE(2, 0, 3, 0));
+			t0 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));
+			t1 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+			ptsY = _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0));
+			t0 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+			t1 = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0));
+			ptsZ = _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0));
+
+			outCodes = _mm_setzero_ps();
+			for (u = 0; u < numEnabled; u++) {
+				__m128 dot;
+
+				dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cpNX[u], ptsX), _mm_mul_ps(cpNY[u], ptsY)), _mm_mul_ps(cpNZ[u], ptsZ));
+				//Not greater or equal, so NaN is outside like in the scalar path
+				outCodes = _mm_or_ps(outCodes, _mm_and_ps(_mm_cmpnge_ps(dot, cpNegD[u]), cpBits[u]));
+			}
+
+			_mm_storeu_ps((float *)&pOutCodes[ptNum], outCodes);
+		}
+	}
+#endif
+
+	//Remaining points
+	for (; ptNum < numPts; ptNum++) {
+		unsigned int outCode = 0;
+
+		cpBitsRemain = m_cpEnableBits;
+		for (cpNum = 0, cpBit = 0x1; cpBitsRemain != 0; cpNum++, cpBit <<= 1) {
+			if (cpBit & cpBitsRemain) {
+				const plane_t &clPlane = m_cp[cpNum];
+
+				cpBitsRemain -= cpBit;
+
+				if (!(Dot3(clPlane.n, pPts[ptNum]) >= -clPlane.d)) {
+					outCode |= cpBit;
+				}
+			}
+		}
+		pOutCodes[ptNum] = outCode;
+	}
+
+	return;
+}
+
+void CGClip::SelectDrawTriOutCodes(const vec3_t &pt0, const vec3_t &pt1, const vec3_t &pt2, unsigned int outCode0, unsigned int outCode1, unsigned int outCode2) {
+	cl_tri_t clTri;
+	unsigned int u;
+
+	//Discard if all points are outside of the same plane
+	//Clipping to other planes first cannot bring any of it back inside
+	if (outCode0 & outCode1 & outCode2) {
+		return;
+	}
+
+	//All points inside, so clipping would not change the triangle
+	if ((outCode0 | outCode1 | outCode2) == 0) {
+		SelectHitDepth(pt0.z);
+		SelectHitDepth(pt1.z);
+		SelectHitDepth(pt2.z);
+		return;
+	}
+
+	//Crosses a plane, so clip it
+	clTri.numPts = 3;
+	clTri.pts[0] = pt0;
+	clTri.pts[1] = pt1;
+	clTri.pts[2] = pt2;
+
+	ClipTri(clTri);
+
+	for (u = 0; u < clTri.numPts; u++) {
+		SelectHitDepth(clTri.pts[u].z);
 	}
 
 	return;
@@ -3,9 +3,16 @@
 #define _C_GCLIP_
 
 #include <math.h>
-#include <deque>
+#include <string.h>
+#include <vector>
 #include <limits>
 
+//Plane tests run on four vertices at a time when the target has SSE
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#define CGCLIP_USE_SSE
+#include <xmmintrin.h>
+#endif
+
 class CGClip {
 public:
 	enum { NUM_CP = 6 };
@@ -57,12 +64,32 @@ public:
 
 	void SelectDrawLine(const vec3_t *pLnPts);
 	void SelectDrawTri(const vec3_t *pTriPts);
+	void SelectDrawTris(const vec3_t *pTriPts, unsigned int numTris);
+	void SelectDrawPoly(const vec3_t *pPts, unsigned int numPts);
+	void SelectDrawPolys(const vec3_t *pPts, const unsigned int *pNumPts, unsigned int numPolys);
+
+	float GetSelectClosestDepth(void);
+
+private:
+	void ComputeOutCodes(const vec3_t *pPts, unsigned int numPts);
+	void SelectDrawTriOutCodes(const vec3_t &pt0, const vec3_t &pt1, const vec3_t &pt2, unsigned int outCode0, unsigned int outCode1, unsigned int outCode2);
+
+	inline void SelectHitDepth(float ptZ) {
+		if (ptZ <= m_selClosestDepth) {
+			m_selClosestDepth = ptZ;
+			m_selHit = true;
+		}
+	}
 
 private:
 	unsigned int m_cpEnableBits;
 	plane_t m_cp[NUM_CP];
 
-	std::deque<unsigned int> m_hitNameStack;
+	//Per vertex bits of the enabled planes each vertex is outside of
+	std::vector<unsigned int> m_outCodes;
+
+	//Flat stack, names are copied out in order
+	std::vector<unsigned int> m_hitNameStack;
 	float m_selClosestDepth;
 	bool m_selHit;
 };
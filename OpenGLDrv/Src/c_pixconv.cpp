@@ -0,0 +1,163 @@
+#include "c_pixconv.h"
+
+
+//Full range BT.601 coefficients in 1.15 fixed point
+//The chroma coefficients sum to zero, so gray maps to the 128 chroma center
+enum { YUV_SHIFT = 15 };
+enum { Y_R = 9798, Y_G = 19235, Y_B = 3736 };
+enum { U_R = -5529, U_G = -10855, U_B = 16384 };
+enum { V_R = 16384, V_G = -13720, V_B = -2664 };
+enum { Y_BIAS = 1 << (YUV_SHIFT - 1) };
+enum { UV_BIAS = (128 << YUV_SHIFT) + (1 << (YUV_SHIFT - 1)) };
+
+
+static inline unsigned char ClampByte(int x) {
+	return (unsigned char)((x < 0) ? 0 : ((x > 255) ? 255 : x));
+}
+
+
+void CPixConv::SwapRB(const unsigned char *pSrc, unsigned char *pDst, unsigned int width, bool useSSE2) {
+	unsigned int u;
+
+#ifdef C_PIXCONV_INCLUDE_SSE2_CODE
+	if (useSSE2) {
+		SwapRB_SSE2(pSrc, pDst, width);
+		return;
+	}
+#endif
+
+	for (u = 0; u < width; u++) {
+		unsigned char c0 = pSrc[0];
+
+		pDst[0] = pSrc[2];
+		pDst[1] = pSrc[1];
+		pDst[2] = c0;
+		pDst[3] = pSrc[3];
+
+		pSrc += 4;
+		pDst += 4;
+	}
+
+	return;
+}
+
+void CPixConv::ApplyRamp(const unsigned char *pSrc, unsigned char *pDst, unsigned int width,
+	const unsigned char *pRampR, const unsigned char *pRampG, const unsigned char *pRampB)
+{
+	unsigned int u;
+
+	//Table lookups do not vectorize with SSE2
+	for (u = 0; u < width; u++) {
+		pDst[0] = pRampB[pSrc[0]];
+		pDst[1] = pRampG[pSrc[1]];
+		pDst[2] = pRampR[pSrc[2]];
+		pDst[3] = pSrc[3];
+
+		pSrc += 4;
+		pDst += 4;
+	}
+
+	return;
+}
+
+void CPixConv::ToYUV444(const unsigned char *pSrc, unsigned int width, unsigned char *pY, unsigned char *pU, unsigned char *pV, bool useSSE2) {
+	unsigned int u;
+
+#ifdef C_PIXCONV_INCLUDE_SSE2_CODE
+	if (useSSE2) {
+		unsigned int numVec = width & ~3;
+
+		ToYUV444_SSE2(pSrc, numVec, pY, pU, pV);
+
+		//Remaining texels use the scalar path
+		pSrc += numVec * 4;
+		pY += numVec;
+		pU += numVec;
+		pV += numVec;
+		width -= numVec;
+	}
+#endif
+
+	for (u = 0; u < width; u++) {
+		int b = pSrc[0];
+		int g = pSrc[1];
+		int r = pSrc[2];
+
+		pY[u] = ClampByte((Y_R * r + Y_G * g + Y_B * b + Y_BIAS) >> YUV_SHIFT);
+		pU[u] = ClampByte((U_R * r + U_G * g + U_B * b + UV_BIAS) >> YUV_SHIFT);
+		pV[u] = ClampByte((V_R * r + V_G * g + V_B * b + UV_BIAS) >> YUV_SHIFT);
+
+		pSrc += 4;
+	}
+
+	return;
+}
+
+
+#ifdef C_PIXCONV_INCLUDE_SSE2_CODE
+//Same as SwapRB, four texels at a time
+void CPixConv::SwapRB_SSE2(const unsigned char *pSrc, unsigned char *pDst, unsigned int width) {
+	__m128i maskGA = _mm_set1_epi32(0xFF00FF00);
+	__m128i maskC = _mm_set1_epi32(0x000000FF);
+	unsigned int u;
+
+	for (u = 0; u + 4 <= width; u += 4) {
+		__m128i t = _mm_loadu_si128((const __m128i *)pSrc);
+
+		t = _mm_or_si128(_mm_and_si128(t, maskGA),
+			_mm_or_si128(_mm_and_si128(_mm_srli_epi32(t, 16), maskC), _mm_slli_epi32(_mm_and_si128(t, maskC), 16)));
+		_mm_storeu_si128((__m128i *)pDst, t);
+
+		pSrc += 16;
+		pDst += 16;
+	}
+
+	//Remaining texels use the scalar path
+	SwapRB(pSrc, pDst, width - u, false);
+
+	return;
+}
+
+//Sums the two products of each texel from the low and high texel pairs and scales them
+static inline __m128i YUVDot4(__m128i lo, __m128i hi, __m128i coefs, __m128i bias) {
+	__m128 dotLo = _mm_castsi128_ps(_mm_madd_epi16(lo, coefs));
+	__m128 dotHi = _mm_castsi128_ps(_mm_madd_epi16(hi, coefs));
+	__m128i bg = _mm_castps_si128(_mm_shuffle_ps(dotLo, dotHi, _MM_SHUFFLE(2, 0, 2, 0)));
+	__m128i ra = _mm_castps_si128(_mm_shuffle_ps(dotLo, dotHi, _MM_SHUFFLE(3, 1, 3, 1)));
+
+	return _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(bg, ra), bias), YUV_SHIFT);
+}
+
+//Same as ToYUV444, four texels at a time
+//The width must be a multiple of 4
+void CPixConv::ToYUV444_SSE2(const unsigned char *pSrc, unsigned int width, unsigned char *pY, unsigned char *pU, unsigned char *pV) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i coefsY = _mm_set_epi16(0, Y_R, Y_G, Y_B, 0, Y_R, Y_G, Y_B);
+	__m128i coefsU = _mm_set_epi16(0, U_R, U_G, U_B, 0, U_R, U_G, U_B);
+	__m128i coefsV = _mm_set_epi16(0, V_R, V_G, V_B, 0, V_R, V_G, V_B);
+	__m128i biasY = _mm_set1_epi32(Y_BIAS);
+	__m128i biasUV = _mm_set1_epi32(UV_BIAS);
+	unsigned int u;
+
+	for (u = 0; u < width; u += 4) {
+		__m128i t = _mm_loadu_si128((const __m128i *)(pSrc + u * 4));
+		__m128i lo = _mm_unpacklo_epi8(t, zero);
+		__m128i hi = _mm_unpackhi_epi8(t, zero);
+		__m128i y = YUVDot4(lo, hi, coefsY, biasY);
+		__m128i cb = YUVDot4(lo, hi, coefsU, biasUV);
+		__m128i cr = YUVDot4(lo, hi, coefsV, biasUV);
+		int packed;
+
+		//Saturating packs clamp to the byte range
+		y = _mm_packus_epi16(_mm_packs_epi32(y, cb), _mm_packs_epi32(cr, zero));
+		packed = _mm_cvtsi128_si32(y);
+		*(int *)(pY + u) = packed;
+		packed = _mm_cvtsi128_si32(_mm_srli_si128(y, 4));
+		*(int *)(pU + u) = packed;
+		packed = _mm_cvtsi128_si32(_mm_srli_si128(y, 8));
+		*(int *)(pV + u) = packed;
+	}
+
+	return;
+}
+#endif
@@ -0,0 +1,30 @@
+#ifndef _C_PIXCONV_
+#define _C_PIXCONV_
+
+#if defined(_WIN32) || defined(__SSE2__)
+#define C_PIXCONV_INCLUDE_SSE2_CODE
+#include <emmintrin.h>
+#endif
+
+//Row conversions for frame read back
+//Texels are 8-bit BGRA in memory order unless noted otherwise
+class CPixConv {
+public:
+	//Swaps the first and third channel, converting between RGBA and BGRA
+	static void SwapRB(const unsigned char *pSrc, unsigned char *pDst, unsigned int width, bool useSSE2);
+
+	//Maps each color channel through its lookup table, alpha is copied
+	static void ApplyRamp(const unsigned char *pSrc, unsigned char *pDst, unsigned int width,
+		const unsigned char *pRampR, const unsigned char *pRampG, const unsigned char *pRampB);
+
+	//Converts to full range BT.601 YCbCr planes without chroma subsampling
+	static void ToYUV444(const unsigned char *pSrc, unsigned int width, unsigned char *pY, unsigned char *pU, unsigned char *pV, bool useSSE2);
+
+private:
+#ifdef C_PIXCONV_INCLUDE_SSE2_CODE
+	static void SwapRB_SSE2(const unsigned char *pSrc, unsigned char *pDst, unsigned int width);
+	static void ToYUV444_SSE2(const unsigned char *pSrc, unsigned int width, unsigned char *pY, unsigned char *pU, unsigned char *pV);
+#endif
+};
+
+#endif
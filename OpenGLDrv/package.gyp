@@ -14,7 +14,10 @@
 			"sources": [
 				"Src/OpenGLDrv.cpp",
 				"Src/OpenGL.cpp",
-				"Src/c_gclip.cpp"
+				"Src/c_gclip.cpp",
+				"Src/c_bcenc.cpp",
+				"Src/c_pixconv.cpp",
+				"../Core/Src/FThreadPool.cpp"
 			]
 		}
 	]
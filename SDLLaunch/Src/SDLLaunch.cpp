@@ -19,6 +19,8 @@ extern "C" {TCHAR GPackage[64]=TEXT("SDLLaunch");}
 
 // Memory allocator.
 FMallocNative Malloc;
+#include "FMallocProfiler.h"
+FMallocProfiler Profiler( &Malloc );
 
 // Log file.
 #include "FOutputDeviceFile.h"
@@ -122,7 +124,7 @@ static UEngine* InitEngine()
 	FTime LoadTime = appSeconds();
 
 	// Set exec hook.
-	GExec = NULL;
+	GExec = Profiler.IsEnabled() ? &Profiler : NULL;
 
 	// Update first-run.
 	INT FirstRun=0;
@@ -238,10 +240,11 @@ int main( int argc, char* argv[] )
 			appStrcat( CmdLine, appFromAnsi(argv[i]) );
 		}
 
-		// Init core.
+		// Init core, profiling allocations if requested.
 		GIsClient = 1;
 		GIsGuarded = 1;
-		appInit( TEXT("UnrealTournament"), CmdLine, &Malloc, &Log, &Error, &Warn, &FileManager, FConfigCacheIni::Factory, 1 );
+		FMalloc* UsedMalloc = Profiler.Enable( CmdLine ) ? (FMalloc*)&Profiler : &Malloc;
+		appInit( TEXT("UnrealTournament"), CmdLine, UsedMalloc, &Log, &Error, &Warn, &FileManager, FConfigCacheIni::Factory, 1 );
 
 		// Init mode.
 		GIsServer		= 1;
@@ -10,7 +10,8 @@
 				"../Deps/SDL-gyp/SDL.gyp:*"
 			],
 			"sources": [
-				"Src/SDLLaunch.cpp"
+				"Src/SDLLaunch.cpp",
+				"../Core/Src/FThreadPool.cpp"
 			]
 		}
 	]
@@ -32,7 +32,9 @@ class FInstallPoll GNoPoll;
 
 // Memory allocator.
 #include "FMallocWindows.h"
-FMallocWindows Malloc;
+#include "FThreadPool.h"
+FMallocWindows InnerMalloc;
+FMallocThreadSafeProxy Malloc( &InnerMalloc );
 
 // Error handler.
 #include "FOutputDeviceWindowsError.h"
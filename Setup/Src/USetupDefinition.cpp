@@ -595,7 +595,7 @@ void USetupDefinition::ProcessPreCopy( FString Key, FString Value, UBOOL Selecte
 void USetupDefinition::ProcessCopy( FString Key, FString Value, UBOOL Selected, FInstallPoll* Poll )
 {
 	guard(USetupDefinition::ProcessCopy);
-	BYTE Buffer[4096];
+	BYTE Buffer[65536];
 	if( Selected && Key==TEXT("File") )
 	{
 		// Get source and dest filenames.
@@ -630,7 +630,7 @@ void USetupDefinition::ProcessCopy( FString Key, FString Value, UBOOL Selected,
 			if( !SrcAr )
 				LocalizedFileError( TEXT("FailedOpenSource"), Patch ? TEXT("AdviseBadDownload") : TEXT("AdviseBadMedia"), *FullSrc );
 			INT Size = SrcAr->TotalSize();
-			FArchive* DestAr = GFileManager->CreateFileWriter( *ThisDest, FILEWRITE_EvenIfReadOnly );
+			FArchive* DestAr = GFileManager->CreateFileWriter( *ThisDest, FILEWRITE_EvenIfReadOnly|FILEWRITE_Async );
 			if( !DestAr )
 				LocalizedFileError( TEXT("FailedOpenDest"), TEXT("AdviseBadDest"), *ThisDest );
 
@@ -639,27 +639,42 @@ void USetupDefinition::ProcessCopy( FString Key, FString Value, UBOOL Selected,
 				INT Signature;
 				FString OrigFilename;
 				*SrcAr << Signature;
-				if( Signature != 5678 )
+				if( !FUzDecoder::IsKnownSignature(Signature) )
 					LocalizedFileError( TEXT("FailedOpenSource"), TEXT("AdviseBadMedia"), *FullSrc );
 				else
 				{
+					// Decode in chunks so progress and cancel stay responsive.
 					*SrcAr << OrigFilename;
-					FCodecFull Codec;
-					Codec.AddCodec(new FCodecRLE);
-					Codec.AddCodec(new FCodecBWT);
-					Codec.AddCodec(new FCodecMTF);
-					Codec.AddCodec(new FCodecRLE);
-					Codec.AddCodec(new FCodecHuffman);
-					Codec.Decode( *SrcAr, *DestAr );
-					if( !Poll->Poll(*FullDest,Size,Size,RunningBytes+=Size,TotalBytes) )					{
-						delete SrcAr;
-						delete DestAr;
-						DidCancel();
+					FUzDecoder Decoder( *SrcAr, Signature );
+					if( Decoder.GetRawSize()>=0 )
+						DestAr->Precache( Decoder.GetRawSize() );
+					INT Count, LastPos=SrcAr->Tell();
+					RunningBytes += LastPos;
+					while( (Count=Decoder.Read( Buffer, sizeof(Buffer) ))>0 )
+					{
+						DestAr->Serialize( Buffer, Count );
+						if( DestAr->IsError() )
+						{
+							delete SrcAr;
+							delete DestAr;
+							LocalizedFileError( TEXT("FailedWritingDest"), TEXT("AdviseBadDest"), *ThisDest );
+						}
+						INT Pos = SrcAr->Tell();
+						if( !Poll->Poll(*FullDest,Pos,Size,RunningBytes+=Pos-LastPos,TotalBytes) )
+						{
+							delete SrcAr;
+							delete DestAr;
+							DidCancel();
+						}
+						LastPos = Pos;
 					}
+					RunningBytes += Size-LastPos;
 				}
 			}
 			else
 			{
+				// Reserve space up front so the file is laid out contiguously.
+				DestAr->Precache( Size );
 				for( SQWORD Pos=0; Pos<Size; Pos+=sizeof(Buffer) )
 				{
 					INT Count = Min( Size-Pos, (SQWORD)sizeof(Buffer) );
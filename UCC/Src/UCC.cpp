@@ -17,8 +17,8 @@ Revision history:
 #endif
 #include <stdio.h>
 
-// Core and Engine
-#include "Engine.h"
+// Core, Engine and native applets.
+#include "UCCPrivate.h"
 
 INT GFilesOpen, GFilesOpened;
 
@@ -33,6 +33,9 @@ extern "C" {TCHAR GPackage[64]=TEXT("UCC");}
 
 // Memory allocator.
 FMallocNative Malloc;
+#include "FMallocTrace.h"
+#include "FMallocProfiler.h"
+FMallocProfiler Profiler( &Malloc );
 
 // Log.
 #include "FOutputDeviceFile.h"
@@ -67,6 +70,13 @@ INT Compare( FString& A, FString& B )
 {
 	return appStricmp( *A, *B );
 }
+FNativeApplet* FindNativeApplet( const TCHAR* Token )
+{
+	for( INT i=0; GNativeApplets[i].Name; i++ )
+		if( appStricmp( Token, GNativeApplets[i].Name )==0 )
+			return &GNativeApplets[i];
+	return NULL;
+}
 void ShowBanner( FOutputDevice& Warn )
 {
 	Warn.Logf( TEXT("=======================================") );
@@ -115,8 +125,24 @@ int main( int argc, char* argv[] )
 			}
 		#endif
 
+		// Profile allocations by tag if requested.
+		FMalloc* UsedMalloc = &Malloc;
+		if( Profiler.Enable( CmdLine ) )
+			UsedMalloc = &Profiler;
+
+		// Record allocations for "ucc mallocbench" if requested.
+		TCHAR TraceFilename[256];
+		if( Parse( CmdLine, TEXT("MALLOCTRACE="), TraceFilename, ARRAY_COUNT(TraceFilename) ) )
+		{
+			static FMallocTrace Trace( UsedMalloc, TCHAR_TO_ANSI(TraceFilename) );
+			if( Trace.IsTracing() )
+				UsedMalloc = &Trace;
+		}
+
 		// Init engine core.
-		appInit( TEXT("UnrealTournament"), CmdLine, &Malloc, &Log, &Error, &Warn, &FileManager, FConfigCacheIni::Factory, 1 );
+		appInit( TEXT("UnrealTournament"), CmdLine, UsedMalloc, &Log, &Error, &Warn, &FileManager, FConfigCacheIni::Factory, 1 );
+		if( Profiler.IsEnabled() )
+			GExec = &Profiler;
 
 		// Get the ucc stuff going.	
 		UObject::SetLanguage(TEXT("int"));
@@ -155,6 +181,8 @@ int main( int argc, char* argv[] )
 						new(Items)FString( FString(TEXT("   ucc ")) + RightPad(Default->HelpCmd,21) + TEXT(" ") + Default->HelpOneLiner );
 					}
 				}
+				for( i=0; GNativeApplets[i].Name; i++ )
+					new(Items)FString( FString(TEXT("   ucc ")) + RightPad(GNativeApplets[i].HelpCmd,21) + TEXT(" ") + GNativeApplets[i].HelpOneLiner );
 				new(Items)FString( TEXT("   ucc help <command>        Get help on a command") );
 				Sort( &Items(0), Items.Num() );
 				for( i=0; i<Items.Num(); i++ )
@@ -166,6 +194,12 @@ int main( int argc, char* argv[] )
 				goto Process;
 			}
 		}
+		else if( FindNativeApplet(*Token) )
+		{
+			// Run a built-in applet.
+			ShowBanner( Warn );
+			ErrorLevel = FindNativeApplet(*Token)->Main( appCmdLine() );
+		}
 		else
 		{
 			// Look it up.
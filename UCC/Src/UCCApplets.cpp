@@ -0,0 +1,551 @@
+/*=============================================================================
+	UCCApplets.cpp: Native applets built into ucc.
+=============================================================================*/
+
+#include "UCCPrivate.h"
+#include "FCodec.h"
+#include "FMallocAnsi.h"
+#include "FMallocTrace.h"
+#if defined(WIN32)
+	#include "FMallocWindows.h"
+#else
+	#include "FMallocPool.h"
+#endif
+
+/*-----------------------------------------------------------------------------
+	Helpers.
+-----------------------------------------------------------------------------*/
+
+// Run a codec over an in-memory buffer, returning the elapsed seconds.
+static FLOAT TimeCodec( FCodec& Codec, UBOOL (FCodec::*Func)(FArchive&,FArchive&), const TArray<BYTE>& InData, TArray<BYTE>& OutData )
+{
+	guard(TimeCodec);
+	FBufferReader Reader(InData);
+	FBufferWriter Writer(OutData);
+	FTime StartTime = appSeconds();
+	(Codec.*Func)( Reader, Writer );
+	return appSeconds() - StartTime;
+	unguard;
+}
+
+// Throughput in megabytes per second.
+static FLOAT Throughput( INT Bytes, FLOAT Seconds )
+{
+	return Seconds>0.f ? Bytes/(1024.f*1024.f)/Seconds : 0.f;
+}
+
+// Filename without its directory.
+static FString StripPath( FString Filename )
+{
+	for( INT i=Filename.Len()-1; i>=0; i-- )
+		if( (*Filename)[i]=='/' || (*Filename)[i]=='\\' )
+			return Filename.Mid( i+1 );
+	return Filename;
+}
+
+/*-----------------------------------------------------------------------------
+	CodecBench.
+-----------------------------------------------------------------------------*/
+
+//
+// Time each stage of the .uz chain on real package files, encoding and
+// decoding separately. The BWT stage is run with both the comparison
+// sort and the suffix array encoders, which must produce the same data.
+// The LZ codec is timed on the same files for comparison.
+//
+static INT CodecBenchMain( const TCHAR* Parms )
+{
+	guard(CodecBenchMain);
+	enum {STAGE_COUNT=5};
+	static const TCHAR* StageNames[STAGE_COUNT] = { TEXT("rle"), TEXT("bwt"), TEXT("mtf"), TEXT("rle"), TEXT("huffman") };
+	FCodec* Stages[STAGE_COUNT] = { new FCodecRLE, new FCodecBWT(1), new FCodecMTF, new FCodecRLE, new FCodecHuffman };
+	FCodecBWT SortedCodec(0);
+	FCodecLZ LZCodec;
+	FLOAT EncodeTotal[STAGE_COUNT], DecodeTotal[STAGE_COUNT], SortedTotal=0.f, LZEncodeTotal=0.f, LZDecodeTotal=0.f;
+	INT StageBytes[STAGE_COUNT], Errors=0, TotalBytes=0, PackedBytes=0, LZBytes=0, i;
+	for( i=0; i<STAGE_COUNT; i++ )
+		EncodeTotal[i] = DecodeTotal[i] = StageBytes[i] = 0;
+
+	FString Filename;
+	while( ParseToken( Parms, Filename, 0 ) )
+	{
+		TArray<BYTE> Data[STAGE_COUNT+1], Sorted;
+		if( !appLoadFileToArray( Data[0], *Filename ) )
+		{
+			GWarn->Logf( NAME_Error, TEXT("Failed to load %s"), *Filename );
+			Errors++;
+			continue;
+		}
+		if( !Data[0].Num() )
+			continue;
+
+		// Encode stage by stage, keeping every intermediate.
+		FString Line = FString::Printf( TEXT("%s: %i bytes, encode"), *Filename, Data[0].Num() );
+		for( i=0; i<STAGE_COUNT; i++ )
+		{
+			FLOAT Time = TimeCodec( *Stages[i], &FCodec::Encode, Data[i], Data[i+1] );
+			EncodeTotal[i] += Time;
+			StageBytes [i] += Data[i].Num();
+			Line += FString::Printf( TEXT(" %s %.2f"), StageNames[i], Throughput(Data[i].Num(),Time) );
+		}
+		FLOAT SortedTime = TimeCodec( SortedCodec, &FCodec::Encode, Data[1], Sorted );
+		SortedTotal += SortedTime;
+		Line += FString::Printf( TEXT(" (bwt qsort %.2f) MB/s, ratio %.3f"), Throughput(Data[1].Num(),SortedTime), (FLOAT)Data[STAGE_COUNT].Num()/Data[0].Num() );
+		GWarn->Log( Line );
+		if( Sorted.Num()!=Data[2].Num() || appMemcmp( &Sorted(0), &Data[2](0), Sorted.Num() ) )
+		{
+			GWarn->Logf( NAME_Error, TEXT("%s: BWT encoders disagree"), *Filename );
+			Errors++;
+		}
+
+		// Decode each stage from its own encoded output.
+		Line = FString::Printf( TEXT("%s: decode"), *Filename );
+		for( i=STAGE_COUNT-1; i>=0; i-- )
+		{
+			TArray<BYTE> Decoded;
+			FLOAT Time = TimeCodec( *Stages[i], &FCodec::Decode, Data[i+1], Decoded );
+			DecodeTotal[i] += Time;
+			Line += FString::Printf( TEXT(" %s %.2f"), StageNames[i], Throughput(Data[i].Num(),Time) );
+			if( Decoded.Num()!=Data[i].Num() || appMemcmp( &Decoded(0), &Data[i](0), Decoded.Num() ) )
+			{
+				GWarn->Logf( NAME_Error, TEXT("%s: %s stage round trip failed"), *Filename, StageNames[i] );
+				Errors++;
+			}
+		}
+		GWarn->Log( Line + TEXT(" MB/s") );
+
+		// Same file through the LZ codec.
+		TArray<BYTE> LZPacked, LZDecoded;
+		FLOAT LZEncodeTime = TimeCodec( LZCodec, &FCodec::Encode, Data[0], LZPacked );
+		FLOAT LZDecodeTime = TimeCodec( LZCodec, &FCodec::Decode, LZPacked, LZDecoded );
+		LZEncodeTotal += LZEncodeTime;
+		LZDecodeTotal += LZDecodeTime;
+		GWarn->Logf( TEXT("%s: lz encode %.2f decode %.2f MB/s, ratio %.3f"), *Filename, Throughput(Data[0].Num(),LZEncodeTime), Throughput(Data[0].Num(),LZDecodeTime), (FLOAT)LZPacked.Num()/Data[0].Num() );
+		if( LZDecoded.Num()!=Data[0].Num() || appMemcmp( &LZDecoded(0), &Data[0](0), LZDecoded.Num() ) )
+		{
+			GWarn->Logf( NAME_Error, TEXT("%s: lz round trip failed"), *Filename );
+			Errors++;
+		}
+		TotalBytes  += Data[0].Num();
+		PackedBytes += Data[STAGE_COUNT].Num();
+		LZBytes     += LZPacked.Num();
+	}
+
+	GWarn->Logf( TEXT("Total: %i bytes, %i error(s)"), TotalBytes, Errors );
+	for( i=0; i<STAGE_COUNT; i++ )
+		GWarn->Logf( TEXT("   %i %-8s encode %8.2f MB/s, decode %8.2f MB/s"), i, StageNames[i], Throughput(StageBytes[i],EncodeTotal[i]), Throughput(StageBytes[i],DecodeTotal[i]) );
+	GWarn->Logf( TEXT("   bwt qsort  encode %8.2f MB/s"), Throughput(StageBytes[1],SortedTotal) );
+	GWarn->Logf( TEXT("   lz         encode %8.2f MB/s, decode %8.2f MB/s"), Throughput(TotalBytes,LZEncodeTotal), Throughput(TotalBytes,LZDecodeTotal) );
+	if( TotalBytes )
+		GWarn->Logf( TEXT("   ratio %.3f for the chain, %.3f for lz"), (FLOAT)PackedBytes/TotalBytes, (FLOAT)LZBytes/TotalBytes );
+	for( i=0; i<STAGE_COUNT; i++ )
+		delete Stages[i];
+	return Errors!=0;
+	unguard;
+}
+
+/*-----------------------------------------------------------------------------
+	UzCompress and UzDecompress.
+-----------------------------------------------------------------------------*/
+
+//
+// Compress files into .uz files that stock clients and servers accept.
+// With -parallel, into block-parallel .uz files, or with -lz into LZ .uz
+// files which decompress much faster. Both need a patched reader.
+//
+static INT UzCompressMain( const TCHAR* Parms )
+{
+	guard(UzCompressMain);
+	INT NumThreads=0, Errors=0;
+	UBOOL UseLZ = ParseParam( Parms, TEXT("LZ") );
+	UBOOL UseParallel = ParseParam( Parms, TEXT("PARALLEL") );
+	Parse( Parms, TEXT("THREADS="), NumThreads );
+	FString Filename;
+	while( ParseToken( Parms, Filename, 0 ) )
+	{
+		if( Filename.Left(1)==TEXT("-") )
+			continue;
+		FString UzFilename = Filename + TEXT(".uz");
+		FArchive* SrcAr = GFileManager->CreateFileReader( *Filename );
+		if( !SrcAr )
+		{
+			GWarn->Logf( NAME_Error, TEXT("Failed to read %s"), *Filename );
+			Errors++;
+			continue;
+		}
+		FArchive* DestAr = GFileManager->CreateFileWriter( *UzFilename );
+		if( !DestAr )
+		{
+			GWarn->Logf( NAME_Error, TEXT("Failed to write %s"), *UzFilename );
+			delete SrcAr;
+			Errors++;
+			continue;
+		}
+		INT Signature = UseLZ ? UZ_SIGNATURE_LZ : UseParallel ? UZ_SIGNATURE_PARALLEL : UZ_SIGNATURE_FULL;
+		FString OrigFilename = StripPath( Filename );
+		*DestAr << Signature << OrigFilename;
+		FTime StartTime = appSeconds();
+		if( UseLZ )
+		{
+			FCodecLZ Codec;
+			Codec.Encode( *SrcAr, *DestAr );
+		}
+		else if( UseParallel )
+		{
+			FCodecParallel Codec( CreateQuietUzCodec, NumThreads );
+			Codec.Encode( *SrcAr, *DestAr );
+		}
+		else
+		{
+			FCodecFull* Codec = CreateUzCodec( 0 );
+			Codec->Encode( *SrcAr, *DestAr );
+			delete Codec;
+		}
+		FLOAT Seconds = appSeconds() - StartTime;
+		INT RawSize = SrcAr->TotalSize(), PackedSize = DestAr->Tell();
+		delete SrcAr;
+		if( !DestAr->Close() )
+		{
+			GWarn->Logf( NAME_Error, TEXT("Failed to write %s"), *UzFilename );
+			Errors++;
+		}
+		delete DestAr;
+		GWarn->Logf( TEXT("%s: %i -> %i bytes in %.2f secs (%.2f MB/s)"), *UzFilename, RawSize, PackedSize, Seconds, Throughput(RawSize,Seconds) );
+	}
+	return Errors!=0;
+	unguard;
+}
+
+//
+// Decompress .uz files of any known signature next to the source file.
+//
+static INT UzDecompressMain( const TCHAR* Parms )
+{
+	guard(UzDecompressMain);
+	INT NumThreads=0, Errors=0;
+	Parse( Parms, TEXT("THREADS="), NumThreads );
+	FString Filename;
+	while( ParseToken( Parms, Filename, 0 ) )
+	{
+		if( Filename.Left(1)==TEXT("-") )
+			continue;
+		FArchive* SrcAr = GFileManager->CreateFileReader( *Filename );
+		if( !SrcAr )
+		{
+			GWarn->Logf( NAME_Error, TEXT("Failed to read %s"), *Filename );
+			Errors++;
+			continue;
+		}
+		INT Signature;
+		FString OrigFilename;
+		*SrcAr << Signature;
+		if( !FUzDecoder::IsKnownSignature(Signature) )
+		{
+			GWarn->Logf( NAME_Error, TEXT("%s: unknown signature %i"), *Filename, Signature );
+			delete SrcAr;
+			Errors++;
+			continue;
+		}
+		*SrcAr << OrigFilename;
+		FString DestFilename = Filename.Left( Filename.Len()-StripPath(Filename).Len() ) + StripPath( OrigFilename );
+		FArchive* DestAr = GFileManager->CreateFileWriter( *DestFilename );
+		if( !DestAr )
+		{
+			GWarn->Logf( NAME_Error, TEXT("Failed to write %s"), *DestFilename );
+			delete SrcAr;
+			Errors++;
+			continue;
+		}
+		FTime StartTime = appSeconds();
+		if( Signature==UZ_SIGNATURE_PARALLEL && NumThreads>0 )
+		{
+			// Decode whole blocks on worker threads.
+			FCodecParallel Codec( CreateQuietUzCodec, NumThreads );
+			Codec.Decode( *SrcAr, *DestAr );
+		}
+		else
+		{
+			// Stream with bounded memory.
+			FUzDecoder Decoder( *SrcAr, Signature );
+			Decoder.Pump( *DestAr );
+		}
+		FLOAT Seconds = appSeconds() - StartTime;
+		INT RawSize = DestAr->Tell();
+		delete SrcAr;
+		if( !DestAr->Close() )
+		{
+			GWarn->Logf( NAME_Error, TEXT("Failed to write %s"), *DestFilename );
+			Errors++;
+		}
+		delete DestAr;
+		GWarn->Logf( TEXT("%s: %i bytes in %.2f secs (%.2f MB/s)"), *DestFilename, RawSize, Seconds, Throughput(RawSize,Seconds) );
+	}
+	return Errors!=0;
+	unguard;
+}
+
+/*-----------------------------------------------------------------------------
+	MallocBench.
+-----------------------------------------------------------------------------*/
+
+// One allocator call of a workload, with pointers replaced by slots.
+struct FMallocBenchOp
+{
+	BYTE	Op;		// MTRACE_Malloc, MTRACE_Realloc or MTRACE_Free.
+	INT		Slot;
+	DWORD	Size;
+};
+
+// Append a call to a workload.
+static void AddMallocOp( TArray<FMallocBenchOp>& Ops, BYTE Op, INT Slot, DWORD Size )
+{
+	FMallocBenchOp& Item = Ops( Ops.Add() );
+	Item.Op   = Op;
+	Item.Slot = Slot;
+	Item.Size = Size;
+}
+
+// Repeatable random numbers for the synthetic workload.
+static DWORD MallocBenchRand( DWORD& Seed )
+{
+	Seed = Seed*196314165 + 907633515;
+	return Seed >> 8;
+}
+
+//
+// Read a trace written by FMallocTrace. Pointers allocated before
+// tracing started are unknown, so freeing them is dropped and
+// reallocating them becomes a new allocation.
+//
+static UBOOL LoadMallocTrace( const TCHAR* Filename, TArray<FMallocBenchOp>& Ops, INT& NumSlots )
+{
+	guard(LoadMallocTrace);
+	FArchive* Ar = GFileManager->CreateFileReader( Filename );
+	if( !Ar )
+		return 0;
+	DWORD Magic=0;
+	*Ar << Magic;
+	UBOOL Result = Magic==MALLOC_TRACE_MAGIC;
+
+	// Live pointers by address. Keys are shifted, as blocks are at least
+	// 8 byte aligned, and dead entries are set to INDEX_NONE because
+	// removing from a TMap is slow.
+	TMap<QWORD,INT> Live;
+	TArray<INT> FreeSlots;
+	NumSlots = 0;
+	while( Result && !Ar->AtEnd() && !Ar->IsError() )
+	{
+		BYTE Op=0;
+		QWORD Ptr=0, NewPtr=0;
+		DWORD Size=0;
+		INT TagIndex=0, Length=0;
+		*Ar << Op;
+		if( Op==MTRACE_Tag )
+		{
+			// Tags don't affect the allocators, so skip them.
+			*Ar << TagIndex << Length;
+			Ar->Seek( Ar->Tell()+Length );
+			continue;
+		}
+		else if( Op==MTRACE_Malloc )
+		{
+			*Ar << NewPtr << Size << TagIndex;
+		}
+		else if( Op==MTRACE_Realloc )
+		{
+			*Ar << Ptr << NewPtr << Size << TagIndex;
+		}
+		else if( Op==MTRACE_Free )
+		{
+			*Ar << Ptr;
+		}
+		else
+		{
+			GWarn->Logf( NAME_Error, TEXT("%s: bad record type %i"), Filename, Op );
+			Result = 0;
+			break;
+		}
+
+		// Find the slot of the old pointer, if any.
+		INT Slot = INDEX_NONE;
+		if( Ptr )
+		{
+			INT* Found = Live.Find( Ptr>>3 );
+			if( Found && *Found!=INDEX_NONE )
+			{
+				Slot   = *Found;
+				*Found = INDEX_NONE;
+			}
+			else if( Op==MTRACE_Free )
+			{
+				continue;
+			}
+		}
+
+		// Give the new pointer a slot, or release the old one.
+		if( NewPtr )
+		{
+			if( Slot==INDEX_NONE )
+				Slot = FreeSlots.Num() ? FreeSlots.Pop() : NumSlots++;
+			Live.Set( NewPtr>>3, Slot );
+		}
+		else if( Slot!=INDEX_NONE )
+		{
+			FreeSlots.AddItem( Slot );
+		}
+		if( Slot!=INDEX_NONE )
+			AddMallocOp( Ops, Op, Slot, Size );
+	}
+	delete Ar;
+	return Result;
+	unguard;
+}
+
+//
+// Generate a repeatable workload shaped like the engine's: mostly small
+// blocks, arrays growing by reallocation, and the odd large buffer.
+//
+static void MakeMallocWorkload( TArray<FMallocBenchOp>& Ops, INT& NumSlots )
+{
+	guard(MakeMallocWorkload);
+	enum {NUM_OPS=4000000};
+	NumSlots = 32768;
+	TArray<DWORD> Sizes(NumSlots);
+	appMemzero( &Sizes(0), NumSlots*sizeof(DWORD) );
+	DWORD Seed = 0x12345678;
+	for( INT i=0; i<NUM_OPS; i++ )
+	{
+		INT Slot = MallocBenchRand( Seed ) % NumSlots;
+		DWORD Kind = MallocBenchRand( Seed ) % 100;
+		if( !Sizes(Slot) )
+		{
+			DWORD Size;
+			if( Kind<60 )
+				Size = 16 + MallocBenchRand( Seed ) % 112;
+			else if( Kind<90 )
+				Size = 128 + MallocBenchRand( Seed ) % 3968;
+			else if( Kind<99 )
+				Size = 4096 + MallocBenchRand( Seed ) % 28672;
+			else
+				Size = 32768 + MallocBenchRand( Seed ) % 1015808;
+			AddMallocOp( Ops, MTRACE_Malloc, Slot, Size );
+			Sizes(Slot) = Size;
+		}
+		else if( Kind<40 && Sizes(Slot)<0x100000 )
+		{
+			Sizes(Slot) += Sizes(Slot)*3/8 + 16;
+			AddMallocOp( Ops, MTRACE_Realloc, Slot, Sizes(Slot) );
+		}
+		else
+		{
+			AddMallocOp( Ops, MTRACE_Free, Slot, 0 );
+			Sizes(Slot) = 0;
+		}
+	}
+	unguard;
+}
+
+// Replay a workload, returning the elapsed seconds. Every block is
+// written to once, as its user would.
+static FLOAT ReplayMallocWorkload( FMalloc& Malloc, const TArray<FMallocBenchOp>& Ops, INT NumSlots )
+{
+	guard(ReplayMallocWorkload);
+	TArray<BYTE*> Slots(NumSlots);
+	appMemzero( &Slots(0), NumSlots*sizeof(BYTE*) );
+	FTime StartTime = appSeconds();
+	for( INT i=0; i<Ops.Num(); i++ )
+	{
+		const FMallocBenchOp& Item = Ops(i);
+		BYTE*& Ptr = Slots(Item.Slot);
+		if( Item.Op==MTRACE_Malloc )
+		{
+			Ptr = (BYTE*)Malloc.Malloc( Item.Size, TEXT("MallocBench") );
+			Ptr[0] = 0;
+		}
+		else if( Item.Op==MTRACE_Realloc )
+		{
+			Ptr = (BYTE*)Malloc.Realloc( Ptr, Item.Size, TEXT("MallocBench") );
+			if( Ptr )
+				Ptr[Item.Size-1] = 0;
+		}
+		else
+		{
+			Malloc.Free( Ptr );
+			Ptr = NULL;
+		}
+	}
+	FLOAT Seconds = appSeconds() - StartTime;
+	for( INT i=0; i<NumSlots; i++ )
+		if( Slots(i) )
+			Malloc.Free( Slots(i) );
+	return Seconds;
+	unguard;
+}
+
+//
+// Compare allocators on a trace recorded with -MALLOCTRACE=<file>, or
+// on a synthetic workload when no trace is given.
+//
+static INT MallocBenchMain( const TCHAR* Parms )
+{
+	guard(MallocBenchMain);
+	TArray<FMallocBenchOp> Ops;
+	INT NumSlots=0;
+	FString Filename;
+	if( ParseToken( Parms, Filename, 0 ) && Filename.Left(1)!=TEXT("-") )
+	{
+		if( !LoadMallocTrace( *Filename, Ops, NumSlots ) )
+		{
+			GWarn->Logf( NAME_Error, TEXT("Failed to load trace %s"), *Filename );
+			return 1;
+		}
+		GWarn->Logf( TEXT("%s: %i calls, %i blocks live at most"), *Filename, Ops.Num(), NumSlots );
+	}
+	else
+	{
+		MakeMallocWorkload( Ops, NumSlots );
+		GWarn->Logf( TEXT("Synthetic workload: %i calls"), Ops.Num() );
+	}
+	if( !Ops.Num() )
+		return 0;
+
+	// Fresh instances, so the engine's own heap doesn't skew the results.
+	FMallocAnsi AnsiMalloc;
+#if defined(WIN32)
+	FMallocWindows PoolMalloc;
+	static const TCHAR* PoolName = TEXT("windows");
+#else
+	FMallocPool PoolMalloc;
+	static const TCHAR* PoolName = TEXT("pool");
+#endif
+	FMalloc* Allocators[2] = { &AnsiMalloc, &PoolMalloc };
+	const TCHAR* Names[2] = { TEXT("ansi"), PoolName };
+	for( INT i=0; i<2; i++ )
+	{
+		Allocators[i]->Init();
+		FLOAT Seconds = ReplayMallocWorkload( *Allocators[i], Ops, NumSlots );
+		GWarn->Logf( TEXT("   %-8s %8.3f secs, %8.2f M calls/s"), Names[i], Seconds, Seconds>0.f ? Ops.Num()/Seconds/1000000.f : 0.f );
+		if( Allocators[i]==&PoolMalloc )
+			PoolMalloc.DumpAllocs();
+		Allocators[i]->Exit();
+	}
+	return 0;
+	unguard;
+}
+
+/*-----------------------------------------------------------------------------
+	Applet table.
+-----------------------------------------------------------------------------*/
+
+FNativeApplet GNativeApplets[] =
+{
+	{ TEXT("CodecBench"),   TEXT("codecbench <files>"),                TEXT("Benchmark the .uz codec stages"),     CodecBenchMain   },
+	{ TEXT("MallocBench"),  TEXT("mallocbench [tracefile]"),           TEXT("Benchmark the memory allocators"),    MallocBenchMain  },
+	{ TEXT("UzCompress"),   TEXT("uzcompress [-parallel|-lz] <files>"), TEXT("Compress files to .uz"),             UzCompressMain   },
+	{ TEXT("UzDecompress"), TEXT("uzdecompress [-threads=N] <files>"), TEXT("Decompress .uz files"),               UzDecompressMain },
+	{ NULL, NULL, NULL, NULL }
+};
+
+/*-----------------------------------------------------------------------------
+	The End.
+-----------------------------------------------------------------------------*/
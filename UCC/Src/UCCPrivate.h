@@ -0,0 +1,33 @@
+/*=============================================================================
+	UCCPrivate.h: Unreal command-line launcher private header.
+=============================================================================*/
+
+#if defined(WIN32)
+	#include <windows.h>
+#endif
+
+// Core and Engine
+#include "Engine.h"
+
+/*-----------------------------------------------------------------------------
+	Native applets.
+-----------------------------------------------------------------------------*/
+
+//
+// An applet built into ucc itself rather than loaded as a commandlet.
+// Used for low-level tools that operate below the object system.
+//
+struct FNativeApplet
+{
+	const TCHAR* Name;
+	const TCHAR* HelpCmd;
+	const TCHAR* HelpOneLiner;
+	INT (*Main)( const TCHAR* Parms );
+};
+
+// Applet table, terminated by an entry with a NULL Name.
+extern FNativeApplet GNativeApplets[];
+
+/*-----------------------------------------------------------------------------
+	The End.
+-----------------------------------------------------------------------------*/
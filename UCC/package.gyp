@@ -9,7 +9,9 @@
 				"../Engine/package.gyp:*"
 			],
 			"sources": [
-				"Src/UCC.cpp"
+				"Src/UCC.cpp",
+				"Src/UCCApplets.cpp",
+				"../Core/Src/FThreadPool.cpp"
 			]
 		}
 	]